@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "checkerDT.h"
 #include "dynarray.h"
@@ -40,82 +41,186 @@ boolean CheckerDT_Node_isValid(Node_T oNNode) {
    return TRUE;
 }
 
+/* One level of an explicit-stack pre-order walk: a node, and the ID
+   of the next of its children to descend into */
+struct CheckerDT_frame {
+   Node_T oNNode;
+   size_t ulNextChild;
+};
+
 /*
-   Recursively counts the actual number of nodes in the tree rooted at oNNode.
-   Returns the total count of nodes in the subtree.
+  An explicit-stack pre-order walk over a hierarchy. The stack holds
+  one frame per level, so its memory is bounded by the depth of the
+  hierarchy, and the walk never recurses. It does not rely on parent
+  links, which are among the things being checked.
 */
-static size_t CheckerDT_countNodes(Node_T oNNode) {
-   size_t count = 0;
-   size_t ulIndex;
-   
-   if(oNNode == NULL)
-      return 0;
-   
-   count = 1; /* initialized this node */
-   
-   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
-      Node_T oNChild = NULL;
-      int iStatus = Node_getChild(oNNode, ulIndex, &oNChild);
-      if(iStatus == SUCCESS) {
-         count += CheckerDT_countNodes(oNChild);
+struct CheckerDT_walk {
+   /* the frames from the root down to the current node */
+   struct CheckerDT_frame *psFrames;
+   /* the number of frames in use and the room in psFrames */
+   size_t ulDepth;
+   size_t ulMaxDepth;
+   /* TRUE if the walk stopped early because a child ID reported by
+      Node_getNumChildren could not be fetched with Node_getChild */
+   boolean bBadChild;
+   /* TRUE if the walk stopped early for lack of memory */
+   boolean bNoMemory;
+};
+
+/*
+  Pushes oNNode onto the stack of psWalk. Returns TRUE if successful,
+  or FALSE (setting psWalk->bNoMemory) if memory ran out.
+*/
+static boolean CheckerDT_walkPush(struct CheckerDT_walk *psWalk,
+                                  Node_T oNNode) {
+   assert(psWalk != NULL);
+
+   if(psWalk->ulDepth == psWalk->ulMaxDepth) {
+      size_t ulNewMax = 2 * psWalk->ulMaxDepth + 16;
+      struct CheckerDT_frame *psNew = realloc(psWalk->psFrames,
+                           ulNewMax * sizeof(struct CheckerDT_frame));
+      if(psNew == NULL) {
+         psWalk->bNoMemory = TRUE;
+         return FALSE;
       }
+      psWalk->psFrames = psNew;
+      psWalk->ulMaxDepth = ulNewMax;
    }
-   
+   psWalk->psFrames[psWalk->ulDepth].oNNode = oNNode;
+   psWalk->psFrames[psWalk->ulDepth].ulNextChild = 0;
+   psWalk->ulDepth++;
+   return TRUE;
+}
+
+/* Starts psWalk at oNRoot, which may be NULL for an empty walk. */
+static void CheckerDT_walkStart(struct CheckerDT_walk *psWalk,
+                                Node_T oNRoot) {
+   assert(psWalk != NULL);
+
+   psWalk->psFrames = NULL;
+   psWalk->ulDepth = 0;
+   psWalk->ulMaxDepth = 0;
+   psWalk->bBadChild = FALSE;
+   psWalk->bNoMemory = FALSE;
+   if(oNRoot != NULL)
+      (void) CheckerDT_walkPush(psWalk, oNRoot);
+}
+
+/*
+  Returns the next node of psWalk in pre-order (the root first), or
+  NULL once the walk is over or has stopped early.
+*/
+static Node_T CheckerDT_walkNext(struct CheckerDT_walk *psWalk) {
+   struct CheckerDT_frame *psTop;
+   Node_T oNChild = NULL;
+
+   assert(psWalk != NULL);
+
+   while(psWalk->ulDepth > 0) {
+      psTop = &psWalk->psFrames[psWalk->ulDepth - 1];
+
+      /* a frame's own node is visited when the frame is new */
+      if(psTop->ulNextChild == 0 && psTop->oNNode != NULL) {
+         psTop->ulNextChild = 1;
+         return psTop->oNNode;
+      }
+
+      /* then each of its children in turn, then it is popped */
+      if(psTop->ulNextChild - 1 < Node_getNumChildren(psTop->oNNode)) {
+         if(Node_getChild(psTop->oNNode, psTop->ulNextChild - 1,
+                          &oNChild) != SUCCESS) {
+            psWalk->bBadChild = TRUE;
+            return NULL;
+         }
+         psTop->ulNextChild++;
+         if(!CheckerDT_walkPush(psWalk, oNChild))
+            return NULL;
+      }
+      else
+         psWalk->ulDepth--;
+   }
+   return NULL;
+}
+
+/* Releases the memory held by psWalk. */
+static void CheckerDT_walkEnd(struct CheckerDT_walk *psWalk) {
+   assert(psWalk != NULL);
+
+   free(psWalk->psFrames);
+   psWalk->psFrames = NULL;
+   psWalk->ulDepth = 0;
+}
+
+/*
+   Counts the actual number of nodes in the tree rooted at oNNode,
+   stopping once the count passes ulLimit (so that a hierarchy with a
+   cycle cannot loop forever). Returns the count.
+*/
+static size_t CheckerDT_countNodes(Node_T oNNode, size_t ulLimit) {
+   struct CheckerDT_walk sWalk;
+   size_t count = 0;
+
+   CheckerDT_walkStart(&sWalk, oNNode);
+   while(count <= ulLimit && CheckerDT_walkNext(&sWalk) != NULL)
+      count++;
+   CheckerDT_walkEnd(&sWalk);
+
    return count;
 }
 
+/*
+  Compares the paths *poPFirst and *poPSecond, for use with
+  DynArray_sort on an array of Path_T.
+*/
+static int CheckerDT_comparePaths(const void *pvFirst,
+                                  const void *pvSecond) {
+   return Path_comparePath((Path_T) pvFirst, (Path_T) pvSecond);
+}
+
 /*
    Checks for duplicate paths in the tree rooted at oNNode.
-   Uses oPaths to track all paths encountered during traversal.
+   Uses oPaths to collect all paths encountered during traversal,
+   then sorts them so that any duplicates end up adjacent.
    Returns TRUE if no duplicate paths are found, FALSE otherwise.
 */
 static boolean CheckerDT_noDuplicatePaths(Node_T oNNode, DynArray_T oPaths) {
-   size_t ulIndex;
-   size_t i;
+   struct CheckerDT_walk sWalk;
+   Node_T oNCurr;
    Path_T oPCurrentPath;
-   
-   if(oNNode == NULL)
-      return TRUE;
+   size_t i;
 
-   /* get this path */
-   oPCurrentPath = Node_getPath(oNNode);
-   
-   /* check if this current path is NULL */
-   if(oPCurrentPath == NULL) {
-      fprintf(stderr, "Node has NULL path\n");
-      return FALSE;
-   }
-   
-   /* check if this path already exists in our array */
-   for(i = 0; i < DynArray_getLength(oPaths); i++) {
-      Path_T oPExistingPath = (Path_T)DynArray_get(oPaths, i);
-    
-      /* skip NULL entries */
-      if(oPExistingPath == NULL) continue;
-         
-      if(Path_comparePath(oPCurrentPath, oPExistingPath) == 0) {
-         fprintf(stderr, "found duplicate path: %s\n", 
-                 Path_getPathname(oPCurrentPath));
+   CheckerDT_walkStart(&sWalk, oNNode);
+   while((oNCurr = CheckerDT_walkNext(&sWalk)) != NULL) {
+      /* get this path */
+      oPCurrentPath = Node_getPath(oNCurr);
+
+      /* check if this current path is NULL */
+      if(oPCurrentPath == NULL) {
+         fprintf(stderr, "Node has NULL path\n");
+         CheckerDT_walkEnd(&sWalk);
+         return FALSE;
+      }
+
+      /* add current path to array */
+      if(DynArray_add(oPaths, oPCurrentPath) == 0) {
+         fprintf(stderr, "Failed to add path to checking array\n");
+         CheckerDT_walkEnd(&sWalk);
          return FALSE;
       }
    }
-   
-   /* add current path to array */
-   if(DynArray_add(oPaths, oPCurrentPath) == 0) {
-      fprintf(stderr, "Failed to add path to checking array\n");
-      return FALSE;
-   }
-   
-   /* check children recursively */
-   for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++) {
-      Node_T oNChild = NULL;
-      int iStatus = Node_getChild(oNNode, ulIndex, &oNChild);
-      if(iStatus == SUCCESS) {
-         if(!CheckerDT_noDuplicatePaths(oNChild, oPaths))
-            return FALSE;
+   CheckerDT_walkEnd(&sWalk);
+
+   /* check if any path appears twice */
+   DynArray_sort(oPaths, CheckerDT_comparePaths);
+   for(i = 1; i < DynArray_getLength(oPaths); i++) {
+      if(Path_comparePath(DynArray_get(oPaths, i - 1),
+                          DynArray_get(oPaths, i)) == 0) {
+         fprintf(stderr, "found duplicate path: %s\n",
+                 Path_getPathname(DynArray_get(oPaths, i)));
+         return FALSE;
       }
    }
-   
+
    return TRUE;
 }
 
@@ -125,51 +230,53 @@ static boolean CheckerDT_noDuplicatePaths(Node_T oNNode, DynArray_T oPaths) {
    returns TRUE otherwise.
 */
 static boolean CheckerDT_treeCheck(Node_T oNNode) {
+   struct CheckerDT_walk sWalk;
+   Node_T oNCurr;
    size_t ulIndex;
 
-   if(oNNode != NULL) {
+   CheckerDT_walkStart(&sWalk, oNNode);
+   while((oNCurr = CheckerDT_walkNext(&sWalk)) != NULL) {
       /* Sample check on each node: node must be valid */
       /* If not, pass that failure back up immediately */
-      if(!CheckerDT_Node_isValid(oNNode))
+      if(!CheckerDT_Node_isValid(oNCurr)) {
+         CheckerDT_walkEnd(&sWalk);
          return FALSE;
+      }
 
-      /* Recur on every child of oNNode */
-      for(ulIndex = 0; ulIndex < Node_getNumChildren(oNNode); ulIndex++)
+      /* check: children must follow lexicographic order */
+      for(ulIndex = 1; ulIndex < Node_getNumChildren(oNCurr); ulIndex++)
       {
+         Node_T oNPrevChild = NULL;
          Node_T oNChild = NULL;
-         int iStatus = Node_getChild(oNNode, ulIndex, &oNChild);
-         
-         if(iStatus != SUCCESS) {
-            fprintf(stderr, "getNumChildren claims more children than getChild returns\n");
-            return FALSE;
-         }
 
-         /* check: children must follow lexicographic order */
-         if(ulIndex > 0) {
-            Node_T oNPrevChild = NULL;
-            int iPrevStatus = Node_getChild(oNNode, ulIndex-1, &oNPrevChild);
-            
-            if(iPrevStatus != SUCCESS) {
-               fprintf(stderr, "could not get previous child in ordering check\n");
-               return FALSE;
-            }
-            
-            if(Path_comparePath(Node_getPath(oNPrevChild), 
-                               Node_getPath(oNChild)) >= 0) {
-               fprintf(stderr, "child of node %s are not in lexicographic order\n",
-                       Path_getPathname(Node_getPath(oNNode)));
-               fprintf(stderr, "wrong order of child at index %lu and %lu\n", (unsigned long)(ulIndex-1),
-               (unsigned long)ulIndex);
-               return FALSE;
-            }
-         }
+         if(Node_getChild(oNCurr, ulIndex-1, &oNPrevChild) != SUCCESS ||
+            Node_getChild(oNCurr, ulIndex, &oNChild) != SUCCESS)
+            break;
 
-         /* if recurring down one subtree results in a failed check
-            farther down, passes the failure back up immediately */
-         if(!CheckerDT_treeCheck(oNChild))
+         if(Path_comparePath(Node_getPath(oNPrevChild),
+                            Node_getPath(oNChild)) >= 0) {
+            fprintf(stderr, "child of node %s are not in lexicographic order\n",
+                    Path_getPathname(Node_getPath(oNCurr)));
+            fprintf(stderr, "wrong order of child at index %lu and %lu\n", (unsigned long)(ulIndex-1),
+            (unsigned long)ulIndex);
+            CheckerDT_walkEnd(&sWalk);
             return FALSE;
+         }
       }
    }
+
+   if(sWalk.bBadChild) {
+      fprintf(stderr, "getNumChildren claims more children than getChild returns\n");
+      CheckerDT_walkEnd(&sWalk);
+      return FALSE;
+   }
+   if(sWalk.bNoMemory) {
+      fprintf(stderr, "could not allocate stack for tree traversal\n");
+      CheckerDT_walkEnd(&sWalk);
+      return FALSE;
+   }
+
+   CheckerDT_walkEnd(&sWalk);
    return TRUE;
 }
 
@@ -190,7 +297,7 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
    
    /* check: object count must match actual number of nodes in tree */
    if(bIsInitialized) {
-      size_t ulActualCount = CheckerDT_countNodes(oNRoot);
+      size_t ulActualCount = CheckerDT_countNodes(oNRoot, ulCount);
       if(ulActualCount != ulCount) {
          fprintf(stderr, "Count is %lu while we have %lu actual nodes \n", 
                  (unsigned long)ulCount, (unsigned long)ulActualCount);
@@ -200,12 +307,7 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
    
    /* check: no duplicate paths in the tree */
    if(oNRoot != NULL) {
-      size_t arraySize;
-      if (ulCount > 0) {
-       arraySize = ulCount;
-      } else 
-	arraySize = 1;
-      oPaths = DynArray_new(arraySize);
+      oPaths = DynArray_new(0);
       if(oPaths == NULL) {
          fprintf(stderr, "could not create array for duplicate path checking\n");
          return FALSE;
@@ -218,6 +320,6 @@ boolean CheckerDT_isValid(boolean bIsInitialized, Node_T oNRoot,
          return FALSE;
    }
    
-   /* Now checks invariants recursively at each node from the root. */
+   /* Now checks invariants at each node from the root. */
    return CheckerDT_treeCheck(oNRoot);
 }
@@ -0,0 +1,179 @@
+/*--------------------------------------------------------------------*/
+/* bloom.c                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "bloom.h"
+
+/*
+  The filter is an array of byte counters, a power of two of them, and
+  each string maps to uiProbes of them by double hashing. A counter
+  that reaches UCHAR_MAX sticks there, since its true count is no
+  longer known; that can only cause false positives, never false
+  negatives.
+*/
+struct bloom {
+   /* the counters, ulSlots of them */
+   unsigned char *pucCounters;
+   /* the number of counters, a power of two */
+   size_t ulSlots;
+   /* the number of counters each string maps to */
+   unsigned int uiProbes;
+   /* the number of strings currently held */
+   size_t ulLength;
+   /* the parameters the filter was sized for */
+   size_t ulCapacity;
+   double dFalsePositiveRate;
+};
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Computes two independent hashes of string pcKey: FNV-1a into *pulH1
+  and djb2 into *pulH2. *pulH2 is made odd so that stepping by it
+  visits distinct counters in a power-of-two table.
+*/
+static void Bloom_hash(const char *pcKey, size_t *pulH1,
+                       size_t *pulH2) {
+   unsigned long ulH1 = 2166136261UL;
+   unsigned long ulH2 = 5381UL;
+
+   assert(pcKey != NULL);
+
+   while(*pcKey != '\0') {
+      ulH1 ^= (unsigned char) *pcKey;
+      ulH1 *= 16777619UL;
+      ulH2 = (ulH2 * 33UL) ^ (unsigned char) *pcKey;
+      pcKey++;
+   }
+   *pulH1 = (size_t) ulH1;
+   *pulH2 = (size_t) ulH2 | 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+Bloom_T Bloom_new(size_t ulCapacity, double dFalsePositiveRate) {
+   Bloom_T oBFilter;
+   unsigned int uiProbes = 0;
+   double dRate;
+   size_t ulWanted;
+   size_t ulSlots = 1;
+
+   assert(ulCapacity > 0);
+   assert(dFalsePositiveRate > 0.0 && dFalsePositiveRate < 1.0);
+
+   /* the optimal number of probes is log2(1 / rate) and the optimal
+      number of counters per string is that divided by ln 2; taking
+      the ceiling of the logarithm avoids needing the math library */
+   for(dRate = dFalsePositiveRate; dRate < 1.0; dRate *= 2.0)
+      uiProbes++;
+   ulWanted = (size_t) ((double) ulCapacity * uiProbes / 0.693147) + 1;
+   while(ulSlots < ulWanted)
+      ulSlots <<= 1;
+
+   oBFilter = malloc(sizeof(struct bloom));
+   if(oBFilter == NULL)
+      return NULL;
+
+   oBFilter->pucCounters = calloc(ulSlots, 1);
+   if(oBFilter->pucCounters == NULL) {
+      free(oBFilter);
+      return NULL;
+   }
+
+   oBFilter->ulSlots = ulSlots;
+   oBFilter->uiProbes = uiProbes;
+   oBFilter->ulLength = 0;
+   oBFilter->ulCapacity = ulCapacity;
+   oBFilter->dFalsePositiveRate = dFalsePositiveRate;
+   return oBFilter;
+}
+
+void Bloom_free(Bloom_T oBFilter) {
+   if(oBFilter == NULL)
+      return;
+
+   free(oBFilter->pucCounters);
+   free(oBFilter);
+}
+
+void Bloom_add(Bloom_T oBFilter, const char *pcKey) {
+   size_t ulH1, ulH2;
+   size_t ulMask;
+   unsigned int ui;
+   unsigned char *pucCounter;
+
+   assert(oBFilter != NULL);
+
+   Bloom_hash(pcKey, &ulH1, &ulH2);
+   ulMask = oBFilter->ulSlots - 1;
+   for(ui = 0; ui < oBFilter->uiProbes; ui++) {
+      pucCounter = &oBFilter->pucCounters[(ulH1 + ui * ulH2) & ulMask];
+      if(*pucCounter != UCHAR_MAX)
+         (*pucCounter)++;
+   }
+   oBFilter->ulLength++;
+}
+
+void Bloom_remove(Bloom_T oBFilter, const char *pcKey) {
+   size_t ulH1, ulH2;
+   size_t ulMask;
+   unsigned int ui;
+   unsigned char *pucCounter;
+
+   assert(oBFilter != NULL);
+   assert(oBFilter->ulLength > 0);
+
+   Bloom_hash(pcKey, &ulH1, &ulH2);
+   ulMask = oBFilter->ulSlots - 1;
+   for(ui = 0; ui < oBFilter->uiProbes; ui++) {
+      pucCounter = &oBFilter->pucCounters[(ulH1 + ui * ulH2) & ulMask];
+      assert(*pucCounter != 0);
+      if(*pucCounter != UCHAR_MAX)
+         (*pucCounter)--;
+   }
+   oBFilter->ulLength--;
+}
+
+boolean Bloom_mayContain(Bloom_T oBFilter, const char *pcKey) {
+   size_t ulH1, ulH2;
+   size_t ulMask;
+   unsigned int ui;
+
+   assert(oBFilter != NULL);
+
+   Bloom_hash(pcKey, &ulH1, &ulH2);
+   ulMask = oBFilter->ulSlots - 1;
+   for(ui = 0; ui < oBFilter->uiProbes; ui++)
+      if(oBFilter->pucCounters[(ulH1 + ui * ulH2) & ulMask] == 0)
+         return FALSE;
+   return TRUE;
+}
+
+size_t Bloom_getLength(Bloom_T oBFilter) {
+   assert(oBFilter != NULL);
+
+   return oBFilter->ulLength;
+}
+
+size_t Bloom_getCapacity(Bloom_T oBFilter) {
+   assert(oBFilter != NULL);
+
+   return oBFilter->ulCapacity;
+}
+
+double Bloom_getFalsePositiveRate(Bloom_T oBFilter) {
+   assert(oBFilter != NULL);
+
+   return oBFilter->dFalsePositiveRate;
+}
+
+size_t Bloom_getBytes(Bloom_T oBFilter) {
+   assert(oBFilter != NULL);
+
+   return sizeof(struct bloom) + oBFilter->ulSlots;
+}
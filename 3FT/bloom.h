@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------*/
+/* bloom.h                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef BLOOM_INCLUDED
+#define BLOOM_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A Bloom_T is a counting Bloom filter over strings. It can say for
+  certain that a string was never added (or has since been removed),
+  but may wrongly say that a string is present, at a rate that grows
+  with the number of strings held. Each slot is a counter rather than
+  a bit, so strings can also be removed.
+*/
+typedef struct bloom *Bloom_T;
+
+/*
+  Returns a new, empty Bloom_T sized so that it answers "maybe" for
+  strings that are absent with probability at most about
+  dFalsePositiveRate while it holds ulCapacity strings. Returns NULL
+  if memory could not be allocated.
+  It is a checked runtime error for ulCapacity to be 0 or for
+  dFalsePositiveRate not to be strictly between 0 and 1.
+*/
+Bloom_T Bloom_new(size_t ulCapacity, double dFalsePositiveRate);
+
+/* Frees oBFilter. */
+void Bloom_free(Bloom_T oBFilter);
+
+/* Adds string pcKey to oBFilter. Never allocates, so cannot fail. */
+void Bloom_add(Bloom_T oBFilter, const char *pcKey);
+
+/*
+  Removes string pcKey, which must have been added and not since
+  removed, from oBFilter.
+*/
+void Bloom_remove(Bloom_T oBFilter, const char *pcKey);
+
+/*
+  Returns FALSE if pcKey is certainly not in oBFilter, or TRUE if it
+  may be.
+*/
+boolean Bloom_mayContain(Bloom_T oBFilter, const char *pcKey);
+
+/* Returns the number of strings currently in oBFilter. */
+size_t Bloom_getLength(Bloom_T oBFilter);
+
+/* Returns the ulCapacity that oBFilter was created with. */
+size_t Bloom_getCapacity(Bloom_T oBFilter);
+
+/* Returns the dFalsePositiveRate that oBFilter was created with. */
+double Bloom_getFalsePositiveRate(Bloom_T oBFilter);
+
+/* Returns the number of bytes of memory oBFilter uses. */
+size_t Bloom_getBytes(Bloom_T oBFilter);
+
+#endif
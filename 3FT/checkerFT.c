@@ -0,0 +1,399 @@
+/*--------------------------------------------------------------------*/
+/* checkerFT.c                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkerFT.h"
+#include "dynarray.h"
+#include "path.h"
+
+/* see checkerFT.h for specification */
+boolean CheckerFT_Node_isValid(Node_T oNNode) {
+   Node_T oNParent;
+   Path_T oPNPath;
+   Path_T oPPPath;
+
+   /* a NULL pointer is not a valid node */
+   if(oNNode == NULL) {
+      fprintf(stderr, "A node is a NULL pointer\n");
+      return FALSE;
+   }
+
+   /* files are always leaves */
+   if(Node_isFile(oNNode) && Node_getNumChildren(oNNode) != 0) {
+      fprintf(stderr, "File has children: (%s)\n",
+              Path_getPathname(Node_getPath(oNNode)));
+      return FALSE;
+   }
+
+   /* parent's path must be the longest possible proper prefix of the
+      node's path, and the parent must be a directory */
+   oNParent = Node_getParent(oNNode);
+   if(oNParent != NULL) {
+      oPNPath = Node_getPath(oNNode);
+      oPPPath = Node_getPath(oNParent);
+
+      if(Path_getSharedPrefixDepth(oPNPath, oPPPath) !=
+         Path_getDepth(oPNPath) - 1) {
+         fprintf(stderr, "P-C nodes don't have P-C paths: (%s) (%s)\n",
+                 Path_getPathname(oPPPath), Path_getPathname(oPNPath));
+         return FALSE;
+      }
+
+      if(Node_isFile(oNParent)) {
+         fprintf(stderr, "Parent is a file: (%s)\n",
+                 Path_getPathname(oPPPath));
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+/* One level of an explicit-stack pre-order walk: a node, and the ID
+   of the next of its children to descend into */
+struct CheckerFT_frame {
+   Node_T oNNode;
+   size_t ulNextChild;
+};
+
+/*
+  An explicit-stack pre-order walk over a hierarchy. The stack holds
+  one frame per level, so its memory is bounded by the depth of the
+  hierarchy, and the walk never recurses. It does not rely on parent
+  links, which are among the things being checked.
+*/
+struct CheckerFT_walk {
+   /* the frames from the root down to the current node */
+   struct CheckerFT_frame *psFrames;
+   /* the number of frames in use and the room in psFrames */
+   size_t ulDepth;
+   size_t ulMaxDepth;
+   /* TRUE if the walk stopped early because a child ID reported by
+      Node_getNumChildren could not be fetched with Node_getChild */
+   boolean bBadChild;
+   /* TRUE if the walk stopped early for lack of memory */
+   boolean bNoMemory;
+};
+
+/*
+  Pushes oNNode onto the stack of psWalk. Returns TRUE if successful,
+  or FALSE (setting psWalk->bNoMemory) if memory ran out.
+*/
+static boolean CheckerFT_walkPush(struct CheckerFT_walk *psWalk,
+                                  Node_T oNNode) {
+   assert(psWalk != NULL);
+
+   if(psWalk->ulDepth == psWalk->ulMaxDepth) {
+      size_t ulNewMax = 2 * psWalk->ulMaxDepth + 16;
+      struct CheckerFT_frame *psNew = realloc(psWalk->psFrames,
+                           ulNewMax * sizeof(struct CheckerFT_frame));
+      if(psNew == NULL) {
+         psWalk->bNoMemory = TRUE;
+         return FALSE;
+      }
+      psWalk->psFrames = psNew;
+      psWalk->ulMaxDepth = ulNewMax;
+   }
+   psWalk->psFrames[psWalk->ulDepth].oNNode = oNNode;
+   psWalk->psFrames[psWalk->ulDepth].ulNextChild = 0;
+   psWalk->ulDepth++;
+   return TRUE;
+}
+
+/* Starts psWalk at oNRoot, which may be NULL for an empty walk. */
+static void CheckerFT_walkStart(struct CheckerFT_walk *psWalk,
+                                Node_T oNRoot) {
+   assert(psWalk != NULL);
+
+   psWalk->psFrames = NULL;
+   psWalk->ulDepth = 0;
+   psWalk->ulMaxDepth = 0;
+   psWalk->bBadChild = FALSE;
+   psWalk->bNoMemory = FALSE;
+   if(oNRoot != NULL)
+      (void) CheckerFT_walkPush(psWalk, oNRoot);
+}
+
+/*
+  Returns the next node of psWalk in pre-order (the root first), or
+  NULL once the walk is over or has stopped early.
+*/
+static Node_T CheckerFT_walkNext(struct CheckerFT_walk *psWalk) {
+   struct CheckerFT_frame *psTop;
+   Node_T oNChild = NULL;
+
+   assert(psWalk != NULL);
+
+   while(psWalk->ulDepth > 0) {
+      psTop = &psWalk->psFrames[psWalk->ulDepth - 1];
+
+      /* a frame's own node is visited when the frame is new */
+      if(psTop->ulNextChild == 0) {
+         psTop->ulNextChild = 1;
+         return psTop->oNNode;
+      }
+
+      /* then each of its children in turn, then it is popped */
+      if(psTop->ulNextChild - 1 < Node_getNumChildren(psTop->oNNode)) {
+         if(Node_getChild(psTop->oNNode, psTop->ulNextChild - 1,
+                          &oNChild) != SUCCESS) {
+            psWalk->bBadChild = TRUE;
+            return NULL;
+         }
+         psTop->ulNextChild++;
+         if(!CheckerFT_walkPush(psWalk, oNChild))
+            return NULL;
+      }
+      else
+         psWalk->ulDepth--;
+   }
+   return NULL;
+}
+
+/* Releases the memory held by psWalk. */
+static void CheckerFT_walkEnd(struct CheckerFT_walk *psWalk) {
+   assert(psWalk != NULL);
+
+   free(psWalk->psFrames);
+   psWalk->psFrames = NULL;
+   psWalk->ulDepth = 0;
+}
+
+/*
+   Counts the actual number of nodes in the tree rooted at oNNode,
+   stopping once the count passes ulLimit (so that a hierarchy with a
+   cycle cannot loop forever). Returns the count.
+*/
+static size_t CheckerFT_countNodes(Node_T oNNode, size_t ulLimit) {
+   struct CheckerFT_walk sWalk;
+   size_t ulCount = 0;
+
+   CheckerFT_walkStart(&sWalk, oNNode);
+   while(ulCount <= ulLimit && CheckerFT_walkNext(&sWalk) != NULL)
+      ulCount++;
+   CheckerFT_walkEnd(&sWalk);
+
+   return ulCount;
+}
+
+/*
+  Compares the paths pvFirst and pvSecond, for use with DynArray_sort
+  on an array of Path_T.
+*/
+static int CheckerFT_comparePaths(const void *pvFirst,
+                                  const void *pvSecond) {
+   return Path_comparePath((Path_T) pvFirst, (Path_T) pvSecond);
+}
+
+/*
+   Checks for duplicate paths in the tree rooted at oNNode, collecting
+   every path in oPaths and sorting them so that any duplicates end
+   up adjacent. Returns TRUE if no duplicate paths are found, FALSE
+   otherwise.
+*/
+static boolean CheckerFT_noDuplicatePaths(Node_T oNNode,
+                                          DynArray_T oPaths) {
+   struct CheckerFT_walk sWalk;
+   Node_T oNCurr;
+   size_t ul;
+
+   CheckerFT_walkStart(&sWalk, oNNode);
+   while((oNCurr = CheckerFT_walkNext(&sWalk)) != NULL) {
+      if(Node_getPath(oNCurr) == NULL) {
+         fprintf(stderr, "Node has NULL path\n");
+         CheckerFT_walkEnd(&sWalk);
+         return FALSE;
+      }
+
+      if(DynArray_add(oPaths, Node_getPath(oNCurr)) == 0) {
+         fprintf(stderr, "Failed to add path to checking array\n");
+         CheckerFT_walkEnd(&sWalk);
+         return FALSE;
+      }
+   }
+   CheckerFT_walkEnd(&sWalk);
+
+   DynArray_sort(oPaths, CheckerFT_comparePaths);
+   for(ul = 1; ul < DynArray_getLength(oPaths); ul++) {
+      if(Path_comparePath(DynArray_get(oPaths, ul - 1),
+                          DynArray_get(oPaths, ul)) == 0) {
+         fprintf(stderr, "found duplicate path: %s\n",
+                 Path_getPathname(DynArray_get(oPaths, ul)));
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+/*
+   Returns TRUE if the children of oNNode are in child ID order: all
+   files before all directories, each group in lexicographic order,
+   and each naming oNNode as its parent. Returns FALSE otherwise.
+*/
+static boolean CheckerFT_childrenInOrder(Node_T oNNode) {
+   Node_T oNPrevChild = NULL;
+   Node_T oNChild = NULL;
+   size_t ul;
+
+   for(ul = 0; ul < Node_getNumChildren(oNNode); ul++) {
+      if(Node_getChild(oNNode, ul, &oNChild) != SUCCESS)
+         return TRUE;
+
+      if(Node_getParent(oNChild) != oNNode) {
+         fprintf(stderr, "child %s does not link back to its parent\n",
+                 Path_getPathname(Node_getPath(oNChild)));
+         return FALSE;
+      }
+
+      if(oNPrevChild != NULL) {
+         if(!Node_isFile(oNPrevChild) && Node_isFile(oNChild)) {
+            fprintf(stderr, "children of %s: file %s after a dir\n",
+                    Path_getPathname(Node_getPath(oNNode)),
+                    Path_getPathname(Node_getPath(oNChild)));
+            return FALSE;
+         }
+         if(Node_isFile(oNPrevChild) == Node_isFile(oNChild) &&
+            Path_comparePath(Node_getPath(oNPrevChild),
+                             Node_getPath(oNChild)) >= 0) {
+            fprintf(stderr, "children of %s are not in order at %lu\n",
+                    Path_getPathname(Node_getPath(oNNode)),
+                    (unsigned long) ul);
+            return FALSE;
+         }
+      }
+      oNPrevChild = oNChild;
+   }
+
+   return TRUE;
+}
+
+/*
+   Returns TRUE if the subtree totals of oNNode are its own file,
+   directory and bytes plus the sums of its children's. Returns FALSE
+   otherwise.
+*/
+static boolean CheckerFT_sizeAddsUp(Node_T oNNode) {
+   Node_T oNChild = NULL;
+   size_t ulFiles, ulDirs, ulBytes;
+   size_t ulChildFiles, ulChildDirs, ulChildBytes;
+   size_t ulHasFiles, ulHasDirs, ulHasBytes;
+   size_t ul;
+
+   ulFiles = Node_isFile(oNNode) ? 1 : 0;
+   ulDirs = 1 - ulFiles;
+   ulBytes = Node_getLength(oNNode);
+   for(ul = 0; ul < Node_getNumChildren(oNNode); ul++)
+      if(Node_getChild(oNNode, ul, &oNChild) == SUCCESS) {
+         Node_getTotals(oNChild, &ulChildFiles, &ulChildDirs,
+                        &ulChildBytes);
+         ulFiles += ulChildFiles;
+         ulDirs += ulChildDirs;
+         ulBytes += ulChildBytes;
+      }
+
+   Node_getTotals(oNNode, &ulHasFiles, &ulHasDirs, &ulHasBytes);
+   if(ulHasFiles != ulFiles || ulHasDirs != ulDirs ||
+      ulHasBytes != ulBytes) {
+      fprintf(stderr, "subtree of %s has %lu files, %lu dirs and "
+              "%lu bytes, not %lu, %lu and %lu\n",
+              Path_getPathname(Node_getPath(oNNode)),
+              (unsigned long) ulHasFiles, (unsigned long) ulHasDirs,
+              (unsigned long) ulHasBytes, (unsigned long) ulFiles,
+              (unsigned long) ulDirs, (unsigned long) ulBytes);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/*
+   Performs a pre-order traversal of the tree rooted at oNNode.
+   Returns FALSE if a broken invariant is found and
+   returns TRUE otherwise.
+*/
+static boolean CheckerFT_treeCheck(Node_T oNNode) {
+   struct CheckerFT_walk sWalk;
+   Node_T oNCurr;
+
+   CheckerFT_walkStart(&sWalk, oNNode);
+   while((oNCurr = CheckerFT_walkNext(&sWalk)) != NULL) {
+      if(!CheckerFT_Node_isValid(oNCurr) ||
+         !CheckerFT_childrenInOrder(oNCurr) ||
+         !CheckerFT_sizeAddsUp(oNCurr)) {
+         CheckerFT_walkEnd(&sWalk);
+         return FALSE;
+      }
+   }
+
+   if(sWalk.bBadChild) {
+      fprintf(stderr,
+              "getNumChildren claims more children than getChild "
+              "returns\n");
+      CheckerFT_walkEnd(&sWalk);
+      return FALSE;
+   }
+   if(sWalk.bNoMemory) {
+      fprintf(stderr, "could not allocate stack for tree traversal\n");
+      CheckerFT_walkEnd(&sWalk);
+      return FALSE;
+   }
+
+   CheckerFT_walkEnd(&sWalk);
+   return TRUE;
+}
+
+/* see checkerFT.h for specification */
+boolean CheckerFT_isValid(boolean bIsInitialized, Node_T oNRoot,
+                          size_t ulCount) {
+   DynArray_T oPaths;
+   boolean bResult;
+
+   /* if the FT is not initialized, it is empty */
+   if(!bIsInitialized) {
+      if(ulCount != 0 || oNRoot != NULL) {
+         fprintf(stderr, "Not initialized, but not empty\n");
+         return FALSE;
+      }
+      return TRUE;
+   }
+
+   /* the root is a directory at depth 1 */
+   if(oNRoot != NULL) {
+      if(Node_getParent(oNRoot) != NULL || Node_isFile(oNRoot) ||
+         Path_getDepth(Node_getPath(oNRoot)) != 1) {
+         fprintf(stderr, "Root is not a parentless top directory\n");
+         return FALSE;
+      }
+   }
+
+   /* the count must match the actual number of nodes in the tree */
+   if(CheckerFT_countNodes(oNRoot, ulCount) != ulCount) {
+      fprintf(stderr, "Count is %lu but the tree has a different "
+              "number of nodes\n", (unsigned long) ulCount);
+      return FALSE;
+   }
+
+   /* no path may appear twice */
+   if(oNRoot != NULL) {
+      oPaths = DynArray_new(0);
+      if(oPaths == NULL) {
+         fprintf(stderr, "could not create array for duplicate "
+                 "path checking\n");
+         return FALSE;
+      }
+
+      bResult = CheckerFT_noDuplicatePaths(oNRoot, oPaths);
+      DynArray_free(oPaths);
+
+      if(!bResult)
+         return FALSE;
+   }
+
+   /* now check invariants at each node from the root */
+   return CheckerFT_treeCheck(oNRoot);
+}
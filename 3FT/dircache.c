@@ -0,0 +1,162 @@
+/*--------------------------------------------------------------------*/
+/* dircache.c                                                         */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dircache.h"
+
+/* The number of directories remembered */
+enum { DIRCACHE_SLOTS = 8 };
+
+/*
+  The cached directories, most recently used first. The array is small
+  enough that a linear scan beats any index structure.
+*/
+struct dirCache {
+   /* the cached directories; only the first uiLength are in use */
+   Node_T aoNDirs[DIRCACHE_SLOTS];
+   /* the number of cached directories */
+   unsigned int uiLength;
+   /* the number of DirCache_find calls */
+   size_t ulOps;
+   /* the total depth of the directories DirCache_find returned */
+   size_t ulLevelsSkipped;
+};
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Returns TRUE if pathname pcPrefix, of length ulPrefixLength, is
+  pathname pcPath or names an ancestor of it. Comparing the strings
+  directly is cheaper than comparing components.
+*/
+static boolean DirCache_isPrefix(const char *pcPrefix,
+                                 size_t ulPrefixLength,
+                                 const char *pcPath,
+                                 size_t ulPathLength) {
+   if(ulPrefixLength > ulPathLength)
+      return FALSE;
+   if(memcmp(pcPrefix, pcPath, ulPrefixLength) != 0)
+      return FALSE;
+   return (boolean) (pcPath[ulPrefixLength] == '\0' ||
+                     pcPath[ulPrefixLength] == '/');
+}
+
+/* Moves the uiIndex'th directory of oDCache to the front. */
+static void DirCache_touch(DirCache_T oDCache, unsigned int uiIndex) {
+   Node_T oNDir;
+
+   assert(uiIndex < oDCache->uiLength);
+
+   oNDir = oDCache->aoNDirs[uiIndex];
+   memmove(&oDCache->aoNDirs[1], &oDCache->aoNDirs[0],
+           uiIndex * sizeof(Node_T));
+   oDCache->aoNDirs[0] = oNDir;
+}
+
+/*--------------------------------------------------------------------*/
+
+DirCache_T DirCache_new(void) {
+   DirCache_T oDCache;
+
+   oDCache = calloc(1, sizeof(struct dirCache));
+   return oDCache;
+}
+
+void DirCache_free(DirCache_T oDCache) {
+   free(oDCache);
+}
+
+void DirCache_clear(DirCache_T oDCache) {
+   assert(oDCache != NULL);
+
+   oDCache->uiLength = 0;
+}
+
+Node_T DirCache_find(DirCache_T oDCache, Path_T oPPath) {
+   const char *pcPath;
+   size_t ulPathLength;
+   Path_T oPDir;
+   size_t ulBestDepth = 0;
+   unsigned int uiBest = 0;
+   unsigned int ui;
+
+   assert(oDCache != NULL);
+   assert(oPPath != NULL);
+
+   pcPath = Path_getPathname(oPPath);
+   ulPathLength = Path_getStrLength(oPPath);
+   oDCache->ulOps++;
+
+   for(ui = 0; ui < oDCache->uiLength; ui++) {
+      oPDir = Node_getPath(oDCache->aoNDirs[ui]);
+      if(Path_getDepth(oPDir) > ulBestDepth &&
+         DirCache_isPrefix(Path_getPathname(oPDir),
+                           Path_getStrLength(oPDir),
+                           pcPath, ulPathLength)) {
+         ulBestDepth = Path_getDepth(oPDir);
+         uiBest = ui;
+      }
+   }
+
+   if(ulBestDepth == 0)
+      return NULL;
+
+   oDCache->ulLevelsSkipped += ulBestDepth;
+   DirCache_touch(oDCache, uiBest);
+   return oDCache->aoNDirs[0];
+}
+
+void DirCache_add(DirCache_T oDCache, Node_T oNDir) {
+   unsigned int ui;
+
+   assert(oDCache != NULL);
+   assert(oNDir != NULL);
+   assert(!Node_isFile(oNDir));
+
+   for(ui = 0; ui < oDCache->uiLength; ui++)
+      if(oDCache->aoNDirs[ui] == oNDir) {
+         DirCache_touch(oDCache, ui);
+         return;
+      }
+
+   /* the least recently used directory falls off the end if full */
+   if(oDCache->uiLength < DIRCACHE_SLOTS)
+      oDCache->uiLength++;
+   oDCache->aoNDirs[oDCache->uiLength - 1] = oNDir;
+   DirCache_touch(oDCache, oDCache->uiLength - 1);
+}
+
+void DirCache_removeSubtree(DirCache_T oDCache, Path_T oPPath) {
+   Path_T oPDir;
+   unsigned int ui;
+   unsigned int uiKept = 0;
+
+   assert(oDCache != NULL);
+   assert(oPPath != NULL);
+
+   /* compact the survivors, keeping their order */
+   for(ui = 0; ui < oDCache->uiLength; ui++) {
+      oPDir = Node_getPath(oDCache->aoNDirs[ui]);
+      if(!DirCache_isPrefix(Path_getPathname(oPPath),
+                            Path_getStrLength(oPPath),
+                            Path_getPathname(oPDir),
+                            Path_getStrLength(oPDir)))
+         oDCache->aoNDirs[uiKept++] = oDCache->aoNDirs[ui];
+   }
+   oDCache->uiLength = uiKept;
+}
+
+void DirCache_getStats(DirCache_T oDCache, size_t *pulOps,
+                       size_t *pulLevelsSkipped) {
+   assert(oDCache != NULL);
+   assert(pulOps != NULL);
+   assert(pulLevelsSkipped != NULL);
+
+   *pulOps = oDCache->ulOps;
+   *pulLevelsSkipped = oDCache->ulLevelsSkipped;
+}
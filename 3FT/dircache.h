@@ -0,0 +1,69 @@
+/*--------------------------------------------------------------------*/
+/* dircache.h                                                         */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef DIRCACHE_INCLUDED
+#define DIRCACHE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "path.h"
+#include "nodeFT.h"
+
+/*
+  A DirCache_T remembers the few directory nodes most recently
+  resolved, in least-recently-used order, so that a walk towards a
+  path can resume from the deepest remembered ancestor of that path
+  instead of from the root. Runs of operations on siblings, such as
+  inserting root/day/file0001 through root/day/file9999, then cost a
+  walk of one level each.
+
+  The cache holds no references of its own: each cached node must be
+  dropped, with DirCache_removeSubtree or DirCache_clear, before it is
+  freed.
+*/
+typedef struct dirCache *DirCache_T;
+
+/*
+  Returns a new, empty DirCache_T, or NULL if memory could not be
+  allocated.
+*/
+DirCache_T DirCache_new(void);
+
+/* Frees oDCache. The cached nodes are not freed. */
+void DirCache_free(DirCache_T oDCache);
+
+/* Drops every node from oDCache, keeping its statistics. */
+void DirCache_clear(DirCache_T oDCache);
+
+/*
+  Returns the deepest directory in oDCache whose path is oPPath or a
+  proper prefix of oPPath, marking it most recently used, or NULL if
+  there is none. Counts the call as one operation, and adds the depth
+  of the returned directory (the number of levels that need not be
+  walked) to the levels skipped.
+*/
+Node_T DirCache_find(DirCache_T oDCache, Path_T oPPath);
+
+/*
+  Records directory oNDir in oDCache as most recently used, evicting
+  the least recently used directory if oDCache is full.
+*/
+void DirCache_add(DirCache_T oDCache, Node_T oNDir);
+
+/*
+  Drops from oDCache every directory whose path is oPPath or lies
+  below oPPath. Must be called before the subtree at oPPath is freed.
+*/
+void DirCache_removeSubtree(DirCache_T oDCache, Path_T oPPath);
+
+/*
+  Sets *pulOps to the number of DirCache_find calls on oDCache and
+  *pulLevelsSkipped to the total depth of the directories they
+  returned.
+*/
+void DirCache_getStats(DirCache_T oDCache, size_t *pulOps,
+                       size_t *pulLevelsSkipped);
+
+#endif
@@ -0,0 +1,241 @@
+/*--------------------------------------------------------------------*/
+/* epoch.c                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthreads and sched_yield */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "epoch.h"
+
+/*
+  A global epoch counter advances only once every reader has entered
+  in the current epoch. An item retired in epoch E goes on list E % 3;
+  when the epoch advances to E + 2, every reader that could have seen
+  the item before it was unlinked has left, so the list is freed.
+*/
+
+enum {
+   /* the most threads that may be reading at once */
+   EPOCH_MAX_READERS = 256,
+   /* the number of items retired between attempts to advance */
+   EPOCH_BATCH = 64,
+   /* the size of a cache line, which each reader's slot fills */
+   EPOCH_CACHE_LINE = 64
+};
+
+/*
+  A reader's slot. Only its owner writes it, and it has a cache line
+  to itself, so that entering and leaving writes nothing that another
+  reader uses.
+*/
+struct epochSlot {
+   /* the epoch the owner entered in, or 0 while it is not reading */
+   unsigned long ulEpoch;
+   char acPad[EPOCH_CACHE_LINE - sizeof(unsigned long)];
+};
+
+/* An item waiting to be freed */
+struct retired {
+   void *pvItem;
+   void (*pfFree)(void *pvItem);
+   struct retired *psNext;
+};
+
+/* The readers' slots */
+static struct epochSlot asSlots[EPOCH_MAX_READERS];
+/* Whether each slot belongs to a thread; guarded by sEpochLock */
+static boolean abTaken[EPOCH_MAX_READERS];
+
+/* The current epoch; changed only under sEpochLock */
+static unsigned long ulGlobal = 1;
+/* The items retired in each of the last three epochs, by epoch % 3 */
+static struct retired *apsRetired[3];
+/* The number of items retired since the last attempt to advance */
+static size_t ulPending = 0;
+/* Guards everything above that readers do not read */
+static pthread_mutex_t sEpochLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The key under which each thread keeps its slot */
+static pthread_key_t sSlotKey;
+static pthread_once_t sKeyOnce = PTHREAD_ONCE_INIT;
+static boolean bKeyMade = FALSE;
+
+/*--------------------------------------------------------------------*/
+
+/* Gives slot pvSlot back when its thread exits. */
+static void Epoch_releaseSlot(void *pvSlot) {
+   struct epochSlot *psSlot = pvSlot;
+
+   assert(psSlot != NULL);
+
+   (void) pthread_mutex_lock(&sEpochLock);
+   abTaken[psSlot - asSlots] = FALSE;
+   (void) pthread_mutex_unlock(&sEpochLock);
+}
+
+/* Creates sSlotKey; run once. */
+static void Epoch_makeKey(void) {
+   bKeyMade = (boolean)
+      (pthread_key_create(&sSlotKey, Epoch_releaseSlot) == 0);
+}
+
+/*
+  Returns the calling thread's slot, taking a free one on its first
+  call, or NULL if none could be had.
+*/
+static struct epochSlot *Epoch_getSlot(void) {
+   struct epochSlot *psSlot;
+   size_t ul;
+
+   (void) pthread_once(&sKeyOnce, Epoch_makeKey);
+   if(!bKeyMade)
+      return NULL;
+
+   psSlot = pthread_getspecific(sSlotKey);
+   if(psSlot != NULL)
+      return psSlot;
+
+   (void) pthread_mutex_lock(&sEpochLock);
+   for(ul = 0; ul < EPOCH_MAX_READERS; ul++)
+      if(!abTaken[ul]) {
+         abTaken[ul] = TRUE;
+         psSlot = &asSlots[ul];
+         break;
+      }
+   (void) pthread_mutex_unlock(&sEpochLock);
+   if(psSlot == NULL)
+      return NULL;
+
+   if(pthread_setspecific(sSlotKey, psSlot) != 0) {
+      Epoch_releaseSlot(psSlot);
+      return NULL;
+   }
+   return psSlot;
+}
+
+/*
+  Advances the epoch if every thread now reading entered in the
+  current one, and returns the list of items that thereby became safe
+  to free, taking it off apsRetired; otherwise returns NULL. Sets
+  *pbAdvanced to whether it advanced. The caller holds sEpochLock.
+*/
+static struct retired *Epoch_advance(boolean *pbAdvanced) {
+   struct retired *psFree;
+   unsigned long ulSeen;
+   size_t ul;
+
+   assert(pbAdvanced != NULL);
+
+   *pbAdvanced = FALSE;
+   for(ul = 0; ul < EPOCH_MAX_READERS; ul++) {
+      ulSeen = __atomic_load_n(&asSlots[ul].ulEpoch, __ATOMIC_SEQ_CST);
+      if(ulSeen != 0 && ulSeen != ulGlobal)
+         return NULL;
+   }
+
+   __atomic_store_n(&ulGlobal, ulGlobal + 1, __ATOMIC_SEQ_CST);
+   *pbAdvanced = TRUE;
+
+   /* the items retired two epochs ago */
+   psFree = apsRetired[(ulGlobal + 1) % 3];
+   apsRetired[(ulGlobal + 1) % 3] = NULL;
+   return psFree;
+}
+
+/* Frees every item on list psFree, and the list itself. */
+static void Epoch_freeList(struct retired *psFree) {
+   struct retired *psNext;
+
+   while(psFree != NULL) {
+      psNext = psFree->psNext;
+      (*psFree->pfFree)(psFree->pvItem);
+      free(psFree);
+      psFree = psNext;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+boolean Epoch_enter(void) {
+   struct epochSlot *psSlot;
+
+   psSlot = Epoch_getSlot();
+   if(psSlot == NULL)
+      return FALSE;
+
+   __atomic_store_n(&psSlot->ulEpoch,
+                    __atomic_load_n(&ulGlobal, __ATOMIC_RELAXED),
+                    __ATOMIC_RELAXED);
+   /* the slot must be visible before anything is read */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   return TRUE;
+}
+
+void Epoch_exit(void) {
+   struct epochSlot *psSlot;
+
+   assert(bKeyMade);
+
+   psSlot = pthread_getspecific(sSlotKey);
+   assert(psSlot != NULL);
+   __atomic_store_n(&psSlot->ulEpoch, 0UL, __ATOMIC_RELEASE);
+}
+
+void Epoch_retire(void *pvItem, void (*pfFree)(void *pvItem)) {
+   struct retired *psRetired;
+   struct retired *psFree = NULL;
+   boolean bAdvanced;
+
+   assert(pfFree != NULL);
+
+   psRetired = malloc(sizeof(struct retired));
+   if(psRetired == NULL) {
+      Epoch_drain();
+      (*pfFree)(pvItem);
+      return;
+   }
+   psRetired->pvItem = pvItem;
+   psRetired->pfFree = pfFree;
+
+   (void) pthread_mutex_lock(&sEpochLock);
+   psRetired->psNext = apsRetired[ulGlobal % 3];
+   apsRetired[ulGlobal % 3] = psRetired;
+   ulPending++;
+   if(ulPending >= EPOCH_BATCH) {
+      ulPending = 0;
+      psFree = Epoch_advance(&bAdvanced);
+   }
+   (void) pthread_mutex_unlock(&sEpochLock);
+
+   Epoch_freeList(psFree);
+}
+
+void Epoch_drain(void) {
+   struct retired *psFree;
+   unsigned long ulTarget;
+   boolean bAdvanced;
+   boolean bDone;
+
+   (void) pthread_mutex_lock(&sEpochLock);
+   ulTarget = ulGlobal + 2;
+   (void) pthread_mutex_unlock(&sEpochLock);
+
+   /* two advances free everything retired before the call */
+   do {
+      (void) pthread_mutex_lock(&sEpochLock);
+      psFree = Epoch_advance(&bAdvanced);
+      bDone = (boolean) (ulGlobal >= ulTarget);
+      (void) pthread_mutex_unlock(&sEpochLock);
+
+      Epoch_freeList(psFree);
+      if(!bAdvanced)
+         (void) sched_yield();
+   } while(!bDone);
+}
@@ -0,0 +1,47 @@
+/*--------------------------------------------------------------------*/
+/* epoch.h                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef EPOCH_INCLUDED
+#define EPOCH_INCLUDED
+
+#include "a4def.h"
+
+/*
+  Epoch-based reclamation, for memory that threads read without
+  holding any lock. A reader brackets its reads with Epoch_enter and
+  Epoch_exit; a writer that unlinks an item hands it to Epoch_retire
+  instead of freeing it, and the item is freed only once every reader
+  that might still have been reading it has left. There is one
+  reclamation domain per process.
+*/
+
+/*
+  Marks the calling thread as reading. Returns TRUE, or FALSE if the
+  thread could not be given a slot (too many threads read at once, or
+  memory ran out), in which case the caller must not read without a
+  lock. Calls do not nest.
+*/
+boolean Epoch_enter(void);
+
+/* Marks the calling thread, which called Epoch_enter, as done. */
+void Epoch_exit(void);
+
+/*
+  Arranges for (*pfFree)(pvItem) to be called once no thread that was
+  reading at the time of the call still is. pvItem must already be
+  unreachable for readers that start after the call. If memory to
+  record the item cannot be allocated, waits for those readers and
+  frees it at once.
+*/
+void Epoch_retire(void *pvItem, void (*pfFree)(void *pvItem));
+
+/*
+  Waits until every thread now reading is done, then frees every item
+  retired so far. Must not be called between Epoch_enter and
+  Epoch_exit.
+*/
+void Epoch_drain(void);
+
+#endif
@@ -3,30 +3,127 @@
 /* Author: Helen Hui, George Xie                                       */
 /*--------------------------------------------------------------------*/
 
+/* for pthread_rwlock_t and sched_yield */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "dynarray.h"
 #include "path.h"
 #include "nodeFT.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include "bloom.h"
+#include "epoch.h"
+#include "checkerFT.h"
 #include "ft.h"
+#include "ftimpl.h"
+#include "ftsnap.h"
+#include "ftreclaim.h"
+#include "ftbuild.h"
+#include "ftload.h"
+#include "fttxn.h"
+#include "ftcombine.h"
+#include "ftshard.h"
+
+/* A path that FT_statManyIn or FT_getContentsManyIn looks up */
+struct ftPathKey {
+   /* the FT that holds the path's node: for a sharded FT, the shard */
+   FT_T oFTHolder;
+   const char *pcPath;
+   /* the path's place among the paths looked up */
+   size_t ulIndex;
+};
+
+/* The instance used by the functions without an FT_T parameter */
+static struct ft sDefaultFT;
+
+/* The number of lock-free attempts at a lookup before it falls back
+   to the lock */
+enum { FT_OPTIMISTIC_TRIES = 8 };
+
+/* What a lock-free lookup saw of the node it looked up */
+struct ftSighting {
+   /* the lookup's status, as FT_findNode would have returned it */
+   int iStatus;
+   /* if iStatus is SUCCESS, the node's kind, contents length and
+      contents */
+   boolean bIsFile;
+   size_t ulLength;
+   void *pvContents;
+};
+
+
+void FT_lockShared(FT_T oFT) {
+   if(oFT->eLocking != FT_LOCK_NONE)
+      (void) pthread_rwlock_rdlock(&oFT->sLock);
+}
+
+void FT_lockExclusive(FT_T oFT) {
+   if(oFT->eLocking != FT_LOCK_NONE)
+      (void) pthread_rwlock_wrlock(&oFT->sLock);
+}
+
+void FT_unlock(FT_T oFT) {
+   if(oFT->eLocking != FT_LOCK_NONE)
+      (void) pthread_rwlock_unlock(&oFT->sLock);
+}
 
+/*
+  Returns TRUE if oFT's locking mode allows the path cache and the
+  Bloom filter: not under per-directory locking, where no lock covers
+  them, nor under lock-free reads, where readers would see them
+  change.
+*/
+static boolean FT_allowsIndexes(FT_T oFT) {
+   return (boolean) (oFT->eLocking != FT_LOCK_DIRS &&
+                     oFT->eLocking != FT_LOCK_OPTIMISTIC);
+}
 
 /*
-  A File Tree is a representation of a hierarchy of directories and
-  files, represented as an AO with 3 state variables:
+  Takes oFT's lock for an operation that may change the node with
+  path pcPath. That is exclusive unless per-directory locking is on,
+  in which case only a change that may create or remove the root
+  needs the whole tree.
 */
+static void FT_lockForUpdate(FT_T oFT, const char *pcPath) {
+   assert(pcPath != NULL);
+
+   /* a path without a '/' can only name the root */
+   if(oFT->eLocking != FT_LOCK_DIRS || strchr(pcPath, '/') == NULL) {
+      FT_lockExclusive(oFT);
+      return;
+   }
+
+   FT_lockShared(oFT);
+   if(oFT->oNRoot == NULL) {
+      FT_unlock(oFT);
+      FT_lockExclusive(oFT);
+   }
+}
+
+void FT_lockWhole(FT_T oFT) {
+   if(oFT->eLocking == FT_LOCK_DIRS)
+      FT_lockExclusive(oFT);
+   else
+      FT_lockShared(oFT);
+}
 
-/* 1. a flag for being in an initialized state (TRUE) or not (FALSE) */
-static boolean bIsInitialized;
-/* 2. a pointer to the root node in the hierarchy */
-static Node_T oNRoot;
-/* 3. a counter of the number of nodes in the hierarchy */
-static size_t ulCount;
+void FT_lockState(FT_T oFT) {
+   if(oFT->eLocking == FT_LOCK_DIRS)
+      (void) pthread_mutex_lock(&oFT->sStateLock);
+}
 
+void FT_unlockState(FT_T oFT) {
+   if(oFT->eLocking == FT_LOCK_DIRS)
+      (void) pthread_mutex_unlock(&oFT->sStateLock);
+}
 
 /* --------------------------------------------------------------------
 
@@ -36,6 +133,120 @@ static size_t ulCount;
   node if the full path was reached, respectively.
 */
 
+/*
+  Returns the directory whose lock guards oNNode under per-directory
+  locking: oNNode itself if it is a directory, else its parent.
+*/
+static Node_T FT_guardOf(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(Node_isFile(oNNode))
+      return Node_getParent(oNNode);
+   return oNNode;
+}
+
+void FT_releaseGuard(FT_T oFT, Node_T oNFurthest) {
+   if(oFT->eLocking == FT_LOCK_DIRS && oNFurthest != NULL)
+      Node_unlock(FT_guardOf(oNFurthest));
+}
+
+/* Takes the lock of directory oNDir, exclusively if bExclusive. */
+static void FT_lockDir(Node_T oNDir, boolean bExclusive) {
+   if(bExclusive)
+      Node_lockExclusive(oNDir);
+   else
+      Node_lockShared(oNDir);
+}
+
+/*
+  Like FT_traversePath, but for per-directory locking, and going no
+  deeper than depth ulStopDepth. The walk couples locks down the
+  path: it locks each directory before releasing the one above, so
+  that no writer can change or remove a directory between the two.
+  On success with *poNFurthest not NULL, the lock of FT_guardOf
+  *poNFurthest is left held, exclusively if bExclusive and shared
+  otherwise; every other lock has been released.
+*/
+static int FT_traverseCoupled(FT_T oFT, Path_T oPPath,
+                              size_t ulStopDepth, boolean bExclusive,
+                              Node_T *poNFurthest) {
+   int iStatus;
+   Node_T oNParent = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   Node_T oNFile;
+   boolean bHeldExclusive;
+   size_t i = 1;
+   size_t ulChildID = 0;
+
+   assert(oPPath != NULL);
+   assert(ulStopDepth >= 1);
+   assert(poNFurthest != NULL);
+
+   /* the root only changes under the whole-tree lock, which the
+      caller holds at least shared */
+   if(oFT->oNRoot == NULL) {
+      *poNFurthest = NULL;
+      return SUCCESS;
+   }
+   if(strcmp(Path_getPathname(Node_getPath(oFT->oNRoot)),
+             Path_getComponent(oPPath, 0))) {
+      *poNFurthest = NULL;
+      return CONFLICTING_PATH;
+   }
+
+   oNCurr = oFT->oNRoot;
+   bHeldExclusive = (boolean) (bExclusive && ulStopDepth == 1);
+   FT_lockDir(oNCurr, bHeldExclusive);
+
+   for(;;) {
+      oNFile = NULL;
+      if(i < ulStopDepth &&
+         Node_hasChildNamed(oNCurr, Path_getComponent(oPPath, i),
+                            &ulChildID)) {
+         iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+         if(iStatus != SUCCESS) {
+            if(oNParent != NULL)
+               Node_unlock(oNParent);
+            Node_unlock(oNCurr);
+            *poNFurthest = NULL;
+            return iStatus;
+         }
+
+         /* a directory child: descend to it, keeping oNCurr locked
+            as its parent and letting go of the one above */
+         if(!Node_isFile(oNChild)) {
+            if(oNParent != NULL)
+               Node_unlock(oNParent);
+            oNParent = oNCurr;
+            oNCurr = oNChild;
+            i++;
+            bHeldExclusive = (boolean) (bExclusive && i == ulStopDepth);
+            FT_lockDir(oNCurr, bHeldExclusive);
+            continue;
+         }
+         oNFile = oNChild;
+      }
+
+      /* oNCurr is the deepest directory reached. Locks cannot be
+         upgraded, so retake it exclusively; its parent, still held,
+         keeps it from being removed meanwhile, but a writer may have
+         extended the path, so look again. */
+      if(bExclusive && !bHeldExclusive) {
+         Node_unlock(oNCurr);
+         Node_lockExclusive(oNCurr);
+         bHeldExclusive = TRUE;
+         continue;
+      }
+      break;
+   }
+
+   if(oNParent != NULL)
+      Node_unlock(oNParent);
+   *poNFurthest = (oNFile != NULL) ? oNFile : oNCurr;
+   return SUCCESS;
+}
+
 /*
   Traverses the FT starting at the root as far as possible towards
   absolute path oPPath. If able to traverse, returns an int SUCCESS
@@ -44,10 +255,20 @@ static size_t ulCount;
   Otherwise, sets *poNFurthest to NULL and returns with status:
   * CONFLICTING_PATH if the root's path is not a prefix of oPPath
   * MEMORY_ERROR if memory could not be allocated to complete request
+
+  The walk starts from the deepest recently used directory that is an
+  ancestor of oPPath, if any, rather than from the root, and records
+  the directory where it ended (or the parent of the file where it
+  ended) as recently used. If bShared, the caller holds only the
+  shared lock, so the walk starts at the root and records nothing.
+
+  Under per-directory locking, the walk is FT_traverseCoupled's, and
+  leaves the guard of *poNFurthest locked: shared if bShared and
+  exclusively otherwise.
 */
-static int FT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
+static int FT_traversePath(FT_T oFT, Path_T oPPath, boolean bShared,
+                           Node_T *poNFurthest) {
    int iStatus;
-   Path_T oPPrefix = NULL;
    Node_T oNCurr;
    Node_T oNChild = NULL;
    size_t ulDepth;
@@ -57,38 +278,40 @@ static int FT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
    assert(oPPath != NULL);
    assert(poNFurthest != NULL);
 
+   if(oFT->eLocking == FT_LOCK_DIRS)
+      return FT_traverseCoupled(oFT, oPPath, Path_getDepth(oPPath),
+                                !bShared, poNFurthest);
+
    /* root is NULL -> won't find anything */
-   if(oNRoot == NULL) {
+   if(oFT->oNRoot == NULL) {
       *poNFurthest = NULL;
       return SUCCESS;
    }
 
-   iStatus = Path_prefix(oPPath, 1, &oPPrefix);
-   if(iStatus != SUCCESS) {
-      *poNFurthest = NULL;
-      return iStatus;
-   }
+   oNCurr = NULL;
+   if(oFT->oDCache != NULL && !bShared)
+      oNCurr = DirCache_find(oFT->oDCache, oPPath);
 
-   if(Path_comparePath(Node_getPath(oNRoot), oPPrefix)) {
-      Path_free(oPPrefix);
-      *poNFurthest = NULL;
-      return CONFLICTING_PATH;
+   if(oNCurr != NULL)
+      i = Path_getDepth(Node_getPath(oNCurr));
+   else {
+      /* the root's path has depth 1, so its pathname is its
+         component */
+      if(strcmp(Path_getPathname(Node_getPath(oFT->oNRoot)),
+                Path_getComponent(oPPath, 0))) {
+         *poNFurthest = NULL;
+         return CONFLICTING_PATH;
+      }
+      oNCurr = oFT->oNRoot;
+      i = 1;
    }
-   Path_free(oPPrefix);
-   oPPrefix = NULL;
 
-   oNCurr = oNRoot;
+   /* descend one component at a time, without building prefixes */
    ulDepth = Path_getDepth(oPPath);
-   for(i = 2; i <= ulDepth; i++) {
-      iStatus = Path_prefix(oPPath, i, &oPPrefix);
-      if(iStatus != SUCCESS) {
-         *poNFurthest = NULL;
-         return iStatus;
-      }
-      if(Node_hasChild(oNCurr, oPPrefix, &ulChildID)) {
-         /* go to that child and continue with next prefix */
-         Path_free(oPPrefix);
-         oPPrefix = NULL;
+   for(; i < ulDepth; i++) {
+      if(Node_hasChildNamed(oNCurr, Path_getComponent(oPPath, i),
+                            &ulChildID)) {
+         /* go to that child and continue with next component */
          iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
          if(iStatus != SUCCESS) {
             *poNFurthest = NULL;
@@ -97,28 +320,22 @@ static int FT_traversePath(Path_T oPPath, Node_T *poNFurthest) {
          oNCurr = oNChild;
       }
       else {
-         /* oNCurr doesn't have child with path oPPrefix:
+         /* oNCurr doesn't have child with this component:
             this is as far as we can go */
          break;
       }
    }
 
-   Path_free(oPPrefix);
+   if(oFT->oDCache != NULL && !bShared)
+      DirCache_add(oFT->oDCache, Node_isFile(oNCurr) ?
+                   Node_getParent(oNCurr) : oNCurr);
+
    *poNFurthest = oNCurr;
    return SUCCESS;
 }
 
-/*
-  Traverses the FT to find a node with absolute path pcPath. Returns a
-  int SUCCESS status and sets *poNResult to be the node, if found.
-  Otherwise, sets *poNResult to NULL and returns with status:
-  * INITIALIZATION_ERROR if the FT is not in an initialized state
-  * BAD_PATH if pcPath does not represent a well-formatted path
-  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
-  * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
-  * MEMORY_ERROR if memory could not be allocated to complete request
- */
-static int FT_findNode(const char *pcPath, Node_T *poNResult) {
+int FT_findNode(FT_T oFT, const char *pcPath, boolean bShared,
+                Node_T *poNResult) {
    Path_T oPPath = NULL;
    Node_T oNFound = NULL;
    int iStatus;
@@ -126,18 +343,31 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult) {
    assert(pcPath != NULL);
    assert(poNResult != NULL);
 
-   if(!bIsInitialized) {
+   if(!oFT->bIsInitialized) {
       *poNResult = NULL;
       return INITIALIZATION_ERROR;
    }
 
+   /* a hit is an exact match of an existing node's pathname, which
+      is necessarily well-formed, so no parsing is needed */
+   if(oFT->oPCache != NULL) {
+      if(bShared)
+         oNFound = PathCache_peek(oFT->oPCache, pcPath);
+      else
+         oNFound = PathCache_lookup(oFT->oPCache, pcPath);
+      if(oNFound != NULL) {
+         *poNResult = oNFound;
+         return SUCCESS;
+      }
+   }
+
    iStatus = Path_new(pcPath, &oPPath);
    if(iStatus != SUCCESS) {
       *poNResult = NULL;
       return iStatus;
    }
 
-   iStatus = FT_traversePath(oPPath, &oNFound);
+   iStatus = FT_traversePath(oFT, oPPath, bShared, &oNFound);
    if(iStatus != SUCCESS)
    {
       Path_free(oPPath);
@@ -152,6 +382,7 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult) {
    }
 
    if(Path_comparePath(Node_getPath(oNFound), oPPath) != 0) {
+      FT_releaseGuard(oFT, oNFound);
       Path_free(oPPath);
       *poNResult = NULL;
       return NO_SUCH_PATH;
@@ -161,504 +392,2696 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult) {
    *poNResult = oNFound;
    return SUCCESS;
 }
-/*--------------------------------------------------------------------*/
 
+/*
+  Adds oNNode to the path cache of FT pvFT, if it is enabled. A
+  failure to add is ignored: the node is then simply found by walking.
+  The FT is passed as a void * so that this can be a traversal
+  visitor, as can the three functions below.
+*/
+static void FT_cacheAdd(Node_T oNNode, void *pvFT) {
+   FT_T oFT = pvFT;
 
-int FT_insertDir(const char *pcPath) {
-   int iStatus;
-   Path_T oPPath = NULL;
-   Node_T oNFirstNew = NULL;
-   Node_T oNCurr = NULL;
-   size_t ulDepth, ulIndex;
-   size_t ulNewNodes = 0;
+   if(oFT->oPCache != NULL)
+      (void) PathCache_add(oFT->oPCache,
+                           Path_getPathname(Node_getPath(oNNode)),
+                           oNNode);
+}
 
-   assert(pcPath != NULL);
+/* Removes oNNode from the path cache of FT pvFT, if it is enabled. */
+static void FT_cacheRemove(Node_T oNNode, void *pvFT) {
+   FT_T oFT = pvFT;
 
-   /* validate pcPath and generate a Path_T for it */
-   if(!bIsInitialized)
-      return INITIALIZATION_ERROR;
+   if(oFT->oPCache != NULL)
+      PathCache_remove(oFT->oPCache,
+                       Path_getPathname(Node_getPath(oNNode)));
+}
 
-   iStatus = Path_new(pcPath, &oPPath);
-   if(iStatus != SUCCESS)
-      return iStatus;
+/* Adds oNNode's pathname to the Bloom filter of FT pvFT, if any. */
+static void FT_filterAdd(Node_T oNNode, void *pvFT) {
+   FT_T oFT = pvFT;
 
-   /* find the closest ancestor of oPPath already in the tree */
-   iStatus = FT_traversePath(oPPath, &oNCurr);
-   if(iStatus != SUCCESS)
-   {
-      Path_free(oPPath);
-      return iStatus;
-   }
+   if(oFT->oBFilter != NULL)
+      Bloom_add(oFT->oBFilter, Path_getPathname(Node_getPath(oNNode)));
+}
 
-   /* no ancestor node found, so if root is not NULL,
-      pcPath isn't underneath root. */
-   if(oNCurr == NULL && oNRoot != NULL) {
-      Path_free(oPPath);
-      return CONFLICTING_PATH;
-   }
+/* Removes oNNode's pathname from the Bloom filter of FT pvFT, if
+   any. */
+static void FT_filterRemove(Node_T oNNode, void *pvFT) {
+   FT_T oFT = pvFT;
 
-   ulDepth = Path_getDepth(oPPath);
-   if(oNCurr == NULL) /* new root! */
-      ulIndex = 1;
-   else {
-      ulIndex = Path_getDepth(Node_getPath(oNCurr))+1;
+   if(oFT->oBFilter != NULL)
+      Bloom_remove(oFT->oBFilter,
+                   Path_getPathname(Node_getPath(oNNode)));
+}
 
-      /* oNCurr is the node we're trying to insert */
-      if(ulIndex == ulDepth+1 && !Path_comparePath(oPPath,
-                                       Node_getPath(oNCurr))) {
-         Path_free(oPPath);
-         return ALREADY_IN_TREE;
-      }
-   }
+void FT_indexAdd(Node_T oNNode, void *pvFT) {
+   FT_cacheAdd(oNNode, pvFT);
+   FT_filterAdd(oNNode, pvFT);
+}
 
-   /* starting at oNCurr, build rest of the path one level at a time */
-   while(ulIndex <= ulDepth) {
-      Path_T oPPrefix = NULL;
-      Node_T oNNewNode = NULL;
+/* Removes oNNode from the path cache and the Bloom filter of FT
+   pvFT. */
+static void FT_indexRemove(Node_T oNNode, void *pvFT) {
+   FT_cacheRemove(oNNode, pvFT);
+   FT_filterRemove(oNNode, pvFT);
+}
 
-      /* generate a Path_T for this level */
-      iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
-      if(iStatus != SUCCESS) {
-         Path_free(oPPath);
-         if(oNFirstNew != NULL)
-            (void) Node_free(oNFirstNew);
-         return iStatus;
-      }
+void FT_growFilter(FT_T oFT) {
+   Bloom_T oBOld = oFT->oBFilter;
 
-      /* insert the new directory node for this level */
-      iStatus = Node_new(oPPrefix, oNCurr, &oNNewNode, FALSE, NULL, 0);
-      if(iStatus != SUCCESS) {
-         Path_free(oPPath);
-         Path_free(oPPrefix);
-         if(oNFirstNew != NULL)
-            (void) Node_free(oNFirstNew);
-         return iStatus;
-      }
+   if(oBOld == NULL || Bloom_getLength(oBOld) <= Bloom_getCapacity(oBOld))
+      return;
 
-      /* set up for next level */
-      Path_free(oPPrefix);
-      oNCurr = oNNewNode;
-      ulNewNodes++;
-      if(oNFirstNew == NULL)
-         oNFirstNew = oNCurr;
-      ulIndex++;
+   oFT->oBFilter = Bloom_new(2 * Bloom_getCapacity(oBOld),
+                             Bloom_getFalsePositiveRate(oBOld));
+   if(oFT->oBFilter == NULL) {
+      oFT->oBFilter = oBOld;
+      return;
    }
 
-   Path_free(oPPath);
-   /* update FT state variables to reflect insertion */
-   if(oNRoot == NULL)
-      oNRoot = oNFirstNew;
-   ulCount += ulNewNodes;
+   FT_preOrderTraversal(oFT->oNRoot, FT_filterAdd, oFT);
+   Bloom_free(oBOld);
+}
 
-   return SUCCESS;
+void FT_indexInserted(FT_T oFT, Node_T oNFirstNew,
+                      Node_T oNDir) {
+   assert(oNFirstNew != NULL);
+   assert(oNDir != NULL);
+
+   if(oFT->oPCache != NULL || oFT->oBFilter != NULL)
+      FT_preOrderTraversal(oNFirstNew, FT_indexAdd, oFT);
+   FT_growFilter(oFT);
+   if(oFT->oDCache != NULL)
+      DirCache_add(oFT->oDCache, oNDir);
 }
 
-int FT_insertFile(const char *pcPath, void *pvContents,
-                  size_t ulLength) {
+/*
+  Like FT_findNode, but first consults the Bloom filter, if there is
+  one, and returns NO_SUCH_PATH at once if it rules pcPath out. A
+  filtered "no" does not tell a malformed path from an absent one, so
+  this is only for callers that report every failure alike. If
+  bShared, the filter's counters are left alone.
+*/
+static int FT_findFiltered(FT_T oFT, const char *pcPath,
+                           boolean bShared, Node_T *poNResult) {
    int iStatus;
-   Path_T oPPath = NULL;
-   Node_T oNFirstNew = NULL;
-   Node_T oNCurr = NULL;
-   Node_T oNNewNode = NULL;
-   size_t ulDepth, ulIndex;
-   size_t ulNewNodes = 0;
+   boolean bCount;
 
    assert(pcPath != NULL);
+   assert(poNResult != NULL);
 
-   if(!bIsInitialized)
-      return INITIALIZATION_ERROR;
-
-   /*create path object oPPath */
-   iStatus = Path_new(pcPath, &oPPath);
-   if(iStatus != SUCCESS)
-      return iStatus;
+   bCount = (boolean) (oFT->oBFilter != NULL && !bShared);
 
-   /* find the closest ancestor of oPPath already in the tree 
-    * and store into oNCurr */
-   iStatus = FT_traversePath(oPPath, &oNCurr);
-   if(iStatus != SUCCESS)
-   {
-      Path_free(oPPath);
-      return iStatus;
+   if(oFT->oBFilter != NULL) {
+      if(bCount)
+         oFT->ulFilterProbes++;
+      if(!Bloom_mayContain(oFT->oBFilter, pcPath)) {
+         if(bCount)
+            oFT->ulFilterNegatives++;
+         *poNResult = NULL;
+         return NO_SUCH_PATH;
+      }
    }
 
-   /* find depth of path */
-   ulDepth = Path_getDepth(oPPath);
+   iStatus = FT_findNode(oFT, pcPath, bShared, poNResult);
+   if(bCount && iStatus != SUCCESS)
+      oFT->ulFilterFalsePositives++;
+   return iStatus;
+}
 
-   /* files cannot be root */
-   if(ulDepth < 1) {
-      Path_free(oPPath);
-      return CONFLICTING_PATH;
-   }
+/*
+  Drops directory handle oDHandle, whose FT must not have been
+  destroyed, from that FT's oDHandles by moving the last handle into
+  its place.
+*/
+static void FT_unregisterHandle(DirHandle_T oDHandle) {
+   FT_T oFT;
+   DirHandle_T oDLast;
+   size_t ulLast;
+
+   assert(oDHandle != NULL);
+   assert(oDHandle->oFT != NULL);
+
+   oFT = oDHandle->oFT;
+   assert(oFT->oDHandles != NULL);
+
+   ulLast = DynArray_getLength(oFT->oDHandles) - 1;
+   oDLast = DynArray_get(oFT->oDHandles, ulLast);
+   (void) DynArray_set(oFT->oDHandles, oDHandle->ulIndex, oDLast);
+   oDLast->ulIndex = oDHandle->ulIndex;
+   (void) DynArray_removeAt(oFT->oDHandles, ulLast);
+}
 
-   /* no ancestor node found, so if root is not NULL,
-      pcPath isn't underneath root. */
-   if(oNCurr == NULL && oNRoot != NULL) {
-      Path_free(oPPath);
-      return CONFLICTING_PATH;
-   }
+void FT_invalidateHandlesUnder(FT_T oFT, Path_T oPPath) {
+   DirHandle_T oDHandle;
+   Path_T oPDir;
+   size_t ulDepth;
+   size_t ul;
 
-   /* if there's no tree yet, can't insert a file as root */
-   if(oNCurr == NULL) {
-      Path_free(oPPath);
-      return CONFLICTING_PATH;
-   }
+   assert(oPPath != NULL);
 
-   ulIndex = Path_getDepth(Node_getPath(oNCurr)) + 1;
+   if(oFT->oDHandles == NULL)
+      return;
 
-   /* check if path already exists */
-   if(ulIndex == ulDepth + 1 && !Path_comparePath(oPPath,
-                                    Node_getPath(oNCurr))) {
-      Path_free(oPPath);
-      return ALREADY_IN_TREE;
+   ulDepth = Path_getDepth(oPPath);
+   for(ul = 0; ul < DynArray_getLength(oFT->oDHandles); ul++) {
+      oDHandle = DynArray_get(oFT->oDHandles, ul);
+      if(oDHandle->oNDir == NULL)
+         continue;
+      oPDir = Node_getPath(oDHandle->oNDir);
+      if(Path_getDepth(oPDir) >= ulDepth &&
+         Path_getSharedPrefixDepth(oPPath, oPDir) == ulDepth)
+         oDHandle->oNDir = NULL;
    }
+}
 
-   /* Build intermediate directory nodes up to depth-1 */
-   while(ulIndex < ulDepth) {
-      Path_T oPPrefix = NULL;
+void FT_unindexSubtree(FT_T oFT, Node_T oNNode) {
+   assert(oNNode != NULL);
 
-      /* generate a Path_T object for this level */
-      iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
-      if(iStatus != SUCCESS) {
-         Path_free(oPPath);
-         if(oNFirstNew != NULL)
-            (void) Node_free(oNFirstNew);
-         return iStatus;
-      }
+   if(oFT->oPCache != NULL || oFT->oBFilter != NULL)
+      FT_preOrderTraversal(oNNode, FT_indexRemove, oFT);
+   if(oFT->oDCache != NULL)
+      DirCache_removeSubtree(oFT->oDCache, Node_getPath(oNNode));
+}
 
-      /* insert the new directory node for this level */
-      iStatus = Node_new(oPPrefix, oNCurr, &oNNewNode, FALSE, NULL, 0);
-      if(iStatus != SUCCESS) {
-         Path_free(oPPath);
-         Path_free(oPPrefix);
-         if(oNFirstNew != NULL)
-            (void) Node_free(oNFirstNew);
-         return iStatus;
-      }
+/*
+  Removes the subtree rooted at oNNode, first dropping all of its
+  nodes from the path cache, the Bloom filter and the directory cache
+  and invalidating any handles to its directories, and updates the FT
+  state variables to match. The subtree is freed as FT_freeSubtree
+  frees it, unless snapshots are open, in which case it is only
+  detached and kept for them. Returns SUCCESS, or MEMORY_ERROR with
+  nothing removed.
+*/
+static int FT_removeSubtree(FT_T oFT, Node_T oNNode) {
+   struct ftRemoved *psRemoved = NULL;
+   Node_T oNParent;
+   size_t ulRemoved;
+   int iStatus;
 
-      /* set up for next level */
-      Path_free(oPPrefix);
-      oNCurr = oNNewNode;
-      ulNewNodes++;
-      if(oNFirstNew == NULL)
-         oNFirstNew = oNCurr;
-      ulIndex++;
-   }
+   assert(oNNode != NULL);
 
-   /* Now create the file node at the final level */
-   iStatus = Node_new(oPPath, oNCurr, &oNNewNode, TRUE, 
-                      pvContents, ulLength);
-   if(iStatus != SUCCESS) {
-      Path_free(oPPath);
-      if(oNFirstNew != NULL)
-         (void) Node_free(oNFirstNew);
-      return iStatus;
+   if(FT_hasSnapshots(oFT)) {
+      oNParent = Node_getParent(oNNode);
+      if(oNParent != NULL) {
+         iStatus = FT_preserve(oFT, oNParent);
+         if(iStatus != SUCCESS)
+            return iStatus;
+      }
+      psRemoved = malloc(sizeof(struct ftRemoved));
+      if(psRemoved == NULL)
+         return MEMORY_ERROR;
+      if(!DynArray_add(oFT->oDRemoved, psRemoved)) {
+         free(psRemoved);
+         return MEMORY_ERROR;
+      }
    }
 
-   ulNewNodes++;
-   if(oNFirstNew == NULL)
-      oNFirstNew = oNNewNode;
-
-   Path_free(oPPath);
+   FT_unindexSubtree(oFT, oNNode);
+   if(!Node_isFile(oNNode)) {
+      FT_lockState(oFT);
+      FT_invalidateHandlesUnder(oFT, Node_getPath(oNNode));
+      FT_unlockState(oFT);
+   }
 
-   /* update FT state variables to reflect insertion */
-   if(oNRoot == NULL)
-      oNRoot = oNFirstNew;
-   ulCount += ulNewNodes;
+   ulRemoved = Node_getSubtreeSize(oNNode);
+   if(psRemoved == NULL)
+      FT_freeSubtree(oFT, oNNode);
+   else {
+      Node_detach(oNNode);
+      psRemoved->oNSubtree = oNNode;
+      psRemoved->ulSeq = oFT->ulSnapshotSeq;
+   }
 
+   FT_lockState(oFT);
+   oFT->ulCount -= ulRemoved;
+   if(oFT->ulCount == 0)
+      __atomic_store_n(&oFT->oNRoot, NULL, __ATOMIC_RELEASE);
+   FT_unlockState(oFT);
    return SUCCESS;
 }
 
-boolean FT_containsDir(const char *pcPath) {
-   int iStatus;
-   Node_T oNFound = NULL;
-
-   assert(pcPath != NULL);
-
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if(iStatus != SUCCESS)
-      return FALSE;
+/*
+  Waits until no walk holds the lock of directory oNNode, if it is
+  one, by taking the lock exclusively and releasing it again. Applied
+  in pre-order to a subtree whose parent is locked exclusively, it
+  waits out every walk inside the subtree: walks only move down, and
+  none can enter. pvExtra is unused.
+*/
+static void FT_drainDir(Node_T oNNode, void *pvExtra) {
+   (void) pvExtra;
 
-   return !Node_isFile(oNFound);
+   if(!Node_isFile(oNNode)) {
+      Node_lockExclusive(oNNode);
+      Node_unlock(oNNode);
+   }
 }
 
-boolean FT_containsFile(const char *pcPath) {
+/*
+  Implements FT_rmDirIn under per-directory locking for pcPath, which
+  must contain a '/' and so cannot name the root. Locks the parent of
+  the directory exclusively, waits out the walks inside the subtree,
+  and removes it.
+*/
+static int FT_rmDirCoupled(FT_T oFT, const char *pcPath) {
    int iStatus;
+   Path_T oPPath = NULL;
+   Node_T oNParent = NULL;
    Node_T oNFound = NULL;
+   size_t ulDepth;
+   size_t ulChildID;
 
-   assert(pcPath != NULL);
-
-   iStatus = FT_findNode(pcPath, &oNFound);
+   iStatus = Path_new(pcPath, &oPPath);
    if(iStatus != SUCCESS)
-      return FALSE;
-
-   return Node_isFile(oNFound);
-}
-
-int FT_rmDir(const char *pcPath) {
-   int iStatus;
-   Node_T oNFound = NULL;
-
-   assert(pcPath != NULL);
+      return iStatus;
+   ulDepth = Path_getDepth(oPPath);
+   assert(ulDepth >= 2);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if(iStatus != SUCCESS)
+   iStatus = FT_traverseCoupled(oFT, oPPath, ulDepth - 1, TRUE,
+                                &oNParent);
+   if(iStatus != SUCCESS) {
+      Path_free(oPPath);
       return iStatus;
+   }
+
+   /* the parent itself must have been reached, as a directory */
+   if(oNParent == NULL || Node_isFile(oNParent) ||
+      Path_getDepth(Node_getPath(oNParent)) != ulDepth - 1 ||
+      !Node_hasChildNamed(oNParent,
+                          Path_getComponent(oPPath, ulDepth - 1),
+                          &ulChildID)) {
+      FT_releaseGuard(oFT, oNParent);
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
+   Path_free(oPPath);
+
+   iStatus = Node_getChild(oNParent, ulChildID, &oNFound);
+   if(iStatus != SUCCESS) {
+      Node_unlock(oNParent);
+      return iStatus;
+   }
+   if(Node_isFile(oNFound)) {
+      Node_unlock(oNParent);
+      return NOT_A_DIRECTORY;
+   }
+
+   FT_preOrderTraversal(oNFound, FT_drainDir, NULL);
+   iStatus = FT_removeSubtree(oFT, oNFound);
+   Node_unlock(oNParent);
+   return iStatus;
+}
+
+/*
+  Makes one lock-free attempt to look up oPPath in oFT, filling in
+  *psSeen. Walks down from the root validating each directory after
+  finding the next node in it, and validates the node found after
+  copying out its fields. Returns TRUE if every validation passed, or
+  FALSE if a writer interfered, in which case *psSeen is meaningless.
+  The caller must be between Epoch_enter and Epoch_exit.
+*/
+static boolean FT_tryOptimistic(FT_T oFT, Path_T oPPath,
+                                struct ftSighting *psSeen) {
+   Node_T oNCurr;
+   Node_T oNChild;
+   unsigned int uiVersion;
+   size_t ulDepth;
+   size_t i;
+
+   assert(oPPath != NULL);
+   assert(psSeen != NULL);
+
+   oNCurr = __atomic_load_n(&oFT->oNRoot, __ATOMIC_ACQUIRE);
+   if(oNCurr == NULL) {
+      psSeen->iStatus = NO_SUCH_PATH;
+      return TRUE;
+   }
+   uiVersion = Node_readBegin(oNCurr);
+
+   /* paths never change, so the root's can be read before
+      validating */
+   if(strcmp(Path_getPathname(Node_getPath(oNCurr)),
+             Path_getComponent(oPPath, 0))) {
+      psSeen->iStatus = CONFLICTING_PATH;
+      return Node_readValidate(oNCurr, uiVersion);
+   }
+
+   ulDepth = Path_getDepth(oPPath);
+   for(i = 1; i < ulDepth; i++) {
+      oNChild = Node_findChildNamed(oNCurr,
+                                    Path_getComponent(oPPath, i));
+      if(!Node_readValidate(oNCurr, uiVersion))
+         return FALSE;
+      if(oNChild == NULL) {
+         psSeen->iStatus = NO_SUCH_PATH;
+         return TRUE;
+      }
+      /* a child removed since is marked so, and fails validation */
+      oNCurr = oNChild;
+      uiVersion = Node_readBegin(oNCurr);
+   }
+
+   psSeen->iStatus = SUCCESS;
+   psSeen->bIsFile = Node_isFile(oNCurr);
+   psSeen->ulLength = Node_getLength(oNCurr);
+   psSeen->pvContents = Node_getContents(oNCurr);
+   return Node_readValidate(oNCurr, uiVersion);
+}
+
+/*
+  Looks up pcPath in oFT, whose locking is FT_LOCK_OPTIMISTIC, without
+  taking any lock, and fills in *psSeen. Returns TRUE, or FALSE if
+  writers interfered with FT_OPTIMISTIC_TRIES attempts in a row, a
+  transaction is open, or the thread could not enter an epoch; the
+  caller must then look up pcPath under the lock instead.
+*/
+static boolean FT_lookOptimistic(FT_T oFT, const char *pcPath,
+                                 struct ftSighting *psSeen) {
+   Path_T oPPath = NULL;
+   boolean bDone = FALSE;
+   unsigned int uiTxnVersion;
+   int iTry;
+
+   assert(pcPath != NULL);
+   assert(psSeen != NULL);
+
+   if(!oFT->bIsInitialized) {
+      psSeen->iStatus = INITIALIZATION_ERROR;
+      return TRUE;
+   }
+
+   psSeen->iStatus = Path_new(pcPath, &oPPath);
+   if(psSeen->iStatus != SUCCESS)
+      return TRUE;
+
+   if(Epoch_enter()) {
+      for(iTry = 0; iTry < FT_OPTIMISTIC_TRIES && !bDone; iTry++) {
+         /* while a transaction is open, wait for its end under the
+            lock rather than see what it may yet undo */
+         uiTxnVersion = __atomic_load_n(&oFT->uiTxnVersion,
+                                        __ATOMIC_ACQUIRE);
+         if(uiTxnVersion % 2 == 1)
+            break;
+         bDone = FT_tryOptimistic(oFT, oPPath, psSeen);
+         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+         if(__atomic_load_n(&oFT->uiTxnVersion, __ATOMIC_RELAXED) !=
+            uiTxnVersion)
+            bDone = FALSE;
+      }
+      Epoch_exit();
+   }
+
+   Path_free(oPPath);
+   return bDone;
+}
+
+/*--------------------------------------------------------------------*/
+
+
+int FT_growChain(Path_T oPPath, Node_T oNCurr, boolean bIsFile,
+                 void *pvContents, size_t ulLength,
+                 Node_T *poNFirstNew, Node_T *poNDir,
+                 size_t *pulNewNodes) {
+   int iStatus;
+   Node_T oNFirstNew = NULL;
+   Node_T oNNewNode = NULL;
+   size_t ulDepth, ulIndex;
+   size_t ulNewNodes = 0;
+
+   assert(oPPath != NULL);
+   assert(poNFirstNew != NULL);
+   assert(poNDir != NULL);
+   assert(pulNewNodes != NULL);
+
+   ulDepth = Path_getDepth(oPPath);
+   if(oNCurr == NULL)
+      ulIndex = 1;
+   else
+      ulIndex = Path_getDepth(Node_getPath(oNCurr)) + 1;
+
+   /* starting at oNCurr, build rest of the path one level at a time;
+      the last level is the file, if one is being inserted */
+   while(ulIndex <= ulDepth) {
+      Path_T oPPrefix = NULL;
+      boolean bLast = (boolean) (ulIndex == ulDepth);
+
+      /* generate a Path_T for this level; the node copies it */
+      if(bLast)
+         oPPrefix = oPPath;
+      else {
+         iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
+         if(iStatus != SUCCESS) {
+            if(oNFirstNew != NULL)
+               (void) Node_free(oNFirstNew);
+            return iStatus;
+         }
+      }
+
+      /* insert the new node for this level */
+      iStatus = Node_new(oPPrefix, oNCurr, &oNNewNode,
+                         (boolean) (bLast && bIsFile),
+                         pvContents, ulLength);
+      if(!bLast)
+         Path_free(oPPrefix);
+      if(iStatus != SUCCESS) {
+         if(oNFirstNew != NULL)
+            (void) Node_free(oNFirstNew);
+         return iStatus;
+      }
+
+      /* set up for next level; oNCurr stays the deepest directory */
+      ulNewNodes++;
+      if(oNFirstNew == NULL)
+         oNFirstNew = oNNewNode;
+      if(!(bLast && bIsFile))
+         oNCurr = oNNewNode;
+      ulIndex++;
+   }
+
+   *poNFirstNew = oNFirstNew;
+   *poNDir = oNCurr;
+   *pulNewNodes = ulNewNodes;
+   return SUCCESS;
+}
+
+/*
+  Inserts the node with path oPPath into oFT, along with any missing
+  directories above it, given oNFurthest, the deepest node on oPPath
+  already in oFT, as FT_traversePath finds it. The node is a file
+  with a copy of the ulLength bytes at pvContents if bIsFile is TRUE,
+  and a directory otherwise. Returns SUCCESS and sets *poNDir to the
+  deepest directory on oPPath, which is the new node itself or its
+  parent, or returns a status as FT_insertDirIn and FT_insertFileIn
+  do, with oFT unchanged. If psUndo is not NULL, records in it how to
+  undo the insertion. The caller holds oFT's lock as FT_lockForUpdate
+  takes it.
+*/
+static int FT_insertBelow(FT_T oFT, Path_T oPPath, Node_T oNFurthest,
+                          boolean bIsFile, void *pvContents,
+                          size_t ulLength, Node_T *poNDir,
+                          struct ftUndo *psUndo) {
+   int iStatus;
+   Node_T oNFirstNew = NULL;
+   Node_T oNCurr = oNFurthest;
+   size_t ulNewNodes = 0;
+
+   assert(oFT != NULL);
+   assert(oPPath != NULL);
+   assert(poNDir != NULL);
+
+   /* no ancestor node found, so if root is not NULL,
+      pcPath isn't underneath root. */
+   if(oNCurr == NULL && oFT->oNRoot != NULL)
+      return CONFLICTING_PATH;
+
+   if(oNCurr == NULL) {
+      /* if there's no tree yet, can't insert a file as root */
+      if(bIsFile)
+         return CONFLICTING_PATH;
+   }
+   else {
+      /* oNCurr is the node we're trying to insert */
+      if(Path_getDepth(Node_getPath(oNCurr)) ==
+            Path_getDepth(oPPath) &&
+         !Path_comparePath(oPPath, Node_getPath(oNCurr)))
+         return ALREADY_IN_TREE;
+
+      /* open snapshots must keep seeing oNCurr as it is */
+      iStatus = FT_preserve(oFT, oNCurr);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   iStatus = FT_growChain(oPPath, oNCurr, bIsFile, pvContents,
+                          ulLength, &oNFirstNew, &oNCurr,
+                          &ulNewNodes);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* update FT state variables to reflect insertion */
+   /* lock-free lookups may load the root at any time */
+   if(oFT->oNRoot == NULL)
+      __atomic_store_n(&oFT->oNRoot, oNFirstNew, __ATOMIC_RELEASE);
+   FT_lockState(oFT);
+   oFT->ulCount += ulNewNodes;
+   FT_unlockState(oFT);
+   FT_indexInserted(oFT, oNFirstNew, oNCurr);
+
+   if(psUndo != NULL) {
+      psUndo->oNNode = oNFirstNew;
+      psUndo->ulNodes = ulNewNodes;
+   }
+   *poNDir = oNCurr;
+   return SUCCESS;
+}
+
+int FT_insertLocked(FT_T oFT, const char *pcPath,
+                    boolean bIsFile, void *pvContents,
+                    size_t ulLength, struct ftUndo *psUndo) {
+   int iStatus;
+   Path_T oPPath = NULL;
+   Node_T oNFurthest = NULL;
+   Node_T oNDir;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   if(!oFT->bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   /* validate pcPath and generate a Path_T for it */
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* find the closest ancestor of oPPath already in the tree */
+   iStatus = FT_traversePath(oFT, oPPath, FALSE, &oNFurthest);
+   if(iStatus != SUCCESS) {
+      Path_free(oPPath);
+      return iStatus;
+   }
+
+   iStatus = FT_insertBelow(oFT, oPPath, oNFurthest, bIsFile,
+                            pvContents, ulLength, &oNDir, psUndo);
+   Path_free(oPPath);
+   FT_releaseGuard(oFT, oNFurthest);
+   return iStatus;
+}
+
+int FT_insertDirLocked(FT_T oFT, const char *pcPath) {
+   return FT_insertLocked(oFT, pcPath, FALSE, NULL, 0, NULL);
+}
+
+int FT_insertFileLocked(FT_T oFT, const char *pcPath,
+                        void *pvContents, size_t ulLength) {
+   return FT_insertLocked(oFT, pcPath, TRUE, pvContents, ulLength,
+                          NULL);
+}
+
+int FT_descendFrom(FT_T oFT, Path_T oPPath, Node_T oNStart,
+                   Node_T *poNFurthest) {
+   Node_T oNCurr = oNStart;
+   Node_T oNChild = NULL;
+   size_t ulDepth;
+   size_t ulChildID = 0;
+   size_t i;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(oPPath != NULL);
+   assert(poNFurthest != NULL);
+
+   *poNFurthest = NULL;
+   if(oNCurr != NULL)
+      i = Path_getDepth(Node_getPath(oNCurr));
+   else {
+      if(oFT->oNRoot == NULL)
+         return SUCCESS;
+      if(strcmp(Path_getPathname(Node_getPath(oFT->oNRoot)),
+                Path_getComponent(oPPath, 0)))
+         return CONFLICTING_PATH;
+      oNCurr = oFT->oNRoot;
+      i = 1;
+   }
+
+   ulDepth = Path_getDepth(oPPath);
+   for(; i < ulDepth; i++) {
+      if(!Node_hasChildNamed(oNCurr, Path_getComponent(oPPath, i),
+                             &ulChildID))
+         break;
+      iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+      oNCurr = oNChild;
+   }
+
+   *poNFurthest = oNCurr;
+   return SUCCESS;
+}
+
+Node_T FT_climbToward(Node_T oNAnchor, Path_T oPPath) {
+   Path_T oPAnchor;
+   size_t ulLength;
+   size_t ulShared;
+
+   assert(oPPath != NULL);
+
+   if(oNAnchor == NULL)
+      return NULL;
+
+   /* most often, the anchor is itself a prefix: one comparison */
+   oPAnchor = Node_getPath(oNAnchor);
+   ulLength = Path_getStrLength(oPAnchor);
+   if(Path_getStrLength(oPPath) > ulLength &&
+      Path_getPathname(oPPath)[ulLength] == '/' &&
+      strncmp(Path_getPathname(oPPath), Path_getPathname(oPAnchor),
+              ulLength) == 0)
+      return oNAnchor;
+
+   ulShared = Path_getSharedPrefixDepth(oPAnchor, oPPath);
+   if(ulShared == 0)
+      return NULL;
+   while(Path_getDepth(Node_getPath(oNAnchor)) > ulShared)
+      oNAnchor = Node_getParent(oNAnchor);
+   return oNAnchor;
+}
+
+Node_T FT_dirOf(Node_T oNNode) {
+   if(oNNode == NULL || !Node_isFile(oNNode))
+      return oNNode;
+   return Node_getParent(oNNode);
+}
+
+int FT_compareEntries(const void *pvFirst,
+                      const void *pvSecond) {
+   const struct ftBatchEntry *psFirst =
+      *(const struct ftBatchEntry * const *) pvFirst;
+   const struct ftBatchEntry *psSecond =
+      *(const struct ftBatchEntry * const *) pvSecond;
+   int iCmp;
+
+   iCmp = strcmp(psFirst->pcPath, psSecond->pcPath);
+   if(iCmp != 0)
+      return iCmp;
+   if(psFirst < psSecond)
+      return -1;
+   if(psFirst > psSecond)
+      return 1;
+   return 0;
+}
+
+void FT_insertBatchLocked(FT_T oFT,
+                          const struct ftBatchEntry *psEntries,
+                          const struct ftBatchEntry **ppsSorted,
+                          size_t ulCount, int *piResults) {
+   const struct ftBatchEntry *psEntry;
+   Path_T oPPath = NULL;
+   /* the deepest directory on the path of the entry before */
+   Node_T oNAnchor = NULL;
+   Node_T oNFurthest;
+   Node_T oNDir;
+   size_t ul;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(psEntries != NULL || ulCount == 0);
+   assert(ppsSorted != NULL);
+   assert(piResults != NULL || ulCount == 0);
+
+   for(ul = 0; ul < ulCount; ul++) {
+      psEntry = ppsSorted[ul];
+      assert(psEntry->pcPath != NULL);
+
+      iStatus = Path_new(psEntry->pcPath, &oPPath);
+      if(iStatus != SUCCESS) {
+         piResults[psEntry - psEntries] = iStatus;
+         continue;
+      }
+
+      /* nothing is removed, so the anchor is still in the tree */
+      iStatus = FT_descendFrom(oFT, oPPath,
+                               FT_climbToward(oNAnchor, oPPath),
+                               &oNFurthest);
+      if(iStatus == SUCCESS)
+         iStatus = FT_insertBelow(oFT, oPPath, oNFurthest,
+                                  psEntry->bIsFile,
+                                  psEntry->pvContents,
+                                  psEntry->ulLength, &oNDir,
+                                  NULL);
+      Path_free(oPPath);
+      piResults[psEntry - psEntries] = iStatus;
+
+      /* a failed insert leaves the tree as it was, oNFurthest too */
+      if(iStatus == SUCCESS)
+         oNAnchor = oNDir;
+      else
+         oNAnchor = FT_dirOf(oNFurthest);
+   }
+}
+
+/*
+  Compares the path keys that pvFirst and pvSecond point to by the FT
+  holding them, then by path, then by place, so that sorting groups
+  the paths of each FT together in lexicographic order. A qsort
+  comparator.
+*/
+static int FT_comparePathKeys(const void *pvFirst,
+                              const void *pvSecond) {
+   const struct ftPathKey *psFirst = pvFirst;
+   const struct ftPathKey *psSecond = pvSecond;
+   size_t ulFirst = (size_t) psFirst->oFTHolder;
+   size_t ulSecond = (size_t) psSecond->oFTHolder;
+   int iCmp;
+
+   if(ulFirst != ulSecond)
+      return (ulFirst < ulSecond) ? -1 : 1;
+   iCmp = strcmp(psFirst->pcPath, psSecond->pcPath);
+   if(iCmp != 0)
+      return iCmp;
+   if(psFirst->ulIndex != psSecond->ulIndex)
+      return (psFirst->ulIndex < psSecond->ulIndex) ? -1 : 1;
+   return 0;
+}
+
+/*
+  Finds the node with path pcPath in oFT, as FT_findNode does, but
+  splits pcPath in place rather than building a Path_T from it: climbs
+  from oNAnchor, a directory in oFT or NULL, to the deepest of it and
+  its ancestors whose path is a prefix of pcPath, and walks down from
+  there, or from the root if there is none. Copies pcPath into
+  pcBuffer, which must have room for it. Returns SUCCESS and sets
+  *poNFound to the node, or returns BAD_PATH, CONFLICTING_PATH or
+  NO_SUCH_PATH and sets *poNFound to the deepest node found on pcPath,
+  or NULL if there is none. The caller holds oFT's lock as
+  FT_lockWhole takes it, if locking is on.
+*/
+static int FT_resolveString(FT_T oFT, const char *pcPath,
+                            Node_T oNAnchor, char *pcBuffer,
+                            Node_T *poNFound) {
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   Path_T oPCurr;
+   const char *pcName;
+   size_t ulLength;
+   size_t ulPrefix = 0;
+   size_t ulChildID;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+   assert(pcBuffer != NULL);
+   assert(poNFound != NULL);
+
+   *poNFound = NULL;
+
+   /* the checks of Path_new, ending each component in pcBuffer */
+   if(*pcPath == '\0' || *pcPath == '/')
+      return BAD_PATH;
+   for(ulLength = 0; pcPath[ulLength] != '\0'; ulLength++) {
+      if(pcPath[ulLength] != '/') {
+         pcBuffer[ulLength] = pcPath[ulLength];
+         continue;
+      }
+      if(pcPath[ulLength + 1] == '/' || pcPath[ulLength + 1] == '\0')
+         return BAD_PATH;
+      pcBuffer[ulLength] = '\0';
+   }
+   pcBuffer[ulLength] = '\0';
+
+   for(oNCurr = oNAnchor; oNCurr != NULL;
+       oNCurr = Node_getParent(oNCurr)) {
+      oPCurr = Node_getPath(oNCurr);
+      ulPrefix = Path_getStrLength(oPCurr);
+      if(ulPrefix <= ulLength &&
+         (pcPath[ulPrefix] == '/' || pcPath[ulPrefix] == '\0') &&
+         strncmp(pcPath, Path_getPathname(oPCurr), ulPrefix) == 0)
+         break;
+   }
+
+   if(oNCurr == NULL) {
+      if(oFT->oNRoot == NULL)
+         return NO_SUCH_PATH;
+      /* pcBuffer starts with the first component alone */
+      oPCurr = Node_getPath(oFT->oNRoot);
+      if(strcmp(Path_getPathname(oPCurr), pcBuffer) != 0)
+         return CONFLICTING_PATH;
+      oNCurr = oFT->oNRoot;
+      ulPrefix = Path_getStrLength(oPCurr);
+   }
+
+   /* at each step, oNCurr's path is the first ulPrefix characters */
+   while(ulPrefix < ulLength) {
+      pcName = pcBuffer + ulPrefix + 1;
+      if(!Node_hasChildNamed(oNCurr, pcName, &ulChildID))
+         break;
+      iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
+      if(iStatus != SUCCESS) {
+         *poNFound = oNCurr;
+         return iStatus;
+      }
+      oNCurr = oNChild;
+      ulPrefix += 1 + strlen(pcName);
+   }
+
+   *poNFound = oNCurr;
+   return (ulPrefix == ulLength) ? SUCCESS : NO_SUCH_PATH;
+}
+
+/*
+  Looks up the ulCount paths at psKeys, all held by oFT and sorted by
+  path, and fills in the result at psResults for each path's place,
+  with its contents if bContents is TRUE. pcBuffer has room for the
+  longest of the paths. The caller holds oFT's lock as FT_lockWhole
+  takes it, if locking is on.
+*/
+static void FT_lookupManyLocked(FT_T oFT,
+                                const struct ftPathKey *psKeys,
+                                size_t ulCount, boolean bContents,
+                                char *pcBuffer,
+                                struct ftLookup *psResults) {
+   struct ftLookup *psResult;
+   /* the deepest directory on the path looked up before */
+   Node_T oNAnchor = NULL;
+   Node_T oNFound;
+   size_t ul;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(psKeys != NULL || ulCount == 0);
+   assert(pcBuffer != NULL);
+   assert(psResults != NULL || ulCount == 0);
+
+   for(ul = 0; ul < ulCount; ul++) {
+      assert(psKeys[ul].pcPath != NULL);
+      psResult = &psResults[psKeys[ul].ulIndex];
+      psResult->bIsFile = FALSE;
+      psResult->ulSize = 0;
+      psResult->pvContents = NULL;
+
+      /* a path cache hit needs no parsing, as in FT_findNode */
+      oNFound = NULL;
+      iStatus = SUCCESS;
+      if(oFT->oPCache != NULL)
+         oNFound = PathCache_peek(oFT->oPCache, psKeys[ul].pcPath);
+      if(oNFound == NULL)
+         iStatus = FT_resolveString(oFT, psKeys[ul].pcPath, oNAnchor,
+                                    pcBuffer, &oNFound);
+      if(oNFound != NULL)
+         oNAnchor = FT_dirOf(oNFound);
+      if(iStatus != SUCCESS) {
+         psResult->iStatus = iStatus;
+         continue;
+      }
+
+      psResult->bIsFile = Node_isFile(oNFound);
+      if(psResult->bIsFile) {
+         psResult->ulSize = Node_getLength(oNFound);
+         if(bContents)
+            psResult->pvContents = Node_getContents(oNFound);
+         psResult->iStatus = SUCCESS;
+      }
+      else
+         psResult->iStatus = bContents ? NOT_A_FILE : SUCCESS;
+   }
+}
+
+/* Implements FT_containsDirIn; the caller holds oFT's lock shared,
+   if locking is on. */
+static boolean FT_containsDirLocked(FT_T oFT, const char *pcPath) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   boolean bResult;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_findFiltered(oFT, pcPath,
+                             oFT->eLocking != FT_LOCK_NONE, &oNFound);
+   if(iStatus != SUCCESS)
+      return FALSE;
+
+   bResult = (boolean) !Node_isFile(oNFound);
+   FT_releaseGuard(oFT, oNFound);
+   return bResult;
+}
+
+/* Implements FT_containsFileIn; the caller holds oFT's lock shared,
+   if locking is on. */
+static boolean FT_containsFileLocked(FT_T oFT, const char *pcPath) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   boolean bResult;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_findFiltered(oFT, pcPath,
+                             oFT->eLocking != FT_LOCK_NONE, &oNFound);
+   if(iStatus != SUCCESS)
+      return FALSE;
+
+   bResult = Node_isFile(oNFound);
+   FT_releaseGuard(oFT, oNFound);
+   return bResult;
+}
+
+int FT_rmDirLocked(FT_T oFT, const char *pcPath) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   /* below the root, only the parent and the subtree are locked */
+   if(oFT->eLocking == FT_LOCK_DIRS && oFT->bIsInitialized &&
+      strchr(pcPath, '/') != NULL)
+      return FT_rmDirCoupled(oFT, pcPath);
+
+   iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* the whole tree is locked, so no other walk can reach the node,
+      whose lock must be free before it is destroyed */
+   FT_releaseGuard(oFT, oNFound);
 
    /* check if it's a directory */
    if(Node_isFile(oNFound))
       return NOT_A_DIRECTORY;
 
-   /* Remove entire subtree */
-   ulCount -= Node_free(oNFound);
-   if(ulCount == 0)
-      oNRoot = NULL;
+   /* Remove entire subtree */
+   return FT_removeSubtree(oFT, oNFound);
+}
+
+int FT_rmFileLocked(FT_T oFT, const char *pcPath) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   Node_T oNParent;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* check if it's a file */
+   if(!Node_isFile(oNFound)) {
+      FT_releaseGuard(oFT, oNFound);
+      return NOT_A_FILE;
+   }
+
+   /* a file's guard is its parent, which outlives it */
+   oNParent = Node_getParent(oNFound);
+   iStatus = FT_removeSubtree(oFT, oNFound);
+   FT_releaseGuard(oFT, oNParent);
+
+   return iStatus;
+}
+
+void *FT_getFileContentsLocked(FT_T oFT, const char *pcPath) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   void *pvContents = NULL;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   if(!oFT->bIsInitialized)
+      return NULL;
+
+   iStatus = FT_findFiltered(oFT, pcPath,
+                             oFT->eLocking != FT_LOCK_NONE, &oNFound);
+   if(iStatus != SUCCESS)
+      return NULL;
+
+   /* check if it's a file */
+   if(Node_isFile(oNFound))
+      pvContents = Node_getContents(oNFound);
+   FT_releaseGuard(oFT, oNFound);
+
+   return pvContents;
+}
+
+/* Implements FT_replaceFileContentsIn; the caller holds oFT's lock as
+   FT_lockForUpdate takes it. */
+static void *FT_replaceFileContentsLocked(FT_T oFT, const char *pcPath,
+                                          void *pvNewContents,
+                                          size_t ulNewLength) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   void *pvOldContents = NULL;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+
+   if(!oFT->bIsInitialized)
+      return NULL;
+
+   iStatus = FT_findFiltered(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return NULL;
+
+   /* check if it's a file */
+   if(!Node_isFile(oNFound)) {
+      FT_releaseGuard(oFT, oNFound);
+      return NULL;
+   }
+
+   iStatus = FT_preserve(oFT, oNFound);
+   if(iStatus != SUCCESS) {
+      FT_releaseGuard(oFT, oNFound);
+      return NULL;
+   }
+
+   /* the node keeps a copy of the new contents and hands back the
+      old contents in a buffer that the client now owns */
+   iStatus = Node_replaceContents(oNFound, pvNewContents, ulNewLength,
+                                  &pvOldContents);
+   FT_releaseGuard(oFT, oNFound);
+   if(iStatus != SUCCESS)
+      return NULL;
+
+   return pvOldContents;
+}
+
+int FT_statLocked(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+                  size_t *pulSize) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   if(!oFT->bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   iStatus = FT_findNode(oFT, pcPath, oFT->eLocking != FT_LOCK_NONE,
+                         &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   *pbIsFile = Node_isFile(oNFound);
+   
+   if(*pbIsFile)
+      *pulSize = Node_getLength(oNFound);
+   /* pulSize unchanged for directories per spec */
+   FT_releaseGuard(oFT, oNFound);
+
+   return SUCCESS;
+}
+
+/* Implements FT_statTreeIn; the caller holds oFT's lock shared, if
+   locking is on. */
+static int FT_statTreeLocked(FT_T oFT, const char *pcPath,
+                             size_t *pulFiles, size_t *pulDirs,
+                             size_t *pulBytes) {
+   int iStatus;
+   Node_T oNFound = NULL;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+   assert(pulFiles != NULL);
+   assert(pulDirs != NULL);
+   assert(pulBytes != NULL);
+
+   if(!oFT->bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   iStatus = FT_findNode(oFT, pcPath, oFT->eLocking != FT_LOCK_NONE,
+                         &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(Node_isFile(oNFound)) {
+      FT_releaseGuard(oFT, oNFound);
+      return NOT_A_DIRECTORY;
+   }
+
+   Node_getTotals(oNFound, pulFiles, pulDirs, pulBytes);
+   FT_releaseGuard(oFT, oNFound);
+
+   return SUCCESS;
+}
+
+/*
+  Sets oFT, which must not be initialized, to an initialized state
+  with an empty hierarchy. Returns SUCCESS.
+*/
+static int FT_initIn(FT_T oFT) {
+   assert(oFT != NULL);
+   assert(!oFT->bIsInitialized);
+
+   oFT->bIsInitialized = TRUE;
+   oFT->oNRoot = NULL;
+   oFT->ulCount = 0;
+   /* the FT works without the directory cache, only slower; under
+      per-directory locking, it goes without */
+   if(oFT->eLocking != FT_LOCK_DIRS)
+      oFT->oDCache = DirCache_new();
+   oFT->ulFilterProbes = 0;
+   oFT->ulFilterNegatives = 0;
+   oFT->ulFilterFalsePositives = 0;
+
+   return SUCCESS;
+}
+
+/*
+  Like FT_initIn, but also gives oFT a Bloom filter sized for
+  ulExpectedPaths paths at false-positive rate dFalsePositiveRate,
+  if its locking mode allows. Returns SUCCESS, or MEMORY_ERROR with
+  oFT left uninitialized.
+*/
+static int FT_initWithFilterIn(FT_T oFT, size_t ulExpectedPaths,
+                               double dFalsePositiveRate) {
+   assert(oFT != NULL);
+   assert(ulExpectedPaths > 0);
+   assert(dFalsePositiveRate > 0.0 && dFalsePositiveRate < 1.0);
+
+   if(FT_allowsIndexes(oFT)) {
+      oFT->oBFilter = Bloom_new(ulExpectedPaths, dFalsePositiveRate);
+      if(oFT->oBFilter == NULL)
+         return MEMORY_ERROR;
+   }
+
+   return FT_initIn(oFT);
+}
+
+/*
+  Removes all contents of oFT, which must be initialized, invalidates
+  its directory handles, and returns it to an uninitialized state. The
+  path cache setting is kept.
+*/
+static void FT_destroyIn(FT_T oFT) {
+   assert(oFT != NULL);
+   assert(oFT->bIsInitialized);
+   assert(!FT_hasSnapshots(oFT));
+
+   FT_waitReclaimed(oFT);
+   if(oFT->oNRoot) {
+      if(oFT->oPCache != NULL)
+         PathCache_clear(oFT->oPCache);
+      oFT->ulCount -= Node_free(oFT->oNRoot);
+      oFT->oNRoot = NULL;
+
+      /* no lookup can be running, so free the nodes now */
+      if(oFT->eLocking == FT_LOCK_OPTIMISTIC)
+         Epoch_drain();
+   }
+
+   DirCache_free(oFT->oDCache);
+   oFT->oDCache = NULL;
+   Bloom_free(oFT->oBFilter);
+   oFT->oBFilter = NULL;
+
+   /* with no snapshot open, every removed subtree has been freed */
+   if(oFT->oDSnapshots != NULL) {
+      assert(DynArray_getLength(oFT->oDRemoved) == 0);
+      DynArray_free(oFT->oDSnapshots);
+      DynArray_free(oFT->oDRemoved);
+      oFT->oDSnapshots = NULL;
+      oFT->oDRemoved = NULL;
+   }
+
+   /* handles still open are invalid from now on, and no longer
+      refer to oFT, which may be freed */
+   if(oFT->oDHandles != NULL) {
+      size_t ul;
+
+      for(ul = 0; ul < DynArray_getLength(oFT->oDHandles); ul++) {
+         DirHandle_T oDHandle = DynArray_get(oFT->oDHandles, ul);
+         oDHandle->oNDir = NULL;
+         oDHandle->oFT = NULL;
+      }
+      DynArray_free(oFT->oDHandles);
+      oFT->oDHandles = NULL;
+   }
+
+   oFT->bIsInitialized = FALSE;
+}
+
+int FT_init(void) {
+   if(sDefaultFT.bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_initIn(&sDefaultFT);
+}
+
+int FT_initWithFilter(size_t ulExpectedPaths,
+                      double dFalsePositiveRate) {
+   if(sDefaultFT.bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_initWithFilterIn(&sDefaultFT, ulExpectedPaths,
+                              dFalsePositiveRate);
+}
+
+int FT_destroy(void) {
+   if(!sDefaultFT.bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   FT_destroyIn(&sDefaultFT);
+   return SUCCESS;
+}
+
+int FT_new(FT_T *poFResult) {
+   FT_T oFT;
+
+   assert(poFResult != NULL);
+
+   /* all-zero is the uninitialized state, as for sDefaultFT */
+   oFT = calloc(1, sizeof(struct ft));
+   if(oFT == NULL) {
+      *poFResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   (void) FT_initIn(oFT);
+   *poFResult = oFT;
+   return SUCCESS;
+}
+
+int FT_newWithFilter(size_t ulExpectedPaths, double dFalsePositiveRate,
+                     FT_T *poFResult) {
+   FT_T oFT;
+   int iStatus;
+
+   assert(poFResult != NULL);
+
+   oFT = calloc(1, sizeof(struct ft));
+   if(oFT == NULL) {
+      *poFResult = NULL;
+      return MEMORY_ERROR;
+   }
+
+   iStatus = FT_initWithFilterIn(oFT, ulExpectedPaths,
+                                 dFalsePositiveRate);
+   if(iStatus != SUCCESS) {
+      free(oFT);
+      *poFResult = NULL;
+      return iStatus;
+   }
+
+   *poFResult = oFT;
+   return SUCCESS;
+}
+
+void FT_free(FT_T oFT) {
+   size_t ul;
+
+   if(oFT == NULL)
+      return;
+
+   assert(oFT != &sDefaultFT);
+
+   if(oFT->poFShards != NULL) {
+      for(ul = 0; ul < oFT->ulShards; ul++)
+         FT_free(oFT->poFShards[ul]);
+      free(oFT->poFShards);
+      oFT->poFShards = NULL;
+   }
+
+   FT_destroyIn(oFT);
+   PathCache_free(oFT->oPCache);
+   (void) FT_setLockingIn(oFT, FT_LOCK_NONE);
+   free(oFT);
+}
+
+int FT_setLockingIn(FT_T oFT, FT_Locking eLocking) {
+   FT_Locking eOld;
+
+   assert(oFT != NULL);
+   assert(eLocking == FT_LOCK_NONE || eLocking == FT_LOCK_TREE ||
+          eLocking == FT_LOCK_DIRS || eLocking == FT_LOCK_OPTIMISTIC ||
+          eLocking == FT_LOCK_COMBINING);
+
+   if(oFT->poFShards != NULL)
+      return FT_setLockingSharded(oFT, eLocking);
+
+   eOld = oFT->eLocking;
+   if(eLocking == eOld)
+      return SUCCESS;
+   /* the reclaimer may be freeing nodes as this mode has them freed */
+   FT_waitReclaimed(oFT);
+   /* snapshots need writers to exclude every reader of the tree */
+   assert(eLocking != FT_LOCK_DIRS || !FT_hasSnapshots(oFT));
+
+   if(eOld == FT_LOCK_NONE) {
+      if(pthread_rwlock_init(&oFT->sLock, NULL) != 0)
+         return MEMORY_ERROR;
+      if(pthread_mutex_init(&oFT->sStateLock, NULL) != 0) {
+         (void) pthread_rwlock_destroy(&oFT->sLock);
+         return MEMORY_ERROR;
+      }
+      if(pthread_mutex_init(&oFT->sCombineLock, NULL) != 0) {
+         (void) pthread_mutex_destroy(&oFT->sStateLock);
+         (void) pthread_rwlock_destroy(&oFT->sLock);
+         return MEMORY_ERROR;
+      }
+   }
+   else if(eLocking == FT_LOCK_NONE) {
+      (void) pthread_rwlock_destroy(&oFT->sLock);
+      (void) pthread_mutex_destroy(&oFT->sStateLock);
+      (void) pthread_mutex_destroy(&oFT->sCombineLock);
+   }
+
+   oFT->eLocking = eLocking;
+
+   /* lookups that no lock covers must not consult these */
+   if(!FT_allowsIndexes(oFT)) {
+      PathCache_free(oFT->oPCache);
+      oFT->oPCache = NULL;
+      Bloom_free(oFT->oBFilter);
+      oFT->oBFilter = NULL;
+   }
+
+   /* the directory cache would need the whole-tree lock to update,
+      so per-directory locking drops it, and leaving that mode brings
+      it back, empty */
+   if(eLocking == FT_LOCK_DIRS) {
+      DirCache_free(oFT->oDCache);
+      oFT->oDCache = NULL;
+   }
+   else if(oFT->oDCache == NULL && oFT->bIsInitialized)
+      oFT->oDCache = DirCache_new();
+
+   /* lock-free lookups need removed nodes kept until they are done */
+   if(eLocking == FT_LOCK_OPTIMISTIC)
+      Node_setDeferred(TRUE);
+   else if(eOld == FT_LOCK_OPTIMISTIC)
+      Node_setDeferred(FALSE);
+   return SUCCESS;
+}
+
+/* Implements FT_setPathCacheIn; the caller holds oFT's lock
+   exclusively, if locking is on. */
+static int FT_setPathCacheLocked(FT_T oFT, boolean bEnable) {
+   assert(oFT != NULL);
+
+   if(!bEnable) {
+      PathCache_free(oFT->oPCache);
+      oFT->oPCache = NULL;
+      return SUCCESS;
+   }
+
+   if(!FT_allowsIndexes(oFT))
+      return INITIALIZATION_ERROR;
+
+   if(oFT->oPCache != NULL)
+      return SUCCESS;
+
+   oFT->oPCache = PathCache_new();
+   if(oFT->oPCache == NULL)
+      return MEMORY_ERROR;
+
+   /* the cache must cover the nodes already in the tree */
+   FT_preOrderTraversal(oFT->oNRoot, FT_cacheAdd, oFT);
+   if(PathCache_getLength(oFT->oPCache) != oFT->ulCount) {
+      PathCache_free(oFT->oPCache);
+      oFT->oPCache = NULL;
+      return MEMORY_ERROR;
+   }
+
+   return SUCCESS;
+}
+
+/* Implements FT_getPathCacheStatsIn; the caller holds oFT's lock
+   shared, if locking is on. */
+static void FT_getPathCacheStatsLocked(FT_T oFT, size_t *pulHits,
+                                       size_t *pulMisses) {
+   assert(oFT != NULL);
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+   if(oFT->oPCache == NULL) {
+      *pulHits = 0;
+      *pulMisses = 0;
+      return;
+   }
+
+   PathCache_getStats(oFT->oPCache, pulHits, pulMisses);
+}
+
+/* Implements FT_getDirCacheStatsIn; the caller holds oFT's lock
+   shared, if locking is on. */
+static void FT_getDirCacheStatsLocked(FT_T oFT, size_t *pulOps,
+                                      size_t *pulLevelsSkipped) {
+   assert(oFT != NULL);
+   assert(pulOps != NULL);
+   assert(pulLevelsSkipped != NULL);
+
+   if(oFT->oDCache == NULL) {
+      *pulOps = 0;
+      *pulLevelsSkipped = 0;
+      return;
+   }
+
+   DirCache_getStats(oFT->oDCache, pulOps, pulLevelsSkipped);
+}
+
+/* Implements FT_getFilterStatsIn; the caller holds oFT's lock
+   shared, if locking is on. */
+static void FT_getFilterStatsLocked(FT_T oFT, size_t *pulProbes,
+                                    size_t *pulNegatives,
+                                    size_t *pulFalsePositives,
+                                    size_t *pulBytes) {
+   assert(oFT != NULL);
+   assert(pulProbes != NULL);
+   assert(pulNegatives != NULL);
+   assert(pulFalsePositives != NULL);
+   assert(pulBytes != NULL);
+
+   *pulProbes = oFT->ulFilterProbes;
+   *pulNegatives = oFT->ulFilterNegatives;
+   *pulFalsePositives = oFT->ulFilterFalsePositives;
+   *pulBytes = (oFT->oBFilter == NULL) ?
+               0 : Bloom_getBytes(oFT->oBFilter);
+}
+
+/* --------------------------------------------------------------------
+
+  Directory handles: operations relative to an open directory resolve
+  a single component from the handle's node instead of walking from
+  the root.
+*/
+
+/*
+  Returns SUCCESS if pcName is a single path component, that is, a
+  non-empty string without '/', and BAD_PATH otherwise.
+*/
+static int FT_checkName(const char *pcName) {
+   assert(pcName != NULL);
+
+   if(*pcName == '\0' || strchr(pcName, '/') != NULL)
+      return BAD_PATH;
+   return SUCCESS;
+}
+
+/*
+  Returns a new string holding the path of the entry named pcName in
+  the directory with path oPDir, or NULL if memory ran out. The caller
+  owns the string.
+*/
+static char *FT_childPath(Path_T oPDir, const char *pcName) {
+   size_t ulDirLength;
+   size_t ulNameLength;
+   char *pcPath;
+
+   assert(oPDir != NULL);
+   assert(pcName != NULL);
+
+   ulDirLength = Path_getStrLength(oPDir);
+   ulNameLength = strlen(pcName);
+   pcPath = malloc(ulDirLength + ulNameLength + 2);
+   if(pcPath == NULL)
+      return NULL;
+   memcpy(pcPath, Path_getPathname(oPDir), ulDirLength);
+   pcPath[ulDirLength] = '/';
+   memcpy(pcPath + ulDirLength + 1, pcName, ulNameLength + 1);
+   return pcPath;
+}
+
+/*
+  Sets *poNDir to the directory of handle oDHandle, whose FT must not
+  have been destroyed and whose FT's lock the caller holds, if locking
+  is on. Returns SUCCESS, or NO_SUCH_PATH if the handle has been
+  invalidated.
+*/
+static int FT_handleDir(DirHandle_T oDHandle, Node_T *poNDir) {
+   assert(oDHandle != NULL);
+   assert(poNDir != NULL);
+
+   if(oDHandle->oNDir == NULL)
+      return NO_SUCH_PATH;
+
+   assert(oDHandle->oFT->bIsInitialized);
+   *poNDir = oDHandle->oNDir;
+   return SUCCESS;
+}
+
+/* Implements FT_openDirIn; the caller holds oFT's lock exclusively,
+   if locking is on. */
+static int FT_openDirLocked(FT_T oFT, const char *pcPath,
+                            DirHandle_T *poDResult) {
+   int iStatus;
+   Node_T oNFound = NULL;
+   DirHandle_T oDHandle;
+
+   assert(oFT != NULL);
+   assert(pcPath != NULL);
+   assert(poDResult != NULL);
+
+   *poDResult = NULL;
+
+   iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   FT_releaseGuard(oFT, oNFound);
+   if(Node_isFile(oNFound))
+      return NOT_A_DIRECTORY;
+
+   if(oFT->oDHandles == NULL) {
+      oFT->oDHandles = DynArray_new(0);
+      if(oFT->oDHandles == NULL)
+         return MEMORY_ERROR;
+   }
+
+   oDHandle = malloc(sizeof(struct dirHandle));
+   if(oDHandle == NULL)
+      return MEMORY_ERROR;
+
+   oDHandle->oFT = oFT;
+   oDHandle->oNDir = oNFound;
+   oDHandle->bShardRoot = FALSE;
+   oDHandle->ulIndex = DynArray_getLength(oFT->oDHandles);
+   if(!DynArray_add(oFT->oDHandles, oDHandle)) {
+      free(oDHandle);
+      return MEMORY_ERROR;
+   }
+
+   *poDResult = oDHandle;
+   return SUCCESS;
+}
+
+void FT_closeDir(DirHandle_T oDHandle) {
+   FT_T oFT;
+
+   if(oDHandle == NULL)
+      return;
+
+   /* once its FT is destroyed, a handle is no longer registered */
+   oFT = oDHandle->oFT;
+   if(oFT != NULL) {
+      FT_lockExclusive(oFT);
+      FT_unregisterHandle(oDHandle);
+      FT_unlock(oFT);
+   }
+   free(oDHandle);
+}
+
+/* Implements FT_insertFileAt; the caller holds the lock of
+   oDHandle's FT exclusively, if locking is on. */
+static int FT_insertFileAtLocked(DirHandle_T oDHandle,
+                                 const char *pcName,
+                                 void *pvContents, size_t ulLength) {
+   int iStatus;
+   Node_T oNDir = NULL;
+   Node_T oNNewNode = NULL;
+   Path_T oPPath = NULL;
+   char *pcPath;
+
+   assert(oDHandle != NULL);
+   assert(pcName != NULL);
+
+   iStatus = FT_handleDir(oDHandle, &oNDir);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = FT_checkName(pcName);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* the new node still needs its full path */
+   pcPath = FT_childPath(Node_getPath(oNDir), pcName);
+   if(pcPath == NULL)
+      return MEMORY_ERROR;
+
+   iStatus = Path_new(pcPath, &oPPath);
+   free(pcPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = FT_preserve(oDHandle->oFT, oNDir);
+   if(iStatus != SUCCESS) {
+      Path_free(oPPath);
+      return iStatus;
+   }
+
+   iStatus = Node_new(oPPath, oNDir, &oNNewNode, TRUE,
+                      pvContents, ulLength);
+   Path_free(oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   oDHandle->oFT->ulCount++;
+   FT_indexInserted(oDHandle->oFT, oNNewNode, oNDir);
+   return SUCCESS;
+}
+
+/* Implements FT_statAt; the caller holds the lock of oDHandle's FT
+   as FT_lockWhole takes it. */
+static int FT_statAtLocked(DirHandle_T oDHandle, const char *pcName,
+                           boolean *pbIsFile, size_t *pulSize) {
+   int iStatus;
+   Node_T oNDir = NULL;
+   Node_T oNFound = NULL;
+   size_t ulChildID;
+
+   assert(oDHandle != NULL);
+   assert(pcName != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   iStatus = FT_handleDir(oDHandle, &oNDir);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = FT_checkName(pcName);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(!Node_hasChildNamed(oNDir, pcName, &ulChildID))
+      return NO_SUCH_PATH;
+
+   iStatus = Node_getChild(oNDir, ulChildID, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   *pbIsFile = Node_isFile(oNFound);
+   if(*pbIsFile)
+      *pulSize = Node_getLength(oNFound);
+
+   return SUCCESS;
+}
+
+/*
+  Sets *ppcPath to a new string holding the path of the entry named
+  pcName under the root that oDHandle, a shard root handle of sharded
+  FT oFTOwner, names, and *poFShard to the shard that holds that
+  entry. Returns SUCCESS, or NO_SUCH_PATH, BAD_PATH or MEMORY_ERROR as
+  FT_insertFileAt does. The caller holds oFTOwner's lock, which keeps
+  the root from being removed.
+*/
+static int FT_routeRootEntry(FT_T oFTOwner, DirHandle_T oDHandle,
+                             const char *pcName, char **ppcPath,
+                             FT_T *poFShard) {
+   int iStatus;
+
+   assert(oFTOwner != NULL);
+   assert(oDHandle != NULL);
+   assert(oDHandle->bShardRoot);
+   assert(ppcPath != NULL);
+   assert(poFShard != NULL);
+
+   if(oDHandle->oNDir == NULL)
+      return NO_SUCH_PATH;
+
+   iStatus = FT_checkName(pcName);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   *ppcPath = FT_childPath(Node_getPath(oDHandle->oNDir), pcName);
+   if(*ppcPath == NULL)
+      return MEMORY_ERROR;
+
+   *poFShard = FT_shardOf(oFTOwner, *ppcPath);
+   return SUCCESS;
+}
+
+/* Implements FT_insertFileAt for oDHandle, a shard root handle of
+   sharded FT oFTOwner. */
+static int FT_insertFileAtRoot(FT_T oFTOwner, DirHandle_T oDHandle,
+                               const char *pcName, void *pvContents,
+                               size_t ulLength) {
+   int iStatus;
+   char *pcPath = NULL;
+   FT_T oFTShard = NULL;
+
+   FT_lockShared(oFTOwner);
+   iStatus = FT_routeRootEntry(oFTOwner, oDHandle, pcName, &pcPath,
+                               &oFTShard);
+   if(iStatus == SUCCESS) {
+      /* the root exists, so this creates nothing but the file */
+      iStatus = FT_insertFileIn(oFTShard, pcPath, pvContents,
+                                ulLength);
+      free(pcPath);
+   }
+   FT_unlock(oFTOwner);
+   return iStatus;
+}
+
+/* Implements FT_statAt for oDHandle, a shard root handle of sharded
+   FT oFTOwner. */
+static int FT_statAtRoot(FT_T oFTOwner, DirHandle_T oDHandle,
+                         const char *pcName, boolean *pbIsFile,
+                         size_t *pulSize) {
+   int iStatus;
+   char *pcPath = NULL;
+   FT_T oFTShard = NULL;
+
+   FT_lockShared(oFTOwner);
+   iStatus = FT_routeRootEntry(oFTOwner, oDHandle, pcName, &pcPath,
+                               &oFTShard);
+   if(iStatus == SUCCESS) {
+      iStatus = FT_statIn(oFTShard, pcPath, pbIsFile, pulSize);
+      free(pcPath);
+   }
+   FT_unlock(oFTOwner);
+   return iStatus;
+}
+
+int FT_insertFileAt(DirHandle_T oDHandle, const char *pcName,
+                    void *pvContents, size_t ulLength) {
+   FT_T oFT;
+   int iStatus;
+
+   assert(oDHandle != NULL);
+
+   /* the FT is not consulted first: once destroyed, it may be freed */
+   oFT = oDHandle->oFT;
+   if(oFT == NULL)
+      return NO_SUCH_PATH;
+
+   if(oDHandle->bShardRoot)
+      return FT_insertFileAtRoot(oFT->oFTOwner, oDHandle, pcName,
+                                 pvContents, ulLength);
+
+   FT_lockExclusive(oFT);
+   iStatus = FT_insertFileAtLocked(oDHandle, pcName, pvContents,
+                                   ulLength);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+int FT_statAt(DirHandle_T oDHandle, const char *pcName,
+              boolean *pbIsFile, size_t *pulSize) {
+   FT_T oFT;
+   int iStatus;
+
+   assert(oDHandle != NULL);
+
+   oFT = oDHandle->oFT;
+   if(oFT == NULL)
+      return NO_SUCH_PATH;
+
+   if(oDHandle->bShardRoot)
+      return FT_statAtRoot(oFT->oFTOwner, oDHandle, pcName, pbIsFile,
+                           pulSize);
+
+   FT_lockWhole(oFT);
+   iStatus = FT_statAtLocked(oDHandle, pcName, pbIsFile, pulSize);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions are used for generating the
+  string representation of the FT.
+*/
+
+
+/*
+  Returns the node after oNCurr in a pre-order walk of the tree rooted
+  at oNNode, or NULL if oNCurr is the last one.
+
+  The walk visits a node, then its children in child ID order, which
+  nodeFT guarantees is all file children followed by all directory
+  children, each group in lexicographic order.
+
+  The walk keeps no stack: after a leaf, it climbs through parent
+  links until some ancestor has a next child. It thus uses constant
+  auxiliary memory however deep the tree is.
+*/
+static Node_T FT_preOrderNext(Node_T oNNode, Node_T oNCurr) {
+   Node_T oNParent;
+   size_t ulChildID = 0;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNCurr != NULL);
+
+   /* go down to the first child, if any */
+   if(Node_getNumChildren(oNCurr) > 0) {
+      iStatus = Node_getChild(oNCurr, 0, &oNCurr);
+      assert(iStatus == SUCCESS);
+      return oNCurr;
+   }
+
+   /* otherwise go up until some ancestor has a next child */
+   for(;;) {
+      boolean bFound;
+
+      if(oNCurr == oNNode)
+         return NULL;
+
+      oNParent = Node_getParent(oNCurr);
+      bFound = Node_hasChild(oNParent, Node_getPath(oNCurr),
+                             &ulChildID);
+      assert(bFound);
+
+      if(ulChildID + 1 < Node_getNumChildren(oNParent)) {
+         iStatus = Node_getChild(oNParent, ulChildID + 1, &oNCurr);
+         assert(iStatus == SUCCESS);
+         return oNCurr;
+      }
+      oNCurr = oNParent;
+   }
+}
+
+void FT_preOrderTraversal(Node_T oNNode,
+                          void (*pfVisit)(Node_T, void *),
+                          void *pvExtra) {
+   Node_T oNCurr;
+
+   assert(pfVisit != NULL);
+
+   if(oNNode == NULL)
+      return;
+
+   for(oNCurr = oNNode; oNCurr != NULL;
+       oNCurr = FT_preOrderNext(oNNode, oNCurr))
+      (*pfVisit)(oNCurr, pvExtra);
+}
+
+void FT_strlenAccumulate(Node_T oNNode, size_t *pulAcc) {
+   assert(pulAcc != NULL);
+
+   if(oNNode != NULL)
+      *pulAcc += (Path_getStrLength(Node_getPath(oNNode)) + 1);
+}
+
+void FT_strcatAccumulate(Node_T oNNode, char **ppcEnd) {
+   size_t ulLength;
+
+   assert(ppcEnd != NULL);
+
+   if(oNNode != NULL) {
+      ulLength = Path_getStrLength(Node_getPath(oNNode));
+      memcpy(*ppcEnd, Path_getPathname(Node_getPath(oNNode)), ulLength);
+      (*ppcEnd)[ulLength] = '\n';
+      *ppcEnd += ulLength + 1;
+   }
+}
+/*--------------------------------------------------------------------*/
+
+/* Implements FT_toStringIn; the caller holds oFT's lock as
+   FT_lockWhole takes it. */
+static char *FT_toStringLocked(FT_T oFT) {
+   size_t totalStrlen = 1;
+   char *result = NULL;
+   char *pcEnd;
+
+   assert(oFT != NULL);
+
+   if(!oFT->bIsInitialized)
+      return NULL;
+
+   FT_preOrderTraversal(oFT->oNRoot,
+                        (void (*)(Node_T, void *)) FT_strlenAccumulate,
+                        (void *) &totalStrlen);
+
+   result = malloc(totalStrlen);
+   if(result == NULL)
+      return NULL;
+
+   pcEnd = result;
+   FT_preOrderTraversal(oFT->oNRoot,
+                        (void (*)(Node_T, void *)) FT_strcatAccumulate,
+                        (void *) &pcEnd);
+   *pcEnd = '\0';
+
+   return result;
+}
+
+/* --------------------------------------------------------------------
+
+  Positions in the FT_toString order. Every node knows the size of its
+  subtree, so the position of a node is that of its parent, plus one,
+  plus the sizes of the subtrees of its earlier siblings, and finding
+  the node at a position takes the same sums on the way down. A
+  directory with many children keeps those sums, once a listing has
+  needed them, until its children change, so each level then costs a
+  lookup or a binary search; see Node_countBefore.
+*/
+
+/*
+  Returns the number of nodes that come after directory oNParent and
+  before its child oNChild in a pre-order walk: those in the subtrees
+  of oNChild's earlier siblings.
+*/
+static size_t FT_countBefore(Node_T oNParent, Node_T oNChild) {
+   size_t ulChildID = 0;
+   boolean bFound;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   bFound = Node_hasChild(oNParent, Node_getPath(oNChild), &ulChildID);
+   assert(bFound);
+   (void) bFound;
+
+   return Node_countBefore(oNParent, ulChildID);
+}
+
+/*
+  Returns the child of directory oNParent whose subtree holds the node
+  *pulIndex places after oNParent in a pre-order walk, counting from
+  0 for the node right after it, and sets *pulIndex to that node's
+  place within the child's subtree. *pulIndex must be less than the
+  number of nodes below oNParent.
+*/
+static Node_T FT_childHolding(Node_T oNParent, size_t *pulIndex) {
+   Node_T oNChild = NULL;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(pulIndex != NULL);
+
+   iStatus = Node_getChild(oNParent,
+                           Node_findChildAt(oNParent, pulIndex),
+                           &oNChild);
+   assert(iStatus == SUCCESS);
+   (void) iStatus;
+   return oNChild;
+}
+
+/* Implements FT_listRangeIn; the caller holds oFT's lock as
+   FT_lockWhole takes it. */
+static char *FT_listRangeLocked(FT_T oFT, size_t ulStart,
+                                size_t ulCount) {
+   Node_T oNFirst = NULL;
+   Node_T oNCurr;
+   size_t ulLength = 1;
+   size_t ul;
+   char *pcResult;
+   char *pcEnd;
+
+   assert(oFT != NULL);
+
+   if(!oFT->bIsInitialized)
+      return NULL;
 
-   return SUCCESS;
+   if(oFT->oNRoot != NULL &&
+      ulStart < Node_getSubtreeSize(oFT->oNRoot)) {
+      oNFirst = oFT->oNRoot;
+      while(ulStart > 0) {
+         ulStart--;
+         oNFirst = FT_childHolding(oNFirst, &ulStart);
+      }
+   }
+
+   oNCurr = oNFirst;
+   for(ul = 0; ul < ulCount && oNCurr != NULL; ul++) {
+      FT_strlenAccumulate(oNCurr, &ulLength);
+      oNCurr = FT_preOrderNext(oFT->oNRoot, oNCurr);
+   }
+
+   pcResult = malloc(ulLength);
+   if(pcResult == NULL)
+      return NULL;
+
+   pcEnd = pcResult;
+   oNCurr = oNFirst;
+   for(ul = 0; ul < ulCount && oNCurr != NULL; ul++) {
+      FT_strcatAccumulate(oNCurr, &pcEnd);
+      oNCurr = FT_preOrderNext(oFT->oNRoot, oNCurr);
+   }
+   *pcEnd = '\0';
+
+   return pcResult;
 }
 
-int FT_rmFile(const char *pcPath) {
-   int iStatus;
+/* Implements FT_indexOfIn; the caller holds oFT's lock as
+   FT_lockWhole takes it. */
+static int FT_indexOfLocked(FT_T oFT, const char *pcPath,
+                            size_t *pulIndex) {
    Node_T oNFound = NULL;
+   Node_T oNCurr;
+   Node_T oNParent;
+   size_t ulIndex = 0;
+   int iStatus;
 
+   assert(oFT != NULL);
    assert(pcPath != NULL);
+   assert(pulIndex != NULL);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
+   iStatus = FT_findNode(oFT, pcPath, oFT->eLocking != FT_LOCK_NONE,
+                         &oNFound);
    if(iStatus != SUCCESS)
       return iStatus;
+   FT_releaseGuard(oFT, oNFound);
 
-   /* check if it's a file */
-   if(!Node_isFile(oNFound))
-      return NOT_A_FILE;
-
-   ulCount -= Node_free(oNFound);
-   if(ulCount == 0)
-      oNRoot = NULL;
+   for(oNCurr = oNFound; oNCurr != oFT->oNRoot; oNCurr = oNParent) {
+      oNParent = Node_getParent(oNCurr);
+      ulIndex += 1 + FT_countBefore(oNParent, oNCurr);
+   }
 
+   *pulIndex = ulIndex;
    return SUCCESS;
 }
 
-void *FT_getFileContents(const char *pcPath) {
+
+
+
+
+
+/* --------------------------------------------------------------------
+
+  The FT_T operations take oFT's lock around their implementations
+  above: shared for those that only read the hierarchy, exclusive for
+  those that may change it, except as per-directory locking allows.
+  Under FT_LOCK_OPTIMISTIC, single-path lookups first try without it,
+  and under FT_LOCK_COMBINING, inserts and removals go to a combiner.
+*/
+
+int FT_insertDirIn(FT_T oFT, const char *pcPath) {
    int iStatus;
-   Node_T oNFound = NULL;
 
-   assert(pcPath != NULL);
+   assert(oFT != NULL);
 
-   if(!bIsInitialized)
-      return NULL;
+   if(oFT->poFShards != NULL)
+      return FT_insertDirSharded(oFT, pcPath);
+   if(oFT->eLocking == FT_LOCK_COMBINING)
+      return FT_combineUpdate(oFT, FT_UPDATE_INSERT_DIR, pcPath, NULL,
+                              0);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if(iStatus != SUCCESS)
-      return NULL;
+   FT_lockForUpdate(oFT, pcPath);
+   iStatus = FT_insertDirLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return iStatus;
+}
 
-   /* check if it's a file */
-   if(!Node_isFile(oNFound))
-      return NULL;
+int FT_insertFileIn(FT_T oFT, const char *pcPath, void *pvContents,
+                    size_t ulLength) {
+   int iStatus;
+
+   assert(oFT != NULL);
 
-   return Node_getContents(oNFound);
+   if(oFT->poFShards != NULL)
+      return FT_insertFileSharded(oFT, pcPath, pvContents, ulLength);
+   if(oFT->eLocking == FT_LOCK_COMBINING)
+      return FT_combineUpdate(oFT, FT_UPDATE_INSERT_FILE, pcPath,
+                              pvContents, ulLength);
+
+   FT_lockForUpdate(oFT, pcPath);
+   iStatus = FT_insertFileLocked(oFT, pcPath, pvContents, ulLength);
+   FT_unlock(oFT);
+   return iStatus;
 }
 
-void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
-                              size_t ulNewLength) {
+boolean FT_containsDirIn(FT_T oFT, const char *pcPath) {
+   struct ftSighting sSeen;
+   boolean bResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_containsDirSharded(oFT, pcPath);
+
+   if(oFT->eLocking == FT_LOCK_OPTIMISTIC &&
+      FT_lookOptimistic(oFT, pcPath, &sSeen))
+      return (boolean) (sSeen.iStatus == SUCCESS && !sSeen.bIsFile);
+
+   FT_lockShared(oFT);
+   bResult = FT_containsDirLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return bResult;
+}
+
+boolean FT_containsFileIn(FT_T oFT, const char *pcPath) {
+   struct ftSighting sSeen;
+   boolean bResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_containsFileSharded(oFT, pcPath);
+
+   if(oFT->eLocking == FT_LOCK_OPTIMISTIC &&
+      FT_lookOptimistic(oFT, pcPath, &sSeen))
+      return (boolean) (sSeen.iStatus == SUCCESS && sSeen.bIsFile);
+
+   FT_lockShared(oFT);
+   bResult = FT_containsFileLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return bResult;
+}
+
+int FT_rmDirIn(FT_T oFT, const char *pcPath) {
    int iStatus;
-   Node_T oNFound = NULL;
-   void *pvOldContents;
-   void *pvNewCopy = NULL;
 
-   assert(pcPath != NULL);
+   assert(oFT != NULL);
 
-   if(!bIsInitialized)
-      return NULL;
+   if(oFT->poFShards != NULL)
+      return FT_rmDirSharded(oFT, pcPath);
+   if(oFT->eLocking == FT_LOCK_COMBINING)
+      return FT_combineUpdate(oFT, FT_UPDATE_RM_DIR, pcPath, NULL, 0);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if(iStatus != SUCCESS)
-      return NULL;
+   FT_lockForUpdate(oFT, pcPath);
+   iStatus = FT_rmDirLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return iStatus;
+}
 
-   /* check if it's a file */
-   if(!Node_isFile(oNFound))
-      return NULL;
+int FT_rmFileIn(FT_T oFT, const char *pcPath) {
+   int iStatus;
+
+   assert(oFT != NULL);
 
-   /* Save old contents to return */
-   pvOldContents = Node_getContents(oNFound);
+   if(oFT->poFShards != NULL)
+      return FT_rmFileSharded(oFT, pcPath);
+   if(oFT->eLocking == FT_LOCK_COMBINING)
+      return FT_combineUpdate(oFT, FT_UPDATE_RM_FILE, pcPath, NULL, 0);
 
-   /* Allocate and copy new contents */
-   if(pvNewContents != NULL && ulNewLength > 0) {
-      pvNewCopy = malloc(ulNewLength);
-      if(pvNewCopy == NULL)
+   FT_lockForUpdate(oFT, pcPath);
+   iStatus = FT_rmFileLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+void *FT_getFileContentsIn(FT_T oFT, const char *pcPath) {
+   struct ftSighting sSeen;
+   void *pvResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_getFileContentsSharded(oFT, pcPath);
+
+   if(oFT->eLocking == FT_LOCK_OPTIMISTIC &&
+      FT_lookOptimistic(oFT, pcPath, &sSeen)) {
+      if(sSeen.iStatus != SUCCESS || !sSeen.bIsFile)
          return NULL;
-      memcpy(pvNewCopy, pvNewContents, ulNewLength);
+      return sSeen.pvContents;
    }
 
-   /* Replace without freeing old contents */
-   iStatus = Node_replaceContents(oNFound, pvNewCopy, ulNewLength);
-   if(iStatus != SUCCESS) {
-      if(pvNewCopy != NULL)
-         free(pvNewCopy);
-      return NULL;
+   FT_lockShared(oFT);
+   pvResult = FT_getFileContentsLocked(oFT, pcPath);
+   FT_unlock(oFT);
+   return pvResult;
+}
+
+void *FT_replaceFileContentsIn(FT_T oFT, const char *pcPath,
+                               void *pvNewContents,
+                               size_t ulNewLength) {
+   void *pvResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_replaceFileContentsSharded(oFT, pcPath, pvNewContents,
+                                           ulNewLength);
+
+   FT_lockForUpdate(oFT, pcPath);
+   pvResult = FT_replaceFileContentsLocked(oFT, pcPath, pvNewContents,
+                                           ulNewLength);
+   FT_unlock(oFT);
+   return pvResult;
+}
+
+int FT_statIn(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize) {
+   struct ftSighting sSeen;
+   int iStatus;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_statSharded(oFT, pcPath, pbIsFile, pulSize);
+
+   if(oFT->eLocking == FT_LOCK_OPTIMISTIC &&
+      FT_lookOptimistic(oFT, pcPath, &sSeen)) {
+      assert(pbIsFile != NULL);
+      assert(pulSize != NULL);
+
+      if(sSeen.iStatus != SUCCESS)
+         return sSeen.iStatus;
+      *pbIsFile = sSeen.bIsFile;
+      /* pulSize unchanged for directories per spec */
+      if(sSeen.bIsFile)
+         *pulSize = sSeen.ulLength;
+      return SUCCESS;
    }
 
-   return pvOldContents;
+   FT_lockShared(oFT);
+   iStatus = FT_statLocked(oFT, pcPath, pbIsFile, pulSize);
+   FT_unlock(oFT);
+   return iStatus;
 }
 
-int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize) {
+int FT_statTreeIn(FT_T oFT, const char *pcPath, size_t *pulFiles,
+                  size_t *pulDirs, size_t *pulBytes) {
    int iStatus;
-   Node_T oNFound = NULL;
 
-   assert(pcPath != NULL);
-   assert(pbIsFile != NULL);
-   assert(pulSize != NULL);
+   assert(oFT != NULL);
 
-   if(!bIsInitialized)
-      return INITIALIZATION_ERROR;
+   if(oFT->poFShards != NULL)
+      return FT_statTreeSharded(oFT, pcPath, pulFiles, pulDirs,
+                                pulBytes);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if(iStatus != SUCCESS)
-      return iStatus;
+   /* lock-free lookups sight one node's fields, not its totals, so
+      this takes the lock even under FT_LOCK_OPTIMISTIC */
+   FT_lockShared(oFT);
+   iStatus = FT_statTreeLocked(oFT, pcPath, pulFiles, pulDirs,
+                               pulBytes);
+   FT_unlock(oFT);
+   return iStatus;
+}
 
-   *pbIsFile = Node_isFile(oNFound);
-   
-   if(*pbIsFile)
-      *pulSize = Node_getLength(oNFound);
-   /* pulSize unchanged for directories per spec */
+int FT_insertBatchIn(FT_T oFT, const struct ftBatchEntry *psEntries,
+                     size_t ulCount, int *piResults) {
+   const struct ftBatchEntry **ppsSorted;
+   size_t ul;
+
+   assert(oFT != NULL);
+   assert(psEntries != NULL || ulCount == 0);
+   assert(piResults != NULL || ulCount == 0);
+
+   /* malloc(0) may return NULL, so even an empty batch gets a slot */
+   ppsSorted = malloc((ulCount > 0 ? ulCount : 1) * sizeof(*ppsSorted));
+   if(ppsSorted == NULL)
+      return MEMORY_ERROR;
+   for(ul = 0; ul < ulCount; ul++)
+      ppsSorted[ul] = &psEntries[ul];
+   qsort(ppsSorted, ulCount, sizeof(*ppsSorted), FT_compareEntries);
+
+   if(oFT->poFShards != NULL) {
+      FT_insertBatchSharded(oFT, psEntries, ppsSorted, ulCount,
+                            piResults);
+      free(ppsSorted);
+      return SUCCESS;
+   }
+
+   FT_lockExclusive(oFT);
+   if(!oFT->bIsInitialized) {
+      FT_unlock(oFT);
+      free(ppsSorted);
+      return INITIALIZATION_ERROR;
+   }
+   FT_insertBatchLocked(oFT, psEntries, ppsSorted, ulCount, piResults);
+   FT_unlock(oFT);
 
+   free(ppsSorted);
    return SUCCESS;
 }
 
-int FT_init(void) {
-   if(bIsInitialized)
+int FT_buildParallelIn(FT_T oFT, const struct ftBatchEntry *psEntries,
+                       size_t ulCount, size_t ulThreads,
+                       int *piResults) {
+   const struct ftBatchEntry **ppsSorted;
+   size_t ul;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(psEntries != NULL || ulCount == 0);
+   assert(piResults != NULL || ulCount == 0);
+
+   /* the shards already keep the root's subtrees apart */
+   if(oFT->poFShards != NULL || ulThreads <= 1)
+      return FT_insertBatchIn(oFT, psEntries, ulCount, piResults);
+
+   /* malloc(0) may return NULL, so even an empty batch gets a slot */
+   ppsSorted = malloc((ulCount > 0 ? ulCount : 1) * sizeof(*ppsSorted));
+   if(ppsSorted == NULL)
+      return MEMORY_ERROR;
+   for(ul = 0; ul < ulCount; ul++)
+      ppsSorted[ul] = &psEntries[ul];
+   qsort(ppsSorted, ulCount, sizeof(*ppsSorted), FT_compareGroupKeys);
+
+   FT_lockExclusive(oFT);
+   if(!oFT->bIsInitialized) {
+      FT_unlock(oFT);
+      free(ppsSorted);
       return INITIALIZATION_ERROR;
+   }
+   iStatus = FT_buildParallelLocked(oFT, psEntries, ppsSorted, ulCount,
+                                    ulThreads, piResults);
+   FT_unlock(oFT);
+
+   free(ppsSorted);
+   return iStatus;
+}
+
+/*
+  Implements FT_statManyIn (bContents FALSE) and FT_getContentsManyIn
+  (bContents TRUE). Sorts the paths, and looks up those held by each
+  FT, oFT itself or each of its shards, under one lock.
+*/
+static int FT_lookupManyIn(FT_T oFT, const char *const *ppcPaths,
+                           size_t ulCount, boolean bContents,
+                           struct ftLookup *psResults) {
+   struct ftPathKey *psKeys;
+   char *pcBuffer;
+   FT_T oFTHolder;
+   size_t ulLongest = 0;
+   size_t ulLength;
+   size_t ulStart;
+   size_t ul;
+
+   assert(oFT != NULL);
+   assert(ppcPaths != NULL || ulCount == 0);
+   assert(psResults != NULL || ulCount == 0);
+
+   /* malloc(0) may return NULL, so even no paths get a slot */
+   psKeys = malloc((ulCount > 0 ? ulCount : 1) *
+                   sizeof(struct ftPathKey));
+   if(psKeys == NULL)
+      return MEMORY_ERROR;
+   for(ul = 0; ul < ulCount; ul++) {
+      assert(ppcPaths[ul] != NULL);
+      psKeys[ul].pcPath = ppcPaths[ul];
+      psKeys[ul].ulIndex = ul;
+      psKeys[ul].oFTHolder = oFT;
+      ulLength = strlen(ppcPaths[ul]);
+      if(ulLength > ulLongest)
+         ulLongest = ulLength;
+      /* every shard holds the root, so shard 0 answers for it */
+      if(oFT->poFShards != NULL) {
+         psKeys[ul].oFTHolder = FT_shardOf(oFT, ppcPaths[ul]);
+         if(psKeys[ul].oFTHolder == NULL)
+            psKeys[ul].oFTHolder = oFT->poFShards[0];
+      }
+   }
+   qsort(psKeys, ulCount, sizeof(struct ftPathKey), FT_comparePathKeys);
+
+   /* each path is split into one buffer in turn */
+   pcBuffer = malloc(ulLongest + 1);
+   if(pcBuffer == NULL) {
+      free(psKeys);
+      return MEMORY_ERROR;
+   }
 
-   bIsInitialized = TRUE;
-   oNRoot = NULL;
-   ulCount = 0;
+   if(oFT->poFShards == NULL) {
+      FT_lockWhole(oFT);
+      if(!oFT->bIsInitialized) {
+         FT_unlock(oFT);
+         free(pcBuffer);
+         free(psKeys);
+         return INITIALIZATION_ERROR;
+      }
+      FT_lookupManyLocked(oFT, psKeys, ulCount, bContents, pcBuffer,
+                          psResults);
+      FT_unlock(oFT);
+   }
+   else
+      for(ulStart = 0; ulStart < ulCount; ulStart = ul) {
+         oFTHolder = psKeys[ulStart].oFTHolder;
+         for(ul = ulStart; ul < ulCount &&
+                psKeys[ul].oFTHolder == oFTHolder; ul++)
+            ;
+         FT_lockWhole(oFTHolder);
+         FT_lookupManyLocked(oFTHolder, psKeys + ulStart, ul - ulStart,
+                             bContents, pcBuffer, psResults);
+         FT_unlock(oFTHolder);
+      }
 
+   free(pcBuffer);
+   free(psKeys);
    return SUCCESS;
 }
 
-int FT_destroy(void) {
-   if(!bIsInitialized)
+int FT_statManyIn(FT_T oFT, const char *const *ppcPaths,
+                  size_t ulCount, struct ftLookup *psResults) {
+   return FT_lookupManyIn(oFT, ppcPaths, ulCount, FALSE, psResults);
+}
+
+int FT_getContentsManyIn(FT_T oFT, const char *const *ppcPaths,
+                         size_t ulCount, struct ftLookup *psResults) {
+   return FT_lookupManyIn(oFT, ppcPaths, ulCount, TRUE, psResults);
+}
+
+int FT_bulkLoadSortedIn(FT_T oFT,
+                        boolean (*pfNext)(void *pvReader,
+                                          struct ftBatchEntry *psEntry),
+                        void *pvReader) {
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(pfNext != NULL);
+
+   /* the root must reach every shard before anything below it */
+   if(oFT->poFShards != NULL)
       return INITIALIZATION_ERROR;
 
-   if(oNRoot) {
-      ulCount -= Node_free(oNRoot);
-      oNRoot = NULL;
+   FT_lockExclusive(oFT);
+   if(!oFT->bIsInitialized || oFT->oNRoot != NULL) {
+      FT_unlock(oFT);
+      return INITIALIZATION_ERROR;
    }
+   iStatus = FT_bulkLoadLocked(oFT, pfNext, pvReader);
+   FT_unlock(oFT);
+   return iStatus;
+}
 
-   bIsInitialized = FALSE;
+int FT_setPathCacheIn(FT_T oFT, boolean bEnable) {
+   int iStatus;
 
-   return SUCCESS;
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_setPathCacheSharded(oFT, bEnable);
+
+   FT_lockExclusive(oFT);
+   iStatus = FT_setPathCacheLocked(oFT, bEnable);
+   FT_unlock(oFT);
+   return iStatus;
 }
 
+void FT_setBackgroundReclaimIn(FT_T oFT, boolean bEnable) {
+   assert(oFT != NULL);
 
-/* --------------------------------------------------------------------
+   if(oFT->poFShards != NULL) {
+      FT_setBackgroundReclaimSharded(oFT, bEnable);
+      return;
+   }
 
-  The following auxiliary functions are used for generating the
-  string representation of the FT.
-*/
+   FT_lockExclusive(oFT);
+   oFT->bBackgroundReclaim = bEnable;
+   FT_unlock(oFT);
+}
 
+void FT_getPathCacheStatsIn(FT_T oFT, size_t *pulHits,
+                            size_t *pulMisses) {
+   assert(oFT != NULL);
 
-/*
-  Performs a pre-order traversal of the tree rooted at oNNode,
-  inserting each node into DynArray_T oDNodes beginning at index ulIndex.
-  Returns the next unused index in oDNodes after the insertion(s).
-  
-  Visits Current node, all file children (recursively, in lexicographic order), 
-  and all directory children (recursively, in lexicographic order).
+   if(oFT->poFShards != NULL) {
+      FT_getPathCacheStatsSharded(oFT, pulHits, pulMisses);
+      return;
+   }
 
-  Updated variable name to be descriptive.
-*/
-static size_t FT_preOrderTraversal(Node_T oNNode, DynArray_T oDNodes, 
-                                    size_t ulIndex) {
-   size_t ulChildIdx;
+   FT_lockShared(oFT);
+   FT_getPathCacheStatsLocked(oFT, pulHits, pulMisses);
+   FT_unlock(oFT);
+}
 
-   assert(oDNodes != NULL);
+void FT_getDirCacheStatsIn(FT_T oFT, size_t *pulOps,
+                           size_t *pulLevelsSkipped) {
+   assert(oFT != NULL);
 
-   if(oNNode != NULL) {
-      /* add current node to array */
-      (void) DynArray_set(oDNodes, ulIndex, oNNode);
-      ulIndex++;
-      
-      /* 1st pass: visit all file children */
-      for(ulChildIdx = 0; ulChildIdx < Node_getNumChildren(oNNode); 
-          ulChildIdx++) {
-         int iStatus;
-         Node_T oNChild = NULL;
-         
-         iStatus = Node_getChild(oNNode, ulChildIdx, &oNChild);
-         assert(iStatus == SUCCESS);
-         
-         if(Node_isFile(oNChild))
-            ulIndex = FT_preOrderTraversal(oNChild, oDNodes, ulIndex);
-      }
-      
-      /* 2nd pass: visit all directory children */
-      for(ulChildIdx = 0; ulChildIdx < Node_getNumChildren(oNNode); 
-          ulChildIdx++) {
-         int iStatus;
-         Node_T oNChild = NULL;
-         
-         iStatus = Node_getChild(oNNode, ulChildIdx, &oNChild);
-         assert(iStatus == SUCCESS);
-         
-         if(!Node_isFile(oNChild))
-            ulIndex = FT_preOrderTraversal(oNChild, oDNodes, ulIndex);
-      }
+   if(oFT->poFShards != NULL) {
+      FT_getDirCacheStatsSharded(oFT, pulOps, pulLevelsSkipped);
+      return;
    }
-   return ulIndex;
+
+   FT_lockShared(oFT);
+   FT_getDirCacheStatsLocked(oFT, pulOps, pulLevelsSkipped);
+   FT_unlock(oFT);
 }
 
-/*
-  Alternate version of strlen that uses pulAcc as an in-out parameter
-  to accumulate a string length, rather than returning the length of
-  oNNode's path, and also always adds one addition byte to the sum.
-*/
-static void FT_strlenAccumulate(Node_T oNNode, size_t *pulAcc) {
-   assert(pulAcc != NULL);
+void FT_getFilterStatsIn(FT_T oFT, size_t *pulProbes,
+                         size_t *pulNegatives,
+                         size_t *pulFalsePositives, size_t *pulBytes) {
+   assert(oFT != NULL);
 
-   if(oNNode != NULL)
-      *pulAcc += (Path_getStrLength(Node_getPath(oNNode)) + 1);
+   if(oFT->poFShards != NULL) {
+      FT_getFilterStatsSharded(oFT, pulProbes, pulNegatives,
+                               pulFalsePositives, pulBytes);
+      return;
+   }
+
+   FT_lockShared(oFT);
+   FT_getFilterStatsLocked(oFT, pulProbes, pulNegatives,
+                           pulFalsePositives, pulBytes);
+   FT_unlock(oFT);
 }
 
-/*
-  Alternate version of strcat that inverts the typical argument
-  order, appending oNNode's path onto pcAcc, and also always adds one
-  newline at the end of the concatenated string.
+int FT_openDirIn(FT_T oFT, const char *pcPath, DirHandle_T *poDResult) {
+   int iStatus;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_openDirSharded(oFT, pcPath, poDResult);
+
+   FT_lockExclusive(oFT);
+   iStatus = FT_openDirLocked(oFT, pcPath, poDResult);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+char *FT_toStringIn(FT_T oFT) {
+   char *pcResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_toStringSharded(oFT);
+
+   FT_lockWhole(oFT);
+   pcResult = FT_toStringLocked(oFT);
+   FT_unlock(oFT);
+   return pcResult;
+}
+
+char *FT_listRangeIn(FT_T oFT, size_t ulStart, size_t ulCount) {
+   char *pcResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return NULL;
+
+   FT_lockWhole(oFT);
+   pcResult = FT_listRangeLocked(oFT, ulStart, ulCount);
+   FT_unlock(oFT);
+   return pcResult;
+}
+
+int FT_indexOfIn(FT_T oFT, const char *pcPath, size_t *pulIndex) {
+   int iStatus;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return INITIALIZATION_ERROR;
+
+   FT_lockWhole(oFT);
+   iStatus = FT_indexOfLocked(oFT, pcPath, pulIndex);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+boolean FT_isValidIn(FT_T oFT) {
+   boolean bResult;
+
+   assert(oFT != NULL);
+
+   if(oFT->poFShards != NULL)
+      return FT_isValidSharded(oFT);
+
+   /* no walk may hold a directory while the checker reads it */
+   FT_lockExclusive(oFT);
+   bResult = CheckerFT_isValid(oFT->bIsInitialized, oFT->oNRoot,
+                               oFT->ulCount);
+   FT_unlock(oFT);
+   return bResult;
+}
+
+
+/* --------------------------------------------------------------------
+
+  The functions without an FT_T parameter act on the default instance.
 */
-static void FT_strcatAccumulate(Node_T oNNode, char *pcAcc) {
-   assert(pcAcc != NULL);
 
-   if(oNNode != NULL) {
-      strcat(pcAcc, Path_getPathname(Node_getPath(oNNode)));
-      strcat(pcAcc, "\n");
-   }
+int FT_insertDir(const char *pcPath) {
+   return FT_insertDirIn(&sDefaultFT, pcPath);
+}
+
+boolean FT_containsDir(const char *pcPath) {
+   return FT_containsDirIn(&sDefaultFT, pcPath);
+}
+
+int FT_rmDir(const char *pcPath) {
+   return FT_rmDirIn(&sDefaultFT, pcPath);
+}
+
+int FT_insertFile(const char *pcPath, void *pvContents,
+                  size_t ulLength) {
+   return FT_insertFileIn(&sDefaultFT, pcPath, pvContents, ulLength);
+}
+
+boolean FT_containsFile(const char *pcPath) {
+   return FT_containsFileIn(&sDefaultFT, pcPath);
+}
+
+int FT_rmFile(const char *pcPath) {
+   return FT_rmFileIn(&sDefaultFT, pcPath);
+}
+
+void *FT_getFileContents(const char *pcPath) {
+   return FT_getFileContentsIn(&sDefaultFT, pcPath);
+}
+
+void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
+                             size_t ulNewLength) {
+   return FT_replaceFileContentsIn(&sDefaultFT, pcPath, pvNewContents,
+                                   ulNewLength);
+}
+
+int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize) {
+   return FT_statIn(&sDefaultFT, pcPath, pbIsFile, pulSize);
+}
+
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes) {
+   return FT_statTreeIn(&sDefaultFT, pcPath, pulFiles, pulDirs,
+                        pulBytes);
+}
+
+int FT_insertBatch(const struct ftBatchEntry *psEntries, size_t ulCount,
+                   int *piResults) {
+   return FT_insertBatchIn(&sDefaultFT, psEntries, ulCount, piResults);
+}
+
+int FT_buildParallel(const struct ftBatchEntry *psEntries,
+                     size_t ulCount, size_t ulThreads, int *piResults) {
+   return FT_buildParallelIn(&sDefaultFT, psEntries, ulCount,
+                             ulThreads, piResults);
+}
+
+int FT_statMany(const char *const *ppcPaths, size_t ulCount,
+                struct ftLookup *psResults) {
+   return FT_statManyIn(&sDefaultFT, ppcPaths, ulCount, psResults);
+}
+
+int FT_getContentsMany(const char *const *ppcPaths, size_t ulCount,
+                       struct ftLookup *psResults) {
+   return FT_getContentsManyIn(&sDefaultFT, ppcPaths, ulCount,
+                               psResults);
+}
+
+int FT_bulkLoadSorted(boolean (*pfNext)(void *pvReader,
+                                        struct ftBatchEntry *psEntry),
+                      void *pvReader) {
+   return FT_bulkLoadSortedIn(&sDefaultFT, pfNext, pvReader);
 }
-/*--------------------------------------------------------------------*/
 
 char *FT_toString(void) {
-   DynArray_T nodes;
-   size_t totalStrlen = 1;
-   char *result = NULL;
+   return FT_toStringIn(&sDefaultFT);
+}
 
-   if(!bIsInitialized)
-      return NULL;
+char *FT_listRange(size_t ulStart, size_t ulCount) {
+   return FT_listRangeIn(&sDefaultFT, ulStart, ulCount);
+}
 
-   nodes = DynArray_new(ulCount);
-   (void) FT_preOrderTraversal(oNRoot, nodes, 0);
+int FT_indexOf(const char *pcPath, size_t *pulIndex) {
+   return FT_indexOfIn(&sDefaultFT, pcPath, pulIndex);
+}
 
-   DynArray_map(nodes, (void (*)(void *, void*)) FT_strlenAccumulate,
-                (void*) &totalStrlen);
+boolean FT_isValid(void) {
+   return FT_isValidIn(&sDefaultFT);
+}
 
-   result = malloc(totalStrlen);
-   if(result == NULL) {
-      DynArray_free(nodes);
-      return NULL;
-   }
-   *result = '\0';
+int FT_setPathCache(boolean bEnable) {
+   return FT_setPathCacheIn(&sDefaultFT, bEnable);
+}
+
+void FT_setBackgroundReclaim(boolean bEnable) {
+   FT_setBackgroundReclaimIn(&sDefaultFT, bEnable);
+}
 
-   DynArray_map(nodes, (void (*)(void *, void*)) FT_strcatAccumulate,
-                (void *) result);
+void FT_getPathCacheStats(size_t *pulHits, size_t *pulMisses) {
+   FT_getPathCacheStatsIn(&sDefaultFT, pulHits, pulMisses);
+}
 
-   DynArray_free(nodes);
+void FT_getDirCacheStats(size_t *pulOps, size_t *pulLevelsSkipped) {
+   FT_getDirCacheStatsIn(&sDefaultFT, pulOps, pulLevelsSkipped);
+}
 
-   return result;
+int FT_setLocking(FT_Locking eLocking) {
+   return FT_setLockingIn(&sDefaultFT, eLocking);
+}
+
+void FT_getFilterStats(size_t *pulProbes, size_t *pulNegatives,
+                       size_t *pulFalsePositives, size_t *pulBytes) {
+   FT_getFilterStatsIn(&sDefaultFT, pulProbes, pulNegatives,
+                       pulFalsePositives, pulBytes);
+}
+
+int FT_openDir(const char *pcPath, DirHandle_T *poDResult) {
+   return FT_openDirIn(&sDefaultFT, pcPath, poDResult);
+}
+
+int FT_snapshot(FTSnapshot_T *poSResult) {
+   return FT_snapshotIn(&sDefaultFT, poSResult);
+}
+
+int FT_begin(FTTxn_T *poTResult) {
+   return FT_beginIn(&sDefaultFT, poTResult);
 }
@@ -10,6 +10,12 @@
   A File Tree is a representation of a hierarchy of directories and
   files: the File Tree is rooted at a directory, directories
   may be internal nodes or leaves, and files are always leaves.
+
+  The functions below act on a single default File Tree, set up by
+  FT_init and torn down by FT_destroy. A client that needs several
+  independent trees creates FT_T instances with FT_new instead, and
+  uses the "In" variants of the functions, declared at the end of
+  this file, which take the instance as their first parameter.
 */
 
 #include <stddef.h>
@@ -89,14 +95,22 @@ int FT_rmFile(const char *pcPath);
 
   Note: checking for a non-NULL return is not an appropriate
   contains check, because the contents of a file may be NULL.
+
+  The FT stores its own copy of file contents, small ones inside the
+  file's node, so the returned pointer is owned by the FT and is valid
+  only until the file's contents are replaced or the file is removed.
 */
 void *FT_getFileContents(const char *pcPath);
 
 /*
   Replaces current contents of the file with absolute path pcPath with
-  the parameter pvNewContents of size ulNewLength bytes.
+  a copy of the parameter pvNewContents of size ulNewLength bytes.
   Returns the old contents if successful. (Note: contents may be NULL.)
   Returns NULL if unable to complete the request for any reason.
+
+  The returned old contents are a heap buffer owned by the client,
+  who must free it, regardless of whether the FT had been storing
+  them inline or in a buffer of their own.
 */
 void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
                              size_t ulNewLength);
@@ -119,6 +133,138 @@ void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
 */
 int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 
+/*
+  Sets *pulFiles and *pulDirs to the numbers of files and of
+  directories in the hierarchy rooted at directory pcPath, pcPath
+  itself included, and *pulBytes to the total length of those files'
+  contents. Every directory keeps these totals up to date as nodes
+  below it come and go and as contents are replaced, so this takes
+  time proportional to the depth of pcPath only. Returns SUCCESS,
+  NOT_A_DIRECTORY if pcPath is a file, or another status as FT_stat
+  does, with the totals unchanged if it is not SUCCESS. Under
+  FT_LOCK_DIRS, changes deeper in the hierarchy may be under way, and
+  the totals may count some of them and not others.
+*/
+int FT_statTree(const char *pcPath, size_t *pulFiles, size_t *pulDirs,
+                size_t *pulBytes);
+
+/* An entry of a batch for FT_insertBatch */
+struct ftBatchEntry {
+   /* the absolute path of the new directory or file */
+   const char *pcPath;
+   /* TRUE to insert a file, FALSE to insert a directory */
+   boolean bIsFile;
+   /* for a file, its contents and their length in bytes */
+   void *pvContents;
+   size_t ulLength;
+};
+
+/*
+  Inserts the ulCount directories and files described at psEntries,
+  each as FT_insertDir or FT_insertFile would, and sets piResults[i]
+  to the status that psEntries[i] got. The entries are applied in
+  lexicographic order of their paths, entries with the same path in
+  the order given, and each entry's walk starts from the deepest
+  directory it shares with the one before, so a batch of paths with
+  common prefixes is parsed once per entry but walked about once in
+  all. Under any locking mode, the FT is locked once for the whole
+  batch. Returns SUCCESS once every entry has its status, whether or
+  not it was inserted. Otherwise, inserts nothing, leaves piResults
+  unchanged, and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory to sort the batch could not be allocated
+*/
+int FT_insertBatch(const struct ftBatchEntry *psEntries, size_t ulCount,
+                   int *piResults);
+
+/*
+  Inserts the ulCount entries at psEntries as FT_insertBatch does,
+  with the same resulting tree, node count and statuses in
+  piResults, but on up to ulThreads threads. The entries are split by
+  the subtree under the root that they fall in, and each subtree not
+  yet in the FT is built by one thread on its own, with node slots
+  from an arena of that thread's, and then linked under the root.
+  The root itself, and subtrees already in the FT, are inserted as
+  FT_insertBatch would. So the more subtrees under the root, the more
+  threads find work. The FT is locked throughout, if locking is on.
+  With ulThreads at most 1, or an FT created by FT_newSharded, this
+  is FT_insertBatchIn. Returns SUCCESS once every entry has its
+  status. Otherwise, inserts nothing and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory to sort or split the batch, or to make the
+                 root, could not be allocated
+*/
+int FT_buildParallel(const struct ftBatchEntry *psEntries,
+                     size_t ulCount, size_t ulThreads, int *piResults);
+
+/* What FT_statMany or FT_getContentsMany found for one path */
+struct ftLookup {
+   /* the status that FT_stat would return for the path, except that
+      FT_getContentsMany gives NOT_A_FILE for a directory */
+   int iStatus;
+   /* if iStatus is SUCCESS, whether the path is a file, and for a
+      file, the length of its contents and, from FT_getContentsMany,
+      the contents as FT_getFileContents would return them */
+   boolean bIsFile;
+   size_t ulSize;
+   void *pvContents;
+};
+
+/*
+  Looks up the ulCount paths at ppcPaths together and sets
+  psResults[i] to what was found for ppcPaths[i], as FT_stat would.
+  The paths are looked up in lexicographic order, each walk starting
+  from the deepest directory it shares with the path before, and
+  under one lock for them all, and no path is copied into a Path_T,
+  so looking up many paths in the same few directories costs little
+  more than one walk each to the directories. Returns SUCCESS once
+  every path has its result. Otherwise, leaves psResults unchanged
+  and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory to sort the paths could not be allocated
+*/
+int FT_statMany(const char *const *ppcPaths, size_t ulCount,
+                struct ftLookup *psResults);
+
+/*
+  Like FT_statMany, but also sets each file's contents in its result,
+  and gives a directory NOT_A_FILE.
+*/
+int FT_getContentsMany(const char *const *ppcPaths, size_t ulCount,
+                       struct ftLookup *psResults);
+
+/*
+  Loads an empty FT in one pass from a stream of entries, such as a
+  sorted list of paths or the lines of an earlier FT_toString. Each
+  call (*pfNext)(pvReader, psEntry) must set *psEntry to the next
+  entry and return TRUE, or return FALSE at the end of the stream;
+  the entry's path need only stay valid until the next call, and
+  directories above a path that are not given are created as
+  FT_insertFile would. Entries must come depth first: all of a
+  directory's subtree follows the directory, and a directory's files
+  come in increasing order, as do its subdirectories, in whatever mix
+  of the two. FT_toString lists paths in such an order, and so does
+  sort(1) in the C locale if no name holds a character that sorts
+  before '/'. Each directory's children are linked into it at once,
+  in arrays of exactly their number, when the stream leaves it. The
+  FT is locked throughout, if locking is on. Returns SUCCESS once
+  the stream has ended. Otherwise, leaves the FT empty and returns,
+  the entry at fault being the last one read:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state, is
+                         not empty, or was created by FT_newSharded
+  * BAD_PATH if a path is not well-formatted
+  * CONFLICTING_PATH if a path is not below the first one's root, the
+                     first entry is a file, or a path comes out of
+                     order
+  * ALREADY_IN_TREE if a path is given twice, or as both a file and a
+                    directory
+  * NOT_A_DIRECTORY if a path lies below a file
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_bulkLoadSorted(boolean (*pfNext)(void *pvReader,
+                                        struct ftBatchEntry *psEntry),
+                      void *pvReader);
+
 /*
   Sets the FT data structure to an initialized state.
   The data structure is initially empty.
@@ -127,6 +273,24 @@ int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 */
 int FT_init(void);
 
+/*
+  Like FT_init, but also keeps a counting Bloom filter over all the
+  pathnames in the FT, sized to hold ulExpectedPaths paths while
+  wrongly passing about a dFalsePositiveRate fraction of absent paths.
+  FT_containsDir, FT_containsFile, FT_getFileContents and
+  FT_replaceFileContents then reject most absent paths after a few
+  hash probes, without parsing or walking; the other functions, whose
+  statuses must tell a malformed path from an absent one, do not use
+  the filter. The filter doubles in size whenever the FT outgrows it.
+  Returns INITIALIZATION_ERROR if already initialized, MEMORY_ERROR if
+  the filter could not be allocated (the FT is then left
+  uninitialized), and SUCCESS otherwise.
+  It is a checked runtime error for ulExpectedPaths to be 0 or for
+  dFalsePositiveRate not to be strictly between 0 and 1.
+*/
+int FT_initWithFilter(size_t ulExpectedPaths,
+                      double dFalsePositiveRate);
+
 /*
   Removes all contents of the data structure and
   returns it to an uninitialized state.
@@ -149,4 +313,425 @@ int FT_destroy(void);
 */
 char *FT_toString(void);
 
+/*
+  Returns the lines of FT_toString's string from line ulStart, counting
+  from 0, on: ulCount lines, or as many as there are, joined as
+  FT_toString joins them, so the empty string if there are none.
+  Returns NULL if the FT is not in an initialized state, was created
+  by FT_newSharded, or there is an allocation error. Allocates memory
+  for the returned string, which is then owned by the client. Every
+  directory knows how many nodes lie below it, so finding line ulStart
+  costs a step per directory above it, not a pass over the lines
+  before it. A directory with many children keeps the running sums of
+  their sizes from the first listing after its children change, and
+  its step is then a binary search; until then, or over few children,
+  the step scans the children's sizes.
+*/
+char *FT_listRange(size_t ulStart, size_t ulCount);
+
+/*
+  Sets *pulIndex to the line of FT_toString's string, counting from 0,
+  that holds pcPath, as cheaply as FT_listRange finds a line. Returns
+  SUCCESS, or a status as FT_stat does, with *pulIndex then unchanged;
+  INITIALIZATION_ERROR also if the FT was created by FT_newSharded.
+*/
+int FT_indexOf(const char *pcPath, size_t *pulIndex);
+
+/*
+  Enables (bEnable TRUE) or disables (bEnable FALSE) the path cache, a
+  hash map from every node's full pathname to the node. While it is
+  enabled, lookups of paths that exist skip path parsing and the walk
+  from the root, at the cost of one table slot per node. Enabling
+  builds the cache over any nodes already in the FT. The setting
+  survives FT_destroy and FT_init; the cache starts disabled.
+  Returns SUCCESS, or MEMORY_ERROR if the cache could not be built,
+  in which case it stays disabled, or INITIALIZATION_ERROR on an
+  attempt to enable it under FT_LOCK_DIRS, which it does not support.
+*/
+int FT_setPathCache(boolean bEnable);
+
+/*
+  Sets *pulHits and *pulMisses to the number of lookups that the path
+  cache answered and that fell back to walking the tree, since the
+  cache was last enabled. Both are 0 while the cache is disabled.
+*/
+void FT_getPathCacheStats(size_t *pulHits, size_t *pulMisses);
+
+/*
+  Enables (bEnable TRUE) or disables (bEnable FALSE) background
+  reclamation. While it is enabled, FT_rmDir, and FT_commit for the
+  removals it makes final, do not free a large removed subtree before
+  returning: they detach it, take its size off the node count in
+  constant time, and hand it to a thread that frees it a slice at a
+  time while the caller goes on. The walk that drops
+  the subtree's paths from the path cache and the Bloom filter, and
+  under FT_LOCK_DIRS the wait for walks inside it, still take time in
+  the size of the subtree. FT_destroy and FT_setLocking wait until the
+  thread has freed everything the FT handed it. The setting survives
+  FT_destroy and FT_init; reclamation starts disabled.
+*/
+void FT_setBackgroundReclaim(boolean bEnable);
+
+/*
+  Walks towards a path resume from the deepest of the few most
+  recently used directories that is an ancestor of the path, rather
+  than from the root. Sets *pulOps to the number of walks since
+  FT_init and *pulLevelsSkipped to the total number of levels they
+  did not have to walk, so *pulLevelsSkipped / *pulOps is the average
+  saving per walk. Both are 0 if the FT is not initialized.
+*/
+void FT_getDirCacheStats(size_t *pulOps, size_t *pulLevelsSkipped);
+
+/*
+  Sets, for the lookups since FT_init or FT_initWithFilter,
+  *pulProbes to the number that consulted the Bloom filter,
+  *pulNegatives to the number it rejected outright, and
+  *pulFalsePositives to the number it passed that then found no such
+  node. Sets *pulBytes to the memory the filter uses now. All are 0 if
+  the FT has no filter.
+*/
+void FT_getFilterStats(size_t *pulProbes, size_t *pulNegatives,
+                       size_t *pulFalsePositives, size_t *pulBytes);
+
+/* The ways in which an FT may be locked for use by several threads */
+enum ftLocking {
+   /* no locking: the FT must be used from one thread at a time */
+   FT_LOCK_NONE,
+   /* one reader-writer lock over the whole FT */
+   FT_LOCK_TREE,
+   /* a lock per directory, taken hand over hand along each path */
+   FT_LOCK_DIRS,
+   /* FT_LOCK_TREE for writers, and no lock for most lookups */
+   FT_LOCK_OPTIMISTIC,
+   /* FT_LOCK_TREE, with inserts and removals applied in batches */
+   FT_LOCK_COMBINING
+};
+typedef enum ftLocking FT_Locking;
+
+/*
+  Sets how the FT is locked to eLocking. Under FT_LOCK_NONE, the
+  default, the FT must be used from one thread at a time. Otherwise,
+  it may be used from several threads at once:
+
+  * Under FT_LOCK_TREE, the functions that only read it
+    (FT_containsDir, FT_containsFile, FT_getFileContents, FT_stat,
+    FT_toString, FT_statAt and the statistics functions) share a
+    reader-writer lock, and those that may change it take the lock
+    exclusively, so that reads proceed in parallel. Reads under the
+    shared lock do not use the directory cache and are not counted in
+    any statistics.
+
+  * Under FT_LOCK_DIRS, every directory also has a reader-writer lock,
+    and an operation on a path locks the directories along it hand
+    over hand, holding a directory while it locks the next. Writers
+    then only exclude each other where their paths meet, so inserts
+    and removals in different subtrees proceed in parallel. Changes
+    to the root itself, FT_toString, FT_statAt, and the directory
+    handle functions still lock the whole FT. The path cache,
+    directory cache and Bloom filter are not used in this mode:
+    switching to it drops them, and FT_setPathCache cannot enable the
+    path cache while it lasts.
+
+  * Under FT_LOCK_OPTIMISTIC, writers lock as under FT_LOCK_TREE, but
+    FT_containsDir, FT_containsFile, FT_getFileContents and FT_stat
+    take no lock, and write nothing but a slot of their thread's own:
+    they read optimistically and check per-node version counters to
+    detect a writer that got in the way, retrying a few times before
+    falling back to the shared lock. Removed nodes are freed only
+    once no such lookup can still be reading them. The path cache and
+    Bloom filter are not used in this mode, as for FT_LOCK_DIRS.
+
+  * Under FT_LOCK_COMBINING, FT_insertDir, FT_insertFile, FT_rmDir and
+    FT_rmFile do not each take the lock. A thread publishes its update
+    and waits; one waiting thread at a time takes the lock
+    exclusively, applies every update published so far, sorted by
+    path, and hands back each result. Many threads updating at once
+    then cost one lock handoff per batch instead of one per update.
+    Updates published at the same time may be applied in any order.
+    Everything else locks as under FT_LOCK_TREE.
+
+  A pointer returned by FT_getFileContents is only guaranteed until
+  the file is next changed. FT_init, FT_destroy and FT_setLocking
+  itself are never locked, so must not run while other threads use
+  the FT. The setting survives FT_destroy and FT_init. Returns
+  SUCCESS, or MEMORY_ERROR if the locks could not be created, in
+  which case the setting is unchanged.
+*/
+int FT_setLocking(FT_Locking eLocking);
+
+/*
+  Checks the FT's internal invariants: that every node's path extends
+  its parent's, that each directory's children are in order, files
+  first, with no duplicates, and that the node count and every
+  node's subtree totals are right. Returns TRUE if they hold, or FALSE
+  after printing what is wrong to stderr. Locks the whole FT under any
+  locking mode, so may be called while other threads use it.
+*/
+boolean FT_isValid(void);
+
+/*--------------------------------------------------------------------*/
+
+/*
+  A DirHandle_T names a directory in the FT, so that operations on its
+  entries resolve one component from the directory instead of walking
+  the whole path from the root. A handle stays open until closed with
+  FT_closeDir, but becomes invalid as soon as its directory is
+  removed, whether by FT_rmDir on it or on an ancestor, or by
+  FT_destroy or FT_free; operations on an invalid handle return
+  NO_SUCH_PATH, even if a directory with the same path is created
+  again.
+*/
+typedef struct dirHandle *DirHandle_T;
+
+/*
+  Opens a handle to the directory with absolute path pcPath. Returns
+  SUCCESS and sets *poDResult to the new handle, owned by the client,
+  if successful. Otherwise, sets *poDResult to NULL and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_DIRECTORY if pcPath is in the FT as a file not a directory
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_openDir(const char *pcPath, DirHandle_T *poDResult);
+
+/* Closes and frees oDHandle, whether or not it is still valid. */
+void FT_closeDir(DirHandle_T oDHandle);
+
+/*
+  Inserts a new file named pcName, a single path component, into the
+  directory of oDHandle, with contents pvContents of size ulLength
+  bytes. Returns SUCCESS if the new file is inserted successfully.
+  Otherwise, returns:
+  * NO_SUCH_PATH if oDHandle has been invalidated
+  * BAD_PATH if pcName is empty or contains a '/'
+  * ALREADY_IN_TREE if the directory already has an entry pcName
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_insertFileAt(DirHandle_T oDHandle, const char *pcName,
+                    void *pvContents, size_t ulLength);
+
+/*
+  Like FT_stat, for the entry named pcName, a single path component,
+  in the directory of oDHandle. Returns SUCCESS if the entry exists.
+  Otherwise, returns:
+  * NO_SUCH_PATH if oDHandle has been invalidated or the directory has
+                 no entry pcName
+  * BAD_PATH if pcName is empty or contains a '/'
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_statAt(DirHandle_T oDHandle, const char *pcName,
+              boolean *pbIsFile, size_t *pulSize);
+
+/*--------------------------------------------------------------------*/
+
+/*
+  An FTSnapshot_T is a read-only view of the FT as it was at one point
+  in time. Scans of a snapshot lock the FT only briefly, once per
+  directory, so inserts, removals and replacements go on meanwhile
+  without the snapshot seeing any of them. The FT keeps, for each
+  open snapshot, a copy of each node as the snapshot saw it, made
+  when the node is first changed, and keeps removed nodes that a
+  snapshot can still reach, so an open snapshot costs memory in
+  proportion to the changes made since it was taken. Snapshots are
+  not supported under FT_LOCK_DIRS, which must not be switched to
+  while any is open, nor on an FT created by FT_newSharded.
+*/
+typedef struct ftSnapshot *FTSnapshot_T;
+
+/*
+  Takes a snapshot of the FT. Returns SUCCESS and sets *poSResult to
+  the new snapshot, which the client must release with
+  FT_releaseSnapshot before FT_destroy. Otherwise, sets *poSResult to
+  NULL and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state,
+                         or its locking mode does not support
+                         snapshots
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  While a snapshot is open, FT_insertDir, FT_insertFile, FT_rmDir,
+  FT_rmFile, FT_replaceFileContents and FT_insertFileAt may also fail
+  with MEMORY_ERROR if the copy for the snapshot cannot be made, in
+  which case they change nothing.
+*/
+int FT_snapshot(FTSnapshot_T *poSResult);
+
+/*
+  Releases snapshot oS, and frees the copies and removed nodes that
+  no other open snapshot needs. Does nothing if oS is NULL.
+*/
+void FT_releaseSnapshot(FTSnapshot_T oS);
+
+/*
+  Returns the string FT_toString would have returned when snapshot oS
+  was taken, or NULL if memory could not be allocated. Allocates
+  memory for the returned string, which is then owned by the client.
+*/
+char *FT_snapshotToString(FTSnapshot_T oS);
+
+/*
+  Like FT_stat, but as of when snapshot oS was taken. Returns SUCCESS
+  if pcPath existed then. Otherwise, returns:
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath did not exist
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_snapshotStat(FTSnapshot_T oS, const char *pcPath,
+                    boolean *pbIsFile, size_t *pulSize);
+
+/*--------------------------------------------------------------------*/
+
+/*
+  An FTTxn_T is a transaction: a group of inserts, removals and
+  replacements of contents that either all take effect or leave no
+  trace. A transaction takes the FT's lock once, when it begins, and
+  holds it until it ends, so its operations take no lock of their
+  own, and no other thread sees any of them before it commits. Each
+  operation takes effect at once for the operations after it, and
+  logs how to undo it; a removal is undone without memory, so
+  aborting cannot fail. Until the transaction ends, the thread that
+  began it must not use the FT other than through it. Transactions
+  are not supported on an FT created by FT_newSharded.
+*/
+typedef struct ftTxn *FTTxn_T;
+
+/*
+  Begins a transaction on the FT, waiting for the FT's lock if
+  locking is on. Returns SUCCESS and sets *poTResult to the new
+  transaction, which the client must end with FT_commit or FT_abort.
+  Otherwise, sets *poTResult to NULL and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state,
+                         or was created by FT_newSharded
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_begin(FTTxn_T *poTResult);
+
+/*
+  Each of the following does, within transaction oT, what the
+  function of the same name without "txn" does, and returns the same
+  statuses, but for FT_txnReplaceFileContents, which returns SUCCESS
+  or a status as FT_rmFile does, and keeps the old contents until the
+  transaction ends. An operation that fails changes nothing, and the
+  transaction goes on: the client may still commit the operations
+  that succeeded, or abort them all.
+*/
+int FT_txnInsertDir(FTTxn_T oT, const char *pcPath);
+int FT_txnInsertFile(FTTxn_T oT, const char *pcPath,
+                     void *pvContents, size_t ulLength);
+int FT_txnRmDir(FTTxn_T oT, const char *pcPath);
+int FT_txnRmFile(FTTxn_T oT, const char *pcPath);
+int FT_txnReplaceFileContents(FTTxn_T oT, const char *pcPath,
+                              void *pvNewContents,
+                              size_t ulNewLength);
+
+/*
+  Ends transaction oT, keeping every change it made, and frees it,
+  along with the nodes it removed and the contents it replaced.
+  Directory handles to the directories it removed become invalid
+  only now.
+*/
+void FT_commit(FTTxn_T oT);
+
+/*
+  Ends transaction oT, undoing every change it made, latest first, so
+  that the FT is as it was when oT began, and frees it.
+*/
+void FT_abort(FTTxn_T oT);
+
+/*--------------------------------------------------------------------*/
+
+/*
+  An FT_T is an independent File Tree instance. Instances share no
+  state with each other or with the default File Tree.
+*/
+typedef struct ft *FT_T;
+
+/*
+  Creates a new, empty, initialized File Tree. Returns SUCCESS and
+  sets *poFResult to it if successful. Otherwise, sets *poFResult to
+  NULL and returns MEMORY_ERROR.
+*/
+int FT_new(FT_T *poFResult);
+
+/*
+  Like FT_new, but the new File Tree keeps a Bloom filter as described
+  for FT_initWithFilter.
+*/
+int FT_newWithFilter(size_t ulExpectedPaths, double dFalsePositiveRate,
+                     FT_T *poFResult);
+
+/*
+  Like FT_new, but the new File Tree is split into ulShards shards,
+  each an internal tree with its own lock, and is locked for use by
+  several threads from the start. The entries directly under the root
+  are spread across the shards by a hash of their names, and each
+  entry's subtree lives with it, so that operations in different
+  subtrees of the root mostly take different locks, while changes to
+  the root itself take a lock over every shard. FT_toStringIn merges
+  the shards, giving the same string as an unsharded FT would.
+  FT_setLockingIn sets how each shard is locked, FT_LOCK_TREE at
+  first, and the statistics functions sum over the shards.
+*/
+int FT_newSharded(size_t ulShards, FT_T *poFResult);
+
+/*
+  Removes all contents of oFT, invalidates its directory handles, and
+  frees it. Does nothing if oFT is NULL. As with FT_destroy, no other
+  thread may be using oFT.
+*/
+void FT_free(FT_T oFT);
+
+/*
+  Each of the following behaves like the function of the same name
+  without "In", but on File Tree oFT instead of the default one. Since
+  an FT_T is always initialized, none returns INITIALIZATION_ERROR.
+*/
+int FT_insertDirIn(FT_T oFT, const char *pcPath);
+boolean FT_containsDirIn(FT_T oFT, const char *pcPath);
+int FT_rmDirIn(FT_T oFT, const char *pcPath);
+int FT_insertFileIn(FT_T oFT, const char *pcPath, void *pvContents,
+                    size_t ulLength);
+boolean FT_containsFileIn(FT_T oFT, const char *pcPath);
+int FT_rmFileIn(FT_T oFT, const char *pcPath);
+void *FT_getFileContentsIn(FT_T oFT, const char *pcPath);
+void *FT_replaceFileContentsIn(FT_T oFT, const char *pcPath,
+                               void *pvNewContents,
+                               size_t ulNewLength);
+int FT_statIn(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize);
+int FT_statTreeIn(FT_T oFT, const char *pcPath, size_t *pulFiles,
+                  size_t *pulDirs, size_t *pulBytes);
+int FT_insertBatchIn(FT_T oFT, const struct ftBatchEntry *psEntries,
+                     size_t ulCount, int *piResults);
+int FT_buildParallelIn(FT_T oFT, const struct ftBatchEntry *psEntries,
+                       size_t ulCount, size_t ulThreads,
+                       int *piResults);
+int FT_statManyIn(FT_T oFT, const char *const *ppcPaths,
+                  size_t ulCount, struct ftLookup *psResults);
+int FT_getContentsManyIn(FT_T oFT, const char *const *ppcPaths,
+                         size_t ulCount, struct ftLookup *psResults);
+int FT_bulkLoadSortedIn(FT_T oFT,
+                        boolean (*pfNext)(void *pvReader,
+                                          struct ftBatchEntry *psEntry),
+                        void *pvReader);
+char *FT_toStringIn(FT_T oFT);
+char *FT_listRangeIn(FT_T oFT, size_t ulStart, size_t ulCount);
+int FT_indexOfIn(FT_T oFT, const char *pcPath, size_t *pulIndex);
+int FT_setPathCacheIn(FT_T oFT, boolean bEnable);
+void FT_setBackgroundReclaimIn(FT_T oFT, boolean bEnable);
+int FT_setLockingIn(FT_T oFT, FT_Locking eLocking);
+boolean FT_isValidIn(FT_T oFT);
+void FT_getPathCacheStatsIn(FT_T oFT, size_t *pulHits,
+                            size_t *pulMisses);
+void FT_getDirCacheStatsIn(FT_T oFT, size_t *pulOps,
+                           size_t *pulLevelsSkipped);
+void FT_getFilterStatsIn(FT_T oFT, size_t *pulProbes,
+                         size_t *pulNegatives,
+                         size_t *pulFalsePositives, size_t *pulBytes);
+int FT_openDirIn(FT_T oFT, const char *pcPath,
+                 DirHandle_T *poDResult);
+int FT_snapshotIn(FT_T oFT, FTSnapshot_T *poSResult);
+int FT_beginIn(FT_T oFT, FTTxn_T *poTResult);
+
 #endif
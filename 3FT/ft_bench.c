@@ -0,0 +1,953 @@
+/*--------------------------------------------------------------------*/
+/* ft_bench.c                                                         */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for clock_gettime, syscall, and ioctl */
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "ft.h"
+
+/* Benchmark parameters */
+enum {
+   /* number of levels of directories above each file */
+   BENCH_DEPTH = 12,
+   /* number of distinct directory names at each level */
+   BENCH_FANOUT = 4,
+   /* number of files inserted into the tree */
+   BENCH_FILES = 10000,
+   /* number of lookups timed per lookup phase */
+   BENCH_LOOKUPS = 50000,
+   /* number of paths per FT_statMany call */
+   BENCH_MULTI = 256,
+   /* number of files per directory that FT_statMany groups stat */
+   BENCH_GROUP = 16,
+   /* number of lines per FT_listRange page */
+   BENCH_PAGE = 50,
+   /* number of pages and of FT_indexOf calls timed */
+   BENCH_PAGES = 1000,
+   /* number of files in the one wide directory of the listing tree */
+   BENCH_WIDE = 5000,
+   /* number of lines whose FT_indexOf is checked per listing */
+   BENCH_SAMPLES = 500,
+   /* room for any generated path */
+   BENCH_MAXPATH = 256
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A hardware cache-miss counter, or -1 if none could be opened */
+static int iMissCounter = -1;
+
+/*
+  Opens a counter of last-level cache misses for this process, if the
+  platform and its permissions allow it. Leaves iMissCounter at -1
+  otherwise, in which case miss counts are reported as unavailable.
+*/
+static void Bench_openMissCounter(void) {
+#ifdef __linux__
+   struct perf_event_attr sAttr;
+
+   memset(&sAttr, 0, sizeof(sAttr));
+   sAttr.type = PERF_TYPE_HARDWARE;
+   sAttr.size = sizeof(sAttr);
+   sAttr.config = PERF_COUNT_HW_CACHE_MISSES;
+   sAttr.disabled = 1;
+   sAttr.exclude_kernel = 1;
+   sAttr.exclude_hv = 1;
+   iMissCounter = (int) syscall(__NR_perf_event_open, &sAttr, 0, -1,
+                                -1, 0);
+#endif
+}
+
+/* Resets and starts the cache-miss counter, if there is one. */
+static void Bench_startMisses(void) {
+#ifdef __linux__
+   if(iMissCounter >= 0) {
+      (void) ioctl(iMissCounter, PERF_EVENT_IOC_RESET, 0);
+      (void) ioctl(iMissCounter, PERF_EVENT_IOC_ENABLE, 0);
+   }
+#endif
+}
+
+/*
+  Stops the cache-miss counter and returns the number of misses since
+  Bench_startMisses, or -1.0 if there is no counter.
+*/
+static double Bench_stopMisses(void) {
+#ifdef __linux__
+   unsigned long ulValue;
+
+   if(iMissCounter >= 0) {
+      (void) ioctl(iMissCounter, PERF_EVENT_IOC_DISABLE, 0);
+      if(read(iMissCounter, &ulValue, sizeof(ulValue)) ==
+         (ssize_t) sizeof(ulValue))
+         return (double) ulValue;
+   }
+#endif
+   return -1.0;
+}
+
+/* Returns the current monotonic time in seconds. */
+static double Bench_now(void) {
+   struct timespec sNow;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double) sNow.tv_sec + (double) sNow.tv_nsec / 1e9;
+}
+
+/*
+  Prints one result line for phase pcPhase of the run labelled
+  pcLabel, which performed ulOps operations in dSeconds seconds and
+  incurred dMisses cache misses (negative if unknown).
+*/
+static void Bench_report(const char *pcLabel, const char *pcPhase,
+                         size_t ulOps, double dSeconds,
+                         double dMisses) {
+   printf("%-6s %-18s %9lu ops %10.1f ns/op", pcLabel, pcPhase,
+          (unsigned long) ulOps, dSeconds * 1e9 / (double) ulOps);
+   if(dMisses >= 0.0)
+      printf(" %8.2f misses/op\n", dMisses / (double) ulOps);
+   else
+      printf("      n/a misses/op\n");
+}
+
+/*
+  Exits with an error message naming pcWhat unless bOk is TRUE. Used
+  instead of assert so that benchmark operations still run when
+  compiled with NDEBUG.
+*/
+static void Bench_check(boolean bOk, const char *pcWhat) {
+   if(!bOk) {
+      fprintf(stderr, "ft_bench: %s failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Writes into pcBuf the path of the ulFile'th benchmark file, whose
+  BENCH_DEPTH directory levels spell ulFile in base BENCH_FANOUT.
+*/
+static void Bench_filePath(size_t ulFile, char *pcBuf) {
+   size_t ulLevel;
+   size_t ulRest = ulFile;
+
+   pcBuf += sprintf(pcBuf, "root");
+   for(ulLevel = 0; ulLevel < BENCH_DEPTH; ulLevel++) {
+      pcBuf += sprintf(pcBuf, "/d%lu_%lu", (unsigned long) ulLevel,
+                       (unsigned long) (ulRest % BENCH_FANOUT));
+      ulRest /= BENCH_FANOUT;
+   }
+   (void) sprintf(pcBuf, "/file%lu", (unsigned long) ulFile);
+}
+
+/* Returns the next value of a simple linear congruential generator
+   whose state is *pulSeed. */
+static size_t Bench_rand(size_t *pulSeed) {
+   *pulSeed = *pulSeed * 1103515245UL + 12345UL;
+   return (*pulSeed >> 8) & 0xffffffUL;
+}
+
+/*
+  Builds the benchmark tree, then times deep lookups of existing
+  files, lookups of missing files, stats, FT_toString, and removal of
+  a quarter of the tree, with the path cache enabled if bPathCache is
+  TRUE. Lines are prefixed with pcLabel.
+*/
+static void Bench_deepLookups(boolean bPathCache, const char *pcLabel) {
+   char acPath[BENCH_MAXPATH];
+   size_t ulSeed = 217;
+   size_t ul;
+   size_t ulHits = 0;
+   boolean bIsFile;
+   size_t ulSize;
+   char *pcDump;
+   double dStart;
+   size_t ulCacheHits;
+   size_t ulCacheMisses;
+
+   Bench_check(FT_setPathCache(bPathCache) == SUCCESS,
+               "FT_setPathCache");
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+   Bench_report(pcLabel, "insert",
+                BENCH_FILES, Bench_now() - dStart, Bench_stopMisses());
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_LOOKUPS; ul++) {
+      Bench_filePath(Bench_rand(&ulSeed) % BENCH_FILES, acPath);
+      ulHits += (size_t) FT_containsFile(acPath);
+   }
+   Bench_report(pcLabel, "containsFile hit",
+                BENCH_LOOKUPS, Bench_now() - dStart, Bench_stopMisses());
+   Bench_check(ulHits == BENCH_LOOKUPS, "containsFile");
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_LOOKUPS; ul++) {
+      Bench_filePath(BENCH_FILES + Bench_rand(&ulSeed) % BENCH_FILES,
+                     acPath);
+      ulHits += (size_t) FT_containsFile(acPath);
+   }
+   Bench_report(pcLabel, "containsFile miss",
+                BENCH_LOOKUPS, Bench_now() - dStart, Bench_stopMisses());
+   Bench_check(ulHits == BENCH_LOOKUPS, "containsFile");
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_LOOKUPS; ul++) {
+      Bench_filePath(Bench_rand(&ulSeed) % BENCH_FILES, acPath);
+      Bench_check(FT_stat(acPath, &bIsFile, &ulSize) == SUCCESS,
+                  "FT_stat");
+   }
+   Bench_report(pcLabel, "stat",
+                BENCH_LOOKUPS, Bench_now() - dStart, Bench_stopMisses());
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   pcDump = FT_toString();
+   Bench_check(pcDump != NULL, "FT_toString");
+   Bench_report(pcLabel, "toString",
+                1, Bench_now() - dStart, Bench_stopMisses());
+   free(pcDump);
+
+   /* files whose first level is d0_0 are a quarter of the tree;
+      afterwards none of them may be found, cached or not */
+   FT_getPathCacheStats(&ulCacheHits, &ulCacheMisses);
+   dStart = Bench_now();
+   Bench_check(FT_rmDir("root/d0_0") == SUCCESS, "FT_rmDir");
+   Bench_report(pcLabel, "rmDir", 1, Bench_now() - dStart, -1.0);
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_containsFile(acPath) == (ul % BENCH_FANOUT != 0),
+                  "containsFile after FT_rmDir");
+   }
+
+   if(bPathCache)
+      printf("%s path cache: %lu hits, %lu misses (%.1f%% hits)\n",
+             pcLabel, (unsigned long) ulCacheHits,
+             (unsigned long) ulCacheMisses,
+             100.0 * (double) ulCacheHits /
+             (double) (ulCacheHits + ulCacheMisses));
+
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+   Bench_check(FT_setPathCache(FALSE) == SUCCESS, "FT_setPathCache");
+}
+
+/*
+  Inserts BENCH_FILES sibling files into one directory BENCH_DEPTH
+  levels down, then stats them in the same order, timing both and
+  reporting how many levels the directory cache let each walk skip.
+  Then does the same through a handle to the directory, and checks
+  that removing an ancestor invalidates the handle.
+*/
+static void Bench_siblings(void) {
+   char acPath[BENCH_MAXPATH];
+   char *pcName;
+   size_t ulLevel;
+   size_t ul;
+   boolean bIsFile;
+   size_t ulSize;
+   double dStart;
+   size_t ulOps;
+   size_t ulLevelsSkipped;
+   DirHandle_T oDHandle;
+   char acName[BENCH_MAXPATH];
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+
+   pcName = acPath + sprintf(acPath, "root");
+   for(ulLevel = 0; ulLevel < BENCH_DEPTH; ulLevel++)
+      pcName += sprintf(pcName, "/level%lu", (unsigned long) ulLevel);
+   *pcName++ = '/';
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(pcName, "file%05lu", (unsigned long) ul);
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+   Bench_report("dirs", "sibling insert", BENCH_FILES,
+                Bench_now() - dStart, -1.0);
+
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(pcName, "file%05lu", (unsigned long) ul);
+      Bench_check(FT_stat(acPath, &bIsFile, &ulSize) == SUCCESS,
+                  "FT_stat");
+   }
+   Bench_report("dirs", "sibling stat", BENCH_FILES,
+                Bench_now() - dStart, -1.0);
+
+   FT_getDirCacheStats(&ulOps, &ulLevelsSkipped);
+   printf("dirs directory cache: %lu walks, %.2f levels skipped/walk"
+          " of %d\n", (unsigned long) ulOps,
+          (double) ulLevelsSkipped / (double) ulOps, BENCH_DEPTH + 2);
+
+   pcName[-1] = '\0';
+   Bench_check(FT_openDir(acPath, &oDHandle) == SUCCESS, "FT_openDir");
+
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(acName, "handle%05lu", (unsigned long) ul);
+      Bench_check(FT_insertFileAt(oDHandle, acName, acName, 8) ==
+                  SUCCESS, "FT_insertFileAt");
+   }
+   Bench_report("dirs", "insertFileAt", BENCH_FILES,
+                Bench_now() - dStart, -1.0);
+
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(acName, "handle%05lu", (unsigned long) ul);
+      Bench_check(FT_statAt(oDHandle, acName, &bIsFile, &ulSize) ==
+                  SUCCESS, "FT_statAt");
+   }
+   Bench_report("dirs", "statAt", BENCH_FILES,
+                Bench_now() - dStart, -1.0);
+
+   Bench_check(FT_rmDir("root/level0") == SUCCESS, "FT_rmDir");
+   Bench_check(FT_statAt(oDHandle, "handle00000", &bIsFile, &ulSize) ==
+               NO_SUCH_PATH, "FT_statAt after FT_rmDir");
+   FT_closeDir(oDHandle);
+
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+}
+
+/*
+  Inserts BENCH_FILES sibling files, in a shuffled order, into one
+  directory of an FT with lock-free readers, where a children array
+  may not move under a reader once it is published, timing the
+  inserts, and checks that each file is then found.
+*/
+static void Bench_optimisticSiblings(void) {
+   FT_T oFT;
+   char acPath[BENCH_MAXPATH];
+   size_t ulSeed = 1;
+   size_t ul;
+   double dStart;
+
+   Bench_check(FT_new(&oFT) == SUCCESS, "FT_new");
+   Bench_check(FT_setLockingIn(oFT, FT_LOCK_OPTIMISTIC) == SUCCESS,
+               "FT_setLockingIn");
+   Bench_check(FT_insertDirIn(oFT, "root") == SUCCESS,
+               "FT_insertDirIn");
+
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(acPath, "root/file%lu",
+                     (unsigned long) Bench_rand(&ulSeed));
+      (void) FT_insertFileIn(oFT, acPath, acPath, 8);
+   }
+   Bench_report("opt", "sibling insert", BENCH_FILES,
+                Bench_now() - dStart, -1.0);
+
+   ulSeed = 1;
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      (void) sprintf(acPath, "root/file%lu",
+                     (unsigned long) Bench_rand(&ulSeed));
+      Bench_check(FT_containsFileIn(oFT, acPath),
+                  "FT_containsFileIn");
+   }
+   Bench_check(FT_isValidIn(oFT), "FT_isValidIn");
+   FT_free(oFT);
+}
+
+/*
+  Inserts the benchmark files, in a shuffled order, first one call at
+  a time and then again into an empty FT as one FT_insertBatch, timing
+  both and checking that they build the same tree.
+*/
+static void Bench_batchInsert(void) {
+   char *pcPaths;
+   struct ftBatchEntry *psEntries;
+   int *piResults;
+   char *pcOne;
+   char *pcBatch;
+   size_t ulSeed = 217;
+   size_t ul;
+   size_t ulOther;
+   struct ftBatchEntry sSwap;
+   double dStart;
+
+   pcPaths = malloc((size_t) BENCH_FILES * BENCH_MAXPATH);
+   psEntries = malloc(BENCH_FILES * sizeof(struct ftBatchEntry));
+   piResults = malloc(BENCH_FILES * sizeof(int));
+   Bench_check(pcPaths != NULL && psEntries != NULL &&
+               piResults != NULL, "malloc");
+
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, pcPaths + ul * BENCH_MAXPATH);
+      psEntries[ul].pcPath = pcPaths + ul * BENCH_MAXPATH;
+      psEntries[ul].bIsFile = TRUE;
+      psEntries[ul].pvContents = pcPaths + ul * BENCH_MAXPATH;
+      psEntries[ul].ulLength = 8;
+   }
+   for(ul = BENCH_FILES - 1; ul > 0; ul--) {
+      ulOther = Bench_rand(&ulSeed) % (ul + 1);
+      sSwap = psEntries[ul];
+      psEntries[ul] = psEntries[ulOther];
+      psEntries[ulOther] = sSwap;
+   }
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_FILES; ul++)
+      Bench_check(FT_insertFile(psEntries[ul].pcPath,
+                                psEntries[ul].pvContents,
+                                psEntries[ul].ulLength) == SUCCESS,
+                  "FT_insertFile");
+   Bench_report("batch", "insert one by one", BENCH_FILES,
+                Bench_now() - dStart, Bench_stopMisses());
+   pcOne = FT_toString();
+   Bench_check(pcOne != NULL, "FT_toString");
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   Bench_startMisses();
+   dStart = Bench_now();
+   Bench_check(FT_insertBatch(psEntries, BENCH_FILES, piResults) ==
+               SUCCESS, "FT_insertBatch");
+   Bench_report("batch", "insertBatch", BENCH_FILES,
+                Bench_now() - dStart, Bench_stopMisses());
+   for(ul = 0; ul < BENCH_FILES; ul++)
+      Bench_check(piResults[ul] == SUCCESS, "FT_insertBatch entry");
+   pcBatch = FT_toString();
+   Bench_check(pcBatch != NULL && strcmp(pcOne, pcBatch) == 0,
+               "FT_toString after FT_insertBatch");
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+
+   free(pcOne);
+   free(pcBatch);
+   free(piResults);
+   free(psEntries);
+   free(pcPaths);
+}
+
+/* The benchmark files, sorted, as FT_bulkLoadSorted reads them after
+   their root directory */
+struct benchReader {
+   boolean bRootRead;
+   const char **ppcPaths;
+   size_t ulNext;
+   size_t ulCount;
+};
+
+/* Compares the paths that pvFirst and pvSecond point to. A qsort
+   comparator. */
+static int Bench_comparePaths(const void *pvFirst,
+                              const void *pvSecond) {
+   return strcmp(*(const char * const *) pvFirst,
+                 *(const char * const *) pvSecond);
+}
+
+/* Sets *psEntry to the next entry of reader pvReader, and returns
+   TRUE, or returns FALSE once there are none left. */
+static boolean Bench_nextEntry(void *pvReader,
+                               struct ftBatchEntry *psEntry) {
+   struct benchReader *psReader = pvReader;
+
+   if(!psReader->bRootRead) {
+      psReader->bRootRead = TRUE;
+      psEntry->pcPath = "root";
+      psEntry->bIsFile = FALSE;
+      psEntry->pvContents = NULL;
+      psEntry->ulLength = 0;
+      return TRUE;
+   }
+   if(psReader->ulNext == psReader->ulCount)
+      return FALSE;
+   psEntry->pcPath = psReader->ppcPaths[psReader->ulNext++];
+   psEntry->bIsFile = TRUE;
+   psEntry->pvContents = (void *) psEntry->pcPath;
+   psEntry->ulLength = 8;
+   return TRUE;
+}
+
+/*
+  Inserts the benchmark files, sorted, first one call at a time and
+  then again into an empty FT with FT_bulkLoadSorted, timing both and
+  checking that they build the same tree.
+*/
+static void Bench_bulkLoad(void) {
+   char *pcPaths;
+   const char **ppcPaths;
+   struct benchReader sReader;
+   char *pcOne;
+   char *pcLoaded;
+   size_t ul;
+   double dStart;
+
+   pcPaths = malloc((size_t) BENCH_FILES * BENCH_MAXPATH);
+   ppcPaths = malloc(BENCH_FILES * sizeof(const char *));
+   Bench_check(pcPaths != NULL && ppcPaths != NULL, "malloc");
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, pcPaths + ul * BENCH_MAXPATH);
+      ppcPaths[ul] = pcPaths + ul * BENCH_MAXPATH;
+   }
+   qsort(ppcPaths, BENCH_FILES, sizeof(const char *),
+         Bench_comparePaths);
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_startMisses();
+   dStart = Bench_now();
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_FILES; ul++)
+      Bench_check(FT_insertFile(ppcPaths[ul], (void *) ppcPaths[ul],
+                                8) == SUCCESS, "FT_insertFile");
+   Bench_report("load", "insert one by one", BENCH_FILES,
+                Bench_now() - dStart, Bench_stopMisses());
+   pcOne = FT_toString();
+   Bench_check(pcOne != NULL, "FT_toString");
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   sReader.bRootRead = FALSE;
+   sReader.ppcPaths = ppcPaths;
+   sReader.ulNext = 0;
+   sReader.ulCount = BENCH_FILES;
+   Bench_startMisses();
+   dStart = Bench_now();
+   Bench_check(FT_bulkLoadSorted(Bench_nextEntry, &sReader) == SUCCESS,
+               "FT_bulkLoadSorted");
+   Bench_report("load", "bulkLoadSorted", BENCH_FILES,
+                Bench_now() - dStart, Bench_stopMisses());
+   pcLoaded = FT_toString();
+   Bench_check(pcLoaded != NULL && strcmp(pcOne, pcLoaded) == 0,
+               "FT_toString after FT_bulkLoadSorted");
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+
+   free(pcOne);
+   free(pcLoaded);
+   free(ppcPaths);
+   free(pcPaths);
+}
+
+/*
+  Stats the ulGroups * BENCH_MULTI paths at pcPaths, BENCH_MAXPATH
+  bytes apart, first with one FT_stat per path and then with one
+  FT_statMany per BENCH_MULTI of them, timing both as phases named
+  pcKind.
+*/
+static void Bench_timeMulti(const char *pcKind, const char *pcPaths,
+                            size_t ulGroups) {
+   const char *apcGroup[BENCH_MULTI];
+   struct ftLookup asResults[BENCH_MULTI];
+   char acPhase[BENCH_MAXPATH];
+   size_t ulGroup;
+   size_t ul;
+   boolean bIsFile;
+   size_t ulSize;
+   double dStart;
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < ulGroups * BENCH_MULTI; ul++)
+      Bench_check(FT_stat(pcPaths + ul * BENCH_MAXPATH, &bIsFile,
+                          &ulSize) == SUCCESS, "FT_stat");
+   (void) sprintf(acPhase, "%s one by one", pcKind);
+   Bench_report("multi", acPhase, ulGroups * BENCH_MULTI,
+                Bench_now() - dStart, Bench_stopMisses());
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ulGroup = 0; ulGroup < ulGroups; ulGroup++) {
+      for(ul = 0; ul < BENCH_MULTI; ul++)
+         apcGroup[ul] = pcPaths +
+                        (ulGroup * BENCH_MULTI + ul) * BENCH_MAXPATH;
+      Bench_check(FT_statMany(apcGroup, BENCH_MULTI, asResults) ==
+                  SUCCESS, "FT_statMany");
+      for(ul = 0; ul < BENCH_MULTI; ul++)
+         Bench_check(asResults[ul].iStatus == SUCCESS &&
+                     asResults[ul].ulSize == 8, "FT_statMany entry");
+   }
+   (void) sprintf(acPhase, "%s statMany", pcKind);
+   Bench_report("multi", acPhase, ulGroups * BENCH_MULTI,
+                Bench_now() - dStart, Bench_stopMisses());
+}
+
+/*
+  Builds the benchmark tree, and beside it BENCH_FILES files spread
+  BENCH_GROUP to a directory, then times stats with and without
+  FT_statMany of random files of the benchmark tree, and of whole
+  directories of the other, BENCH_MULTI / BENCH_GROUP directories
+  per group with their files interleaved, as a request handler
+  might stat the assets of a page.
+*/
+static void Bench_multiGet(void) {
+   char *pcPaths;
+   size_t ulSeed = 217;
+   size_t ulGroups = BENCH_LOOKUPS / BENCH_MULTI;
+   size_t ulDirs = BENCH_MULTI / BENCH_GROUP;
+   size_t aulDirs[BENCH_MULTI / BENCH_GROUP];
+   size_t ulGroup;
+   size_t ul;
+
+   pcPaths = malloc((size_t) BENCH_LOOKUPS * BENCH_MAXPATH);
+   Bench_check(pcPaths != NULL, "malloc");
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, pcPaths);
+      Bench_check(FT_insertFile(pcPaths, pcPaths, 8) == SUCCESS,
+                  "FT_insertFile");
+      (void) sprintf(pcPaths, "root/pages/page%lu/asset%lu",
+                     (unsigned long) (ul / BENCH_GROUP),
+                     (unsigned long) ul);
+      Bench_check(FT_insertFile(pcPaths, pcPaths, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+
+   for(ul = 0; ul < ulGroups * BENCH_MULTI; ul++)
+      Bench_filePath(Bench_rand(&ulSeed) % BENCH_FILES,
+                     pcPaths + ul * BENCH_MAXPATH);
+   Bench_timeMulti("deep", pcPaths, ulGroups);
+
+   for(ulGroup = 0; ulGroup < ulGroups; ulGroup++) {
+      for(ul = 0; ul < ulDirs; ul++)
+         aulDirs[ul] = Bench_rand(&ulSeed) %
+                       (BENCH_FILES / BENCH_GROUP);
+      for(ul = 0; ul < BENCH_MULTI; ul++)
+         (void) sprintf(pcPaths +
+                        (ulGroup * BENCH_MULTI + ul) * BENCH_MAXPATH,
+                        "root/pages/page%lu/asset%lu",
+                        (unsigned long) aulDirs[ul % ulDirs],
+                        (unsigned long) (aulDirs[ul % ulDirs] *
+                                         BENCH_GROUP + ul / ulDirs));
+   }
+   Bench_timeMulti("grouped", pcPaths, ulGroups);
+
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+   free(pcPaths);
+}
+
+/*
+  Builds the benchmark tree in an FT with a Bloom filter sized for
+  half the tree, so that it must grow once, then times lookups of
+  missing files and reports how many the filter rejected.
+*/
+static void Bench_negativeLookups(void) {
+   char acPath[BENCH_MAXPATH];
+   size_t ulSeed = 217;
+   size_t ul;
+   size_t ulHits = 0;
+   double dStart;
+   size_t ulProbes;
+   size_t ulNegatives;
+   size_t ulFalsePositives;
+   size_t ulBytes;
+
+   Bench_check(FT_initWithFilter(BENCH_FILES, 0.01) == SUCCESS,
+               "FT_initWithFilter");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_LOOKUPS; ul++) {
+      Bench_filePath(BENCH_FILES + Bench_rand(&ulSeed) % BENCH_FILES,
+                     acPath);
+      ulHits += (size_t) FT_containsFile(acPath);
+   }
+   Bench_report("bloom", "containsFile miss", BENCH_LOOKUPS,
+                Bench_now() - dStart, Bench_stopMisses());
+   Bench_check(ulHits == 0, "containsFile");
+
+   /* every file must still be found through the filter */
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_containsFile(acPath), "containsFile");
+   }
+
+   FT_getFilterStats(&ulProbes, &ulNegatives, &ulFalsePositives,
+                     &ulBytes);
+   printf("bloom filter: %lu probes, %lu rejected, %lu false positives,"
+          " %lu bytes\n", (unsigned long) ulProbes,
+          (unsigned long) ulNegatives, (unsigned long) ulFalsePositives,
+          (unsigned long) ulBytes);
+
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+}
+
+/*
+  Builds the benchmark tree and times FT_rmDir of the whole of it,
+  freeing the nodes before returning if bBackground is FALSE and
+  handing them to the background reclaimer otherwise. pcLabel names
+  the run.
+*/
+static void Bench_removeTree(boolean bBackground, const char *pcLabel) {
+   char acPath[BENCH_MAXPATH];
+   size_t ul;
+   double dStart;
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   FT_setBackgroundReclaim(bBackground);
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   Bench_check(FT_rmDir("root") == SUCCESS, "FT_rmDir");
+   Bench_report(pcLabel, "rmDir whole tree", 1, Bench_now() - dStart,
+                Bench_stopMisses());
+   Bench_check(!FT_containsDir("root"), "containsDir");
+
+   /* waits for the reclaimer, if it has anything left */
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+   FT_setBackgroundReclaim(FALSE);
+}
+
+/* Sets pcBuf to the path of file ulFile of the wide directory. */
+static void Bench_widePath(size_t ulFile, char *pcBuf) {
+   (void) sprintf(pcBuf, "root/wide/f%05lu", (unsigned long) ulFile);
+}
+
+/* Sets pcBuf to the path of subdirectory ulDir of the wide directory,
+   followed by pcRest. */
+static void Bench_wideDirPath(size_t ulDir, const char *pcRest,
+                              char *pcBuf) {
+   (void) sprintf(pcBuf, "root/wide/d%05lu%s", (unsigned long) ulDir,
+                  pcRest);
+}
+
+/*
+  Checks FT_listRange and FT_indexOf against FT_toString: that pages
+  of BENCH_PAGE lines put together give the whole listing, that ranges
+  starting at or past its end, running past its end, or of no lines
+  give what is left of it, and that FT_indexOf of BENCH_SAMPLES lines
+  spread over the listing gives their line numbers. Returns the number
+  of lines.
+*/
+static size_t Bench_checkListing(void) {
+   char acPath[BENCH_MAXPATH];
+   char **ppcLines;
+   char *pcListing;
+   char *pcPage;
+   char *pcEnd;
+   size_t ulLines = 0;
+   size_t ulOffset;
+   size_t ulIndex;
+   size_t ulLength;
+   size_t ul;
+
+   pcListing = FT_toString();
+   Bench_check(pcListing != NULL, "FT_toString");
+   for(pcEnd = pcListing; *pcEnd != '\0'; pcEnd++)
+      if(*pcEnd == '\n')
+         ulLines++;
+   Bench_check(ulLines > 3, "listing length");
+
+   /* ppcLines[ul] is where line ul starts, and ppcLines[ulLines] is
+      the end */
+   ppcLines = malloc((ulLines + 1) * sizeof(char *));
+   Bench_check(ppcLines != NULL, "malloc");
+   ppcLines[0] = pcListing;
+   for(ul = 0; ul < ulLines; ul++)
+      ppcLines[ul + 1] = strchr(ppcLines[ul], '\n') + 1;
+
+   ulOffset = 0;
+   for(ul = 0; ul < ulLines; ul += BENCH_PAGE) {
+      pcPage = FT_listRange(ul, BENCH_PAGE);
+      Bench_check(pcPage != NULL, "FT_listRange");
+      ulLength = strlen(pcPage);
+      Bench_check(ppcLines[ul] == pcListing + ulOffset &&
+                  strncmp(pcPage, ppcLines[ul], ulLength) == 0,
+                  "FT_listRange page");
+      ulOffset += ulLength;
+      free(pcPage);
+   }
+   Bench_check(ulOffset == strlen(pcListing), "FT_listRange pages");
+
+   pcPage = FT_listRange(0, 0);
+   Bench_check(pcPage != NULL && *pcPage == '\0', "FT_listRange none");
+   free(pcPage);
+   pcPage = FT_listRange(ulLines, 1);
+   Bench_check(pcPage != NULL && *pcPage == '\0', "FT_listRange end");
+   free(pcPage);
+   pcPage = FT_listRange(ulLines + BENCH_PAGE, BENCH_PAGE);
+   Bench_check(pcPage != NULL && *pcPage == '\0',
+               "FT_listRange past the end");
+   free(pcPage);
+   pcPage = FT_listRange(ulLines - 3, BENCH_PAGE);
+   Bench_check(pcPage != NULL && strcmp(pcPage, ppcLines[ulLines - 3])
+               == 0, "FT_listRange running past the end");
+   free(pcPage);
+   pcPage = FT_listRange(0, ulLines + 1);
+   Bench_check(pcPage != NULL && strcmp(pcPage, pcListing) == 0,
+               "FT_listRange of all");
+   free(pcPage);
+
+   for(ul = 0; ul < BENCH_SAMPLES; ul++) {
+      /* the last line, and lines spread from the first on */
+      if(ul == 0)
+         ulIndex = ulLines - 1;
+      else
+         ulIndex = ul * (ulLines / BENCH_SAMPLES);
+      ulLength = (size_t) (ppcLines[ulIndex + 1] - ppcLines[ulIndex]);
+      ulLength--;
+      Bench_check(ulLength < BENCH_MAXPATH, "path length");
+      memcpy(acPath, ppcLines[ulIndex], ulLength);
+      acPath[ulLength] = '\0';
+      Bench_check(FT_indexOf(acPath, &ulOffset) == SUCCESS &&
+                  ulOffset == ulIndex, "FT_indexOf");
+   }
+   Bench_check(FT_indexOf("root/none", &ulOffset) == NO_SUCH_PATH,
+               "FT_indexOf of a missing path");
+
+   free(ppcLines);
+   free(pcListing);
+   return ulLines;
+}
+
+/*
+  Builds the benchmark tree, with a directory of BENCH_WIDE files and
+  subdirectories besides, and times paging through its FT_toString
+  listing: one whole FT_toString, then BENCH_PAGES pages of BENCH_PAGE
+  lines at random places with FT_listRange, and as many FT_indexOf
+  calls on random files of the deep tree and of the wide directory.
+  Checks the pages and positions against the listing before, and
+  again after removing children of the wide directory and adding a
+  file below it.
+*/
+static void Bench_listPages(void) {
+   char acPath[BENCH_MAXPATH];
+   size_t ulSeed = 4;
+   size_t ulLines;
+   size_t ulIndex;
+   size_t ul;
+   double dStart;
+   char *pcListing;
+
+   Bench_check(FT_init() == SUCCESS, "FT_init");
+   Bench_check(FT_insertDir("root") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_FILES; ul++) {
+      Bench_filePath(ul, acPath);
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+   /* a file for every subdirectory holding a file, so that the
+      subtrees of the wide directory's children differ in size */
+   Bench_check(FT_insertDir("root/wide") == SUCCESS, "FT_insertDir");
+   for(ul = 0; ul < BENCH_WIDE; ul++) {
+      if(ul % 2 == 0)
+         Bench_widePath(ul, acPath);
+      else {
+         Bench_wideDirPath(ul, "", acPath);
+         Bench_check(FT_insertDir(acPath) == SUCCESS, "FT_insertDir");
+         Bench_wideDirPath(ul, "/f", acPath);
+      }
+      Bench_check(FT_insertFile(acPath, acPath, 8) == SUCCESS,
+                  "FT_insertFile");
+   }
+   ulLines = Bench_checkListing();
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   pcListing = FT_toString();
+   Bench_report("whole", "toString", 1, Bench_now() - dStart,
+                Bench_stopMisses());
+   Bench_check(pcListing != NULL, "FT_toString");
+   free(pcListing);
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_PAGES; ul++) {
+      pcListing = FT_listRange(Bench_rand(&ulSeed) % ulLines,
+                               BENCH_PAGE);
+      Bench_check(pcListing != NULL, "FT_listRange");
+      free(pcListing);
+   }
+   Bench_report("page", "listRange", BENCH_PAGES, Bench_now() - dStart,
+                Bench_stopMisses());
+
+   Bench_startMisses();
+   dStart = Bench_now();
+   for(ul = 0; ul < BENCH_PAGES; ul++) {
+      if(ul % 2 == 0)
+         Bench_filePath(Bench_rand(&ulSeed) % BENCH_FILES, acPath);
+      else
+         Bench_widePath(Bench_rand(&ulSeed) % (BENCH_WIDE / 2) * 2,
+                        acPath);
+      Bench_check(FT_indexOf(acPath, &ulIndex) == SUCCESS,
+                  "FT_indexOf");
+   }
+   Bench_report("page", "indexOf", BENCH_PAGES, Bench_now() - dStart,
+                Bench_stopMisses());
+
+   /* the wide directory's sums are kept now, and must not go stale,
+      whether its children or their subtrees change */
+   for(ul = 0; ul < BENCH_WIDE; ul += 7) {
+      if(ul % 2 == 0) {
+         Bench_widePath(ul, acPath);
+         Bench_check(FT_rmFile(acPath) == SUCCESS, "FT_rmFile");
+      }
+      else {
+         Bench_wideDirPath(ul, "", acPath);
+         Bench_check(FT_rmDir(acPath) == SUCCESS, "FT_rmDir");
+      }
+   }
+   (void) Bench_checkListing();
+   Bench_wideDirPath(BENCH_WIDE / 2 + 1, "/g", acPath);
+   Bench_check(FT_insertFile(acPath, "g", 1) == SUCCESS,
+               "FT_insertFile");
+   (void) Bench_checkListing();
+
+   Bench_check(FT_destroy() == SUCCESS, "FT_destroy");
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Runs the FT benchmarks, printing one line per timed phase to
+   stdout. Returns 0. */
+int main(void) {
+   Bench_openMissCounter();
+   if(iMissCounter < 0)
+      fprintf(stderr, "ft_bench: cache-miss counter unavailable\n");
+
+   Bench_deepLookups(FALSE, "walk");
+   Bench_deepLookups(TRUE, "cache");
+   Bench_siblings();
+   Bench_optimisticSiblings();
+   Bench_batchInsert();
+   Bench_bulkLoad();
+   Bench_multiGet();
+   Bench_negativeLookups();
+   Bench_removeTree(FALSE, "sync");
+   Bench_removeTree(TRUE, "bg");
+   Bench_listPages();
+   return 0;
+}
@@ -0,0 +1,411 @@
+/*--------------------------------------------------------------------*/
+/* ft_mtbench.c                                                       */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for clock_gettime, sysconf, and pthreads */
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ft.h"
+
+/* Benchmark parameters */
+enum {
+   /* number of directories under the root */
+   MT_DIRS = 64,
+   /* number of files in each directory */
+   MT_FILES_PER_DIR = 64,
+   /* number of operations each thread performs */
+   MT_OPS_PER_THREAD = 200000,
+   /* percentage of operations that replace a file's contents; the
+      rest look files up */
+   MT_WRITE_PERCENT = 5,
+   /* room for any generated path */
+   MT_MAXPATH = 64,
+   /* number of shards in the sharded run */
+   MT_SHARDS = 16,
+   /* number of files each thread inserts and removes in a burst */
+   MT_BURST_FILES = 256,
+   /* most threads in the burst runs */
+   MT_BURST_THREADS = 64,
+   /* number of subtrees under the root in the parallel build, and of
+      files in each */
+   MT_BUILD_DIRS = 256,
+   MT_BUILD_FILES = 512
+};
+
+/* The tree that every thread works on */
+static FT_T oFTShared;
+
+/* The arguments of one worker thread */
+struct worker {
+   /* the state of the thread's random number generator */
+   unsigned long ulSeed;
+   /* the number of lookups that found their file */
+   size_t ulFound;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the current monotonic time in seconds. */
+static double MtBench_now(void) {
+   struct timespec sNow;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double) sNow.tv_sec + (double) sNow.tv_nsec / 1e9;
+}
+
+/*
+  Exits with an error message naming pcWhat unless bOk is TRUE. Used
+  instead of assert so that the benchmark still checks its work when
+  compiled with NDEBUG.
+*/
+static void MtBench_check(boolean bOk, const char *pcWhat) {
+   if(!bOk) {
+      fprintf(stderr, "ft_mtbench: %s failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+   }
+}
+
+/* Advances *pulSeed and returns a pseudo-random number from it. */
+static unsigned long MtBench_random(unsigned long *pulSeed) {
+   *pulSeed = *pulSeed * 6364136223846793005UL + 1442695040888963407UL;
+   return *pulSeed >> 16;
+}
+
+/* Writes the path of file ulFile into pcPath. */
+static void MtBench_filePath(char *pcPath, size_t ulFile) {
+   sprintf(pcPath, "root/d%lu/f%lu",
+           (unsigned long) (ulFile / MT_FILES_PER_DIR),
+           (unsigned long) (ulFile % MT_FILES_PER_DIR));
+}
+
+/*
+  Performs MT_OPS_PER_THREAD operations on oFTShared, each on a random
+  file: MT_WRITE_PERCENT percent replace its contents and the rest
+  alternate between FT_containsFileIn and FT_statIn. pvWorker is the
+  thread's struct worker. Returns NULL.
+*/
+static void *MtBench_work(void *pvWorker) {
+   struct worker *psWorker = pvWorker;
+   char acPath[MT_MAXPATH];
+   unsigned long ulRandom;
+   boolean bIsFile;
+   size_t ulSize;
+   size_t ul;
+   void *pvOld;
+
+   for(ul = 0; ul < MT_OPS_PER_THREAD; ul++) {
+      ulRandom = MtBench_random(&psWorker->ulSeed);
+      MtBench_filePath(acPath, ulRandom % (MT_DIRS * MT_FILES_PER_DIR));
+      ulRandom /= MT_DIRS * MT_FILES_PER_DIR;
+
+      if(ulRandom % 100 < MT_WRITE_PERCENT) {
+         /* the FT keeps a copy, and hands back the old contents */
+         pvOld = FT_replaceFileContentsIn(oFTShared, acPath, acPath,
+                                          strlen(acPath) + 1);
+         MtBench_check(pvOld != NULL, "FT_replaceFileContentsIn");
+         free(pvOld);
+         psWorker->ulFound++;
+      }
+      else if(ulRandom % 2 == 0) {
+         if(FT_containsFileIn(oFTShared, acPath))
+            psWorker->ulFound++;
+      }
+      else if(FT_statIn(oFTShared, acPath, &bIsFile, &ulSize)
+              == SUCCESS && bIsFile)
+         psWorker->ulFound++;
+   }
+   return NULL;
+}
+
+/*
+  Runs the workload on ulThreads threads at once and returns the
+  number of operations per second they achieved together.
+*/
+static double MtBench_run(size_t ulThreads) {
+   pthread_t *psThreads;
+   struct worker *psWorkers;
+   double dStart, dSeconds;
+   size_t ul;
+
+   psThreads = calloc(ulThreads, sizeof(pthread_t));
+   psWorkers = calloc(ulThreads, sizeof(struct worker));
+   MtBench_check(psThreads != NULL && psWorkers != NULL, "calloc");
+
+   dStart = MtBench_now();
+   for(ul = 0; ul < ulThreads; ul++) {
+      psWorkers[ul].ulSeed = ul + 1;
+      MtBench_check(pthread_create(&psThreads[ul], NULL, MtBench_work,
+                                   &psWorkers[ul]) == 0,
+                    "pthread_create");
+   }
+   for(ul = 0; ul < ulThreads; ul++)
+      MtBench_check(pthread_join(psThreads[ul], NULL) == 0,
+                    "pthread_join");
+   dSeconds = MtBench_now() - dStart;
+
+   /* every path names an existing file */
+   for(ul = 0; ul < ulThreads; ul++)
+      MtBench_check(psWorkers[ul].ulFound == MT_OPS_PER_THREAD,
+                    "lookup");
+
+   free(psThreads);
+   free(psWorkers);
+   return (double) (ulThreads * MT_OPS_PER_THREAD) / dSeconds;
+}
+
+/*
+  Builds oFTShared, locked with eLocking, split into ulShards shards
+  unless ulShards is 0, and with the path cache on if that mode allows
+  it, holding MT_DIRS * MT_FILES_PER_DIR files, then
+  runs the workload on 1, 2, 4, ... threads up to ulMaxThreads and
+  reports the throughput and speedup over one thread under the name
+  pcMode.
+*/
+static void MtBench_mode(FT_Locking eLocking, size_t ulShards,
+                         const char *pcMode, size_t ulMaxThreads) {
+   char acPath[MT_MAXPATH];
+   size_t ulThreads;
+   size_t ul;
+   double dOne = 0.0;
+   double dRate;
+
+   if(ulShards == 0)
+      MtBench_check(FT_new(&oFTShared) == SUCCESS, "FT_new");
+   else
+      MtBench_check(FT_newSharded(ulShards, &oFTShared) == SUCCESS,
+                    "FT_newSharded");
+   MtBench_check(FT_setLockingIn(oFTShared, eLocking) == SUCCESS,
+                 "FT_setLockingIn");
+   if(eLocking != FT_LOCK_OPTIMISTIC)
+      MtBench_check(FT_setPathCacheIn(oFTShared, TRUE) == SUCCESS,
+                    "FT_setPathCacheIn");
+   MtBench_check(FT_insertDirIn(oFTShared, "root") == SUCCESS,
+                 "FT_insertDirIn");
+   for(ul = 0; ul < MT_DIRS * MT_FILES_PER_DIR; ul++) {
+      MtBench_filePath(acPath, ul);
+      MtBench_check(FT_insertFileIn(oFTShared, acPath, acPath,
+                                    strlen(acPath) + 1) == SUCCESS,
+                    "FT_insertFileIn");
+   }
+
+   printf("%s\n", pcMode);
+   printf("%8s %14s %9s\n", "threads", "ops/s", "speedup");
+
+   /* double the thread count each round, ending at exactly the
+      maximum */
+   for(ulThreads = 1; ; ulThreads *= 2) {
+      if(ulThreads > ulMaxThreads)
+         ulThreads = ulMaxThreads;
+      dRate = MtBench_run(ulThreads);
+      if(ulThreads == 1)
+         dOne = dRate;
+      printf("%8lu %14.0f %8.2fx\n", (unsigned long) ulThreads, dRate,
+             dRate / dOne);
+      if(ulThreads == ulMaxThreads)
+         break;
+   }
+
+   FT_free(oFTShared);
+   oFTShared = NULL;
+}
+
+/*
+  Inserts MT_BURST_FILES files into the one directory root/hot of
+  oFTShared, named after the thread number that pvThread points to,
+  then removes them all again. Returns NULL.
+*/
+static void *MtBench_burst(void *pvThread) {
+   size_t ulThread = *(size_t *) pvThread;
+   char acPath[MT_MAXPATH];
+   size_t ul;
+
+   for(ul = 0; ul < MT_BURST_FILES; ul++) {
+      sprintf(acPath, "root/hot/t%luf%lu", (unsigned long) ulThread,
+              (unsigned long) ul);
+      MtBench_check(FT_insertFileIn(oFTShared, acPath, NULL, 0)
+                    == SUCCESS, "FT_insertFileIn");
+   }
+   for(ul = 0; ul < MT_BURST_FILES; ul++) {
+      sprintf(acPath, "root/hot/t%luf%lu", (unsigned long) ulThread,
+              (unsigned long) ul);
+      MtBench_check(FT_rmFileIn(oFTShared, acPath) == SUCCESS,
+                    "FT_rmFileIn");
+   }
+   return NULL;
+}
+
+/*
+  Runs the insert bursts on 1, 2, 4, ... MT_BURST_THREADS threads at
+  once against a new FT locked with eLocking, and reports the
+  throughput and speedup over one thread under the name pcMode.
+*/
+static void MtBench_burstMode(FT_Locking eLocking, const char *pcMode) {
+   pthread_t asThreads[MT_BURST_THREADS];
+   size_t aulThreads[MT_BURST_THREADS];
+   size_t ulThreads;
+   size_t ul;
+   double dStart, dRate;
+   double dOne = 0.0;
+
+   MtBench_check(FT_new(&oFTShared) == SUCCESS, "FT_new");
+   MtBench_check(FT_setLockingIn(oFTShared, eLocking) == SUCCESS,
+                 "FT_setLockingIn");
+   MtBench_check(FT_insertDirIn(oFTShared, "root/hot") == SUCCESS,
+                 "FT_insertDirIn");
+
+   printf("%s\n", pcMode);
+   printf("%8s %14s %9s\n", "threads", "ops/s", "speedup");
+
+   for(ulThreads = 1; ulThreads <= MT_BURST_THREADS; ulThreads *= 2) {
+      dStart = MtBench_now();
+      for(ul = 0; ul < ulThreads; ul++) {
+         aulThreads[ul] = ul;
+         MtBench_check(pthread_create(&asThreads[ul], NULL,
+                                      MtBench_burst, &aulThreads[ul])
+                       == 0, "pthread_create");
+      }
+      for(ul = 0; ul < ulThreads; ul++)
+         MtBench_check(pthread_join(asThreads[ul], NULL) == 0,
+                       "pthread_join");
+      dRate = (double) (2 * ulThreads * MT_BURST_FILES) /
+              (MtBench_now() - dStart);
+
+      if(ulThreads == 1)
+         dOne = dRate;
+      printf("%8lu %14.0f %8.2fx\n", (unsigned long) ulThreads, dRate,
+             dRate / dOne);
+   }
+
+   MtBench_check(FT_isValidIn(oFTShared), "FT_isValidIn");
+   FT_free(oFTShared);
+   oFTShared = NULL;
+}
+
+/*
+  Builds a new FT from one batch of MT_BUILD_DIRS subtrees of
+  MT_BUILD_FILES files each, listed in no particular order, with
+  FT_buildParallelIn on 1, 2, 4, ... threads up to ulMaxThreads, and
+  reports the entries inserted per second and the speedup over one
+  thread, checking that every build gives the same tree.
+*/
+static void MtBench_buildMode(size_t ulMaxThreads) {
+   struct ftBatchEntry *psEntries;
+   int *piResults;
+   char *pcPaths;
+   char *pcOne = NULL;
+   char *pcTree;
+   size_t ulCount = MT_BUILD_DIRS * MT_BUILD_FILES;
+   size_t ulThreads;
+   size_t ul;
+   double dStart, dRate;
+   double dOne = 0.0;
+
+   psEntries = calloc(ulCount, sizeof(struct ftBatchEntry));
+   piResults = calloc(ulCount, sizeof(int));
+   pcPaths = malloc(ulCount * MT_MAXPATH);
+   MtBench_check(psEntries != NULL && piResults != NULL &&
+                 pcPaths != NULL, "malloc");
+   for(ul = 0; ul < ulCount; ul++) {
+      /* consecutive entries fall in different subtrees */
+      sprintf(pcPaths + ul * MT_MAXPATH, "root/d%lu/s%lu/f%lu",
+              (unsigned long) (ul % MT_BUILD_DIRS),
+              (unsigned long) (ul / MT_BUILD_DIRS % 8),
+              (unsigned long) (ul / MT_BUILD_DIRS));
+      psEntries[ul].pcPath = pcPaths + ul * MT_MAXPATH;
+      psEntries[ul].bIsFile = TRUE;
+      psEntries[ul].pvContents = pcPaths + ul * MT_MAXPATH;
+      psEntries[ul].ulLength = strlen(psEntries[ul].pcPath) + 1;
+   }
+
+   printf("parallel build\n");
+   printf("%8s %14s %9s\n", "threads", "entries/s", "speedup");
+
+   for(ulThreads = 1; ; ulThreads *= 2) {
+      if(ulThreads > ulMaxThreads)
+         ulThreads = ulMaxThreads;
+      MtBench_check(FT_new(&oFTShared) == SUCCESS, "FT_new");
+      MtBench_check(FT_insertDirIn(oFTShared, "root") == SUCCESS,
+                    "FT_insertDirIn");
+      dStart = MtBench_now();
+      MtBench_check(FT_buildParallelIn(oFTShared, psEntries, ulCount,
+                                       ulThreads, piResults)
+                    == SUCCESS, "FT_buildParallelIn");
+      dRate = (double) ulCount / (MtBench_now() - dStart);
+      for(ul = 0; ul < ulCount; ul++)
+         MtBench_check(piResults[ul] == SUCCESS, "insert");
+
+      pcTree = FT_toStringIn(oFTShared);
+      MtBench_check(pcTree != NULL, "FT_toStringIn");
+      if(ulThreads == 1) {
+         dOne = dRate;
+         pcOne = pcTree;
+      }
+      else {
+         MtBench_check(strcmp(pcOne, pcTree) == 0, "same tree");
+         free(pcTree);
+      }
+      FT_free(oFTShared);
+      oFTShared = NULL;
+
+      printf("%8lu %14.0f %8.2fx\n", (unsigned long) ulThreads, dRate,
+             dRate / dOne);
+      if(ulThreads == ulMaxThreads)
+         break;
+   }
+
+   free(pcOne);
+   free(pcPaths);
+   free(piResults);
+   free(psEntries);
+}
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Runs the workload under the whole-tree lock, under lock-free
+  lookups, and split into MT_SHARDS shards, each on 1, 2, 4, ...
+  threads up to the number of online processors, or up to argv[1]
+  threads if given. Then runs the insert bursts under the whole-tree
+  lock, which writers hold as a plain mutex, and under flat
+  combining, and last builds a tree from one batch in parallel.
+  Returns 0, or exits
+  with EXIT_FAILURE if anything goes wrong.
+*/
+int main(int argc, char *argv[]) {
+   size_t ulMaxThreads;
+   long lCPUs;
+
+   lCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+   ulMaxThreads = (lCPUs > 0) ? (size_t) lCPUs : 1;
+   if(argc > 1)
+      ulMaxThreads = (size_t) strtoul(argv[1], NULL, 10);
+   MtBench_check(ulMaxThreads > 0, "thread count");
+
+   printf("%d%% lookups, %d ops per thread, %lu processors online\n",
+          100 - MT_WRITE_PERCENT, MT_OPS_PER_THREAD,
+          (unsigned long) lCPUs);
+   MtBench_mode(FT_LOCK_TREE, 0, "tree lock, path cache",
+                ulMaxThreads);
+   MtBench_mode(FT_LOCK_OPTIMISTIC, 0, "lock-free lookups",
+                ulMaxThreads);
+   MtBench_mode(FT_LOCK_TREE, MT_SHARDS, "sharded, path cache",
+                ulMaxThreads);
+
+   printf("\ninsert bursts into one directory, %d files per thread\n",
+          MT_BURST_FILES);
+   MtBench_burstMode(FT_LOCK_TREE, "tree lock");
+   MtBench_burstMode(FT_LOCK_COMBINING, "flat combining");
+
+   printf("\n%d subtrees of %d files, inserted as one batch\n",
+          MT_BUILD_DIRS, MT_BUILD_FILES);
+   MtBench_buildMode(ulMaxThreads);
+   return 0;
+}
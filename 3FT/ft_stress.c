@@ -0,0 +1,941 @@
+/*--------------------------------------------------------------------*/
+/* ft_stress.c                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for clock_gettime and pthreads */
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "ft.h"
+#include "ftqueue.h"
+
+/* Stress parameters */
+enum {
+   /* default depth of the chain of directories */
+   STRESS_DEFAULT_DEPTH = 4000,
+   /* stack size of the thread that runs the workload: far too small
+      for any walk whose stack use grows with the tree's depth */
+   STRESS_STACK_SIZE = 64 * 1024,
+   /* number of threads in the concurrent workload, each ingesting
+      into its own tenant directory */
+   STRESS_TENANTS = 8,
+   /* number of directories each tenant creates */
+   STRESS_TENANT_DIRS = 64,
+   /* number of files in each of those directories */
+   STRESS_TENANT_FILES = 32,
+   /* room for any generated path */
+   STRESS_MAXPATH = 64,
+   /* number of operations run through an FTQueue_T, and its entries:
+      far fewer, so that the rings wrap around */
+   STRESS_QUEUE_OPS = 1000,
+   STRESS_QUEUE_ENTRIES = 8,
+   /* most results reaped at once */
+   STRESS_QUEUE_REAP = 3
+};
+
+/* The depth of the chain built by the workload */
+static size_t ulChainDepth = STRESS_DEFAULT_DEPTH;
+
+/* The tree that the threads of the concurrent workload share */
+static FT_T oFTShared;
+
+/* Returns the current monotonic time in seconds. */
+static double Stress_now(void) {
+   struct timespec sNow;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double) sNow.tv_sec + (double) sNow.tv_nsec / 1e9;
+}
+
+/*
+  Exits with an error message naming pcWhat unless bOk is TRUE. Used
+  instead of assert so that the workload still runs when compiled with
+  NDEBUG.
+*/
+static void Stress_check(boolean bOk, const char *pcWhat) {
+   if(!bOk) {
+      fprintf(stderr, "ft_stress: %s failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+   }
+}
+
+/* Prints the time taken by phase pcPhase, which began at dStart. */
+static void Stress_report(const char *pcPhase, double dStart) {
+   printf("%-12s %10.3f s\n", pcPhase, Stress_now() - dStart);
+}
+
+/*
+  Builds a chain of ulChainDepth directories a/a/.../a with one file
+  at the bottom, looks up the deepest nodes, renders the whole tree
+  with FT_toString, removes and rebuilds the chain, and destroys the
+  tree. pvArg is unused. Returns NULL.
+*/
+static void *Stress_deepChain(void *pvArg) {
+   char *pcPath;
+   char *pcDump;
+   size_t ulLength;
+   size_t ulExpected;
+   size_t ul;
+   double dStart;
+
+   (void) pvArg;
+
+   /* "a/a/.../a" of depth ulChainDepth, plus room for "/f" */
+   ulLength = 2 * ulChainDepth - 1;
+   pcPath = malloc(ulLength + 3);
+   Stress_check(pcPath != NULL, "malloc");
+   for(ul = 0; ul < ulLength; ul++)
+      pcPath[ul] = (ul % 2 == 0) ? 'a' : '/';
+   pcPath[ulLength] = '\0';
+
+   Stress_check(FT_init() == SUCCESS, "FT_init");
+
+   dStart = Stress_now();
+   Stress_check(FT_insertDir(pcPath) == SUCCESS, "FT_insertDir");
+   strcpy(pcPath + ulLength, "/f");
+   Stress_check(FT_insertFile(pcPath, "x", 1) == SUCCESS,
+                "FT_insertFile");
+   Stress_report("insert", dStart);
+
+   dStart = Stress_now();
+   Stress_check(FT_containsFile(pcPath), "FT_containsFile");
+   pcPath[ulLength] = '\0';
+   Stress_check(FT_containsDir(pcPath), "FT_containsDir");
+   Stress_report("lookup", dStart);
+
+   /* line i of the dump is the depth-i path, 2i-1 chars plus a
+      newline; the file adds 2*depth+1 chars plus a newline */
+   dStart = Stress_now();
+   pcDump = FT_toString();
+   Stress_check(pcDump != NULL, "FT_toString");
+   ulExpected = ulChainDepth * ulChainDepth + 3 * ulChainDepth + 2;
+   Stress_check(strlen(pcDump) == ulExpected, "FT_toString length");
+   free(pcDump);
+   Stress_report("toString", dStart);
+
+   dStart = Stress_now();
+   Stress_check(FT_rmDir("a/a") == SUCCESS, "FT_rmDir");
+   Stress_check(!FT_containsDir("a/a"), "FT_rmDir result");
+   Stress_report("rmDir", dStart);
+
+   dStart = Stress_now();
+   Stress_check(FT_insertDir(pcPath) == SUCCESS, "FT_insertDir");
+   Stress_check(FT_destroy() == SUCCESS, "FT_destroy");
+   Stress_report("destroy", dStart);
+
+   free(pcPath);
+   return NULL;
+}
+
+/*
+  Ingests into tenant directory root/t<K> of oFTShared, where K is
+  the size_t that pvTenant points to: creates STRESS_TENANT_DIRS
+  directories of STRESS_TENANT_FILES files each, replacing and
+  statting each file and looking up the same file in the next tenant
+  along the way, then removes every odd-numbered directory again.
+  Returns NULL.
+*/
+static void *Stress_tenant(void *pvTenant) {
+   size_t ulTenant = *(size_t *) pvTenant;
+   size_t ulOther = (ulTenant + 1) % STRESS_TENANTS;
+   char acPath[STRESS_MAXPATH];
+   boolean bIsFile;
+   size_t ulSize;
+   size_t ulDir;
+   size_t ulFile;
+   void *pvOld;
+
+   sprintf(acPath, "root/t%lu", (unsigned long) ulTenant);
+   Stress_check(FT_insertDirIn(oFTShared, acPath) == SUCCESS,
+                "FT_insertDirIn tenant");
+
+   for(ulDir = 0; ulDir < STRESS_TENANT_DIRS; ulDir++) {
+      sprintf(acPath, "root/t%lu/d%lu", (unsigned long) ulTenant,
+              (unsigned long) ulDir);
+      Stress_check(FT_insertDirIn(oFTShared, acPath) == SUCCESS,
+                   "FT_insertDirIn");
+      for(ulFile = 0; ulFile < STRESS_TENANT_FILES; ulFile++) {
+         sprintf(acPath, "root/t%lu/d%lu/f%lu",
+                 (unsigned long) ulTenant, (unsigned long) ulDir,
+                 (unsigned long) ulFile);
+         Stress_check(FT_insertFileIn(oFTShared, acPath, acPath,
+                                      strlen(acPath) + 1) == SUCCESS,
+                      "FT_insertFileIn");
+
+         /* the FT keeps a copy, and hands back the old contents */
+         pvOld = FT_replaceFileContentsIn(oFTShared, acPath, "x", 1);
+         Stress_check(pvOld != NULL, "FT_replaceFileContentsIn");
+         free(pvOld);
+         Stress_check(FT_statIn(oFTShared, acPath, &bIsFile, &ulSize)
+                      == SUCCESS && bIsFile && ulSize == 1,
+                      "FT_statIn");
+
+         /* the other tenant's file may or may not exist yet */
+         sprintf(acPath, "root/t%lu/d%lu/f%lu",
+                 (unsigned long) ulOther, (unsigned long) ulDir,
+                 (unsigned long) ulFile);
+         (void) FT_containsFileIn(oFTShared, acPath);
+      }
+   }
+
+   for(ulDir = 1; ulDir < STRESS_TENANT_DIRS; ulDir += 2) {
+      sprintf(acPath, "root/t%lu/d%lu", (unsigned long) ulTenant,
+              (unsigned long) ulDir);
+      Stress_check(FT_rmDirIn(oFTShared, acPath) == SUCCESS,
+                   "FT_rmDirIn");
+   }
+   return NULL;
+}
+
+/*
+  Does what Stress_tenant does for the tenant that pvTenant points
+  to, but in transactions: each directory is filled in one, after
+  another that removes the directory filled last and fills a
+  directory of the same name with something else is aborted, and
+  the odd-numbered directories are removed in one more. Returns NULL.
+*/
+static void *Stress_txnTenant(void *pvTenant) {
+   size_t ulTenant = *(size_t *) pvTenant;
+   size_t ulOther = (ulTenant + 1) % STRESS_TENANTS;
+   char acPath[STRESS_MAXPATH];
+   boolean bIsFile;
+   size_t ulSize;
+   size_t ulDir;
+   size_t ulFile;
+   FTTxn_T oT;
+
+   sprintf(acPath, "root/t%lu", (unsigned long) ulTenant);
+   Stress_check(FT_insertDirIn(oFTShared, acPath) == SUCCESS,
+                "FT_insertDirIn tenant");
+
+   for(ulDir = 0; ulDir < STRESS_TENANT_DIRS; ulDir++) {
+      if(ulDir > 0) {
+         Stress_check(FT_beginIn(oFTShared, &oT) == SUCCESS,
+                      "FT_beginIn");
+         sprintf(acPath, "root/t%lu/d%lu", (unsigned long) ulTenant,
+                 (unsigned long) (ulDir - 1));
+         Stress_check(FT_txnRmDir(oT, acPath) == SUCCESS,
+                      "FT_txnRmDir");
+         Stress_check(FT_txnInsertFile(oT, acPath, "y", 1) ==
+                      SUCCESS, "FT_txnInsertFile");
+         FT_abort(oT);
+      }
+
+      Stress_check(FT_beginIn(oFTShared, &oT) == SUCCESS,
+                   "FT_beginIn");
+      sprintf(acPath, "root/t%lu/d%lu", (unsigned long) ulTenant,
+              (unsigned long) ulDir);
+      Stress_check(FT_txnInsertDir(oT, acPath) == SUCCESS,
+                   "FT_txnInsertDir");
+      for(ulFile = 0; ulFile < STRESS_TENANT_FILES; ulFile++) {
+         sprintf(acPath, "root/t%lu/d%lu/f%lu",
+                 (unsigned long) ulTenant, (unsigned long) ulDir,
+                 (unsigned long) ulFile);
+         Stress_check(FT_txnInsertFile(oT, acPath, acPath,
+                                       strlen(acPath) + 1) == SUCCESS,
+                      "FT_txnInsertFile");
+         Stress_check(FT_txnReplaceFileContents(oT, acPath, "x", 1)
+                      == SUCCESS, "FT_txnReplaceFileContents");
+      }
+      FT_commit(oT);
+
+      /* the other tenant's file may or may not exist yet */
+      sprintf(acPath, "root/t%lu/d%lu/f0", (unsigned long) ulOther,
+              (unsigned long) ulDir);
+      (void) FT_containsFileIn(oFTShared, acPath);
+      sprintf(acPath, "root/t%lu/d%lu/f0", (unsigned long) ulTenant,
+              (unsigned long) ulDir);
+      Stress_check(FT_statIn(oFTShared, acPath, &bIsFile, &ulSize)
+                   == SUCCESS && bIsFile && ulSize == 1, "FT_statIn");
+   }
+
+   Stress_check(FT_beginIn(oFTShared, &oT) == SUCCESS, "FT_beginIn");
+   for(ulDir = 1; ulDir < STRESS_TENANT_DIRS; ulDir += 2) {
+      sprintf(acPath, "root/t%lu/d%lu", (unsigned long) ulTenant,
+              (unsigned long) ulDir);
+      Stress_check(FT_txnRmDir(oT, acPath) == SUCCESS, "FT_txnRmDir");
+   }
+   FT_commit(oT);
+   return NULL;
+}
+
+/*
+  Runs workload pfTenant, Stress_tenant or Stress_txnTenant, on
+  STRESS_TENANTS threads at once against a new FT locked with
+  eLocking, and split into ulShards shards unless ulShards is 0,
+  reports the time taken under the name pcMode, then checks the FT's
+  invariants and that exactly the expected nodes remain, in the
+  expected order.
+*/
+static void Stress_concurrent(void *(*pfTenant)(void *),
+                              FT_Locking eLocking, size_t ulShards,
+                              const char *pcMode) {
+   pthread_t asThreads[STRESS_TENANTS];
+   size_t aulTenants[STRESS_TENANTS];
+   char acPath[STRESS_MAXPATH];
+   char *pcDump;
+   size_t ulLines;
+   size_t ulExpected;
+   size_t ul;
+   double dStart;
+
+   if(ulShards == 0)
+      Stress_check(FT_new(&oFTShared) == SUCCESS, "FT_new");
+   else
+      Stress_check(FT_newSharded(ulShards, &oFTShared) == SUCCESS,
+                   "FT_newSharded");
+   Stress_check(FT_setLockingIn(oFTShared, eLocking) == SUCCESS,
+                "FT_setLockingIn");
+   Stress_check(FT_insertDirIn(oFTShared, "root") == SUCCESS,
+                "FT_insertDirIn root");
+
+   dStart = Stress_now();
+   for(ul = 0; ul < STRESS_TENANTS; ul++) {
+      aulTenants[ul] = ul;
+      Stress_check(pthread_create(&asThreads[ul], NULL, pfTenant,
+                                  &aulTenants[ul]) == 0,
+                   "pthread_create");
+   }
+   for(ul = 0; ul < STRESS_TENANTS; ul++)
+      Stress_check(pthread_join(asThreads[ul], NULL) == 0,
+                   "pthread_join");
+   Stress_report(pcMode, dStart);
+
+   Stress_check(FT_isValidIn(oFTShared), "FT_isValidIn");
+
+   /* the root, and per tenant its directory and the even-numbered
+      directories with their files */
+   ulExpected = 1 + STRESS_TENANTS *
+      (1 + (STRESS_TENANT_DIRS / 2) * (1 + STRESS_TENANT_FILES));
+   pcDump = FT_toStringIn(oFTShared);
+   Stress_check(pcDump != NULL, "FT_toStringIn");
+   ulLines = 0;
+   for(ul = 0; pcDump[ul] != '\0'; ul++)
+      if(pcDump[ul] == '\n')
+         ulLines++;
+   Stress_check(ulLines == ulExpected, "node count");
+   /* the tenants come in order after the root, however sharded */
+   Stress_check(strncmp(pcDump, "root\nroot/t0\nroot/t0/d0\n",
+                        24) == 0, "FT_toStringIn order");
+   free(pcDump);
+
+   for(ul = 0; ul < STRESS_TENANTS; ul++) {
+      sprintf(acPath, "root/t%lu/d0/f0", (unsigned long) ul);
+      Stress_check(FT_containsFileIn(oFTShared, acPath),
+                   "kept file");
+      sprintf(acPath, "root/t%lu/d1", (unsigned long) ul);
+      Stress_check(!FT_containsDirIn(oFTShared, acPath),
+                   "removed directory");
+   }
+
+   FT_free(oFTShared);
+   oFTShared = NULL;
+}
+
+/* The paths that queued lookups read, some of them missing, under a
+   file, or not valid paths at all */
+static const char *const apcQueueReads[] = {
+   "q/f0", "q/f1", "q/empty", "q", "q/m0", "q/m1", "q/d0", "q/d1",
+   "q/d0/m0", "q/f0/x", "gone/x", "q/none", "/q"
+};
+
+/* The paths that queued changes write, all but q/d0/m0 and the bad
+   ones at the top of the subtree that the lookups may read from */
+static const char *const apcQueueWrites[] = {
+   "q/m0", "q/m1", "q/d0", "q/d1", "q/d0/m0", "q/m0/x", "gone/m",
+   "/m"
+};
+
+/* The contents of every file that a queued FTQ_INSERT_FILE makes */
+static char acQueueData[] = "queued";
+
+/*
+  Sets *psSub to operation ulOp of the queue workload: mostly lookups
+  of apcQueueReads, mixed with changes to apcQueueWrites. pvUser
+  holds ulOp, so that completions can be matched to submissions.
+*/
+static void Stress_queueOp(size_t ulOp, struct ftqSubmission *psSub) {
+   size_t ulReads = sizeof(apcQueueReads) / sizeof(apcQueueReads[0]);
+   size_t ulWrites = sizeof(apcQueueWrites) /
+                     sizeof(apcQueueWrites[0]);
+
+   psSub->eOp = (FTQ_Op) (ulOp % 6);
+   if(psSub->eOp == FTQ_STAT || psSub->eOp == FTQ_GET_FILE_CONTENTS)
+      psSub->pcPath = apcQueueReads[(ulOp * 7) % ulReads];
+   else
+      psSub->pcPath = apcQueueWrites[(ulOp * 5) % ulWrites];
+   psSub->pvContents = acQueueData;
+   psSub->ulLength = (ulOp % 4 == 1) ? 0 : sizeof(acQueueData);
+   psSub->pvUser = (void *) ulOp;
+}
+
+/*
+  Runs psSub on oFTMirror with the synchronous FT_ functions, and
+  checks that psResult, the queue's result for it, agrees: the same
+  status, the same kind and size of a node found, and the same bytes
+  of contents for the files under q that only lookups touch.
+*/
+static void Stress_queueCompare(FT_T oFTMirror,
+                                const struct ftqSubmission *psSub,
+                                const struct ftqCompletion *psResult) {
+   boolean bIsFile = FALSE;
+   size_t ulSize = 0;
+   void *pvContents;
+   int iStatus;
+
+   switch(psSub->eOp) {
+      case FTQ_INSERT_DIR:
+         iStatus = FT_insertDirIn(oFTMirror, psSub->pcPath);
+         break;
+      case FTQ_INSERT_FILE:
+         iStatus = FT_insertFileIn(oFTMirror, psSub->pcPath,
+                                   psSub->pvContents, psSub->ulLength);
+         break;
+      case FTQ_RM_DIR:
+         iStatus = FT_rmDirIn(oFTMirror, psSub->pcPath);
+         break;
+      case FTQ_RM_FILE:
+         iStatus = FT_rmFileIn(oFTMirror, psSub->pcPath);
+         break;
+      default:
+         iStatus = FT_statIn(oFTMirror, psSub->pcPath, &bIsFile,
+                             &ulSize);
+         if(psSub->eOp == FTQ_GET_FILE_CONTENTS && iStatus == SUCCESS
+            && !bIsFile)
+            iStatus = NOT_A_FILE;
+         break;
+   }
+   Stress_check(psResult->iStatus == iStatus, "queued status");
+   if(iStatus != SUCCESS)
+      return;
+
+   if(psSub->eOp == FTQ_STAT || psSub->eOp == FTQ_GET_FILE_CONTENTS) {
+      Stress_check(psResult->bIsFile == bIsFile, "queued kind");
+      Stress_check(!bIsFile || psResult->ulSize == ulSize,
+                   "queued size");
+   }
+   if(psSub->eOp == FTQ_GET_FILE_CONTENTS &&
+      strncmp(psSub->pcPath, "q/f", 3) == 0) {
+      pvContents = FT_getFileContentsIn(oFTMirror, psSub->pcPath);
+      Stress_check(memcmp(psResult->pvContents, pvContents, ulSize)
+                   == 0, "queued contents");
+   }
+}
+
+/*
+  Runs STRESS_QUEUE_OPS operations through an FTQueue_T of
+  STRESS_QUEUE_ENTRIES entries, so that both rings wrap around many
+  times, reaping in small pieces, alternately waiting and polling.
+  Checks that a full queue takes no more, that every result comes
+  back in order and agrees with the same operation run synchronously
+  on a mirror FT, and that both FTs end up the same.
+*/
+static void Stress_queue(void) {
+   struct ftqSubmission asSubs[STRESS_QUEUE_ENTRIES];
+   struct ftqCompletion asDone[STRESS_QUEUE_REAP];
+   struct ftqSubmission sSub;
+   FTQueue_T oQueue;
+   FT_T oFT;
+   FT_T oFTMirror;
+   FT_T oFTEach;
+   char *pcDump;
+   char *pcMirror;
+   size_t ulSubmitted = 0;
+   size_t ulReaped = 0;
+   size_t ulCount;
+   size_t ulRound;
+   size_t ul;
+   double dStart;
+
+   Stress_check(FT_new(&oFT) == SUCCESS, "FT_new");
+   Stress_check(FT_new(&oFTMirror) == SUCCESS, "FT_new");
+   for(ul = 0; ul < 2; ul++) {
+      oFTEach = (ul == 0) ? oFT : oFTMirror;
+      Stress_check(FT_insertDirIn(oFTEach, "q") == SUCCESS,
+                   "FT_insertDirIn");
+      Stress_check(FT_insertFileIn(oFTEach, "q/f0", "zero", 4)
+                   == SUCCESS, "FT_insertFileIn");
+      Stress_check(FT_insertFileIn(oFTEach, "q/f1", "one", 3)
+                   == SUCCESS, "FT_insertFileIn");
+      Stress_check(FT_insertFileIn(oFTEach, "q/empty", NULL, 0)
+                   == SUCCESS, "FT_insertFileIn");
+   }
+
+   oQueue = FTQueue_new(oFT, STRESS_QUEUE_ENTRIES);
+   Stress_check(oQueue != NULL, "FTQueue_new");
+
+   dStart = Stress_now();
+   for(ulRound = 0; ulReaped < STRESS_QUEUE_OPS; ulRound++) {
+      ulCount = STRESS_QUEUE_OPS - ulSubmitted;
+      if(ulCount > STRESS_QUEUE_ENTRIES)
+         ulCount = STRESS_QUEUE_ENTRIES;
+      for(ul = 0; ul < ulCount; ul++)
+         Stress_queueOp(ulSubmitted + ul, &asSubs[ul]);
+      ulCount = FTQueue_submit(oQueue, asSubs, ulCount);
+      ulSubmitted += ulCount;
+
+      /* with every entry in flight, the queue takes nothing more */
+      if(ulSubmitted - ulReaped == STRESS_QUEUE_ENTRIES &&
+         ulSubmitted < STRESS_QUEUE_OPS) {
+         Stress_queueOp(ulSubmitted, &sSub);
+         Stress_check(FTQueue_submit(oQueue, &sSub, 1) == 0,
+                      "FTQueue_submit when full");
+      }
+
+      ulCount = FTQueue_reap(oQueue, asDone, STRESS_QUEUE_REAP,
+                             (boolean) (ulRound % 2 == 0));
+      for(ul = 0; ul < ulCount; ul++) {
+         Stress_check((size_t) asDone[ul].pvUser == ulReaped,
+                      "completion order");
+         Stress_queueOp(ulReaped, &sSub);
+         Stress_queueCompare(oFTMirror, &sSub, &asDone[ul]);
+         ulReaped++;
+      }
+   }
+   Stress_check(FTQueue_reap(oQueue, asDone, STRESS_QUEUE_REAP, TRUE)
+                == 0, "FTQueue_reap when empty");
+   FTQueue_free(oQueue);
+   Stress_report("queue", dStart);
+
+   Stress_check(FT_isValidIn(oFT), "FT_isValidIn");
+   pcDump = FT_toStringIn(oFT);
+   pcMirror = FT_toStringIn(oFTMirror);
+   Stress_check(pcDump != NULL && pcMirror != NULL, "FT_toStringIn");
+   Stress_check(strcmp(pcDump, pcMirror) == 0, "queued tree");
+   free(pcDump);
+   free(pcMirror);
+   FT_free(oFT);
+   FT_free(oFTMirror);
+}
+
+/* What a path was in the snapshot workload's tree at one time */
+enum { SNAP_NONE = -1, SNAP_DIR = -2 };
+
+/*
+  The paths of the snapshot workload, and what each is: a file's size,
+  SNAP_DIR, or SNAP_NONE, before the first round of changes, between
+  the rounds, and after the second
+*/
+static const struct {
+   const char *pcPath;
+   long alIs[3];
+} asSnapPaths[] = {
+   { "s",       { SNAP_DIR,  SNAP_DIR,  SNAP_DIR  } },
+   { "s/a",     { SNAP_DIR,  SNAP_NONE, SNAP_DIR  } },
+   { "s/a/f",   { 5,         SNAP_NONE, 14        } },
+   { "s/a/b",   { SNAP_DIR,  SNAP_NONE, SNAP_NONE } },
+   { "s/a/b/g", { 4,         SNAP_NONE, SNAP_NONE } },
+   { "s/k",     { 4,         8,         3         } },
+   { "s/gone",  { 4,         SNAP_NONE, SNAP_NONE } },
+   { "s/new",   { SNAP_NONE, SNAP_DIR,  SNAP_NONE } },
+   { "s/new/n", { SNAP_NONE, 2,         SNAP_NONE } }
+};
+
+/*
+  Checks that every path of the snapshot workload is what it was at
+  time ulTime, 0, 1 or 2, in snapshot oS if it is not NULL, and in
+  oFT as it is now otherwise.
+*/
+static void Stress_snapshotCheck(FT_T oFT, FTSnapshot_T oS,
+                                 size_t ulTime) {
+   size_t ulPaths = sizeof(asSnapPaths) / sizeof(asSnapPaths[0]);
+   boolean bIsFile;
+   size_t ulSize;
+   long lIs;
+   int iStatus;
+   size_t ul;
+
+   for(ul = 0; ul < ulPaths; ul++) {
+      if(oS != NULL)
+         iStatus = FT_snapshotStat(oS, asSnapPaths[ul].pcPath,
+                                   &bIsFile, &ulSize);
+      else
+         iStatus = FT_statIn(oFT, asSnapPaths[ul].pcPath, &bIsFile,
+                             &ulSize);
+      lIs = asSnapPaths[ul].alIs[ulTime];
+      if(lIs == SNAP_NONE)
+         Stress_check(iStatus == NO_SUCH_PATH, "stat of a gone path");
+      else if(lIs == SNAP_DIR)
+         Stress_check(iStatus == SUCCESS && !bIsFile,
+                      "stat of a directory");
+      else
+         Stress_check(iStatus == SUCCESS && bIsFile &&
+                      ulSize == (size_t) lIs, "stat of a file");
+   }
+}
+
+/*
+  Replaces the contents of file pcPath of oFT with string pcContents,
+  and frees the old contents.
+*/
+static void Stress_replace(FT_T oFT, const char *pcPath,
+                           const char *pcContents) {
+   void *pvOld;
+
+   pvOld = FT_replaceFileContentsIn(oFT, pcPath, (void *) pcContents,
+                                    strlen(pcContents));
+   Stress_check(pvOld != NULL, "FT_replaceFileContentsIn");
+   free(pvOld);
+}
+
+/*
+  Takes a snapshot of a small FT locked with eLocking, changes the FT,
+  takes a second snapshot, and changes it again: inserting, replacing
+  contents, and removing files and directories, among them the whole
+  subtree that holds s/a/b/g. Checks that each snapshot still renders
+  and stats as the FT was when it was taken while the FT itself shows
+  every change, and that the second snapshot is unharmed by releasing
+  the first. The FT is freed once both are released; in a build with
+  the address sanitizer, a copy or removed node that releasing left
+  behind is reported as a leak. Reports the time taken under the name
+  pcMode.
+*/
+static void Stress_snapshot(FT_Locking eLocking, const char *pcMode) {
+   FTSnapshot_T aoS[2];
+   char *apcDump[3];
+   char *pcSnap;
+   FT_T oFT;
+   size_t ul;
+   double dStart;
+
+   dStart = Stress_now();
+   Stress_check(FT_new(&oFT) == SUCCESS, "FT_new");
+   Stress_check(FT_setLockingIn(oFT, eLocking) == SUCCESS,
+                "FT_setLockingIn");
+   Stress_check(FT_insertDirIn(oFT, "s/a/b") == SUCCESS,
+                "FT_insertDirIn");
+   Stress_check(FT_insertFileIn(oFT, "s/a/f", "alpha", 5) == SUCCESS &&
+                FT_insertFileIn(oFT, "s/a/b/g", "beta", 4) == SUCCESS &&
+                FT_insertFileIn(oFT, "s/k", "keep", 4) == SUCCESS &&
+                FT_insertFileIn(oFT, "s/gone", "bye!", 4) == SUCCESS,
+                "FT_insertFileIn");
+   apcDump[0] = FT_toStringIn(oFT);
+   Stress_check(FT_snapshotIn(oFT, &aoS[0]) == SUCCESS,
+                "FT_snapshotIn");
+
+   Stress_check(FT_insertFileIn(oFT, "s/new/n", "nn", 2) == SUCCESS,
+                "FT_insertFileIn");
+   Stress_replace(oFT, "s/k", "changed!");
+   Stress_check(FT_rmFileIn(oFT, "s/gone") == SUCCESS, "FT_rmFileIn");
+   Stress_check(FT_rmDirIn(oFT, "s/a") == SUCCESS, "FT_rmDirIn");
+   apcDump[1] = FT_toStringIn(oFT);
+   Stress_check(FT_snapshotIn(oFT, &aoS[1]) == SUCCESS,
+                "FT_snapshotIn");
+
+   Stress_check(FT_rmDirIn(oFT, "s/new") == SUCCESS, "FT_rmDirIn");
+   Stress_check(FT_insertFileIn(oFT, "s/a/f", "other contents", 14)
+                == SUCCESS, "FT_insertFileIn");
+   Stress_replace(oFT, "s/k", "new");
+   apcDump[2] = FT_toStringIn(oFT);
+   Stress_check(apcDump[0] != NULL && apcDump[1] != NULL &&
+                apcDump[2] != NULL, "FT_toStringIn");
+
+   Stress_snapshotCheck(oFT, NULL, 2);
+   for(ul = 0; ul < 2; ul++) {
+      Stress_snapshotCheck(oFT, aoS[ul], ul);
+      pcSnap = FT_snapshotToString(aoS[ul]);
+      Stress_check(pcSnap != NULL &&
+                   strcmp(pcSnap, apcDump[ul]) == 0,
+                   "FT_snapshotToString");
+      free(pcSnap);
+   }
+
+   FT_releaseSnapshot(aoS[0]);
+   Stress_snapshotCheck(oFT, aoS[1], 1);
+   pcSnap = FT_snapshotToString(aoS[1]);
+   Stress_check(pcSnap != NULL && strcmp(pcSnap, apcDump[1]) == 0,
+                "FT_snapshotToString");
+   free(pcSnap);
+   FT_releaseSnapshot(aoS[1]);
+
+   Stress_check(FT_isValidIn(oFT), "FT_isValidIn");
+   Stress_snapshotCheck(oFT, NULL, 2);
+   pcSnap = FT_toStringIn(oFT);
+   Stress_check(pcSnap != NULL && strcmp(pcSnap, apcDump[2]) == 0,
+                "FT_toStringIn");
+   free(pcSnap);
+   for(ul = 0; ul < 3; ul++)
+      free(apcDump[ul]);
+   FT_free(oFT);
+   Stress_report(pcMode, dStart);
+}
+
+/* One batch for FT_statMany and FT_getContentsMany, out of order and
+   with a path twice, holding files, among them an empty one,
+   directories, missing paths, a path under a file and a bad path */
+static const char *const apcManyPaths[] = {
+   "m/d1/f2", "m/empty", "m", "m/d0/f0", "m/d1", "m/none",
+   "m/d0/f0", "m/d0/f0/x", "gone/f", "m/d0", "m/d1/none", "m//f",
+   "m/d1/f1", "m/empty"
+};
+
+/*
+  Checks FT_statManyIn and FT_getContentsManyIn on one batch of paths
+  against FT_statIn and FT_getFileContentsIn called for each path.
+*/
+static void Stress_lookupMany(void) {
+   enum { MANY = sizeof(apcManyPaths) / sizeof(apcManyPaths[0]) };
+   struct ftLookup asStats[MANY];
+   struct ftLookup asContents[MANY];
+   boolean bIsFile;
+   size_t ulSize;
+   int iStatus;
+   FT_T oFT;
+   size_t ul;
+   double dStart;
+
+   dStart = Stress_now();
+   Stress_check(FT_new(&oFT) == SUCCESS, "FT_new");
+   Stress_check(FT_insertDirIn(oFT, "m") == SUCCESS, "FT_insertDirIn");
+   Stress_check(FT_insertFileIn(oFT, "m/d0/f0", "zero", 4) == SUCCESS &&
+                FT_insertFileIn(oFT, "m/d1/f1", "one", 3) == SUCCESS &&
+                FT_insertFileIn(oFT, "m/d1/f2", "two!", 4) == SUCCESS &&
+                FT_insertFileIn(oFT, "m/empty", NULL, 0) == SUCCESS,
+                "FT_insertFileIn");
+
+   Stress_check(FT_statManyIn(oFT, apcManyPaths, MANY, asStats)
+                == SUCCESS, "FT_statManyIn");
+   Stress_check(FT_getContentsManyIn(oFT, apcManyPaths, MANY,
+                                     asContents) == SUCCESS,
+                "FT_getContentsManyIn");
+
+   for(ul = 0; ul < MANY; ul++) {
+      iStatus = FT_statIn(oFT, apcManyPaths[ul], &bIsFile, &ulSize);
+      Stress_check(asStats[ul].iStatus == iStatus,
+                   "FT_statManyIn status");
+      if(iStatus == SUCCESS) {
+         Stress_check(asStats[ul].bIsFile == bIsFile,
+                      "FT_statManyIn kind");
+         Stress_check(!bIsFile || asStats[ul].ulSize == ulSize,
+                      "FT_statManyIn size");
+      }
+
+      /* a directory has no contents to give */
+      if(iStatus == SUCCESS && !bIsFile)
+         iStatus = NOT_A_FILE;
+      Stress_check(asContents[ul].iStatus == iStatus,
+                   "FT_getContentsManyIn status");
+      if(iStatus != SUCCESS)
+         continue;
+      Stress_check(asContents[ul].bIsFile &&
+                   asContents[ul].ulSize == ulSize,
+                   "FT_getContentsManyIn size");
+      Stress_check(asContents[ul].pvContents ==
+                   FT_getFileContentsIn(oFT, apcManyPaths[ul]),
+                   "FT_getContentsManyIn contents");
+   }
+
+   FT_free(oFT);
+   Stress_report("lookupMany", dStart);
+}
+
+/*
+  Walks the whole of oFT, as FT_toStringIn renders it, and sets
+  *pulFiles, *pulDirs and *pulBytes to the numbers of files and of
+  directories at or below directory pcPath and the total length of
+  those files' contents, as FT_statIn gives them.
+*/
+static void Stress_walkTotals(FT_T oFT, const char *pcPath,
+                              size_t *pulFiles, size_t *pulDirs,
+                              size_t *pulBytes) {
+   size_t ulPrefix = strlen(pcPath);
+   char *pcDump;
+   char *pcLine;
+   char *pcEnd;
+   boolean bIsFile;
+   size_t ulSize;
+
+   *pulFiles = 0;
+   *pulDirs = 0;
+   *pulBytes = 0;
+   pcDump = FT_toStringIn(oFT);
+   Stress_check(pcDump != NULL, "FT_toStringIn");
+   for(pcLine = pcDump; *pcLine != '\0'; pcLine = pcEnd + 1) {
+      pcEnd = strchr(pcLine, '\n');
+      *pcEnd = '\0';
+      if(strncmp(pcLine, pcPath, ulPrefix) != 0 ||
+         (pcLine[ulPrefix] != '\0' && pcLine[ulPrefix] != '/'))
+         continue;
+      Stress_check(FT_statIn(oFT, pcLine, &bIsFile, &ulSize) ==
+                   SUCCESS, "FT_statIn");
+      if(bIsFile) {
+         (*pulFiles)++;
+         *pulBytes += ulSize;
+      }
+      else
+         (*pulDirs)++;
+   }
+   free(pcDump);
+}
+
+/*
+  Checks that FT_statTreeIn gives each directory among the ulCount
+  paths at ppcPaths the totals that walking the whole of oFT finds.
+*/
+static void Stress_checkTotals(FT_T oFT, const char *const *ppcPaths,
+                               size_t ulCount) {
+   size_t ulFiles, ulDirs, ulBytes;
+   size_t ulWalkFiles, ulWalkDirs, ulWalkBytes;
+   size_t ul;
+
+   for(ul = 0; ul < ulCount; ul++) {
+      Stress_check(FT_statTreeIn(oFT, ppcPaths[ul], &ulFiles, &ulDirs,
+                                 &ulBytes) == SUCCESS, "FT_statTreeIn");
+      Stress_walkTotals(oFT, ppcPaths[ul], &ulWalkFiles, &ulWalkDirs,
+                        &ulWalkBytes);
+      Stress_check(ulFiles == ulWalkFiles && ulDirs == ulWalkDirs &&
+                   ulBytes == ulWalkBytes, "FT_statTreeIn totals");
+   }
+}
+
+/*
+  Checks that FT_statTreeIn of oFT gives status iExpected for pcPath,
+  and leaves the totals alone.
+*/
+static void Stress_checkTotalsFail(FT_T oFT, const char *pcPath,
+                                   int iExpected) {
+   size_t ulFiles = 7, ulDirs = 7, ulBytes = 7;
+
+   Stress_check(FT_statTreeIn(oFT, pcPath, &ulFiles, &ulDirs,
+                              &ulBytes) == iExpected &&
+                ulFiles == 7 && ulDirs == 7 && ulBytes == 7,
+                "FT_statTreeIn status");
+}
+
+/* The directories whose totals Stress_statTree checks */
+static const char *const apcTotalsPaths[] = {
+   "t", "t/a", "t/a/b", "t/c"
+};
+
+/*
+  Checks FT_statTreeIn against a full walk of the FT after inserts,
+  replacements of contents, a committed and an aborted transaction
+  and a directory's removal, then over the root of an FT split into
+  STRESS_TENANTS shards, and checks the statuses it gives a file, a
+  missing path and a bad path.
+*/
+static void Stress_statTree(void) {
+   size_t ulPaths = sizeof(apcTotalsPaths) / sizeof(apcTotalsPaths[0]);
+   char acPath[STRESS_MAXPATH];
+   FTTxn_T oT;
+   FT_T oFT;
+   size_t ul;
+   double dStart;
+
+   dStart = Stress_now();
+   Stress_check(FT_new(&oFT) == SUCCESS, "FT_new");
+   Stress_check(FT_insertDirIn(oFT, "t/a/b") == SUCCESS &&
+                FT_insertDirIn(oFT, "t/c") == SUCCESS,
+                "FT_insertDirIn");
+   Stress_check(FT_insertFileIn(oFT, "t/f", "top", 3) == SUCCESS &&
+                FT_insertFileIn(oFT, "t/a/f", "middle", 6) == SUCCESS &&
+                FT_insertFileIn(oFT, "t/a/b/f", "low", 3) == SUCCESS &&
+                FT_insertFileIn(oFT, "t/a/b/e", NULL, 0) == SUCCESS &&
+                FT_insertFileIn(oFT, "t/c/f", "side", 4) == SUCCESS,
+                "FT_insertFileIn");
+   Stress_checkTotals(oFT, apcTotalsPaths, ulPaths);
+
+   Stress_replace(oFT, "t/a/b/f", "much longer now");
+   Stress_replace(oFT, "t/a/f", "m");
+   Stress_checkTotals(oFT, apcTotalsPaths, ulPaths);
+
+   Stress_check(FT_beginIn(oFT, &oT) == SUCCESS, "FT_beginIn");
+   Stress_check(FT_txnInsertFile(oT, "t/c/g", "new", 3) == SUCCESS &&
+                FT_txnReplaceFileContents(oT, "t/c/f", "s", 1) ==
+                SUCCESS, "FT_txn");
+   FT_commit(oT);
+   Stress_checkTotals(oFT, apcTotalsPaths, ulPaths);
+
+   Stress_check(FT_beginIn(oFT, &oT) == SUCCESS, "FT_beginIn");
+   Stress_check(FT_txnRmDir(oT, "t/a/b") == SUCCESS &&
+                FT_txnInsertFile(oT, "t/a/g", "gone", 4) == SUCCESS &&
+                FT_txnReplaceFileContents(oT, "t/c/f", "longer", 6) ==
+                SUCCESS, "FT_txn");
+   FT_abort(oT);
+   Stress_checkTotals(oFT, apcTotalsPaths, ulPaths);
+
+   Stress_check(FT_rmDirIn(oFT, "t/a/b") == SUCCESS, "FT_rmDirIn");
+   Stress_checkTotals(oFT, apcTotalsPaths, ulPaths - 2);
+   Stress_checkTotals(oFT, &apcTotalsPaths[ulPaths - 1], 1);
+
+   Stress_checkTotalsFail(oFT, "t/a/f", NOT_A_DIRECTORY);
+   Stress_checkTotalsFail(oFT, "t/a/b", NO_SUCH_PATH);
+   Stress_checkTotalsFail(oFT, "t//a", BAD_PATH);
+   FT_free(oFT);
+
+   Stress_check(FT_newSharded(STRESS_TENANTS, &oFT) == SUCCESS,
+                "FT_newSharded");
+   Stress_check(FT_insertDirIn(oFT, "t") == SUCCESS, "FT_insertDirIn");
+   for(ul = 0; ul < 2 * STRESS_TENANTS; ul++) {
+      sprintf(acPath, "t/a%lu/b", (unsigned long) ul);
+      Stress_check(FT_insertDirIn(oFT, acPath) == SUCCESS,
+                   "FT_insertDirIn");
+      sprintf(acPath, "t/a%lu/f", (unsigned long) ul);
+      Stress_check(FT_insertFileIn(oFT, acPath, acPath, ul % 8)
+                   == SUCCESS, "FT_insertFileIn");
+   }
+   Stress_check(FT_rmDirIn(oFT, "t/a1") == SUCCESS, "FT_rmDirIn");
+   Stress_checkTotals(oFT, apcTotalsPaths, 1);
+   Stress_checkTotalsFail(oFT, "t/a2/f", NOT_A_DIRECTORY);
+   Stress_checkTotalsFail(oFT, "t/a1", NO_SUCH_PATH);
+   FT_free(oFT);
+   Stress_report("statTree", dStart);
+}
+
+/*
+  Runs the deep-chain workload on a thread with a STRESS_STACK_SIZE
+  stack, so that any walk whose stack use grows with depth crashes,
+  then the tenant workload under whole-tree and under per-directory
+  locking, and split into a shard per tenant, and its transactional
+  form under whole-tree locking and with lock-free lookups, then runs
+  operations through an FTQueue_T, checks snapshots against a
+  changing FT, and checks batched lookups against single ones and
+  subtree totals against full walks. argv[1], if given, is the chain
+  depth. Returns 0 on success.
+*/
+int main(int argc, char *argv[]) {
+   pthread_attr_t sAttr;
+   pthread_t sThread;
+
+   if(argc > 1)
+      ulChainDepth = (size_t) strtoul(argv[1], NULL, 10);
+   Stress_check(ulChainDepth >= 2, "depth argument");
+
+   printf("chain depth %lu, stack %lu bytes\n",
+          (unsigned long) ulChainDepth,
+          (unsigned long) STRESS_STACK_SIZE);
+
+   Stress_check(pthread_attr_init(&sAttr) == 0, "pthread_attr_init");
+   Stress_check(pthread_attr_setstacksize(&sAttr, STRESS_STACK_SIZE)
+                == 0, "pthread_attr_setstacksize");
+   Stress_check(pthread_create(&sThread, &sAttr, Stress_deepChain,
+                               NULL) == 0, "pthread_create");
+   Stress_check(pthread_join(sThread, NULL) == 0, "pthread_join");
+   (void) pthread_attr_destroy(&sAttr);
+
+   printf("%d tenant threads, %d directories of %d files each\n",
+          STRESS_TENANTS, STRESS_TENANT_DIRS, STRESS_TENANT_FILES);
+   Stress_concurrent(Stress_tenant, FT_LOCK_TREE, 0, "tree lock");
+   Stress_concurrent(Stress_tenant, FT_LOCK_DIRS, 0, "dir locks");
+   Stress_concurrent(Stress_tenant, FT_LOCK_TREE, STRESS_TENANTS,
+                     "sharded");
+   Stress_concurrent(Stress_txnTenant, FT_LOCK_TREE, 0, "txn tree");
+   Stress_concurrent(Stress_txnTenant, FT_LOCK_OPTIMISTIC, 0,
+                     "txn lockfree");
+
+   printf("%d queued operations, %d in flight\n", STRESS_QUEUE_OPS,
+          STRESS_QUEUE_ENTRIES);
+   Stress_queue();
+
+   Stress_snapshot(FT_LOCK_TREE, "snapshot");
+   Stress_snapshot(FT_LOCK_OPTIMISTIC, "snapshot opt");
+   Stress_lookupMany();
+   Stress_statTree();
+   return 0;
+}
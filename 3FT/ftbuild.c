@@ -0,0 +1,562 @@
+/*--------------------------------------------------------------------*/
+/* ftbuild.c                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "path.h"
+#include "nodeFT.h"
+#include "ftimpl.h"
+#include "ftsnap.h"
+#include "ftbuild.h"
+
+/*
+  The entries of a batch for FT_buildParallelIn that fall in one
+  subtree under the root: those whose paths agree up to the '/' after
+  their second component, or up to their end if they have no such
+  '/'.
+*/
+struct ftBuildGroup {
+   /* the group's entries, in the order FT_insertBatchIn applies them */
+   const struct ftBatchEntry **ppsEntries;
+   size_t ulEntries;
+   /* once built, the top of the group's new subtree, not yet linked
+      under the root, and its number of nodes, or NULL and 0 if none
+      of the group's entries was inserted */
+   Node_T oNTop;
+   size_t ulNodes;
+   /* TRUE if the group's top turned out to be in the FT already, so
+      that the group must be inserted like any other batch */
+   boolean bExisting;
+};
+
+/* The work that FT_buildParallelIn shares among its threads */
+struct ftBuild {
+   FT_T oFT;
+   /* the batch, and where each entry's status goes */
+   const struct ftBatchEntry *psEntries;
+   int *piResults;
+   /* TRUE if the FT was empty, and then the entry that made the root,
+      which is the first valid directory in the order FT_insertBatchIn
+      applies the batch, or NULL if there is none; entries before it
+      are applied to an empty FT */
+   boolean bWasEmpty;
+   const struct ftBatchEntry *psFirst;
+   /* the groups, in order of their tops' names, and the order in
+      which threads take them, largest first */
+   struct ftBuildGroup *psGroups;
+   struct ftBuildGroup **ppsOrder;
+   size_t ulGroups;
+   /* the index in ppsOrder of the next group to take */
+   size_t ulNextGroup;
+};
+
+/*
+  Returns the length of the key that groups pcPath with the paths in
+  the same subtree under the root: pcPath up to the '/' after its
+  second component, or all of pcPath if it has no such '/'.
+*/
+static size_t FT_groupKeyLength(const char *pcPath) {
+   const char *pcSlash;
+
+   assert(pcPath != NULL);
+
+   pcSlash = strchr(pcPath, '/');
+   if(pcSlash != NULL)
+      pcSlash = strchr(pcSlash + 1, '/');
+   if(pcSlash == NULL)
+      return strlen(pcPath);
+   return (size_t) (pcSlash - pcPath);
+}
+
+int FT_compareGroupKeys(const void *pvFirst,
+                        const void *pvSecond) {
+   const unsigned char *pucFirst = (const unsigned char *)
+      (*(const struct ftBatchEntry * const *) pvFirst)->pcPath;
+   const unsigned char *pucSecond = (const unsigned char *)
+      (*(const struct ftBatchEntry * const *) pvSecond)->pcPath;
+   size_t ulSlashes = 0;
+   boolean bFirstEnds;
+   boolean bSecondEnds;
+
+   while(*pucFirst == *pucSecond && *pucFirst != '\0') {
+      if(*pucFirst == '/')
+         ulSlashes++;
+      pucFirst++;
+      pucSecond++;
+   }
+   if(*pucFirst == *pucSecond)
+      return FT_compareEntries(pvFirst, pvSecond);
+
+   if(ulSlashes < 2) {
+      bFirstEnds = (boolean) (*pucFirst == '\0' ||
+                              (*pucFirst == '/' && ulSlashes == 1));
+      bSecondEnds = (boolean) (*pucSecond == '\0' ||
+                               (*pucSecond == '/' && ulSlashes == 1));
+      if(bFirstEnds != bSecondEnds)
+         return bFirstEnds ? -1 : 1;
+   }
+   return (*pucFirst < *pucSecond) ? -1 : 1;
+}
+
+/*
+  Compares the build groups that pvFirst and pvSecond point to by
+  their number of entries, larger first. A qsort comparator.
+*/
+static int FT_compareGroupSizes(const void *pvFirst,
+                                const void *pvSecond) {
+   size_t ulFirst =
+      (*(struct ftBuildGroup * const *) pvFirst)->ulEntries;
+   size_t ulSecond =
+      (*(struct ftBuildGroup * const *) pvSecond)->ulEntries;
+
+   if(ulFirst != ulSecond)
+      return (ulFirst > ulSecond) ? -1 : 1;
+   return 0;
+}
+
+/*
+  Returns the first entry among the ulCount at ppsEntries, in the
+  order FT_insertBatchIn applies them, that is a directory with a
+  well-formatted path, or NULL if there is none: in an empty FT, the
+  entry that creates the root.
+*/
+static const struct ftBatchEntry *FT_firstDir(
+   const struct ftBatchEntry **ppsEntries, size_t ulCount) {
+   const struct ftBatchEntry *psFirst = NULL;
+   Path_T oPPath = NULL;
+   size_t ul;
+
+   assert(ppsEntries != NULL || ulCount == 0);
+
+   for(ul = 0; ul < ulCount; ul++) {
+      if(ppsEntries[ul]->bIsFile)
+         continue;
+      if(psFirst != NULL &&
+         FT_compareEntries(&ppsEntries[ul], &psFirst) > 0)
+         continue;
+      if(Path_new(ppsEntries[ul]->pcPath, &oPPath) != SUCCESS)
+         continue;
+      Path_free(oPPath);
+      psFirst = ppsEntries[ul];
+   }
+   return psFirst;
+}
+
+/*
+  Sets the statuses of the entries at the start of the ulEntries at
+  ppsEntries, in the order FT_insertBatchIn applies them, that come
+  before the root was made, if psBuild's FT was empty: BAD_PATH or
+  the like for a malformed path, and CONFLICTING_PATH otherwise, as
+  for a file inserted into an empty FT. Returns the number of entries
+  at ppsEntries thereby done, counting psBuild->psFirst, whose status
+  is already set, if it comes next.
+*/
+static size_t FT_buildSkip(struct ftBuild *psBuild,
+                           const struct ftBatchEntry **ppsEntries,
+                           size_t ulEntries) {
+   Path_T oPPath = NULL;
+   size_t ul;
+   int iStatus;
+
+   assert(psBuild != NULL);
+   assert(ppsEntries != NULL);
+
+   if(!psBuild->bWasEmpty)
+      return 0;
+
+   for(ul = 0; ul < ulEntries; ul++) {
+      if(ppsEntries[ul] == psBuild->psFirst)
+         return ul + 1;
+      if(psBuild->psFirst != NULL &&
+         FT_compareEntries(&ppsEntries[ul], &psBuild->psFirst) > 0)
+         break;
+
+      iStatus = Path_new(ppsEntries[ul]->pcPath, &oPPath);
+      if(iStatus == SUCCESS) {
+         Path_free(oPPath);
+         iStatus = CONFLICTING_PATH;
+      }
+      psBuild->piResults[ppsEntries[ul] - psBuild->psEntries] = iStatus;
+   }
+   return ul;
+}
+
+/*
+  Creates, unlinked but with root oNRoot as its parent, the node at
+  depth 2 of oPPath, the path of batch entry psEntry: the entry's own
+  node if oPPath has depth 2, and a directory otherwise. Returns
+  SUCCESS and sets *poNTop to it, or returns MEMORY_ERROR.
+*/
+static int FT_makeTop(Node_T oNRoot, Path_T oPPath,
+                      const struct ftBatchEntry *psEntry,
+                      Node_T *poNTop) {
+   Path_T oPTop = NULL;
+   boolean bIsFile;
+   int iStatus;
+
+   assert(oNRoot != NULL);
+   assert(oPPath != NULL);
+   assert(psEntry != NULL);
+   assert(poNTop != NULL);
+
+   bIsFile = (boolean) (Path_getDepth(oPPath) == 2 && psEntry->bIsFile);
+   iStatus = Path_prefix(oPPath, 2, &oPTop);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   iStatus = Node_newUnlinked(oPTop, oNRoot, poNTop, bIsFile,
+                              psEntry->pvContents, psEntry->ulLength);
+   if(iStatus != SUCCESS)
+      Path_free(oPTop);
+   return iStatus;
+}
+
+/*
+  Inserts the entry at psEntry, with path oPPath below the root of
+  psBuild's FT, into psGroup's new subtree, creating the subtree's top
+  first if need be, and returns the entry's status as FT_insertBatchIn
+  would set it. oNAnchor is the directory that *poNDir was set to for
+  the group's entry before, or NULL. Sets *poNDir to the deepest
+  directory on oPPath in the subtree that the insert reached, or
+  NULL if none. Instead returns SUCCESS with psGroup->bExisting set
+  if the group's top is in the FT already.
+*/
+static int FT_buildEntry(struct ftBuild *psBuild,
+                         struct ftBuildGroup *psGroup,
+                         const struct ftBatchEntry *psEntry,
+                         Path_T oPPath, Node_T oNAnchor,
+                         Node_T *poNDir) {
+   Node_T oNRoot = psBuild->oFT->oNRoot;
+   Node_T oNFurthest;
+   Node_T oNFirstNew;
+   boolean bMadeTop = FALSE;
+   size_t ulChildID;
+   size_t ulNew = 0;
+   int iStatus;
+
+   assert(psGroup != NULL);
+   assert(psEntry != NULL);
+   assert(oPPath != NULL);
+   assert(poNDir != NULL);
+
+   *poNDir = NULL;
+
+   if(psGroup->oNTop == NULL) {
+      /* no writer touches the root while the groups are built */
+      if(Node_hasChildNamed(oNRoot, Path_getComponent(oPPath, 1),
+                            &ulChildID)) {
+         psGroup->bExisting = TRUE;
+         return SUCCESS;
+      }
+      iStatus = FT_makeTop(oNRoot, oPPath, psEntry, &psGroup->oNTop);
+      if(iStatus != SUCCESS)
+         return iStatus;
+      bMadeTop = TRUE;
+      oNFurthest = psGroup->oNTop;
+      if(Path_getDepth(oPPath) == 2) {
+         psGroup->ulNodes++;
+         *poNDir = FT_dirOf(oNFurthest);
+         return SUCCESS;
+      }
+   }
+   else {
+      /* the walk must stay in the subtree, which the root cannot
+         reach yet */
+      oNFurthest = FT_climbToward(oNAnchor, oPPath);
+      if(oNFurthest == NULL ||
+         Path_getDepth(Node_getPath(oNFurthest)) < 2)
+         oNFurthest = psGroup->oNTop;
+      iStatus = FT_descendFrom(psBuild->oFT, oPPath, oNFurthest,
+                               &oNFurthest);
+      if(iStatus != SUCCESS)
+         return iStatus;
+      *poNDir = FT_dirOf(oNFurthest);
+      if(Path_getDepth(Node_getPath(oNFurthest)) ==
+         Path_getDepth(oPPath))
+         return ALREADY_IN_TREE;
+   }
+
+   iStatus = FT_growChain(oPPath, oNFurthest, psEntry->bIsFile,
+                          psEntry->pvContents, psEntry->ulLength,
+                          &oNFirstNew, poNDir, &ulNew);
+   if(iStatus != SUCCESS) {
+      /* a failed insert leaves nothing behind, the top made for it
+         included */
+      if(bMadeTop) {
+         (void) Node_free(psGroup->oNTop);
+         psGroup->oNTop = NULL;
+      }
+      return iStatus;
+   }
+
+   psGroup->ulNodes += ulNew + (bMadeTop ? 1 : 0);
+   return SUCCESS;
+}
+
+/*
+  Builds psGroup of psBuild as a new subtree under the root of
+  psBuild's FT, not yet linked into it, and sets the status of each
+  of the group's entries as FT_insertBatchIn would. Stops, with
+  psGroup->bExisting set, if the group's top is in the FT already.
+  Changes no FT state and no node outside the new subtree, so that
+  threads can build different groups at once while the caller holds
+  the FT's lock.
+*/
+static void FT_buildGroup(struct ftBuild *psBuild,
+                          struct ftBuildGroup *psGroup) {
+   const struct ftBatchEntry *psEntry;
+   const char *pcRoot;
+   Path_T oPPath = NULL;
+   /* the deepest directory reached for the entry before */
+   Node_T oNAnchor = NULL;
+   size_t ul;
+   int iStatus;
+
+   assert(psBuild != NULL);
+   assert(psGroup != NULL);
+   assert(psBuild->oFT->oNRoot != NULL);
+
+   pcRoot = Path_getPathname(Node_getPath(psBuild->oFT->oNRoot));
+   for(ul = FT_buildSkip(psBuild, psGroup->ppsEntries,
+                         psGroup->ulEntries);
+       ul < psGroup->ulEntries; ul++) {
+      psEntry = psGroup->ppsEntries[ul];
+      assert(psEntry->pcPath != NULL);
+
+      iStatus = Path_new(psEntry->pcPath, &oPPath);
+      if(iStatus == SUCCESS) {
+         if(strcmp(Path_getComponent(oPPath, 0), pcRoot) != 0)
+            iStatus = CONFLICTING_PATH;
+         else if(Path_getDepth(oPPath) == 1)
+            iStatus = ALREADY_IN_TREE;
+         else
+            iStatus = FT_buildEntry(psBuild, psGroup, psEntry, oPPath,
+                                    oNAnchor, &oNAnchor);
+         Path_free(oPPath);
+      }
+      if(psGroup->bExisting)
+         return;
+      psBuild->piResults[psEntry - psBuild->psEntries] = iStatus;
+   }
+}
+
+/*
+  Builds groups of psBuild, pvBuild, taking the next one not yet
+  taken until none is left, from node slots of the thread's own.
+  Returns NULL.
+*/
+static void *FT_buildWork(void *pvBuild) {
+   struct ftBuild *psBuild = pvBuild;
+   size_t ul;
+
+   assert(psBuild != NULL);
+
+   /* without an arena, slots come from the shared tables */
+   (void) Node_beginArena();
+   for(;;) {
+      ul = __atomic_fetch_add(&psBuild->ulNextGroup, 1,
+                              __ATOMIC_RELAXED);
+      if(ul >= psBuild->ulGroups)
+         break;
+      FT_buildGroup(psBuild, psBuild->ppsOrder[ul]);
+   }
+   Node_endArena();
+   return NULL;
+}
+
+/*
+  Links the subtrees that psBuild's groups built under the root of
+  its FT, in order of name, and inserts the groups whose tops were in
+  the FT already as FT_insertBatchIn would. A group whose subtree
+  could not be linked is freed, and its inserted entries' statuses
+  become MEMORY_ERROR. The caller holds the FT's lock exclusively, if
+  locking is on.
+*/
+static void FT_buildGraft(struct ftBuild *psBuild) {
+   FT_T oFT = psBuild->oFT;
+   struct ftBuildGroup *psGroup;
+   size_t ulNodes = 0;
+   size_t ulGroup;
+   size_t ul;
+   int *piResult;
+
+   assert(psBuild != NULL);
+
+   for(ulGroup = 0; ulGroup < psBuild->ulGroups; ulGroup++) {
+      psGroup = &psBuild->psGroups[ulGroup];
+      if(psGroup->bExisting) {
+         ul = FT_buildSkip(psBuild, psGroup->ppsEntries,
+                           psGroup->ulEntries);
+         FT_insertBatchLocked(oFT, psBuild->psEntries,
+                              psGroup->ppsEntries + ul,
+                              psGroup->ulEntries - ul,
+                              psBuild->piResults);
+         continue;
+      }
+      if(psGroup->oNTop == NULL)
+         continue;
+
+      if(Node_link(oFT->oNRoot, psGroup->oNTop) != SUCCESS) {
+         (void) Node_free(psGroup->oNTop);
+         for(ul = 0; ul < psGroup->ulEntries; ul++) {
+            piResult = &psBuild->piResults[psGroup->ppsEntries[ul] -
+                                           psBuild->psEntries];
+            if(*piResult == SUCCESS)
+               *piResult = MEMORY_ERROR;
+         }
+         continue;
+      }
+      ulNodes += psGroup->ulNodes;
+      FT_indexInserted(oFT, psGroup->oNTop,
+                       FT_dirOf(psGroup->oNTop));
+   }
+
+   FT_lockState(oFT);
+   oFT->ulCount += ulNodes;
+   FT_unlockState(oFT);
+}
+
+/* Returns TRUE if paths pcFirst and pcSecond have the same group
+   key. */
+static boolean FT_sameGroup(const char *pcFirst, const char *pcSecond) {
+   size_t ulLength = FT_groupKeyLength(pcFirst);
+
+   return (boolean) (FT_groupKeyLength(pcSecond) == ulLength &&
+                     memcmp(pcFirst, pcSecond, ulLength) == 0);
+}
+
+/* Frees what FT_buildSplit allocated for psBuild. */
+static void FT_buildFree(struct ftBuild *psBuild) {
+   assert(psBuild != NULL);
+
+   free(psBuild->psGroups);
+   free(psBuild->ppsOrder);
+}
+
+/*
+  Splits the ulCount entries at ppsSorted, sorted by
+  FT_compareGroupKeys, into psBuild's groups, and orders them for the
+  threads to take. Returns SUCCESS, or MEMORY_ERROR with nothing
+  allocated.
+*/
+static int FT_buildSplit(struct ftBuild *psBuild,
+                         const struct ftBatchEntry **ppsSorted,
+                         size_t ulCount) {
+   struct ftBuildGroup *psGroup = NULL;
+   size_t ul;
+
+   assert(psBuild != NULL);
+   assert(ppsSorted != NULL);
+
+   psBuild->ulGroups = 0;
+   for(ul = 0; ul < ulCount; ul++)
+      if(ul == 0 || !FT_sameGroup(ppsSorted[ul - 1]->pcPath,
+                                  ppsSorted[ul]->pcPath))
+         psBuild->ulGroups++;
+
+   /* malloc(0) may return NULL, so even no groups get a slot */
+   psBuild->psGroups = calloc(psBuild->ulGroups + 1,
+                              sizeof(struct ftBuildGroup));
+   psBuild->ppsOrder = malloc((psBuild->ulGroups + 1) *
+                              sizeof(struct ftBuildGroup *));
+   if(psBuild->psGroups == NULL || psBuild->ppsOrder == NULL) {
+      FT_buildFree(psBuild);
+      return MEMORY_ERROR;
+   }
+
+   for(ul = 0; ul < ulCount; ul++) {
+      if(ul == 0 || !FT_sameGroup(ppsSorted[ul - 1]->pcPath,
+                                  ppsSorted[ul]->pcPath)) {
+         psGroup = (psGroup == NULL) ? psBuild->psGroups : psGroup + 1;
+         psGroup->ppsEntries = &ppsSorted[ul];
+      }
+      psGroup->ulEntries++;
+   }
+
+   /* the biggest groups go first, so that no thread is left with a
+      big one at the end */
+   for(ul = 0; ul < psBuild->ulGroups; ul++)
+      psBuild->ppsOrder[ul] = &psBuild->psGroups[ul];
+   qsort(psBuild->ppsOrder, psBuild->ulGroups,
+         sizeof(struct ftBuildGroup *), FT_compareGroupSizes);
+   return SUCCESS;
+}
+
+int FT_buildParallelLocked(FT_T oFT,
+                           const struct ftBatchEntry *psEntries,
+                           const struct ftBatchEntry **ppsSorted,
+                           size_t ulCount, size_t ulThreads,
+                           int *piResults) {
+   struct ftBuild sBuild;
+   pthread_t *psThreads;
+   size_t ulStarted = 0;
+   size_t ul;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(ppsSorted != NULL);
+
+   sBuild.oFT = oFT;
+   sBuild.psEntries = psEntries;
+   sBuild.piResults = piResults;
+   sBuild.bWasEmpty = (boolean) (oFT->oNRoot == NULL);
+   sBuild.psFirst = NULL;
+   sBuild.ulNextGroup = 0;
+
+   iStatus = FT_buildSplit(&sBuild, ppsSorted, ulCount);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   psThreads = malloc(ulThreads * sizeof(pthread_t));
+   if(psThreads == NULL) {
+      FT_buildFree(&sBuild);
+      return MEMORY_ERROR;
+   }
+
+   /* the root comes first, made as FT_insertBatchIn would make it;
+      otherwise the threads change it only once they are done */
+   if(sBuild.bWasEmpty) {
+      sBuild.psFirst = FT_firstDir(ppsSorted, ulCount);
+      if(sBuild.psFirst != NULL) {
+         FT_insertBatchLocked(oFT, psEntries, &sBuild.psFirst, 1,
+                              piResults);
+         iStatus = piResults[sBuild.psFirst - psEntries];
+      }
+   }
+   else
+      iStatus = FT_preserve(oFT, oFT->oNRoot);
+   if(iStatus != SUCCESS) {
+      free(psThreads);
+      FT_buildFree(&sBuild);
+      return iStatus;
+   }
+
+   if(oFT->oNRoot == NULL) {
+      /* nothing can be inserted without a root */
+      for(ul = 0; ul < sBuild.ulGroups; ul++)
+         (void) FT_buildSkip(&sBuild, sBuild.psGroups[ul].ppsEntries,
+                             sBuild.psGroups[ul].ulEntries);
+   }
+   else {
+      /* this thread builds too; too few threads only make it slower */
+      for(ul = 1; ul < ulThreads && ul < sBuild.ulGroups; ul++)
+         if(pthread_create(&psThreads[ulStarted], NULL, FT_buildWork,
+                           &sBuild) == 0)
+            ulStarted++;
+      (void) FT_buildWork(&sBuild);
+      for(ul = 0; ul < ulStarted; ul++)
+         (void) pthread_join(psThreads[ul], NULL);
+      FT_buildGraft(&sBuild);
+   }
+
+   free(psThreads);
+   FT_buildFree(&sBuild);
+   return SUCCESS;
+}
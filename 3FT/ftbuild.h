@@ -0,0 +1,44 @@
+/*--------------------------------------------------------------------*/
+/* ftbuild.h                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTBUILD_INCLUDED
+#define FTBUILD_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Parallel batch building: FT_buildParallelIn gathers the entries of
+  a batch into groups by their top directories below the root, and
+  builds the groups' subtrees on several threads before grafting
+  them into the tree.
+*/
+
+/*
+  Compares the batch entries that pvFirst and pvSecond point to by
+  group key, then as FT_compareEntries does, so that sorting gathers
+  each group, in the order FT_insertBatchIn applies its entries, and
+  orders the groups by their tops' names. One pass does both: within
+  the keys, the end of a key sorts before any other character. A
+  qsort comparator.
+*/
+int FT_compareGroupKeys(const void *pvFirst,
+                        const void *pvSecond);
+
+/*
+  Implements FT_buildParallelIn for the ulCount entries of the batch
+  at psEntries, given ppsSorted, pointers to them sorted by
+  FT_compareGroupKeys. The caller holds oFT's lock exclusively, if
+  locking is on.
+*/
+int FT_buildParallelLocked(FT_T oFT,
+                           const struct ftBatchEntry *psEntries,
+                           const struct ftBatchEntry **ppsSorted,
+                           size_t ulCount, size_t ulThreads,
+                           int *piResults);
+
+#endif
@@ -0,0 +1,197 @@
+/*--------------------------------------------------------------------*/
+/* ftcombine.c                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthreads and sched_yield */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ftimpl.h"
+#include "ftcombine.h"
+
+/* The most batches a combiner applies before it lets go of the lock */
+enum { FT_COMBINE_BATCHES = 4 };
+
+/*
+  An update published under FT_LOCK_COMBINING. It lives on the stack
+  of the thread that published it, which waits until a combiner has
+  applied it.
+*/
+struct ftRequest {
+   enum ftUpdate eUpdate;
+   const char *pcPath;
+   /* for FT_UPDATE_INSERT_FILE, the new file's contents */
+   void *pvContents;
+   size_t ulLength;
+   /* the update's status, once bDone */
+   int iStatus;
+   /* set by the combiner, which touches the request no more after */
+   boolean bDone;
+   /* the next request published, or next in the combiner's batch */
+   struct ftRequest *psNext;
+};
+
+/*
+  Applies update psRequest to oFT and records its result in
+  psRequest->iStatus. The caller holds oFT's lock exclusively.
+*/
+static void FT_applyRequest(FT_T oFT, struct ftRequest *psRequest) {
+   assert(oFT != NULL);
+   assert(psRequest != NULL);
+
+   switch(psRequest->eUpdate) {
+      case FT_UPDATE_INSERT_DIR:
+         psRequest->iStatus = FT_insertDirLocked(oFT,
+                                                 psRequest->pcPath);
+         break;
+      case FT_UPDATE_INSERT_FILE:
+         psRequest->iStatus = FT_insertFileLocked(oFT,
+                                                  psRequest->pcPath,
+                                                  psRequest->pvContents,
+                                                  psRequest->ulLength);
+         break;
+      case FT_UPDATE_RM_DIR:
+         psRequest->iStatus = FT_rmDirLocked(oFT, psRequest->pcPath);
+         break;
+      default:
+         assert(psRequest->eUpdate == FT_UPDATE_RM_FILE);
+         psRequest->iStatus = FT_rmFileLocked(oFT, psRequest->pcPath);
+         break;
+   }
+}
+
+/*
+  Sorts the ulLength requests of list psList by path, keeping requests
+  for equal paths in list order, and returns the sorted list. A
+  combiner applies a batch in this order so that consecutive updates
+  share prefixes, which the directory cache then skips.
+*/
+static struct ftRequest *FT_sortRequests(struct ftRequest *psList,
+                                         size_t ulLength) {
+   struct ftRequest sHead;
+   struct ftRequest *psSecond;
+   struct ftRequest *psTail;
+   size_t ul;
+
+   if(ulLength < 2)
+      return psList;
+
+   /* split after the first half, sort each half, and merge */
+   psTail = psList;
+   for(ul = 1; ul < ulLength / 2; ul++)
+      psTail = psTail->psNext;
+   psSecond = psTail->psNext;
+   psTail->psNext = NULL;
+
+   psList = FT_sortRequests(psList, ulLength / 2);
+   psSecond = FT_sortRequests(psSecond, ulLength - ulLength / 2);
+
+   psTail = &sHead;
+   while(psList != NULL && psSecond != NULL) {
+      if(strcmp(psSecond->pcPath, psList->pcPath) < 0) {
+         psTail->psNext = psSecond;
+         psSecond = psSecond->psNext;
+      }
+      else {
+         psTail->psNext = psList;
+         psList = psList->psNext;
+      }
+      psTail = psTail->psNext;
+   }
+   psTail->psNext = (psList != NULL) ? psList : psSecond;
+   return sHead.psNext;
+}
+
+/*
+  Takes the updates published to oFT, applies them in path order, and
+  marks each done. Returns FALSE if there were none. The caller is the
+  combiner and holds oFT's lock exclusively.
+*/
+static boolean FT_combineBatch(FT_T oFT) {
+   struct ftRequest *psList;
+   struct ftRequest *psReversed = NULL;
+   struct ftRequest *psNext;
+   size_t ulLength = 0;
+
+   psList = __atomic_exchange_n(&oFT->psPending, NULL,
+                                __ATOMIC_ACQUIRE);
+   if(psList == NULL)
+      return FALSE;
+
+   /* the list is newest first; oldest first is fairer */
+   while(psList != NULL) {
+      psNext = psList->psNext;
+      psList->psNext = psReversed;
+      psReversed = psList;
+      psList = psNext;
+      ulLength++;
+   }
+
+   psList = FT_sortRequests(psReversed, ulLength);
+   while(psList != NULL) {
+      /* once marked done, the request may vanish with its stack */
+      psNext = psList->psNext;
+      FT_applyRequest(oFT, psList);
+      __atomic_store_n(&psList->bDone, TRUE, __ATOMIC_RELEASE);
+      psList = psNext;
+   }
+   return TRUE;
+}
+
+/*
+  Publishes update psRequest to oFT, whose locking is
+  FT_LOCK_COMBINING, and returns once some combiner, perhaps the
+  calling thread itself, has applied it.
+*/
+static void FT_combine(FT_T oFT, struct ftRequest *psRequest) {
+   size_t ulBatch;
+
+   assert(oFT != NULL);
+   assert(psRequest != NULL);
+
+   psRequest->bDone = FALSE;
+   psRequest->psNext = __atomic_load_n(&oFT->psPending,
+                                       __ATOMIC_RELAXED);
+   while(!__atomic_compare_exchange_n(&oFT->psPending,
+                                      &psRequest->psNext, psRequest,
+                                      TRUE, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED))
+      ;
+
+   while(!__atomic_load_n(&psRequest->bDone, __ATOMIC_ACQUIRE)) {
+      if(pthread_mutex_trylock(&oFT->sCombineLock) != 0) {
+         (void) sched_yield();
+         continue;
+      }
+
+      /* any batch taken now includes psRequest, unless another
+         combiner took it first and is applying it */
+      FT_lockExclusive(oFT);
+      for(ulBatch = 0; ulBatch < FT_COMBINE_BATCHES; ulBatch++)
+         if(!FT_combineBatch(oFT))
+            break;
+      FT_unlock(oFT);
+      (void) pthread_mutex_unlock(&oFT->sCombineLock);
+   }
+}
+
+int FT_combineUpdate(FT_T oFT, enum ftUpdate eUpdate,
+                     const char *pcPath, void *pvContents,
+                     size_t ulLength) {
+   struct ftRequest sRequest;
+
+   assert(pcPath != NULL);
+
+   sRequest.eUpdate = eUpdate;
+   sRequest.pcPath = pcPath;
+   sRequest.pvContents = pvContents;
+   sRequest.ulLength = ulLength;
+   FT_combine(oFT, &sRequest);
+   return sRequest.iStatus;
+}
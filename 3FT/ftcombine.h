@@ -0,0 +1,40 @@
+/*--------------------------------------------------------------------*/
+/* ftcombine.h                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTCOMBINE_INCLUDED
+#define FTCOMBINE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Flat combining. Under FT_LOCK_COMBINING, a thread that inserts or
+  removes publishes the update instead of taking the lock itself.
+  Whichever waiting thread gets sCombineLock becomes the combiner: it
+  takes the lock once, applies every published update in path order,
+  and hands each publisher its result, so that a burst of updates
+  costs one lock handoff rather than one per update.
+*/
+
+/* The updates that FT_LOCK_COMBINING hands to a combiner */
+enum ftUpdate {
+   FT_UPDATE_INSERT_DIR,
+   FT_UPDATE_INSERT_FILE,
+   FT_UPDATE_RM_DIR,
+   FT_UPDATE_RM_FILE
+};
+
+/*
+  Performs update eUpdate of pcPath, with pvContents and ulLength for
+  a file insert, on oFT, whose locking is FT_LOCK_COMBINING, through a
+  combiner. Returns the update's status.
+*/
+int FT_combineUpdate(FT_T oFT, enum ftUpdate eUpdate,
+                     const char *pcPath, void *pvContents,
+                     size_t ulLength);
+
+#endif
@@ -0,0 +1,387 @@
+/*--------------------------------------------------------------------*/
+/* ftimpl.h                                                           */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTIMPL_INCLUDED
+#define FTIMPL_INCLUDED
+
+#include <stddef.h>
+#include <pthread.h>
+#include "a4def.h"
+#include "dynarray.h"
+#include "path.h"
+#include "nodeFT.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include "bloom.h"
+#include "ft.h"
+
+/*
+  The internal interface shared by ft.c, which implements the FT_T
+  operations, and the modules that implement its features on top of
+  them: snapshots (ftsnap), the background reclaimer (ftreclaim),
+  parallel batch building (ftbuild), the sorted bulk loader (ftload),
+  transactions (fttxn), flat combining (ftcombine) and sharding
+  (ftshard). None of it is for clients of ft.h.
+*/
+
+/* how to undo one operation of a transaction; see fttxn.h */
+struct ftUndo;
+
+/*
+  A File Tree is a representation of a hierarchy of directories and
+  files. Each FT_T instance holds its own hierarchy and its own
+  indexes over it; the FT_ functions without an FT_T parameter act on
+  a default instance, which FT_init and FT_destroy set up and tear
+  down.
+*/
+struct ft {
+   /* a flag for being in an initialized state (TRUE) or not (FALSE) */
+   boolean bIsInitialized;
+   /* a pointer to the root node in the hierarchy */
+   Node_T oNRoot;
+   /* a counter of the number of nodes in the hierarchy */
+   size_t ulCount;
+
+   /*
+     Optionally, a cache mapping the full pathname of every node to
+     the node, so that lookups of existing paths skip parsing and
+     walking. It is NULL while the cache is disabled. Keys are the
+     nodes' own pathnames, so every node's entry is removed before the
+     node is freed. An entry may be missing if memory ran out while
+     adding it; that only costs a walk, since a cache miss is never
+     taken to mean the path is absent.
+   */
+   PathCache_T oPCache;
+
+   /*
+     While initialized, the directories most recently reached by
+     walks, so that the next walk can resume from the deepest one that
+     is an ancestor of its path. It is NULL if it could not be
+     allocated, in which case every walk starts at the root.
+   */
+   DirCache_T oDCache;
+
+   /*
+     If created with a filter, a counting Bloom filter over every
+     node's pathname, so that most lookups of absent paths are
+     rejected after a few hash probes. It is NULL otherwise. The
+     counters below measure how well it does.
+   */
+   Bloom_T oBFilter;
+   /* the number of lookups that consulted the filter */
+   size_t ulFilterProbes;
+   /* the number of those the filter rejected outright */
+   size_t ulFilterNegatives;
+   /* the number the filter passed that then found no such file or
+      directory */
+   size_t ulFilterFalsePositives;
+
+   /* The open directory handles, valid or not, or NULL if none has
+      been opened since the FT was initialized */
+   DynArray_T oDHandles;
+
+   /*
+     Unless eLocking is FT_LOCK_NONE, a reader-writer lock that every
+     FT_T operation takes. Under FT_LOCK_TREE, it is shared if the
+     operation only reads the hierarchy and exclusive if it may change
+     it. Operations under the shared lock neither use the directory
+     cache nor count anything, so they write nothing.
+
+     Under FT_LOCK_DIRS, operations below the root take it shared and
+     lock the directories on their path hand over hand instead, so
+     that writers to unrelated directories proceed in parallel; only
+     changes to the root, whole-tree traversals and handle operations
+     take it exclusively. The path cache, directory cache and filter,
+     which index the whole tree, are off in this mode, and sStateLock
+     guards ulCount and oDHandles.
+
+     Under FT_LOCK_OPTIMISTIC, writers take it as under FT_LOCK_TREE,
+     but single-path lookups take no lock: they validate what they
+     read against node versions, and fall back to the shared lock
+     only after FT_OPTIMISTIC_TRIES failures. Those lookups must not
+     consult anything a writer may free, so the path cache and filter
+     are off; only writers use the directory cache.
+
+     Under FT_LOCK_COMBINING, readers take it as under FT_LOCK_TREE,
+     but inserts and removals are pushed onto psPending, and only the
+     thread holding sCombineLock, the combiner, takes it exclusively
+     to apply them.
+   */
+   FT_Locking eLocking;
+   pthread_rwlock_t sLock;
+   pthread_mutex_t sStateLock;
+   pthread_mutex_t sCombineLock;
+   struct ftRequest *psPending;
+
+   /*
+     Even while no transaction is open on the FT and odd while one is,
+     so that lock-free lookups, which the transaction's lock does not
+     hold off, can tell that what they read may yet be undone.
+   */
+   unsigned int uiTxnVersion;
+
+   /*
+     TRUE if removals hand large subtrees to the background reclaimer
+     rather than freeing them before returning, and the number of
+     subtrees handed over that it has not freed yet, which
+     sReclaimLock guards.
+   */
+   boolean bBackgroundReclaim;
+   size_t ulReclaimPending;
+
+   /*
+     If the FT was created by FT_newSharded, its ulShards shards, and
+     NULL otherwise. A sharded FT holds no nodes itself: every shard
+     holds the same root, and the subtree of each entry under the root
+     lives in the shard that the entry's name hashes to, so that
+     operations below the root touch one shard and take only its lock.
+     sLock is then always on: operations take it shared, and only
+     those that create or remove the root, in every shard at once,
+     take it exclusively.
+   */
+   FT_T *poFShards;
+   size_t ulShards;
+   /* for a shard, the sharded FT it belongs to, and NULL otherwise */
+   FT_T oFTOwner;
+
+   /*
+     The open snapshots, oldest first, and the subtrees removed while
+     any was open, in the order they were removed; both are NULL until
+     the first snapshot is taken. While a snapshot is open, a change
+     to a node first records what the node looked like in a shadow for
+     the snapshot, and a removal detaches the subtree instead of
+     freeing it, until no open snapshot can still reach it.
+     ulSnapshotSeq is the number of snapshots taken so far.
+   */
+   DynArray_T oDSnapshots;
+   DynArray_T oDRemoved;
+   size_t ulSnapshotSeq;
+};
+
+/*
+  A directory handle names a directory node directly, so operations
+  through it need not walk. Its FT keeps every open handle in
+  oDHandles until it is closed, so that removing a directory can
+  invalidate the handles to it and to its descendants before the
+  nodes are freed, and so that destroying the FT can detach them all.
+*/
+struct dirHandle {
+   /* the FT that the directory belongs to, or NULL once that FT has
+      been destroyed */
+   FT_T oFT;
+   /* the directory, or NULL once the handle has been invalidated */
+   Node_T oNDir;
+   /* the handle's index in oFT->oDHandles, while oFT is not NULL */
+   size_t ulIndex;
+   /* TRUE if the handle names the root of a sharded FT, held in shard
+      0, so that its entries must be found through their own shards */
+   boolean bShardRoot;
+};
+
+/* Takes oFT's lock for reading, if locking is on. */
+void FT_lockShared(FT_T oFT);
+
+/* Takes oFT's lock for writing, if locking is on. */
+void FT_lockExclusive(FT_T oFT);
+
+/* Releases oFT's lock, if locking is on. */
+void FT_unlock(FT_T oFT);
+
+/*
+  Takes oFT's lock for an operation that reads more than one path,
+  which per-directory locking does not cover: shared unless
+  per-directory locking is on, exclusive if it is.
+*/
+void FT_lockWhole(FT_T oFT);
+
+/* Takes oFT's sStateLock, if per-directory locking is on. */
+void FT_lockState(FT_T oFT);
+
+/* Releases oFT's sStateLock, if per-directory locking is on. */
+void FT_unlockState(FT_T oFT);
+
+/*
+  Releases the lock that a walk under per-directory locking left held
+  for oNFurthest, the node it returned: the lock of FT_guardOf
+  oNFurthest. Does nothing if oNFurthest is NULL or per-directory
+  locking is off.
+*/
+void FT_releaseGuard(FT_T oFT, Node_T oNFurthest);
+
+/*
+  Traverses the FT to find a node with absolute path pcPath. Returns a
+  int SUCCESS status and sets *poNResult to be the node, if found.
+  Otherwise, sets *poNResult to NULL and returns with status:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root's path is not a prefix of pcPath
+  * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  If bShared, the caller holds only the shared lock, so the lookup
+  changes neither the caches nor their statistics. Under per-directory
+  locking, success leaves the guard of *poNResult locked as
+  FT_traversePath does, for the caller to release with
+  FT_releaseGuard.
+ */
+int FT_findNode(FT_T oFT, const char *pcPath, boolean bShared,
+                Node_T *poNResult);
+
+/* Adds oNNode to the path cache and the Bloom filter of FT pvFT, as
+   enabled. */
+void FT_indexAdd(Node_T oNNode, void *pvFT);
+
+/*
+  Rebuilds the Bloom filter at twice its capacity once it holds more
+  paths than it was sized for, so that its false-positive rate stays
+  near the one requested. If memory for the bigger filter cannot be
+  allocated, keeps the old one, which is still correct, only less
+  selective.
+*/
+void FT_growFilter(FT_T oFT);
+
+/*
+  Records the nodes of the newly inserted subtree rooted at
+  oNFirstNew in the path cache and the Bloom filter, as enabled, and
+  records oNDir, the deepest directory involved, in the directory
+  cache.
+*/
+void FT_indexInserted(FT_T oFT, Node_T oNFirstNew,
+                      Node_T oNDir);
+
+/*
+  Invalidates every directory handle to a directory at or below path
+  oPPath. The handles stay registered until they are closed.
+*/
+void FT_invalidateHandlesUnder(FT_T oFT, Path_T oPPath);
+
+/*
+  Drops every node of the subtree rooted at oNNode from the path
+  cache, the Bloom filter and the directory cache, as enabled, before
+  the subtree leaves oFT.
+*/
+void FT_unindexSubtree(FT_T oFT, Node_T oNNode);
+
+/*
+  Creates the nodes on oPPath below oNCurr, the deepest node on it
+  that exists, or all of them from the root if oNCurr is NULL, each
+  linked into the one above: directories down to the last level, and
+  there a file with a copy of the ulLength bytes at pvContents if
+  bIsFile is TRUE or a directory otherwise. Touches no FT state. On
+  success, returns SUCCESS and sets *poNFirstNew to the highest new
+  node, *poNDir to the deepest directory on oPPath and *pulNewNodes
+  to the number of nodes created. Otherwise, frees what it created
+  and returns a status as Node_new does.
+*/
+int FT_growChain(Path_T oPPath, Node_T oNCurr, boolean bIsFile,
+                 void *pvContents, size_t ulLength,
+                 Node_T *poNFirstNew, Node_T *poNDir,
+                 size_t *pulNewNodes);
+
+/*
+  Implements FT_insertDirIn (bIsFile FALSE) and FT_insertFileIn
+  (bIsFile TRUE), recording how to undo the insertion in psUndo
+  unless it is NULL; the caller holds oFT's lock as FT_lockForUpdate
+  takes it.
+*/
+int FT_insertLocked(FT_T oFT, const char *pcPath,
+                    boolean bIsFile, void *pvContents,
+                    size_t ulLength, struct ftUndo *psUndo);
+
+/* Implements FT_insertDirIn; the caller holds oFT's lock as
+   FT_lockForUpdate takes it. */
+int FT_insertDirLocked(FT_T oFT, const char *pcPath);
+
+/* Implements FT_insertFileIn; the caller holds oFT's lock as
+   FT_lockForUpdate takes it. */
+int FT_insertFileLocked(FT_T oFT, const char *pcPath,
+                        void *pvContents, size_t ulLength);
+
+/*
+  Finds the deepest node on oPPath in oFT, as FT_traversePath does,
+  but walks down from oNStart, a directory in oFT whose path is a
+  prefix of oPPath, or from the root if oNStart is NULL, and consults
+  neither the directory cache nor any directory's lock. The caller
+  holds oFT's lock exclusively or as FT_lockWhole takes it, if
+  locking is on.
+*/
+int FT_descendFrom(FT_T oFT, Path_T oPPath, Node_T oNStart,
+                   Node_T *poNFurthest);
+
+/*
+  Returns the deepest of directory oNAnchor and its ancestors whose
+  path is a prefix of oPPath, or NULL if there is none or oNAnchor is
+  NULL. Consecutive paths in sorted order share long prefixes, so
+  this usually climbs a level or two rather than walking down from
+  the root again.
+*/
+Node_T FT_climbToward(Node_T oNAnchor, Path_T oPPath);
+
+/*
+  Returns the deepest directory on the path of oNNode: oNNode itself
+  if it is a directory, its parent if it is a file, and NULL if
+  oNNode is NULL.
+*/
+Node_T FT_dirOf(Node_T oNNode);
+
+/*
+  Compares the paths of the batch entries that pvFirst and pvSecond
+  point to, ordering entries with the same path by their place in the
+  batch, so that sorting keeps them in order. A qsort comparator.
+*/
+int FT_compareEntries(const void *pvFirst,
+                      const void *pvSecond);
+
+/*
+  Implements FT_insertBatchIn for the ulCount entries of the batch at
+  psEntries, given ppsSorted, pointers to them sorted by path. The
+  caller holds oFT's lock exclusively, if locking is on.
+*/
+void FT_insertBatchLocked(FT_T oFT,
+                          const struct ftBatchEntry *psEntries,
+                          const struct ftBatchEntry **ppsSorted,
+                          size_t ulCount, int *piResults);
+
+/* Implements FT_rmDirIn; the caller holds oFT's lock as
+   FT_lockForUpdate takes it. */
+int FT_rmDirLocked(FT_T oFT, const char *pcPath);
+
+/* Implements FT_rmFileIn; the caller holds oFT's lock as
+   FT_lockForUpdate takes it. */
+int FT_rmFileLocked(FT_T oFT, const char *pcPath);
+
+/* Implements FT_getFileContentsIn; the caller holds oFT's lock,
+   shared or exclusively, if locking is on. */
+void *FT_getFileContentsLocked(FT_T oFT, const char *pcPath);
+
+/* Implements FT_statIn; the caller holds oFT's lock, shared or
+   exclusively, if locking is on. */
+int FT_statLocked(FT_T oFT, const char *pcPath, boolean *pbIsFile,
+                  size_t *pulSize);
+
+/*
+  Performs a pre-order traversal of the tree rooted at oNNode, calling
+  (*pfVisit)(oNVisited, pvExtra) on each node in turn, in the order of
+  FT_preOrderNext. Each node is touched exactly once.
+*/
+void FT_preOrderTraversal(Node_T oNNode,
+                          void (*pfVisit)(Node_T, void *),
+                          void *pvExtra);
+
+/*
+  Alternate version of strlen that uses pulAcc as an in-out parameter
+  to accumulate a string length, rather than returning the length of
+  oNNode's path, and also always adds one addition byte to the sum.
+*/
+void FT_strlenAccumulate(Node_T oNNode, size_t *pulAcc);
+
+/*
+  Alternate version of strcat that appends oNNode's path and one
+  newline at *ppcEnd, the current end of the string being built, and
+  advances *ppcEnd past them. Tracking the end keeps each append
+  proportional to the appended length rather than the whole string.
+*/
+void FT_strcatAccumulate(Node_T oNNode, char **ppcEnd);
+
+#endif
@@ -0,0 +1,391 @@
+/*--------------------------------------------------------------------*/
+/* ftload.c                                                           */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthread_rwlock_t */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dynarray.h"
+#include "path.h"
+#include "nodeFT.h"
+#include "ftimpl.h"
+#include "ftsnap.h"
+#include "ftload.h"
+
+/* An open directory of a bulk load */
+struct ftLoadFrame {
+   Node_T oNDir;
+   /* where the directory's children start on the pending stacks */
+   size_t ulFirstFile;
+   size_t ulFirstDir;
+   /* how far on the pending stacks new directories have been checked
+      against the files for a clash of names, and new files against
+      the directories; names only grow, so neither cursor goes back */
+   size_t ulFileCursor;
+   size_t ulDirCursor;
+};
+
+/*
+  The state of a bulk load. The directories on the path of the entry
+  loaded last are open. The children of each open directory wait on
+  the pending stacks, in order and above those of the directories it
+  is in, until it is closed and they are linked into it at once.
+*/
+struct ftLoader {
+   /* the frames of the open directories, root first, at the indices
+      below ulOpen; the frames above are kept for reuse */
+   DynArray_T oDFrames;
+   size_t ulOpen;
+   /* the pending file and directory children */
+   DynArray_T oDFiles;
+   DynArray_T oDDirs;
+   /* the root, once it is created */
+   Node_T oNRoot;
+   /* the number of nodes created */
+   size_t ulCount;
+};
+
+/* Returns the last component of the path of oNNode. */
+static const char *FT_nameOf(Node_T oNNode) {
+   Path_T oPPath;
+
+   assert(oNNode != NULL);
+
+   oPPath = Node_getPath(oNNode);
+   return Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+}
+
+/* Returns the frame of the innermost directory open in psLoader. */
+static struct ftLoadFrame *FT_loadTop(struct ftLoader *psLoader) {
+   assert(psLoader != NULL);
+   assert(psLoader->ulOpen > 0);
+
+   return DynArray_get(psLoader->oDFrames, psLoader->ulOpen - 1);
+}
+
+/*
+  Opens directory oNDir in psLoader, as the innermost directory, with
+  no children yet. Returns SUCCESS, or MEMORY_ERROR if there was no
+  frame to reuse and none could be made.
+*/
+static int FT_loadOpen(struct ftLoader *psLoader, Node_T oNDir) {
+   struct ftLoadFrame *psFrame;
+
+   assert(psLoader != NULL);
+   assert(oNDir != NULL);
+
+   if(psLoader->ulOpen == DynArray_getLength(psLoader->oDFrames)) {
+      psFrame = malloc(sizeof(struct ftLoadFrame));
+      if(psFrame == NULL)
+         return MEMORY_ERROR;
+      if(!DynArray_add(psLoader->oDFrames, psFrame)) {
+         free(psFrame);
+         return MEMORY_ERROR;
+      }
+   }
+   psFrame = DynArray_get(psLoader->oDFrames, psLoader->ulOpen);
+   psLoader->ulOpen++;
+
+   psFrame->oNDir = oNDir;
+   psFrame->ulFirstFile = DynArray_getLength(psLoader->oDFiles);
+   psFrame->ulFirstDir = DynArray_getLength(psLoader->oDDirs);
+   psFrame->ulFileCursor = psFrame->ulFirstFile;
+   psFrame->ulDirCursor = psFrame->ulFirstDir;
+   return SUCCESS;
+}
+
+/* Pops the nodes on pending stack oDPending from index ulFirst up. */
+static void FT_loadPop(DynArray_T oDPending, size_t ulFirst) {
+   assert(oDPending != NULL);
+
+   while(DynArray_getLength(oDPending) > ulFirst)
+      (void) DynArray_removeAt(oDPending,
+                               DynArray_getLength(oDPending) - 1);
+}
+
+/*
+  Closes the innermost directory open in psLoader, linking its
+  pending children into it. Returns SUCCESS, or MEMORY_ERROR with the
+  directory still open.
+*/
+static int FT_loadClose(struct ftLoader *psLoader) {
+   struct ftLoadFrame *psFrame;
+
+   assert(psLoader != NULL);
+
+   psFrame = FT_loadTop(psLoader);
+   if(Node_setChildren(psFrame->oNDir, psLoader->oDFiles,
+                       psFrame->ulFirstFile, psLoader->oDDirs,
+                       psFrame->ulFirstDir) != SUCCESS)
+      return MEMORY_ERROR;
+
+   FT_loadPop(psLoader->oDFiles, psFrame->ulFirstFile);
+   FT_loadPop(psLoader->oDDirs, psFrame->ulFirstDir);
+   psLoader->ulOpen--;
+   return SUCCESS;
+}
+
+/*
+  Creates the node with path oPPath, which it takes over, as the next
+  child of the innermost directory open in psLoader, or as the root if
+  none is, and opens it if it is a directory. The node is a file with
+  a copy of the ulLength bytes at pvContents if bIsFile is TRUE. bLast
+  is TRUE if oPPath is the path of the entry being loaded rather than
+  of a directory above it that the entry implies. Returns SUCCESS or,
+  with psLoader's nodes as they were:
+  * CONFLICTING_PATH if the node comes out of order, before or back
+    into a child already loaded
+  * ALREADY_IN_TREE if the entry's path was loaded before
+  * NOT_A_DIRECTORY if an implied directory was loaded as a file
+  * MEMORY_ERROR if memory could not be allocated
+  but with a directory that could not be opened left pending.
+*/
+static int FT_loadChild(struct ftLoader *psLoader, Path_T oPPath,
+                        boolean bIsFile, boolean bLast,
+                        void *pvContents, size_t ulLength) {
+   struct ftLoadFrame *psFrame;
+   DynArray_T oDSame = NULL;
+   DynArray_T oDOther;
+   size_t ulFirstSame;
+   size_t *pulCursor;
+   Node_T oNDir = NULL;
+   Node_T oNNew;
+   const char *pcName;
+   int iCmp;
+   int iStatus;
+
+   assert(psLoader != NULL);
+   assert(oPPath != NULL);
+
+   if(psLoader->ulOpen > 0) {
+      psFrame = FT_loadTop(psLoader);
+      oNDir = psFrame->oNDir;
+      pcName = Path_getComponent(oPPath, Path_getDepth(oPPath) - 1);
+      if(bIsFile) {
+         oDSame = psLoader->oDFiles;
+         ulFirstSame = psFrame->ulFirstFile;
+         oDOther = psLoader->oDDirs;
+         pulCursor = &psFrame->ulDirCursor;
+      }
+      else {
+         oDSame = psLoader->oDDirs;
+         ulFirstSame = psFrame->ulFirstDir;
+         oDOther = psLoader->oDFiles;
+         pulCursor = &psFrame->ulFileCursor;
+      }
+
+      /* the children of each kind come in increasing order of name */
+      if(DynArray_getLength(oDSame) > ulFirstSame) {
+         iCmp = strcmp(FT_nameOf(DynArray_get(oDSame,
+                          DynArray_getLength(oDSame) - 1)), pcName);
+         if(iCmp > 0 || (iCmp == 0 && !bLast)) {
+            Path_free(oPPath);
+            return CONFLICTING_PATH;
+         }
+         if(iCmp == 0) {
+            Path_free(oPPath);
+            return ALREADY_IN_TREE;
+         }
+      }
+
+      /* and no name is taken by both kinds */
+      while(*pulCursor < DynArray_getLength(oDOther) &&
+            strcmp(FT_nameOf(DynArray_get(oDOther, *pulCursor)),
+                   pcName) < 0)
+         (*pulCursor)++;
+      if(*pulCursor < DynArray_getLength(oDOther) &&
+         strcmp(FT_nameOf(DynArray_get(oDOther, *pulCursor)),
+                pcName) == 0) {
+         Path_free(oPPath);
+         return bLast ? ALREADY_IN_TREE : NOT_A_DIRECTORY;
+      }
+   }
+   else
+      assert(psLoader->oNRoot == NULL && !bIsFile);
+
+   iStatus = Node_newUnlinked(oPPath, oNDir, &oNNew, bIsFile,
+                              pvContents, ulLength);
+   if(iStatus != SUCCESS) {
+      Path_free(oPPath);
+      return iStatus;
+   }
+   if(oNDir == NULL)
+      psLoader->oNRoot = oNNew;
+   else if(!DynArray_add(oDSame, oNNew)) {
+      (void) Node_free(oNNew);
+      return MEMORY_ERROR;
+   }
+   psLoader->ulCount++;
+
+   if(bIsFile)
+      return SUCCESS;
+   return FT_loadOpen(psLoader, oNNew);
+}
+
+/*
+  Loads the entry at psEntry into psLoader: closes the open
+  directories not on its path, and creates the node for it and the
+  directories above it that are missing. Returns SUCCESS, BAD_PATH if
+  its path is not well-formatted, CONFLICTING_PATH if it is a file
+  and no root was loaded yet or the root's path is not a prefix of
+  it, ALREADY_IN_TREE if it names an open
+  directory, or a status as FT_loadChild returns.
+*/
+static int FT_loadEntry(struct ftLoader *psLoader,
+                        const struct ftBatchEntry *psEntry) {
+   Path_T oPPath = NULL;
+   Path_T oPLevel = NULL;
+   size_t ulDepth;
+   size_t ulLevel = 0;
+   boolean bLast;
+   int iStatus;
+
+   assert(psLoader != NULL);
+   assert(psEntry != NULL);
+   assert(psEntry->pcPath != NULL);
+
+   iStatus = Path_new(psEntry->pcPath, &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   ulDepth = Path_getDepth(oPPath);
+
+   /* as in FT_insertBelow, a file cannot start an empty tree */
+   if(psLoader->oNRoot == NULL && psEntry->bIsFile) {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+
+   /* the open directories are those on the path of the entry before,
+      one per level from the root */
+   if(psLoader->ulOpen > 0) {
+      ulLevel = Path_getSharedPrefixDepth(
+                   Node_getPath(FT_loadTop(psLoader)->oNDir), oPPath);
+      if(ulLevel == 0 || ulLevel == ulDepth) {
+         Path_free(oPPath);
+         return (ulLevel == 0) ? CONFLICTING_PATH : ALREADY_IN_TREE;
+      }
+      while(psLoader->ulOpen > ulLevel) {
+         iStatus = FT_loadClose(psLoader);
+         if(iStatus != SUCCESS) {
+            Path_free(oPPath);
+            return iStatus;
+         }
+      }
+   }
+
+   for(ulLevel++; ulLevel <= ulDepth; ulLevel++) {
+      bLast = (boolean) (ulLevel == ulDepth);
+      if(bLast)
+         oPLevel = oPPath;
+      else {
+         iStatus = Path_prefix(oPPath, ulLevel, &oPLevel);
+         if(iStatus != SUCCESS) {
+            Path_free(oPPath);
+            return iStatus;
+         }
+      }
+
+      iStatus = FT_loadChild(psLoader, oPLevel,
+                             (boolean) (bLast && psEntry->bIsFile),
+                             bLast, psEntry->pvContents,
+                             psEntry->ulLength);
+      if(iStatus != SUCCESS) {
+         if(!bLast)
+            Path_free(oPPath);
+         return iStatus;
+      }
+   }
+   return SUCCESS;
+}
+
+/* Frees the nodes on pending stack oDPending from index ulFirst up. */
+static void FT_loadDrop(DynArray_T oDPending, size_t ulFirst) {
+   assert(oDPending != NULL);
+
+   while(DynArray_getLength(oDPending) > ulFirst)
+      (void) Node_free(DynArray_removeAt(oDPending,
+                          DynArray_getLength(oDPending) - 1));
+}
+
+/*
+  Frees every node psLoader has created, innermost directory first,
+  so that no node outlives its parent.
+*/
+static void FT_loadAbandon(struct ftLoader *psLoader) {
+   struct ftLoadFrame *psFrame;
+
+   assert(psLoader != NULL);
+
+   while(psLoader->ulOpen > 0) {
+      psFrame = FT_loadTop(psLoader);
+      FT_loadDrop(psLoader->oDFiles, psFrame->ulFirstFile);
+      FT_loadDrop(psLoader->oDDirs, psFrame->ulFirstDir);
+      psLoader->ulOpen--;
+   }
+
+   /* a directory whose frame could not be opened is still pending */
+   FT_loadDrop(psLoader->oDFiles, 0);
+   FT_loadDrop(psLoader->oDDirs, 0);
+   if(psLoader->oNRoot != NULL)
+      (void) Node_free(psLoader->oNRoot);
+   psLoader->oNRoot = NULL;
+   psLoader->ulCount = 0;
+}
+
+int FT_bulkLoadLocked(FT_T oFT,
+                      boolean (*pfNext)(void *pvReader,
+                                        struct ftBatchEntry *psEntry),
+                      void *pvReader) {
+   struct ftLoader sLoader;
+   struct ftBatchEntry sEntry;
+   size_t ul;
+   int iStatus = SUCCESS;
+
+   assert(oFT != NULL);
+   assert(oFT->oNRoot == NULL);
+   assert(pfNext != NULL);
+
+   sLoader.oDFrames = DynArray_new(0);
+   sLoader.oDFiles = DynArray_new(0);
+   sLoader.oDDirs = DynArray_new(0);
+   sLoader.ulOpen = 0;
+   sLoader.oNRoot = NULL;
+   sLoader.ulCount = 0;
+   if(sLoader.oDFrames == NULL || sLoader.oDFiles == NULL ||
+      sLoader.oDDirs == NULL)
+      iStatus = MEMORY_ERROR;
+
+   while(iStatus == SUCCESS && (*pfNext)(pvReader, &sEntry))
+      iStatus = FT_loadEntry(&sLoader, &sEntry);
+   while(iStatus == SUCCESS && sLoader.ulOpen > 0)
+      iStatus = FT_loadClose(&sLoader);
+
+   if(iStatus != SUCCESS && sLoader.oDFrames != NULL &&
+      sLoader.oDFiles != NULL && sLoader.oDDirs != NULL)
+      FT_loadAbandon(&sLoader);
+   if(sLoader.oDFrames != NULL) {
+      for(ul = 0; ul < DynArray_getLength(sLoader.oDFrames); ul++)
+         free(DynArray_get(sLoader.oDFrames, ul));
+      DynArray_free(sLoader.oDFrames);
+   }
+   if(sLoader.oDFiles != NULL)
+      DynArray_free(sLoader.oDFiles);
+   if(sLoader.oDDirs != NULL)
+      DynArray_free(sLoader.oDDirs);
+   if(iStatus != SUCCESS || sLoader.oNRoot == NULL)
+      return iStatus;
+
+   /* the whole tree is linked before lock-free lookups can reach it */
+   __atomic_store_n(&oFT->oNRoot, sLoader.oNRoot, __ATOMIC_RELEASE);
+   FT_lockState(oFT);
+   oFT->ulCount += sLoader.ulCount;
+   FT_unlockState(oFT);
+   FT_indexInserted(oFT, sLoader.oNRoot, sLoader.oNRoot);
+   return SUCCESS;
+}
@@ -0,0 +1,29 @@
+/*--------------------------------------------------------------------*/
+/* ftload.h                                                           */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTLOAD_INCLUDED
+#define FTLOAD_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  The sorted bulk loader: FT_bulkLoadSortedIn builds an empty FT from
+  a stream of entries in sorted path order, directory by directory,
+  without walking from the root for each entry.
+*/
+
+/*
+  Implements FT_bulkLoadSortedIn for oFT, which is empty. The caller
+  holds oFT's lock exclusively, if locking is on.
+*/
+int FT_bulkLoadLocked(FT_T oFT,
+                      boolean (*pfNext)(void *pvReader,
+                                        struct ftBatchEntry *psEntry),
+                      void *pvReader);
+
+#endif
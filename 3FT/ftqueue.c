@@ -0,0 +1,384 @@
+/*--------------------------------------------------------------------*/
+/* ftqueue.c                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "ftimpl.h"
+#include "ftqueue.h"
+
+/*
+  Both rings are circular arrays of ulEntries slots under one mutex.
+  An operation counts as in flight from submission until it is
+  reaped, and at most ulEntries are, so neither ring can overflow:
+  the worker never finds the completion ring full.
+*/
+struct ftQueue {
+   /* the File Tree that operations run on */
+   FT_T oFT;
+   /* the number of slots in each ring, and of operations in flight */
+   size_t ulEntries;
+
+   /* the submission ring: ulSubmitted operations from ulSubmitHead */
+   struct ftqSubmission *psSubmissions;
+   size_t ulSubmitHead;
+   size_t ulSubmitted;
+
+   /* the completion ring: ulCompleted results from ulCompleteHead */
+   struct ftqCompletion *psCompletions;
+   size_t ulCompleteHead;
+   size_t ulCompleted;
+
+   /* the number of operations submitted and not yet reaped */
+   size_t ulInFlight;
+
+   /* the worker's copy of the batch it runs, and its results */
+   struct ftqSubmission *psBatch;
+   struct ftqCompletion *psResults;
+
+   /* TRUE once FTQueue_free has asked the worker to stop */
+   boolean bStopping;
+
+   /* guards everything above but the worker's batch */
+   pthread_mutex_t sLock;
+   /* signaled when operations are submitted, or the worker must stop */
+   pthread_cond_t sSubmitted;
+   /* signaled when results are posted */
+   pthread_cond_t sCompleted;
+   pthread_t sWorker;
+};
+
+/*--------------------------------------------------------------------*/
+
+/*
+  Runs operation psSub on oFT, and sets psResult to its result.
+*/
+static void FTQueue_run(FT_T oFT, const struct ftqSubmission *psSub,
+                        struct ftqCompletion *psResult) {
+   struct ftLookup sLookup;
+
+   assert(psSub != NULL);
+   assert(psResult != NULL);
+
+   psResult->pvUser = psSub->pvUser;
+   psResult->bIsFile = FALSE;
+   psResult->ulSize = 0;
+   psResult->pvContents = NULL;
+
+   switch(psSub->eOp) {
+      case FTQ_INSERT_DIR:
+         psResult->iStatus = FT_insertDirIn(oFT, psSub->pcPath);
+         break;
+      case FTQ_INSERT_FILE:
+         psResult->iStatus = FT_insertFileIn(oFT, psSub->pcPath,
+                                             psSub->pvContents,
+                                             psSub->ulLength);
+         break;
+      case FTQ_STAT:
+         psResult->iStatus = FT_statIn(oFT, psSub->pcPath,
+                                       &psResult->bIsFile,
+                                       &psResult->ulSize);
+         break;
+      case FTQ_GET_FILE_CONTENTS:
+         /* a batch of one looks the path up and reads its contents
+            under one lock, and says why it found no file */
+         psResult->iStatus = FT_getContentsManyIn(oFT, &psSub->pcPath,
+                                                  1, &sLookup);
+         if(psResult->iStatus != SUCCESS)
+            break;
+         psResult->iStatus = sLookup.iStatus;
+         if(sLookup.iStatus == SUCCESS) {
+            psResult->bIsFile = TRUE;
+            psResult->ulSize = sLookup.ulSize;
+            psResult->pvContents = sLookup.pvContents;
+         }
+         break;
+      case FTQ_RM_DIR:
+         psResult->iStatus = FT_rmDirIn(oFT, psSub->pcPath);
+         break;
+      default:
+         assert(psSub->eOp == FTQ_RM_FILE);
+         psResult->iStatus = FT_rmFileIn(oFT, psSub->pcPath);
+         break;
+   }
+}
+
+/*
+  Runs operation psSub on oFT, whose lock the caller holds
+  exclusively, or shared if psSub only reads, through the
+  implementations that FT_ functions wrap in that lock, and sets
+  psResult to its result. oFT is not sharded.
+*/
+static void FTQueue_runLocked(FT_T oFT,
+                              const struct ftqSubmission *psSub,
+                              struct ftqCompletion *psResult) {
+   assert(psSub != NULL);
+   assert(psResult != NULL);
+
+   psResult->pvUser = psSub->pvUser;
+   psResult->bIsFile = FALSE;
+   psResult->ulSize = 0;
+   psResult->pvContents = NULL;
+
+   switch(psSub->eOp) {
+      case FTQ_INSERT_DIR:
+         psResult->iStatus = FT_insertDirLocked(oFT, psSub->pcPath);
+         break;
+      case FTQ_INSERT_FILE:
+         psResult->iStatus = FT_insertFileLocked(oFT, psSub->pcPath,
+                                                 psSub->pvContents,
+                                                 psSub->ulLength);
+         break;
+      case FTQ_STAT:
+         psResult->iStatus = FT_statLocked(oFT, psSub->pcPath,
+                                           &psResult->bIsFile,
+                                           &psResult->ulSize);
+         break;
+      case FTQ_GET_FILE_CONTENTS:
+         psResult->iStatus = FT_statLocked(oFT, psSub->pcPath,
+                                           &psResult->bIsFile,
+                                           &psResult->ulSize);
+         if(psResult->iStatus != SUCCESS)
+            break;
+         if(!psResult->bIsFile) {
+            psResult->iStatus = NOT_A_FILE;
+            break;
+         }
+         psResult->pvContents =
+            FT_getFileContentsLocked(oFT, psSub->pcPath);
+         break;
+      case FTQ_RM_DIR:
+         psResult->iStatus = FT_rmDirLocked(oFT, psSub->pcPath);
+         break;
+      default:
+         assert(psSub->eOp == FTQ_RM_FILE);
+         psResult->iStatus = FT_rmFileLocked(oFT, psSub->pcPath);
+         break;
+   }
+}
+
+/*
+  Runs the ulBatch operations at psBatch on oFT in order, and sets
+  psResults[i] to the result of psBatch[i]. Unless oFT is sharded,
+  whose shards each have a lock of their own, the whole batch runs
+  under one acquisition of oFT's lock: exclusive if any operation
+  may change the tree, and shared otherwise.
+*/
+static void FTQueue_runBatch(FT_T oFT,
+                             const struct ftqSubmission *psBatch,
+                             struct ftqCompletion *psResults,
+                             size_t ulBatch) {
+   boolean bUpdates = FALSE;
+   size_t ul;
+
+   assert(oFT != NULL);
+   assert(psBatch != NULL);
+   assert(psResults != NULL);
+
+   if(oFT->poFShards != NULL) {
+      for(ul = 0; ul < ulBatch; ul++)
+         FTQueue_run(oFT, &psBatch[ul], &psResults[ul]);
+      return;
+   }
+
+   for(ul = 0; ul < ulBatch; ul++)
+      if(psBatch[ul].eOp != FTQ_STAT &&
+         psBatch[ul].eOp != FTQ_GET_FILE_CONTENTS)
+         bUpdates = TRUE;
+
+   if(bUpdates)
+      FT_lockExclusive(oFT);
+   else
+      FT_lockShared(oFT);
+   for(ul = 0; ul < ulBatch; ul++)
+      FTQueue_runLocked(oFT, &psBatch[ul], &psResults[ul]);
+   FT_unlock(oFT);
+}
+
+/*
+  The worker thread of queue pvQueue: until asked to stop with nothing
+  left to run, takes every waiting operation off the submission ring,
+  runs them without holding the queue's lock, and posts their
+  results. Returns NULL.
+*/
+static void *FTQueue_work(void *pvQueue) {
+   FTQueue_T oQueue = pvQueue;
+   size_t ulBatch;
+   size_t ul;
+
+   assert(oQueue != NULL);
+
+   (void) pthread_mutex_lock(&oQueue->sLock);
+   for(;;) {
+      while(oQueue->ulSubmitted == 0 && !oQueue->bStopping)
+         (void) pthread_cond_wait(&oQueue->sSubmitted, &oQueue->sLock);
+      if(oQueue->ulSubmitted == 0)
+         break;
+
+      /* take the whole batch, so that clients can submit meanwhile */
+      ulBatch = oQueue->ulSubmitted;
+      for(ul = 0; ul < ulBatch; ul++)
+         oQueue->psBatch[ul] = oQueue->psSubmissions[
+            (oQueue->ulSubmitHead + ul) % oQueue->ulEntries];
+      oQueue->ulSubmitHead =
+         (oQueue->ulSubmitHead + ulBatch) % oQueue->ulEntries;
+      oQueue->ulSubmitted = 0;
+      (void) pthread_mutex_unlock(&oQueue->sLock);
+
+      FTQueue_runBatch(oQueue->oFT, oQueue->psBatch,
+                       oQueue->psResults, ulBatch);
+
+      (void) pthread_mutex_lock(&oQueue->sLock);
+      for(ul = 0; ul < ulBatch; ul++) {
+         assert(oQueue->ulCompleted < oQueue->ulEntries);
+         oQueue->psCompletions[
+            (oQueue->ulCompleteHead + oQueue->ulCompleted) %
+            oQueue->ulEntries] = oQueue->psResults[ul];
+         oQueue->ulCompleted++;
+      }
+      (void) pthread_cond_broadcast(&oQueue->sCompleted);
+   }
+   (void) pthread_mutex_unlock(&oQueue->sLock);
+   return NULL;
+}
+
+/*
+  Frees oQueue's rings and batch buffers, and oQueue itself.
+*/
+static void FTQueue_freeMemory(FTQueue_T oQueue) {
+   free(oQueue->psSubmissions);
+   free(oQueue->psCompletions);
+   free(oQueue->psBatch);
+   free(oQueue->psResults);
+   free(oQueue);
+}
+
+/*--------------------------------------------------------------------*/
+
+FTQueue_T FTQueue_new(FT_T oFT, size_t ulEntries) {
+   FTQueue_T oQueue;
+
+   assert(oFT != NULL);
+   assert(ulEntries > 0);
+
+   oQueue = calloc(1, sizeof(struct ftQueue));
+   if(oQueue == NULL)
+      return NULL;
+
+   oQueue->oFT = oFT;
+   oQueue->ulEntries = ulEntries;
+   oQueue->psSubmissions = calloc(ulEntries,
+                                  sizeof(struct ftqSubmission));
+   oQueue->psCompletions = calloc(ulEntries,
+                                  sizeof(struct ftqCompletion));
+   oQueue->psBatch = calloc(ulEntries, sizeof(struct ftqSubmission));
+   oQueue->psResults = calloc(ulEntries, sizeof(struct ftqCompletion));
+   if(oQueue->psSubmissions == NULL || oQueue->psCompletions == NULL ||
+      oQueue->psBatch == NULL || oQueue->psResults == NULL) {
+      FTQueue_freeMemory(oQueue);
+      return NULL;
+   }
+
+   if(pthread_mutex_init(&oQueue->sLock, NULL) != 0) {
+      FTQueue_freeMemory(oQueue);
+      return NULL;
+   }
+   if(pthread_cond_init(&oQueue->sSubmitted, NULL) != 0) {
+      (void) pthread_mutex_destroy(&oQueue->sLock);
+      FTQueue_freeMemory(oQueue);
+      return NULL;
+   }
+   if(pthread_cond_init(&oQueue->sCompleted, NULL) != 0) {
+      (void) pthread_cond_destroy(&oQueue->sSubmitted);
+      (void) pthread_mutex_destroy(&oQueue->sLock);
+      FTQueue_freeMemory(oQueue);
+      return NULL;
+   }
+   if(pthread_create(&oQueue->sWorker, NULL, FTQueue_work,
+                     oQueue) != 0) {
+      (void) pthread_cond_destroy(&oQueue->sCompleted);
+      (void) pthread_cond_destroy(&oQueue->sSubmitted);
+      (void) pthread_mutex_destroy(&oQueue->sLock);
+      FTQueue_freeMemory(oQueue);
+      return NULL;
+   }
+
+   return oQueue;
+}
+
+void FTQueue_free(FTQueue_T oQueue) {
+   if(oQueue == NULL)
+      return;
+
+   /* the worker runs what is left before it stops */
+   (void) pthread_mutex_lock(&oQueue->sLock);
+   oQueue->bStopping = TRUE;
+   (void) pthread_cond_signal(&oQueue->sSubmitted);
+   (void) pthread_mutex_unlock(&oQueue->sLock);
+   (void) pthread_join(oQueue->sWorker, NULL);
+
+   (void) pthread_cond_destroy(&oQueue->sCompleted);
+   (void) pthread_cond_destroy(&oQueue->sSubmitted);
+   (void) pthread_mutex_destroy(&oQueue->sLock);
+   FTQueue_freeMemory(oQueue);
+}
+
+size_t FTQueue_submit(FTQueue_T oQueue,
+                      const struct ftqSubmission *psSubs,
+                      size_t ulCount) {
+   size_t ul;
+
+   assert(oQueue != NULL);
+   assert(psSubs != NULL || ulCount == 0);
+
+   (void) pthread_mutex_lock(&oQueue->sLock);
+   if(ulCount > oQueue->ulEntries - oQueue->ulInFlight)
+      ulCount = oQueue->ulEntries - oQueue->ulInFlight;
+
+   for(ul = 0; ul < ulCount; ul++) {
+      assert(psSubs[ul].pcPath != NULL);
+      oQueue->psSubmissions[
+         (oQueue->ulSubmitHead + oQueue->ulSubmitted) %
+         oQueue->ulEntries] = psSubs[ul];
+      oQueue->ulSubmitted++;
+   }
+   oQueue->ulInFlight += ulCount;
+
+   if(ulCount > 0)
+      (void) pthread_cond_signal(&oQueue->sSubmitted);
+   (void) pthread_mutex_unlock(&oQueue->sLock);
+   return ulCount;
+}
+
+size_t FTQueue_reap(FTQueue_T oQueue, struct ftqCompletion *psOut,
+                    size_t ulMax, boolean bWait) {
+   size_t ulCount;
+   size_t ul;
+
+   assert(oQueue != NULL);
+   assert(psOut != NULL || ulMax == 0);
+
+   (void) pthread_mutex_lock(&oQueue->sLock);
+   if(bWait && ulMax > 0)
+      while(oQueue->ulCompleted == 0 && oQueue->ulInFlight > 0)
+         (void) pthread_cond_wait(&oQueue->sCompleted, &oQueue->sLock);
+
+   ulCount = (ulMax < oQueue->ulCompleted) ?
+             ulMax : oQueue->ulCompleted;
+   for(ul = 0; ul < ulCount; ul++)
+      psOut[ul] = oQueue->psCompletions[
+         (oQueue->ulCompleteHead + ul) % oQueue->ulEntries];
+   oQueue->ulCompleteHead =
+      (oQueue->ulCompleteHead + ulCount) % oQueue->ulEntries;
+   oQueue->ulCompleted -= ulCount;
+   oQueue->ulInFlight -= ulCount;
+   (void) pthread_mutex_unlock(&oQueue->sLock);
+   return ulCount;
+}
@@ -0,0 +1,109 @@
+/*--------------------------------------------------------------------*/
+/* ftqueue.h                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTQUEUE_INCLUDED
+#define FTQUEUE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "ft.h"
+
+/*
+  An FTQueue_T runs FT operations asynchronously. The client pushes
+  operations onto a submission ring, without waiting for them; a
+  worker thread of the queue's own takes every operation waiting
+  there at once, runs the batch on its File Tree, and pushes each
+  result onto a completion ring, from which the client reaps them.
+  A client can thus keep many operations in flight from one thread,
+  and pays for the handoff, and for taking the File Tree's lock,
+  once per batch rather than once per call.
+
+  Operations run in the order they were submitted, and complete in
+  that order. Each queue is meant for one client thread: submitting
+  or reaping from several threads at once is safe, but they then
+  share one stream of completions.
+*/
+typedef struct ftQueue *FTQueue_T;
+
+/* The operations an FTQueue_T can run, each as the FT_ function of
+   the same name does */
+enum ftqOp {
+   FTQ_INSERT_DIR,
+   FTQ_INSERT_FILE,
+   FTQ_STAT,
+   FTQ_GET_FILE_CONTENTS,
+   FTQ_RM_DIR,
+   FTQ_RM_FILE
+};
+typedef enum ftqOp FTQ_Op;
+
+/*
+  An operation to run. pcPath, and for FTQ_INSERT_FILE pvContents,
+  must stay valid until the operation completes. pvUser is not used
+  by the queue, but handed back with the result.
+*/
+struct ftqSubmission {
+   FTQ_Op eOp;
+   const char *pcPath;
+   /* for FTQ_INSERT_FILE, the new file's contents and their length */
+   void *pvContents;
+   size_t ulLength;
+   void *pvUser;
+};
+
+/*
+  The result of an operation. iStatus is the status its FT_ function
+  returned, or for FTQ_GET_FILE_CONTENTS, the status FT_stat would
+  return for the path, but NOT_A_FILE for a directory. After a
+  successful FTQ_STAT, bIsFile is set, and ulSize too if bIsFile is
+  TRUE; after a successful FTQ_GET_FILE_CONTENTS, bIsFile, ulSize and
+  pvContents are set, pvContents as FT_getFileContents would return
+  it.
+*/
+struct ftqCompletion {
+   void *pvUser;
+   int iStatus;
+   boolean bIsFile;
+   size_t ulSize;
+   void *pvContents;
+};
+
+/*
+  Returns a new queue running operations on oFT with room for
+  ulEntries operations in flight, submitted but not yet reaped, and
+  starts its worker thread. Returns NULL if memory could not be
+  allocated or the thread could not be started. While the queue
+  exists, other threads may use oFT only if its locking mode allows
+  concurrent use.
+*/
+FTQueue_T FTQueue_new(FT_T oFT, size_t ulEntries);
+
+/*
+  Waits until every submitted operation has run, stops the worker
+  thread, and frees oQueue, dropping completions not yet reaped. Does
+  nothing if oQueue is NULL.
+*/
+void FTQueue_free(FTQueue_T oQueue);
+
+/*
+  Pushes the first operations of the ulCount operations at psSubs onto
+  oQueue's submission ring, as many as there is room for in flight,
+  and wakes the worker. Returns the number pushed, which is 0 if the
+  queue is full.
+*/
+size_t FTQueue_submit(FTQueue_T oQueue,
+                      const struct ftqSubmission *psSubs,
+                      size_t ulCount);
+
+/*
+  Moves up to ulMax results from oQueue's completion ring to psOut,
+  oldest first, and returns how many it moved. If bWait is TRUE and no
+  result is ready while some operation is in flight, first waits for
+  one.
+*/
+size_t FTQueue_reap(FTQueue_T oQueue, struct ftqCompletion *psOut,
+                    size_t ulMax, boolean bWait);
+
+#endif
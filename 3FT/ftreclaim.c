@@ -0,0 +1,150 @@
+/*--------------------------------------------------------------------*/
+/* ftreclaim.c                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthreads and sched_yield */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "nodeFT.h"
+#include "ftimpl.h"
+#include "ftreclaim.h"
+
+/* A removed subtree waiting for the background reclaimer */
+struct ftReclaim {
+   /* the subtree, detached from its tree */
+   Node_T oNSubtree;
+   /* the FT that it was removed from */
+   FT_T oFT;
+   /* the next subtree in the queue, or NULL */
+   struct ftReclaim *psNext;
+};
+
+/*
+  The background reclaimer, which every FT in the process shares: a
+  thread, started when the first subtree is handed to it, that frees
+  the subtrees queued from psReclaimHead to psReclaimTail in order,
+  FT_RECLAIM_SLICE nodes at a time. sReclaimLock guards the queue and
+  every FT's ulReclaimPending; sReclaimWork is signalled when a
+  subtree is queued, and sReclaimDone when one has been freed.
+*/
+static pthread_mutex_t sReclaimLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_cond_t sReclaimWork = PTHREAD_COND_INITIALIZER;
+
+static pthread_cond_t sReclaimDone = PTHREAD_COND_INITIALIZER;
+
+static struct ftReclaim *psReclaimHead = NULL;
+
+static struct ftReclaim *psReclaimTail = NULL;
+
+static boolean bReclaimStarted = FALSE;
+
+/* The most nodes the reclaimer frees before it yields the processor,
+   and the fewest a subtree must have for a removal to hand it over
+   rather than free it at once */
+enum { FT_RECLAIM_SLICE = 1024 };
+
+/*
+  The background reclaimer's thread: takes the subtree at the head of
+  the queue, frees it a slice at a time, yielding the processor after
+  each, then drops it from the queue and tells whoever waits for its
+  FT. Never returns. pvUnused is unused.
+*/
+static void *FT_reclaimWork(void *pvUnused) {
+   struct ftReclaim *psJob;
+
+   (void) pvUnused;
+
+   for(;;) {
+      (void) pthread_mutex_lock(&sReclaimLock);
+      while(psReclaimHead == NULL)
+         (void) pthread_cond_wait(&sReclaimWork, &sReclaimLock);
+      psJob = psReclaimHead;
+      (void) pthread_mutex_unlock(&sReclaimLock);
+
+      /* no thread but this one can reach the subtree's nodes, other
+         than lock-free lookups that will see them removed */
+      while(!Node_freeSome(psJob->oNSubtree, FT_RECLAIM_SLICE))
+         (void) sched_yield();
+
+      (void) pthread_mutex_lock(&sReclaimLock);
+      psReclaimHead = psJob->psNext;
+      if(psReclaimHead == NULL)
+         psReclaimTail = NULL;
+      psJob->oFT->ulReclaimPending--;
+      (void) pthread_cond_broadcast(&sReclaimDone);
+      (void) pthread_mutex_unlock(&sReclaimLock);
+      free(psJob);
+   }
+   return NULL;
+}
+
+/*
+  Queues oNNode, the root of a subtree detached from oFT, for the
+  background reclaimer, starting it if this is its first subtree.
+  Returns TRUE, or FALSE with oNNode still the caller's if memory or
+  the thread could not be had.
+*/
+static boolean FT_reclaimLater(FT_T oFT, Node_T oNNode) {
+   struct ftReclaim *psJob;
+   pthread_t sThread;
+
+   assert(oFT != NULL);
+   assert(oNNode != NULL);
+
+   psJob = malloc(sizeof(struct ftReclaim));
+   if(psJob == NULL)
+      return FALSE;
+   psJob->oNSubtree = oNNode;
+   psJob->oFT = oFT;
+   psJob->psNext = NULL;
+
+   (void) pthread_mutex_lock(&sReclaimLock);
+   if(!bReclaimStarted) {
+      if(pthread_create(&sThread, NULL, FT_reclaimWork, NULL) != 0) {
+         (void) pthread_mutex_unlock(&sReclaimLock);
+         free(psJob);
+         return FALSE;
+      }
+      (void) pthread_detach(sThread);
+      bReclaimStarted = TRUE;
+   }
+   if(psReclaimTail == NULL)
+      psReclaimHead = psJob;
+   else
+      psReclaimTail->psNext = psJob;
+   psReclaimTail = psJob;
+   oFT->ulReclaimPending++;
+   (void) pthread_cond_signal(&sReclaimWork);
+   (void) pthread_mutex_unlock(&sReclaimLock);
+   return TRUE;
+}
+
+void FT_waitReclaimed(FT_T oFT) {
+   assert(oFT != NULL);
+
+   (void) pthread_mutex_lock(&sReclaimLock);
+   while(oFT->ulReclaimPending > 0)
+      (void) pthread_cond_wait(&sReclaimDone, &sReclaimLock);
+   (void) pthread_mutex_unlock(&sReclaimLock);
+}
+
+void FT_freeSubtree(FT_T oFT, Node_T oNNode) {
+   assert(oFT != NULL);
+   assert(oNNode != NULL);
+
+   if(oFT->bBackgroundReclaim &&
+      Node_getSubtreeSize(oNNode) >= FT_RECLAIM_SLICE) {
+      Node_detach(oNNode);
+      if(FT_reclaimLater(oFT, oNNode))
+         return;
+   }
+   (void) Node_free(oNNode);
+}
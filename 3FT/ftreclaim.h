@@ -0,0 +1,32 @@
+/*--------------------------------------------------------------------*/
+/* ftreclaim.h                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTRECLAIM_INCLUDED
+#define FTRECLAIM_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Freeing of subtrees that leave an FT: at once, or, for large ones
+  under background reclamation, by a thread that every FT in the
+  process shares.
+*/
+
+/* Waits until the background reclaimer has freed every subtree that
+   oFT handed to it. */
+void FT_waitReclaimed(FT_T oFT);
+
+/*
+  Frees the subtree rooted at oNNode, which is leaving oFT, whether or
+  not it is still linked: at once, or, if oFT has background
+  reclamation on and the subtree is large, by detaching it and
+  handing it to the background reclaimer.
+*/
+void FT_freeSubtree(FT_T oFT, Node_T oNNode);
+
+#endif
@@ -0,0 +1,566 @@
+/*--------------------------------------------------------------------*/
+/* ftshard.c                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthread_rwlock_t */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "path.h"
+#include "nodeFT.h"
+#include "dircache.h"
+#include "ftimpl.h"
+#include "ftshard.h"
+
+FT_T FT_shardOf(FT_T oFT, const char *pcPath) {
+   const char *pc;
+   unsigned long ulHash = 2166136261UL;
+
+   assert(oFT != NULL);
+   assert(oFT->poFShards != NULL);
+   assert(pcPath != NULL);
+
+   pc = strchr(pcPath, '/');
+   if(pc == NULL)
+      return NULL;
+
+   for(pc++; *pc != '\0' && *pc != '/'; pc++) {
+      ulHash ^= (unsigned char) *pc;
+      ulHash = (ulHash * 16777619UL) & 0xffffffffUL;
+   }
+   return oFT->poFShards[ulHash % oFT->ulShards];
+}
+
+int FT_newSharded(size_t ulShards, FT_T *poFResult) {
+   FT_T oFT;
+   size_t ul;
+   int iStatus;
+
+   assert(ulShards > 0);
+   assert(poFResult != NULL);
+
+   *poFResult = NULL;
+   iStatus = FT_new(&oFT);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* the sharded FT's own lock guards the root in every shard, and
+      its own directory cache would never be used */
+   iStatus = FT_setLockingIn(oFT, FT_LOCK_TREE);
+   if(iStatus != SUCCESS) {
+      FT_free(oFT);
+      return iStatus;
+   }
+   DirCache_free(oFT->oDCache);
+   oFT->oDCache = NULL;
+
+   oFT->poFShards = calloc(ulShards, sizeof(FT_T));
+   if(oFT->poFShards == NULL) {
+      FT_free(oFT);
+      return MEMORY_ERROR;
+   }
+   oFT->ulShards = ulShards;
+
+   for(ul = 0; ul < ulShards; ul++) {
+      iStatus = FT_new(&oFT->poFShards[ul]);
+      if(iStatus == SUCCESS) {
+         oFT->poFShards[ul]->oFTOwner = oFT;
+         iStatus = FT_setLockingIn(oFT->poFShards[ul], FT_LOCK_TREE);
+      }
+      if(iStatus != SUCCESS) {
+         FT_free(oFT);
+         return iStatus;
+      }
+   }
+
+   *poFResult = oFT;
+   return SUCCESS;
+}
+
+int FT_setLockingSharded(FT_T oFT, FT_Locking eLocking) {
+   FT_Locking eOld;
+   size_t ul;
+   int iStatus = SUCCESS;
+
+   eOld = oFT->poFShards[0]->eLocking;
+   for(ul = 0; ul < oFT->ulShards && iStatus == SUCCESS; ul++)
+      iStatus = FT_setLockingIn(oFT->poFShards[ul], eLocking);
+
+   if(iStatus != SUCCESS) {
+      /* the failed shard is unchanged, and the rest go back */
+      for(ul--; ul > 0; ul--)
+         (void) FT_setLockingIn(oFT->poFShards[ul - 1], eOld);
+   }
+   return iStatus;
+}
+
+/*
+  Takes sharded FT oFT's lock for an insert that may create the root,
+  which must then be created in every shard: exclusively if bRoot,
+  that is, if the path names the root, or if there is no root yet,
+  and shared otherwise. Returns TRUE if the caller must then give
+  every shard the root its insert created, that is, if there was no
+  root while it held the lock exclusively.
+*/
+static boolean FT_lockShardedInsert(FT_T oFT, boolean bRoot) {
+   assert(oFT != NULL);
+
+   /* the root changes only under the exclusive lock */
+   if(!bRoot) {
+      FT_lockShared(oFT);
+      if(oFT->poFShards[0]->oNRoot != NULL)
+         return FALSE;
+      FT_unlock(oFT);
+   }
+
+   FT_lockExclusive(oFT);
+   return (boolean) (oFT->poFShards[0]->oNRoot == NULL);
+}
+
+/*
+  Gives every shard of sharded FT oFT other than oFTDone the root that
+  an insert has just created in oFTDone. Returns SUCCESS, or
+  MEMORY_ERROR after removing the root from every shard again,
+  oFTDone included. The caller holds oFT's lock exclusively.
+*/
+static int FT_spreadRoot(FT_T oFT, FT_T oFTDone) {
+   const char *pcRoot;
+   size_t ulDone;
+   size_t ul;
+   int iStatus = SUCCESS;
+
+   assert(oFT != NULL);
+   assert(oFTDone != NULL);
+   assert(oFTDone->oNRoot != NULL);
+
+   pcRoot = Path_getPathname(Node_getPath(oFTDone->oNRoot));
+   for(ulDone = 0; ulDone < oFT->ulShards; ulDone++) {
+      if(oFT->poFShards[ulDone] == oFTDone)
+         continue;
+      iStatus = FT_insertDirIn(oFT->poFShards[ulDone], pcRoot);
+      if(iStatus != SUCCESS)
+         break;
+   }
+   if(iStatus == SUCCESS)
+      return SUCCESS;
+
+   /* oFTDone last, since pcRoot is its root's path */
+   for(ul = 0; ul < ulDone; ul++)
+      if(oFT->poFShards[ul] != oFTDone)
+         (void) FT_rmDirIn(oFT->poFShards[ul], pcRoot);
+   (void) FT_rmDirIn(oFTDone, pcRoot);
+   return MEMORY_ERROR;
+}
+
+int FT_insertDirSharded(FT_T oFT, const char *pcPath) {
+   FT_T oFTShard;
+   boolean bNewRoot;
+   int iStatus;
+
+   oFTShard = FT_shardOf(oFT, pcPath);
+   bNewRoot = FT_lockShardedInsert(oFT, (boolean) (oFTShard == NULL));
+   if(oFTShard == NULL)
+      oFTShard = oFT->poFShards[0];
+
+   iStatus = FT_insertDirIn(oFTShard, pcPath);
+   if(iStatus == SUCCESS && bNewRoot)
+      iStatus = FT_spreadRoot(oFT, oFTShard);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+int FT_insertFileSharded(FT_T oFT, const char *pcPath,
+                         void *pvContents, size_t ulLength) {
+   FT_T oFTShard;
+   boolean bNewRoot;
+   int iStatus;
+
+   oFTShard = FT_shardOf(oFT, pcPath);
+   bNewRoot = FT_lockShardedInsert(oFT, (boolean) (oFTShard == NULL));
+   if(oFTShard == NULL)
+      oFTShard = oFT->poFShards[0];
+
+   iStatus = FT_insertFileIn(oFTShard, pcPath, pvContents, ulLength);
+   if(iStatus == SUCCESS && bNewRoot)
+      iStatus = FT_spreadRoot(oFT, oFTShard);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+void FT_insertBatchSharded(FT_T oFT,
+                           const struct ftBatchEntry *psEntries,
+                           const struct ftBatchEntry **ppsSorted,
+                           size_t ulCount, int *piResults) {
+   const struct ftBatchEntry *psEntry;
+   size_t ul;
+
+   assert(oFT != NULL);
+
+   for(ul = 0; ul < ulCount; ul++) {
+      psEntry = ppsSorted[ul];
+      assert(psEntry->pcPath != NULL);
+      if(psEntry->bIsFile)
+         piResults[psEntry - psEntries] =
+            FT_insertFileSharded(oFT, psEntry->pcPath,
+                                 psEntry->pvContents,
+                                 psEntry->ulLength);
+      else
+         piResults[psEntry - psEntries] =
+            FT_insertDirSharded(oFT, psEntry->pcPath);
+   }
+}
+
+/*
+  Takes sharded FT oFT's lock shared, for an operation on pcPath that
+  cannot create or remove the root, and returns the shard to run it
+  on: the one that holds pcPath, or shard 0 for the root.
+*/
+static FT_T FT_lockShard(FT_T oFT, const char *pcPath) {
+   FT_T oFTShard;
+
+   FT_lockShared(oFT);
+   oFTShard = FT_shardOf(oFT, pcPath);
+   if(oFTShard == NULL)
+      oFTShard = oFT->poFShards[0];
+   return oFTShard;
+}
+
+int FT_rmDirSharded(FT_T oFT, const char *pcPath) {
+   FT_T oFTShard;
+   size_t ul;
+   int iStatus;
+
+   oFTShard = FT_shardOf(oFT, pcPath);
+   if(oFTShard != NULL) {
+      FT_lockShared(oFT);
+      iStatus = FT_rmDirIn(oFTShard, pcPath);
+      FT_unlock(oFT);
+      return iStatus;
+   }
+
+   /* the root: every shard fares as shard 0 does */
+   FT_lockExclusive(oFT);
+   iStatus = FT_rmDirIn(oFT->poFShards[0], pcPath);
+   if(iStatus == SUCCESS)
+      for(ul = 1; ul < oFT->ulShards; ul++)
+         (void) FT_rmDirIn(oFT->poFShards[ul], pcPath);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+int FT_rmFileSharded(FT_T oFT, const char *pcPath) {
+   int iStatus;
+
+   /* the root is never a file, so this never removes it */
+   iStatus = FT_rmFileIn(FT_lockShard(oFT, pcPath), pcPath);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+boolean FT_containsDirSharded(FT_T oFT, const char *pcPath) {
+   boolean bResult;
+
+   bResult = FT_containsDirIn(FT_lockShard(oFT, pcPath), pcPath);
+   FT_unlock(oFT);
+   return bResult;
+}
+
+boolean FT_containsFileSharded(FT_T oFT, const char *pcPath) {
+   boolean bResult;
+
+   bResult = FT_containsFileIn(FT_lockShard(oFT, pcPath), pcPath);
+   FT_unlock(oFT);
+   return bResult;
+}
+
+void *FT_getFileContentsSharded(FT_T oFT, const char *pcPath) {
+   void *pvResult;
+
+   pvResult = FT_getFileContentsIn(FT_lockShard(oFT, pcPath), pcPath);
+   FT_unlock(oFT);
+   return pvResult;
+}
+
+void *FT_replaceFileContentsSharded(FT_T oFT,
+                                    const char *pcPath,
+                                    void *pvNewContents,
+                                    size_t ulNewLength) {
+   void *pvResult;
+
+   pvResult = FT_replaceFileContentsIn(FT_lockShard(oFT, pcPath),
+                                       pcPath, pvNewContents,
+                                       ulNewLength);
+   FT_unlock(oFT);
+   return pvResult;
+}
+
+int FT_statSharded(FT_T oFT, const char *pcPath,
+                   boolean *pbIsFile, size_t *pulSize) {
+   int iStatus;
+
+   iStatus = FT_statIn(FT_lockShard(oFT, pcPath), pcPath, pbIsFile,
+                       pulSize);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+int FT_statTreeSharded(FT_T oFT, const char *pcPath,
+                       size_t *pulFiles, size_t *pulDirs,
+                       size_t *pulBytes) {
+   size_t ulFiles, ulDirs, ulBytes;
+   size_t ulShardFiles, ulShardDirs, ulShardBytes;
+   size_t ul;
+   int iStatus;
+
+   iStatus = FT_statTreeIn(FT_lockShard(oFT, pcPath), pcPath,
+                           &ulFiles, &ulDirs, &ulBytes);
+   if(iStatus == SUCCESS && FT_shardOf(oFT, pcPath) == NULL)
+      for(ul = 1; ul < oFT->ulShards; ul++)
+         if(FT_statTreeIn(oFT->poFShards[ul], pcPath, &ulShardFiles,
+                          &ulShardDirs, &ulShardBytes) == SUCCESS) {
+            ulFiles += ulShardFiles;
+            ulDirs += ulShardDirs - 1;
+            ulBytes += ulShardBytes;
+         }
+   FT_unlock(oFT);
+
+   if(iStatus == SUCCESS) {
+      *pulFiles = ulFiles;
+      *pulDirs = ulDirs;
+      *pulBytes = ulBytes;
+   }
+   return iStatus;
+}
+
+int FT_openDirSharded(FT_T oFT, const char *pcPath,
+                      DirHandle_T *poDResult) {
+   int iStatus;
+
+   assert(poDResult != NULL);
+
+   iStatus = FT_openDirIn(FT_lockShard(oFT, pcPath), pcPath,
+                          poDResult);
+   /* a handle to the root must route its entries by name */
+   if(iStatus == SUCCESS && FT_shardOf(oFT, pcPath) == NULL)
+      (*poDResult)->bShardRoot = TRUE;
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+/*
+  Performs a pre-order traversal of sharded FT oFT as
+  FT_preOrderTraversal does of an unsharded one, so in the same order:
+  visits the root, then the root's files in all shards, merged in
+  lexicographic order, then likewise its directories, each followed by
+  its subtree. pulNext must have room for a child ID per shard. The
+  caller holds the locks of oFT and of every shard.
+*/
+static void FT_shardedTraversal(FT_T oFT,
+                                void (*pfVisit)(Node_T, void *),
+                                void *pvExtra, size_t *pulNext) {
+   Node_T oNRoot;
+   Node_T oNChild;
+   Node_T oNBest;
+   size_t ulBest = 0;
+   size_t ul;
+   boolean bFiles;
+   int iStatus;
+
+   assert(oFT != NULL);
+   assert(pfVisit != NULL);
+   assert(pulNext != NULL);
+
+   if(oFT->poFShards[0]->oNRoot == NULL)
+      return;
+   (*pfVisit)(oFT->poFShards[0]->oNRoot, pvExtra);
+
+   for(ul = 0; ul < oFT->ulShards; ul++)
+      pulNext[ul] = 0;
+
+   /* each shard's root lists its files first, so one pass per kind
+      of child advances every shard's next child in turn */
+   for(bFiles = TRUE; ; bFiles = FALSE) {
+      for(;;) {
+         oNBest = NULL;
+         for(ul = 0; ul < oFT->ulShards; ul++) {
+            oNRoot = oFT->poFShards[ul]->oNRoot;
+            if(pulNext[ul] >= Node_getNumChildren(oNRoot))
+               continue;
+            iStatus = Node_getChild(oNRoot, pulNext[ul], &oNChild);
+            assert(iStatus == SUCCESS);
+            if(Node_isFile(oNChild) != bFiles)
+               continue;
+            if(oNBest == NULL ||
+               Path_comparePath(Node_getPath(oNChild),
+                                Node_getPath(oNBest)) < 0) {
+               oNBest = oNChild;
+               ulBest = ul;
+            }
+         }
+         if(oNBest == NULL)
+            break;
+
+         pulNext[ulBest]++;
+         FT_preOrderTraversal(oNBest, pfVisit, pvExtra);
+      }
+      if(!bFiles)
+         break;
+   }
+}
+
+char *FT_toStringSharded(FT_T oFT) {
+   size_t totalStrlen = 1;
+   size_t *pulNext;
+   char *result = NULL;
+   char *pcEnd;
+   size_t ul;
+
+   pulNext = calloc(oFT->ulShards, sizeof(size_t));
+   if(pulNext == NULL)
+      return NULL;
+
+   /* holding every shard at once gives a consistent dump */
+   FT_lockShared(oFT);
+   for(ul = 0; ul < oFT->ulShards; ul++)
+      FT_lockWhole(oFT->poFShards[ul]);
+
+   FT_shardedTraversal(oFT,
+                       (void (*)(Node_T, void *)) FT_strlenAccumulate,
+                       (void *) &totalStrlen, pulNext);
+
+   result = malloc(totalStrlen);
+   if(result != NULL) {
+      pcEnd = result;
+      FT_shardedTraversal(oFT,
+                          (void (*)(Node_T, void *))
+                          FT_strcatAccumulate,
+                          (void *) &pcEnd, pulNext);
+      *pcEnd = '\0';
+   }
+
+   for(ul = oFT->ulShards; ul > 0; ul--)
+      FT_unlock(oFT->poFShards[ul - 1]);
+   FT_unlock(oFT);
+   free(pulNext);
+   return result;
+}
+
+boolean FT_isValidSharded(FT_T oFT) {
+   Node_T oNRoot;
+   Node_T oNShardRoot;
+   boolean bResult = TRUE;
+   size_t ul;
+
+   FT_lockExclusive(oFT);
+   oNRoot = oFT->poFShards[0]->oNRoot;
+   for(ul = 0; ul < oFT->ulShards; ul++) {
+      if(!FT_isValidIn(oFT->poFShards[ul]))
+         bResult = FALSE;
+
+      /* every shard has the same root, or none */
+      oNShardRoot = oFT->poFShards[ul]->oNRoot;
+      if((oNRoot == NULL) != (oNShardRoot == NULL) ||
+         (oNRoot != NULL &&
+          Path_comparePath(Node_getPath(oNRoot),
+                           Node_getPath(oNShardRoot)) != 0)) {
+         fprintf(stderr, "Shard %lu's root differs from shard 0's\n",
+                 (unsigned long) ul);
+         bResult = FALSE;
+      }
+   }
+   FT_unlock(oFT);
+   return bResult;
+}
+
+int FT_setPathCacheSharded(FT_T oFT, boolean bEnable) {
+   size_t ul;
+   int iStatus = SUCCESS;
+
+   FT_lockExclusive(oFT);
+   for(ul = 0; ul < oFT->ulShards && iStatus == SUCCESS; ul++)
+      iStatus = FT_setPathCacheIn(oFT->poFShards[ul], bEnable);
+
+   /* disabling cannot fail, so undo a partial enable */
+   if(iStatus != SUCCESS)
+      while(ul > 0)
+         (void) FT_setPathCacheIn(oFT->poFShards[--ul], FALSE);
+   FT_unlock(oFT);
+   return iStatus;
+}
+
+void FT_setBackgroundReclaimSharded(FT_T oFT, boolean bEnable) {
+   size_t ul;
+
+   FT_lockExclusive(oFT);
+   for(ul = 0; ul < oFT->ulShards; ul++)
+      FT_setBackgroundReclaimIn(oFT->poFShards[ul], bEnable);
+   FT_unlock(oFT);
+}
+
+void FT_getPathCacheStatsSharded(FT_T oFT, size_t *pulHits,
+                                 size_t *pulMisses) {
+   size_t ulHits, ulMisses;
+   size_t ul;
+
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+   *pulHits = *pulMisses = 0;
+   FT_lockShared(oFT);
+   for(ul = 0; ul < oFT->ulShards; ul++) {
+      FT_getPathCacheStatsIn(oFT->poFShards[ul], &ulHits, &ulMisses);
+      *pulHits += ulHits;
+      *pulMisses += ulMisses;
+   }
+   FT_unlock(oFT);
+}
+
+void FT_getDirCacheStatsSharded(FT_T oFT, size_t *pulOps,
+                                size_t *pulLevelsSkipped) {
+   size_t ulOps, ulLevelsSkipped;
+   size_t ul;
+
+   assert(pulOps != NULL);
+   assert(pulLevelsSkipped != NULL);
+
+   *pulOps = *pulLevelsSkipped = 0;
+   FT_lockShared(oFT);
+   for(ul = 0; ul < oFT->ulShards; ul++) {
+      FT_getDirCacheStatsIn(oFT->poFShards[ul], &ulOps,
+                            &ulLevelsSkipped);
+      *pulOps += ulOps;
+      *pulLevelsSkipped += ulLevelsSkipped;
+   }
+   FT_unlock(oFT);
+}
+
+void FT_getFilterStatsSharded(FT_T oFT, size_t *pulProbes,
+                              size_t *pulNegatives,
+                              size_t *pulFalsePositives,
+                              size_t *pulBytes) {
+   size_t aulShard[4];
+   size_t ul;
+
+   assert(pulProbes != NULL);
+   assert(pulNegatives != NULL);
+   assert(pulFalsePositives != NULL);
+   assert(pulBytes != NULL);
+
+   *pulProbes = *pulNegatives = *pulFalsePositives = *pulBytes = 0;
+   FT_lockShared(oFT);
+   for(ul = 0; ul < oFT->ulShards; ul++) {
+      FT_getFilterStatsIn(oFT->poFShards[ul], &aulShard[0],
+                          &aulShard[1], &aulShard[2], &aulShard[3]);
+      *pulProbes += aulShard[0];
+      *pulNegatives += aulShard[1];
+      *pulFalsePositives += aulShard[2];
+      *pulBytes += aulShard[3];
+   }
+   FT_unlock(oFT);
+}
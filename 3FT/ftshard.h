@@ -0,0 +1,122 @@
+/*--------------------------------------------------------------------*/
+/* ftshard.h                                                          */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTSHARD_INCLUDED
+#define FTSHARD_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Sharding. A sharded FT forwards each operation to the shard that
+  holds its path, under its own lock held shared. Only operations on
+  the root itself concern every shard, and take its lock
+  exclusively. Each FT_xSharded function implements FT_xIn for a
+  sharded FT.
+*/
+
+/*
+  Returns the shard of sharded FT oFT that holds the node with path
+  pcPath, chosen by an FNV-1a hash of pcPath's second component, or
+  NULL if pcPath has no '/' and so can only name the root, which
+  every shard holds. A malformed path goes to some shard, which
+  rejects it.
+*/
+FT_T FT_shardOf(FT_T oFT, const char *pcPath);
+
+/*
+  Implements FT_setLockingIn for sharded FT oFT, whose own lock stays
+  on: sets every shard's mode, or none of them.
+*/
+int FT_setLockingSharded(FT_T oFT, FT_Locking eLocking);
+
+/* Implements FT_insertDirIn for sharded FT oFT. */
+int FT_insertDirSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_insertFileIn for sharded FT oFT. */
+int FT_insertFileSharded(FT_T oFT, const char *pcPath,
+                         void *pvContents, size_t ulLength);
+
+/*
+  Implements FT_insertBatchIn for sharded FT oFT, given ppsSorted as
+  FT_insertBatchLocked is. Entries go to their shards one at a time,
+  since creating the root must reach every shard before the entries
+  below it.
+*/
+void FT_insertBatchSharded(FT_T oFT,
+                           const struct ftBatchEntry *psEntries,
+                           const struct ftBatchEntry **ppsSorted,
+                           size_t ulCount, int *piResults);
+
+/* Implements FT_rmDirIn for sharded FT oFT. */
+int FT_rmDirSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_rmFileIn for sharded FT oFT. */
+int FT_rmFileSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_containsDirIn for sharded FT oFT. */
+boolean FT_containsDirSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_containsFileIn for sharded FT oFT. */
+boolean FT_containsFileSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_getFileContentsIn for sharded FT oFT. */
+void *FT_getFileContentsSharded(FT_T oFT, const char *pcPath);
+
+/* Implements FT_replaceFileContentsIn for sharded FT oFT. */
+void *FT_replaceFileContentsSharded(FT_T oFT,
+                                    const char *pcPath,
+                                    void *pvNewContents,
+                                    size_t ulNewLength);
+
+/* Implements FT_statIn for sharded FT oFT. */
+int FT_statSharded(FT_T oFT, const char *pcPath,
+                   boolean *pbIsFile, size_t *pulSize);
+
+/*
+  Implements FT_statTreeIn for sharded FT oFT. The root's totals are
+  the sums of every shard's, counting the root itself once.
+*/
+int FT_statTreeSharded(FT_T oFT, const char *pcPath,
+                       size_t *pulFiles, size_t *pulDirs,
+                       size_t *pulBytes);
+
+/* Implements FT_openDirIn for sharded FT oFT. */
+int FT_openDirSharded(FT_T oFT, const char *pcPath,
+                      DirHandle_T *poDResult);
+
+/* Implements FT_toStringIn for sharded FT oFT. */
+char *FT_toStringSharded(FT_T oFT);
+
+/* Implements FT_isValidIn for sharded FT oFT. */
+boolean FT_isValidSharded(FT_T oFT);
+
+/* Implements FT_setPathCacheIn for sharded FT oFT. */
+int FT_setPathCacheSharded(FT_T oFT, boolean bEnable);
+
+/* Implements FT_setBackgroundReclaimIn for sharded FT oFT, setting
+   every shard. */
+void FT_setBackgroundReclaimSharded(FT_T oFT, boolean bEnable);
+
+/* Implements FT_getPathCacheStatsIn for sharded FT oFT, summing the
+   shards' counts. */
+void FT_getPathCacheStatsSharded(FT_T oFT, size_t *pulHits,
+                                 size_t *pulMisses);
+
+/* Implements FT_getDirCacheStatsIn for sharded FT oFT, summing the
+   shards' counts. */
+void FT_getDirCacheStatsSharded(FT_T oFT, size_t *pulOps,
+                                size_t *pulLevelsSkipped);
+
+/* Implements FT_getFilterStatsIn for sharded FT oFT, summing the
+   shards' counts. */
+void FT_getFilterStatsSharded(FT_T oFT, size_t *pulProbes,
+                              size_t *pulNegatives,
+                              size_t *pulFalsePositives,
+                              size_t *pulBytes);
+
+#endif
@@ -0,0 +1,537 @@
+/*--------------------------------------------------------------------*/
+/* ftsnap.c                                                           */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthread_rwlock_t */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "dynarray.h"
+#include "path.h"
+#include "nodeFT.h"
+#include "ftimpl.h"
+#include "ftreclaim.h"
+#include "ftsnap.h"
+
+/*
+  What a node looked like before it was first changed while some
+  snapshots were open. One shadow is shared by every snapshot that was
+  open at the time and had none for the node yet, and is freed once
+  the last of them is released.
+*/
+struct ftShadow {
+   /* the node that changed */
+   Node_T oNNode;
+   /* the number of snapshots that hold the shadow */
+   size_t ulRefs;
+   /* for a directory, its children, in child ID order, of which the
+      first ulFiles are files; poNChildren is NULL if it had none */
+   Node_T *poNChildren;
+   size_t ulFiles;
+   size_t ulChildren;
+   /* for a file, the length of its contents */
+   size_t ulLength;
+};
+
+/*
+  A snapshot sees every node as the node was when the snapshot was
+  taken: through its shadow if the node has changed since, and as it
+  is now otherwise. Nodes it can reach are not freed while it is open.
+*/
+struct ftSnapshot {
+   /* the FT that the snapshot was taken of */
+   FT_T oFT;
+   /* the snapshot's number, counting from 1 in the order taken */
+   size_t ulSeq;
+   /* the root when the snapshot was taken */
+   Node_T oNRoot;
+   /* the shadows of the nodes changed since, sorted by node address */
+   DynArray_T oDShadows;
+};
+
+boolean FT_hasSnapshots(FT_T oFT) {
+   return (boolean) (oFT->oDSnapshots != NULL &&
+                     DynArray_getLength(oFT->oDSnapshots) > 0);
+}
+
+/*
+  Compares shadows psFirst and psSecond by the addresses of their
+  nodes. Returns <0, 0, or >0 if psFirst's node comes before, is the
+  same as, or comes after psSecond's.
+*/
+static int FT_compareShadows(const struct ftShadow *psFirst,
+                             const struct ftShadow *psSecond) {
+   size_t ulFirst;
+   size_t ulSecond;
+
+   assert(psFirst != NULL);
+   assert(psSecond != NULL);
+
+   ulFirst = (size_t) psFirst->oNNode;
+   ulSecond = (size_t) psSecond->oNNode;
+   if(ulFirst < ulSecond)
+      return -1;
+   if(ulFirst > ulSecond)
+      return 1;
+   return 0;
+}
+
+/*
+  Returns snapshot oS's shadow of oNNode, or NULL if it has none, and
+  sets *pulIndex to where that shadow is or would go in oS's shadows.
+*/
+static struct ftShadow *FT_findShadow(FTSnapshot_T oS, Node_T oNNode,
+                                      size_t *pulIndex) {
+   struct ftShadow sKey;
+
+   assert(oS != NULL);
+   assert(pulIndex != NULL);
+
+   sKey.oNNode = oNNode;
+   if(!DynArray_bsearch(oS->oDShadows, &sKey, pulIndex,
+                        (int (*)(const void *, const void *))
+                        FT_compareShadows))
+      return NULL;
+   return DynArray_get(oS->oDShadows, *pulIndex);
+}
+
+/* Frees shadow psShadow. */
+static void FT_freeShadow(struct ftShadow *psShadow) {
+   assert(psShadow != NULL);
+
+   free(psShadow->poNChildren);
+   free(psShadow);
+}
+
+/*
+  Returns a new shadow recording what oNNode looks like now, held by
+  no snapshot yet, or NULL if memory could not be allocated.
+*/
+static struct ftShadow *FT_newShadow(Node_T oNNode) {
+   struct ftShadow *psShadow;
+   size_t ul;
+   int iStatus;
+
+   assert(oNNode != NULL);
+
+   psShadow = calloc(1, sizeof(struct ftShadow));
+   if(psShadow == NULL)
+      return NULL;
+   psShadow->oNNode = oNNode;
+
+   if(Node_isFile(oNNode)) {
+      psShadow->ulLength = Node_getLength(oNNode);
+      return psShadow;
+   }
+
+   psShadow->ulChildren = Node_getNumChildren(oNNode);
+   if(psShadow->ulChildren == 0)
+      return psShadow;
+   psShadow->poNChildren = malloc(psShadow->ulChildren *
+                                  sizeof(Node_T));
+   if(psShadow->poNChildren == NULL) {
+      free(psShadow);
+      return NULL;
+   }
+   for(ul = 0; ul < psShadow->ulChildren; ul++) {
+      iStatus = Node_getChild(oNNode, ul, &psShadow->poNChildren[ul]);
+      assert(iStatus == SUCCESS);
+      if(Node_isFile(psShadow->poNChildren[ul]))
+         psShadow->ulFiles++;
+   }
+   return psShadow;
+}
+
+int FT_preserve(FT_T oFT, Node_T oNNode) {
+   struct ftShadow *psShadow = NULL;
+   FTSnapshot_T oS;
+   size_t ulIndex;
+   size_t ul;
+
+   assert(oFT != NULL);
+   assert(oNNode != NULL);
+
+   if(!FT_hasSnapshots(oFT))
+      return SUCCESS;
+
+   for(ul = 0; ul < DynArray_getLength(oFT->oDSnapshots); ul++) {
+      oS = DynArray_get(oFT->oDSnapshots, ul);
+      if(FT_findShadow(oS, oNNode, &ulIndex) != NULL)
+         continue;
+
+      if(psShadow == NULL) {
+         psShadow = FT_newShadow(oNNode);
+         if(psShadow == NULL)
+            return MEMORY_ERROR;
+      }
+      /* snapshots already given the shadow may keep it: it is what
+         the unchanged node looks like to them anyway */
+      if(!DynArray_addAt(oS->oDShadows, ulIndex, psShadow)) {
+         if(psShadow->ulRefs == 0)
+            FT_freeShadow(psShadow);
+         return MEMORY_ERROR;
+      }
+      psShadow->ulRefs++;
+   }
+   return SUCCESS;
+}
+
+/*
+  Returns the child named pcName of directory oNDir among the ulCount
+  children at poNChildren, which are in lexicographic order and whose
+  names start ulSkip bytes into their pathnames, or NULL if there is
+  none.
+*/
+static Node_T FT_searchChildren(Node_T *poNChildren, size_t ulCount,
+                                size_t ulSkip, const char *pcName) {
+   size_t ulLow = 0;
+   size_t ulHigh = ulCount;
+   size_t ulMid;
+   int iCmp;
+
+   assert(poNChildren != NULL || ulCount == 0);
+   assert(pcName != NULL);
+
+   while(ulLow < ulHigh) {
+      ulMid = ulLow + (ulHigh - ulLow) / 2;
+      iCmp = strcmp(Path_getPathname(Node_getPath(poNChildren[ulMid]))
+                    + ulSkip, pcName);
+      if(iCmp == 0)
+         return poNChildren[ulMid];
+      if(iCmp < 0)
+         ulLow = ulMid + 1;
+      else
+         ulHigh = ulMid;
+   }
+   return NULL;
+}
+
+/*
+  Returns the child named pcName that node oNNode had when snapshot oS
+  was taken, or NULL if it had none. The caller holds the lock of oS's
+  FT shared, if locking is on.
+*/
+static Node_T FT_snapshotChild(FTSnapshot_T oS, Node_T oNNode,
+                               const char *pcName) {
+   struct ftShadow *psShadow;
+   Node_T oNChild = NULL;
+   size_t ulChildID;
+   size_t ulSkip;
+   int iStatus;
+
+   assert(oS != NULL);
+   assert(oNNode != NULL);
+   assert(pcName != NULL);
+
+   if(Node_isFile(oNNode))
+      return NULL;
+
+   psShadow = FT_findShadow(oS, oNNode, &ulChildID);
+   if(psShadow == NULL) {
+      if(!Node_hasChildNamed(oNNode, pcName, &ulChildID))
+         return NULL;
+      iStatus = Node_getChild(oNNode, ulChildID, &oNChild);
+      assert(iStatus == SUCCESS);
+      return oNChild;
+   }
+
+   /* a child's pathname is its parent's, a '/', and its name */
+   ulSkip = Path_getStrLength(Node_getPath(oNNode)) + 1;
+   oNChild = FT_searchChildren(psShadow->poNChildren,
+                               psShadow->ulFiles, ulSkip, pcName);
+   if(oNChild == NULL && psShadow->ulChildren > psShadow->ulFiles)
+      oNChild = FT_searchChildren(
+         psShadow->poNChildren + psShadow->ulFiles,
+         psShadow->ulChildren - psShadow->ulFiles, ulSkip, pcName);
+   return oNChild;
+}
+
+/*
+  Performs a pre-order traversal of the tree as snapshot oS sees it,
+  calling (*pfVisit)(oNVisited, pvExtra) on each node in the order
+  FT_preOrderTraversal would have when oS was taken. Takes the lock of
+  oS's FT shared, if locking is on, only while listing the children
+  of each directory, and visits without it. Pending nodes are kept on
+  an explicit stack, since the nodes' parent links and children may
+  have changed since. Returns SUCCESS, or MEMORY_ERROR if the stack
+  could not grow, in which case the traversal stops early.
+*/
+static int FT_snapshotTraversal(FTSnapshot_T oS,
+                                void (*pfVisit)(Node_T, void *),
+                                void *pvExtra) {
+   DynArray_T oDPending;
+   struct ftShadow *psShadow;
+   Node_T oNCurr;
+   Node_T oNChild;
+   size_t ulChildren;
+   size_t ulIndex;
+   size_t ul;
+   int iStatus;
+
+   assert(oS != NULL);
+   assert(pfVisit != NULL);
+
+   if(oS->oNRoot == NULL)
+      return SUCCESS;
+
+   oDPending = DynArray_new(0);
+   if(oDPending == NULL)
+      return MEMORY_ERROR;
+   if(!DynArray_add(oDPending, oS->oNRoot)) {
+      DynArray_free(oDPending);
+      return MEMORY_ERROR;
+   }
+
+   while(DynArray_getLength(oDPending) > 0) {
+      oNCurr = DynArray_removeAt(oDPending,
+                                 DynArray_getLength(oDPending) - 1);
+      (*pfVisit)(oNCurr, pvExtra);
+      if(Node_isFile(oNCurr))
+         continue;
+
+      /* push the children last first, so the first comes off next */
+      FT_lockShared(oS->oFT);
+      psShadow = FT_findShadow(oS, oNCurr, &ulIndex);
+      if(psShadow != NULL)
+         ulChildren = psShadow->ulChildren;
+      else
+         ulChildren = Node_getNumChildren(oNCurr);
+      for(ul = ulChildren; ul > 0; ul--) {
+         if(psShadow != NULL)
+            oNChild = psShadow->poNChildren[ul - 1];
+         else {
+            iStatus = Node_getChild(oNCurr, ul - 1, &oNChild);
+            assert(iStatus == SUCCESS);
+         }
+         if(!DynArray_add(oDPending, oNChild)) {
+            FT_unlock(oS->oFT);
+            DynArray_free(oDPending);
+            return MEMORY_ERROR;
+         }
+      }
+      FT_unlock(oS->oFT);
+   }
+
+   DynArray_free(oDPending);
+   return SUCCESS;
+}
+
+/*
+  Frees the subtrees that oFT removed while snapshots were open and
+  that no snapshot still open can reach. The caller holds oFT's lock
+  exclusively, if locking is on.
+*/
+static void FT_reclaimRemoved(FT_T oFT) {
+   struct ftRemoved *psRemoved;
+   FTSnapshot_T oSOldest;
+   size_t ulOldest;
+   size_t ulFreed = 0;
+   size_t ulLength;
+   size_t ul;
+
+   assert(oFT != NULL);
+   assert(oFT->oDRemoved != NULL);
+
+   /* a subtree is reachable from the snapshots numbered up to its
+      ulSeq, and subtrees were removed in order */
+   if(FT_hasSnapshots(oFT)) {
+      oSOldest = DynArray_get(oFT->oDSnapshots, 0);
+      ulOldest = oSOldest->ulSeq;
+   }
+   else
+      ulOldest = oFT->ulSnapshotSeq + 1;
+
+   ulLength = DynArray_getLength(oFT->oDRemoved);
+   while(ulFreed < ulLength) {
+      psRemoved = DynArray_get(oFT->oDRemoved, ulFreed);
+      if(psRemoved->ulSeq >= ulOldest)
+         break;
+      FT_freeSubtree(oFT, psRemoved->oNSubtree);
+      free(psRemoved);
+      ulFreed++;
+   }
+
+   if(ulFreed == 0)
+      return;
+   for(ul = ulFreed; ul < ulLength; ul++)
+      (void) DynArray_set(oFT->oDRemoved, ul - ulFreed,
+                          DynArray_get(oFT->oDRemoved, ul));
+   for(ul = 0; ul < ulFreed; ul++)
+      (void) DynArray_removeAt(oFT->oDRemoved,
+                               DynArray_getLength(oFT->oDRemoved) - 1);
+}
+
+int FT_snapshotIn(FT_T oFT, FTSnapshot_T *poSResult) {
+   FTSnapshot_T oS;
+
+   assert(oFT != NULL);
+   assert(poSResult != NULL);
+
+   *poSResult = NULL;
+   if(oFT->poFShards != NULL || oFT->eLocking == FT_LOCK_DIRS)
+      return INITIALIZATION_ERROR;
+
+   oS = malloc(sizeof(struct ftSnapshot));
+   if(oS == NULL)
+      return MEMORY_ERROR;
+   oS->oFT = oFT;
+   oS->oDShadows = DynArray_new(0);
+   if(oS->oDShadows == NULL) {
+      free(oS);
+      return MEMORY_ERROR;
+   }
+
+   FT_lockExclusive(oFT);
+   if(!oFT->bIsInitialized) {
+      FT_unlock(oFT);
+      DynArray_free(oS->oDShadows);
+      free(oS);
+      return INITIALIZATION_ERROR;
+   }
+
+   if(oFT->oDSnapshots == NULL) {
+      oFT->oDSnapshots = DynArray_new(0);
+      oFT->oDRemoved = DynArray_new(0);
+      if(oFT->oDSnapshots == NULL || oFT->oDRemoved == NULL) {
+         if(oFT->oDSnapshots != NULL)
+            DynArray_free(oFT->oDSnapshots);
+         if(oFT->oDRemoved != NULL)
+            DynArray_free(oFT->oDRemoved);
+         oFT->oDSnapshots = NULL;
+         oFT->oDRemoved = NULL;
+      }
+   }
+   if(oFT->oDSnapshots == NULL ||
+      !DynArray_add(oFT->oDSnapshots, oS)) {
+      FT_unlock(oFT);
+      DynArray_free(oS->oDShadows);
+      free(oS);
+      return MEMORY_ERROR;
+   }
+
+   oFT->ulSnapshotSeq++;
+   oS->ulSeq = oFT->ulSnapshotSeq;
+   oS->oNRoot = oFT->oNRoot;
+   FT_unlock(oFT);
+
+   *poSResult = oS;
+   return SUCCESS;
+}
+
+void FT_releaseSnapshot(FTSnapshot_T oS) {
+   struct ftShadow *psShadow;
+   FT_T oFT;
+   size_t ul;
+
+   if(oS == NULL)
+      return;
+
+   oFT = oS->oFT;
+   FT_lockExclusive(oFT);
+
+   for(ul = 0; ul < DynArray_getLength(oFT->oDSnapshots); ul++)
+      if(DynArray_get(oFT->oDSnapshots, ul) == oS) {
+         (void) DynArray_removeAt(oFT->oDSnapshots, ul);
+         break;
+      }
+
+   for(ul = 0; ul < DynArray_getLength(oS->oDShadows); ul++) {
+      psShadow = DynArray_get(oS->oDShadows, ul);
+      psShadow->ulRefs--;
+      if(psShadow->ulRefs == 0)
+         FT_freeShadow(psShadow);
+   }
+   DynArray_free(oS->oDShadows);
+   free(oS);
+
+   FT_reclaimRemoved(oFT);
+   FT_unlock(oFT);
+}
+
+char *FT_snapshotToString(FTSnapshot_T oS) {
+   size_t ulTotal = 1;
+   char *pcResult;
+   char *pcEnd;
+
+   assert(oS != NULL);
+
+   if(FT_snapshotTraversal(oS,
+                           (void (*)(Node_T, void *))
+                           FT_strlenAccumulate,
+                           (void *) &ulTotal) != SUCCESS)
+      return NULL;
+
+   pcResult = malloc(ulTotal);
+   if(pcResult == NULL)
+      return NULL;
+
+   pcEnd = pcResult;
+   if(FT_snapshotTraversal(oS,
+                           (void (*)(Node_T, void *))
+                           FT_strcatAccumulate,
+                           (void *) &pcEnd) != SUCCESS) {
+      free(pcResult);
+      return NULL;
+   }
+   *pcEnd = '\0';
+
+   return pcResult;
+}
+
+int FT_snapshotStat(FTSnapshot_T oS, const char *pcPath,
+                    boolean *pbIsFile, size_t *pulSize) {
+   struct ftShadow *psShadow;
+   Path_T oPPath = NULL;
+   Node_T oNCurr;
+   size_t ulDepth;
+   size_t ulIndex;
+   size_t ul;
+   int iStatus;
+
+   assert(oS != NULL);
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(oS->oNRoot == NULL) {
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
+   /* the root's path has depth 1, so its pathname is its component */
+   if(strcmp(Path_getPathname(Node_getPath(oS->oNRoot)),
+             Path_getComponent(oPPath, 0))) {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+
+   FT_lockShared(oS->oFT);
+   oNCurr = oS->oNRoot;
+   ulDepth = Path_getDepth(oPPath);
+   for(ul = 1; ul < ulDepth && oNCurr != NULL; ul++)
+      oNCurr = FT_snapshotChild(oS, oNCurr,
+                                Path_getComponent(oPPath, ul));
+   Path_free(oPPath);
+   if(oNCurr == NULL) {
+      FT_unlock(oS->oFT);
+      return NO_SUCH_PATH;
+   }
+
+   *pbIsFile = Node_isFile(oNCurr);
+   /* pulSize unchanged for directories, as for FT_stat */
+   if(*pbIsFile) {
+      psShadow = FT_findShadow(oS, oNCurr, &ulIndex);
+      *pulSize = (psShadow != NULL) ? psShadow->ulLength :
+                 Node_getLength(oNCurr);
+   }
+   FT_unlock(oS->oFT);
+   return SUCCESS;
+}
@@ -0,0 +1,43 @@
+/*--------------------------------------------------------------------*/
+/* ftsnap.h                                                           */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTSNAP_INCLUDED
+#define FTSNAP_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Snapshots. Writers record what they change in the shadows of every
+  open snapshot, under the exclusive lock, so a reader of a snapshot
+  only needs the shared lock while it looks at one directory: the
+  directory's shadow, if it has one, or else the directory itself is
+  what the snapshot sees. Every function that changes a node's
+  children or contents calls FT_preserve on it first.
+*/
+
+/* A subtree removed while snapshots were open */
+struct ftRemoved {
+   Node_T oNSubtree;
+   /* the number of snapshots taken before the removal, so that only
+      open snapshots numbered up to this one can reach the subtree */
+   size_t ulSeq;
+};
+
+/* Returns TRUE if oFT has snapshots open. */
+boolean FT_hasSnapshots(FT_T oFT);
+
+/*
+  Gives every open snapshot of oFT that has no shadow of oNNode yet a
+  shadow recording what oNNode looks like now, before the caller
+  changes oNNode's children or contents. Returns SUCCESS, or
+  MEMORY_ERROR, in which case the caller must not change oNNode. The
+  caller holds oFT's lock exclusively, if locking is on.
+*/
+int FT_preserve(FT_T oFT, Node_T oNNode);
+
+#endif
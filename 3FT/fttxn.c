@@ -0,0 +1,361 @@
+/*--------------------------------------------------------------------*/
+/* fttxn.c                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+/* for pthread_rwlock_t */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#include "dynarray.h"
+#include "nodeFT.h"
+#include "ftimpl.h"
+#include "ftsnap.h"
+#include "ftreclaim.h"
+#include "fttxn.h"
+
+/* A transaction, which holds its FT's lock until it ends */
+struct ftTxn {
+   FT_T oFT;
+   /* the undo records of the operations applied so far, oldest
+      first */
+   DynArray_T oDUndo;
+};
+
+/*
+  Appends to oT's log a new undo record of kind eKind, and sets
+  *ppsUndo to it. Returns SUCCESS, or MEMORY_ERROR with the log
+  unchanged.
+*/
+static int FT_txnLog(FTTxn_T oT, enum ftUndoKind eKind,
+                     struct ftUndo **ppsUndo) {
+   struct ftUndo *psUndo;
+
+   assert(oT != NULL);
+   assert(ppsUndo != NULL);
+
+   psUndo = calloc(1, sizeof(struct ftUndo));
+   if(psUndo == NULL)
+      return MEMORY_ERROR;
+   if(!DynArray_add(oT->oDUndo, psUndo)) {
+      free(psUndo);
+      return MEMORY_ERROR;
+   }
+   psUndo->eKind = eKind;
+   *ppsUndo = psUndo;
+   return SUCCESS;
+}
+
+/* Drops the last record of oT's log, that of an operation that
+   failed and so changed nothing. */
+static void FT_txnUnlog(FTTxn_T oT) {
+   assert(oT != NULL);
+   assert(DynArray_getLength(oT->oDUndo) > 0);
+
+   free(DynArray_removeAt(oT->oDUndo,
+                          DynArray_getLength(oT->oDUndo) - 1));
+}
+
+/*
+  Implements FT_txnInsertDir (bIsFile FALSE) and FT_txnInsertFile
+  (bIsFile TRUE).
+*/
+static int FT_txnInsert(FTTxn_T oT, const char *pcPath,
+                        boolean bIsFile, void *pvContents,
+                        size_t ulLength) {
+   struct ftUndo *psUndo;
+   int iStatus;
+
+   assert(oT != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_txnLog(oT, FT_UNDO_INSERT, &psUndo);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = FT_insertLocked(oT->oFT, pcPath, bIsFile, pvContents,
+                             ulLength, psUndo);
+   if(iStatus != SUCCESS)
+      FT_txnUnlog(oT);
+   return iStatus;
+}
+
+/*
+  Implements FT_txnRmDir (bIsFile FALSE) and FT_txnRmFile (bIsFile
+  TRUE): sets the subtree at pcPath aside, drops it from the indexes
+  and the node count, and, if snapshots are open, reserves its place
+  among the removed subtrees that they may still reach.
+*/
+static int FT_txnRemove(FTTxn_T oT, const char *pcPath,
+                        boolean bIsFile) {
+   FT_T oFT;
+   struct ftUndo *psUndo;
+   Node_T oNFound = NULL;
+   Node_T oNParent;
+   int iStatus;
+
+   assert(oT != NULL);
+   assert(pcPath != NULL);
+
+   oFT = oT->oFT;
+   iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   /* the whole tree is locked, as for FT_rmDirLocked */
+   FT_releaseGuard(oFT, oNFound);
+
+   if(Node_isFile(oNFound) != bIsFile)
+      return bIsFile ? NOT_A_FILE : NOT_A_DIRECTORY;
+
+   iStatus = FT_txnLog(oT, FT_UNDO_REMOVE, &psUndo);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   psUndo->oNNode = oNFound;
+
+   if(FT_hasSnapshots(oFT)) {
+      oNParent = Node_getParent(oNFound);
+      if(oNParent != NULL)
+         iStatus = FT_preserve(oFT, oNParent);
+      if(iStatus == SUCCESS) {
+         psUndo->psRemoved = malloc(sizeof(struct ftRemoved));
+         if(psUndo->psRemoved == NULL)
+            iStatus = MEMORY_ERROR;
+      }
+      if(iStatus == SUCCESS &&
+         !DynArray_add(oFT->oDRemoved, psUndo->psRemoved))
+         iStatus = MEMORY_ERROR;
+      if(iStatus != SUCCESS) {
+         free(psUndo->psRemoved);
+         FT_txnUnlog(oT);
+         return iStatus;
+      }
+      psUndo->psRemoved->oNSubtree = oNFound;
+      psUndo->psRemoved->ulSeq = oFT->ulSnapshotSeq;
+   }
+
+   Node_setAside(oNFound);
+   FT_unindexSubtree(oFT, oNFound);
+   psUndo->ulNodes = Node_getSubtreeSize(oNFound);
+   FT_lockState(oFT);
+   oFT->ulCount -= psUndo->ulNodes;
+   if(oFT->ulCount == 0)
+      __atomic_store_n(&oFT->oNRoot, NULL, __ATOMIC_RELEASE);
+   FT_unlockState(oFT);
+   return SUCCESS;
+}
+
+/* Undoes the operation that psUndo records, in oFT. */
+static void FT_txnUndo(FT_T oFT, struct ftUndo *psUndo) {
+   Node_T oNNode;
+
+   assert(oFT != NULL);
+   assert(psUndo != NULL);
+
+   oNNode = psUndo->oNNode;
+   switch(psUndo->eKind) {
+      case FT_UNDO_INSERT:
+         FT_unindexSubtree(oFT, oNNode);
+         FT_lockState(oFT);
+         oFT->ulCount -= psUndo->ulNodes;
+         if(oFT->ulCount == 0)
+            __atomic_store_n(&oFT->oNRoot, NULL, __ATOMIC_RELEASE);
+         FT_unlockState(oFT);
+         (void) Node_free(oNNode);
+         break;
+
+      case FT_UNDO_REMOVE:
+         Node_restore(oNNode);
+         FT_lockState(oFT);
+         if(oFT->ulCount == 0)
+            __atomic_store_n(&oFT->oNRoot, oNNode, __ATOMIC_RELEASE);
+         oFT->ulCount += psUndo->ulNodes;
+         FT_unlockState(oFT);
+         if(oFT->oPCache != NULL || oFT->oBFilter != NULL)
+            FT_preOrderTraversal(oNNode, FT_indexAdd, oFT);
+         FT_growFilter(oFT);
+         /* later reservations were undone first, so this one is
+            last */
+         if(psUndo->psRemoved != NULL) {
+            assert(DynArray_get(oFT->oDRemoved,
+                                DynArray_getLength(oFT->oDRemoved) - 1)
+                   == psUndo->psRemoved);
+            (void) DynArray_removeAt(oFT->oDRemoved,
+                                     DynArray_getLength(oFT->oDRemoved)
+                                     - 1);
+            free(psUndo->psRemoved);
+         }
+         break;
+
+      case FT_UNDO_REPLACE:
+         Node_restoreContents(oNNode, psUndo->pvOld,
+                              psUndo->ulOldLength);
+         break;
+   }
+}
+
+/*
+  Makes the operation that psUndo records final in oFT: frees a
+  removed subtree, or leaves it to the snapshots that may still reach
+  it, after invalidating the handles to its directories, and frees
+  replaced contents.
+*/
+static void FT_txnKeep(FT_T oFT, struct ftUndo *psUndo) {
+   Node_T oNNode;
+
+   assert(oFT != NULL);
+   assert(psUndo != NULL);
+
+   oNNode = psUndo->oNNode;
+   switch(psUndo->eKind) {
+      case FT_UNDO_INSERT:
+         break;
+
+      case FT_UNDO_REMOVE:
+         if(!Node_isFile(oNNode)) {
+            FT_lockState(oFT);
+            FT_invalidateHandlesUnder(oFT, Node_getPath(oNNode));
+            FT_unlockState(oFT);
+         }
+         /* a subtree set aside earlier lies outside any set aside
+            later, and its former parent is still allocated */
+         Node_forget(oNNode);
+         if(psUndo->psRemoved == NULL)
+            FT_freeSubtree(oFT, oNNode);
+         break;
+
+      case FT_UNDO_REPLACE:
+         free(psUndo->pvOld);
+         break;
+   }
+}
+
+/* Ends transaction oT: marks it closed for lock-free lookups,
+   releases its FT's lock, and frees it and its log. */
+static void FT_txnEnd(FTTxn_T oT) {
+   FT_T oFT;
+   size_t ul;
+
+   assert(oT != NULL);
+
+   oFT = oT->oFT;
+   __atomic_store_n(&oFT->uiTxnVersion, oFT->uiTxnVersion + 1,
+                    __ATOMIC_RELEASE);
+   FT_unlock(oFT);
+
+   for(ul = 0; ul < DynArray_getLength(oT->oDUndo); ul++)
+      free(DynArray_get(oT->oDUndo, ul));
+   DynArray_free(oT->oDUndo);
+   free(oT);
+}
+
+int FT_beginIn(FT_T oFT, FTTxn_T *poTResult) {
+   FTTxn_T oT;
+
+   assert(oFT != NULL);
+   assert(poTResult != NULL);
+
+   *poTResult = NULL;
+   if(oFT->poFShards != NULL)
+      return INITIALIZATION_ERROR;
+
+   oT = malloc(sizeof(struct ftTxn));
+   if(oT == NULL)
+      return MEMORY_ERROR;
+   oT->oFT = oFT;
+   oT->oDUndo = DynArray_new(0);
+   if(oT->oDUndo == NULL) {
+      free(oT);
+      return MEMORY_ERROR;
+   }
+
+   FT_lockExclusive(oFT);
+   if(!oFT->bIsInitialized) {
+      FT_unlock(oFT);
+      DynArray_free(oT->oDUndo);
+      free(oT);
+      return INITIALIZATION_ERROR;
+   }
+
+   /* as Node_beginWrite does for a node, before any change */
+   __atomic_store_n(&oFT->uiTxnVersion, oFT->uiTxnVersion + 1,
+                    __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   *poTResult = oT;
+   return SUCCESS;
+}
+
+int FT_txnInsertDir(FTTxn_T oT, const char *pcPath) {
+   return FT_txnInsert(oT, pcPath, FALSE, NULL, 0);
+}
+
+int FT_txnInsertFile(FTTxn_T oT, const char *pcPath,
+                     void *pvContents, size_t ulLength) {
+   return FT_txnInsert(oT, pcPath, TRUE, pvContents, ulLength);
+}
+
+int FT_txnRmDir(FTTxn_T oT, const char *pcPath) {
+   return FT_txnRemove(oT, pcPath, FALSE);
+}
+
+int FT_txnRmFile(FTTxn_T oT, const char *pcPath) {
+   return FT_txnRemove(oT, pcPath, TRUE);
+}
+
+int FT_txnReplaceFileContents(FTTxn_T oT, const char *pcPath,
+                              void *pvNewContents,
+                              size_t ulNewLength) {
+   FT_T oFT;
+   struct ftUndo *psUndo;
+   Node_T oNFound = NULL;
+   int iStatus;
+
+   assert(oT != NULL);
+   assert(pcPath != NULL);
+
+   oFT = oT->oFT;
+   iStatus = FT_findNode(oFT, pcPath, FALSE, &oNFound);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   FT_releaseGuard(oFT, oNFound);
+
+   if(!Node_isFile(oNFound))
+      return NOT_A_FILE;
+
+   iStatus = FT_txnLog(oT, FT_UNDO_REPLACE, &psUndo);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   psUndo->oNNode = oNFound;
+   psUndo->ulOldLength = Node_getLength(oNFound);
+
+   iStatus = FT_preserve(oFT, oNFound);
+   if(iStatus == SUCCESS)
+      iStatus = Node_replaceContents(oNFound, pvNewContents,
+                                     ulNewLength, &psUndo->pvOld);
+   if(iStatus != SUCCESS)
+      FT_txnUnlog(oT);
+   return iStatus;
+}
+
+void FT_commit(FTTxn_T oT) {
+   size_t ul;
+
+   assert(oT != NULL);
+
+   for(ul = 0; ul < DynArray_getLength(oT->oDUndo); ul++)
+      FT_txnKeep(oT->oFT, DynArray_get(oT->oDUndo, ul));
+   FT_txnEnd(oT);
+}
+
+void FT_abort(FTTxn_T oT) {
+   size_t ul;
+
+   assert(oT != NULL);
+
+   for(ul = DynArray_getLength(oT->oDUndo); ul > 0; ul--)
+      FT_txnUndo(oT->oFT, DynArray_get(oT->oDUndo, ul - 1));
+   FT_txnEnd(oT);
+}
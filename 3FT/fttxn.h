@@ -0,0 +1,43 @@
+/*--------------------------------------------------------------------*/
+/* fttxn.h                                                            */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef FTTXN_INCLUDED
+#define FTTXN_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+#include "ft.h"
+
+/*
+  Transactions. A transaction holds its FT's lock from FT_beginIn
+  until FT_commit or FT_abort. Each of its operations takes effect at
+  once, as the function of the same name does, and first logs how to
+  undo it. A removal only sets its subtree aside, and a replacement
+  keeps the old contents, so that undoing needs no memory and
+  FT_abort cannot fail; FT_commit frees what they kept.
+*/
+
+/* The kinds of operation whose undo a transaction logs */
+enum ftUndoKind { FT_UNDO_INSERT, FT_UNDO_REMOVE, FT_UNDO_REPLACE };
+
+/* How to undo one operation of a transaction */
+struct ftUndo {
+   enum ftUndoKind eKind;
+   /* the highest node inserted, the node removed, or the file whose
+      contents were replaced */
+   Node_T oNNode;
+   /* for an insertion or removal, the number of nodes it added or
+      removed */
+   size_t ulNodes;
+   /* for a removal, the subtree's place in oDRemoved if snapshots
+      were open, or NULL */
+   struct ftRemoved *psRemoved;
+   /* for a replacement, the old contents and their length */
+   void *pvOld;
+   size_t ulOldLength;
+};
+
+#endif
@@ -3,48 +3,849 @@
 /* Author: Helen Hui, George Xie                                                */
 /*--------------------------------------------------------------------*/
 
+/* for posix_memalign and pthreads */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
+#include <pthread.h>
 #include "dynarray.h"
+#include "epoch.h"
 #include "nodeFT.h"
 
-/* A node in an FT */
+/* The size of a cache line, to which every node is aligned */
+enum { NODE_CACHE_LINE = 64 };
+
+/* The fewest children for which a directory keeps the running sums of
+   its children's subtree sizes, once asked for them; over fewer, a
+   scan of the sizes themselves costs little */
+enum { NODE_PREFIX_MIN = 64 };
+
+/* The fewest children a children array has room for */
+enum { NODE_ARRAY_MIN = 2 };
+
+/* Nodes are allocated from slabs of 2^NODE_SLAB_SHIFT slots */
+enum { NODE_SLAB_SHIFT = 8, NODE_SLAB_SIZE = 1 << NODE_SLAB_SHIFT };
+
+/* Slab pointers are kept in chunks of 2^NODE_CHUNK_SHIFT, enough
+   chunks to address every 32-bit index */
+enum {
+   NODE_CHUNK_SHIFT = 12,
+   NODE_CHUNK_SIZE = 1 << NODE_CHUNK_SHIFT,
+   NODE_MAX_CHUNKS = 1 << (32 - NODE_SLAB_SHIFT - NODE_CHUNK_SHIFT)
+};
+
+/* The node index that refers to no node */
+static const unsigned int NODE_NONE = UINT_MAX;
+
+/* The contents of a file node, kept apart from the fields that path
+   lookups and traversals read */
+struct nodeContents {
+   /* the file's contents: acInline if they fit there, otherwise a
+      heap buffer owned by the node (NULL if empty) */
+   void *pvContents;
+   /* the length of contents in bytes */
+   size_t ulLength;
+   /* inline storage for contents of at most NODE_INLINE_MAX bytes */
+   char acInline[NODE_INLINE_MAX];
+};
+
+/*
+  The children of one kind of a directory node, sorted by name. An
+  array keeps spare room and doubles it when it fills up: an insertion
+  shifts the later children up in place while there is room, and only
+  one that finds the array full moves the children to a new array.
+  Lock-free readers may search an array while a writer changes it, so
+  children are stored and loaded atomically, and the length is stored
+  with release ordering after the children it counts; a reader bounds
+  its search by the length, and checks what it finds against the
+  parent's version.
+*/
+struct nodeArray {
+   /* the number of children */
+   size_t ulLength;
+   /* the number of children there is room for */
+   size_t ulCapacity;
+   /* the children, allocated right after the struct */
+   Node_T *aoNChildren;
+};
+
+/* A node in an FT. The node occupies exactly one cache line, with the
+   fields read on every lookup and traversal step first. A file node's
+   struct nodeContents, or a directory node's struct nodeLock,
+   occupies the cache line right after it. */
 struct node {
    /* the object corresponding to the node's absolute path */
    Path_T oPPath;
-   /* this node's parent */
-   Node_T oNParent;
-   /* the object containing links to this node's children */
-   DynArray_T oDChildren;
+   /* this node's file children, sorted lexicographically (NULL
+      until the first file child) */
+   struct nodeArray *psFiles;
+   /* this node's directory children, sorted lexicographically (NULL
+      until the first dir child) */
+   struct nodeArray *psDirs;
    /* TRUE if this node represents a file, FALSE for directory */
    boolean bIsFile;
-   /* the file's contents (NULL if directory) */
-   void *pvContents;
-   /* the length of contents in bytes (0 if directory) */
-   size_t ulLength;
+   /* the index of this node's parent in sDirTable (NODE_NONE if root);
+      for a free slot, the index of the next free slot instead */
+   unsigned int uiParent;
+   /* the index of this node in its table */
+   unsigned int uiIndex;
+   /* even while the node is stable, odd while its children or
+      contents are being changed, and odd for good once it has been
+      removed; see Node_readBegin */
+   unsigned int uiVersion;
+   /* TRUE while the node is among its parent's children; a node made
+      by Node_newUnlinked, a root and a removed node are not */
+   boolean bLinked;
+   /* the numbers of files and of directories in the subtree rooted
+      at this node, itself included, and the bytes of contents of those
+      files; a change below a node that is not linked stops there, and
+      reaches the nodes above once the node is linked */
+   unsigned int uiFiles;
+   unsigned int uiDirs;
+   /* TRUE while the running sums in a directory's struct nodeLock are
+      up to date; see Node_getPrefix */
+   boolean bPrefixed;
+   size_t ulBytes;
 };
 
+/* Fails to compile if struct node outgrows its cache line */
+typedef char Node_fitsCacheLine[
+   sizeof(struct node) <= NODE_CACHE_LINE ? 1 : -1];
+
+/* Fails to compile if a file node and its contents outgrow two */
+typedef char Node_contentsFitCacheLine[
+   sizeof(struct nodeContents) <= NODE_CACHE_LINE ? 1 : -1];
+
+/* The lock of a directory node, kept in the cache line after the node
+   so that walks that take no locks do not load it, with the running
+   sums of its children's subtree sizes */
+struct nodeLock {
+   pthread_rwlock_t sLock;
+   /* entry i is the number of nodes in the subtrees of the children
+      with IDs below i, for every i up to the number of children, or
+      NULL if no listing has needed them since the children changed */
+   size_t *pulPrefix;
+};
+
+/* Fails to compile if a directory node and its lock outgrow two */
+typedef char Node_lockFitsCacheLine[
+   sizeof(struct nodeLock) <= NODE_CACHE_LINE ? 1 : -1];
+
+/*
+  A table of equally sized node slots addressed by 32-bit index. Slots
+  live in cache-line-aligned slabs that never move, so a Node_T is a
+  stable handle on its slot. Freed slots are reused before new ones.
+
+  A node's fields stay together in its slot rather than in one array
+  per field. Each step of a lookup reads the path, children arrays
+  and version of one node, which a slot serves from one cache line;
+  whole-tree walks read the same fields of every node they visit; and
+  lock-free readers validate what they read against the version kept
+  beside it.
+
+  The tables are shared by every FT in the process. Allocating and
+  releasing slots takes sTableLock, but finding a node by index takes
+  no lock: the slab pointers live in fixed chunks rather than in one
+  growing array, so a table growing on behalf of one FT never moves
+  memory that a reader of another FT is using.
+*/
+struct nodeTable {
+   /* chunks of pointers to slabs of NODE_SLAB_SIZE slots each */
+   char **appcChunks[NODE_MAX_CHUNKS];
+   /* the number of slabs allocated */
+   unsigned int uiNumSlabs;
+   /* the index of the first slot that has never been handed out */
+   unsigned int uiNext;
+   /* the index of the first free slot (NODE_NONE if none) */
+   unsigned int uiFree;
+   /* the number of slots currently in use */
+   unsigned int uiLive;
+   /* the size of each slot in bytes */
+   size_t ulSlotSize;
+};
+
+/* The table of directory nodes, one cache line each for node and
+   lock */
+static struct nodeTable sDirTable = {
+   { NULL }, 0, 0, UINT_MAX, 0, 2 * NODE_CACHE_LINE
+};
+/* The table of file nodes, one cache line each for node and contents */
+static struct nodeTable sFileTable = {
+   { NULL }, 0, 0, UINT_MAX, 0, 2 * NODE_CACHE_LINE
+};
+
+/* Guards the allocation state of both tables */
+static pthread_mutex_t sTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The number of slots an arena takes from a table at once */
+enum { NODE_ARENA_SLOTS = 64 };
+
+/*
+  A thread's stock of slots taken from the tables in advance, for
+  directories at index 0 and files at index 1. The slots from
+  aulNext up to aulHeld are still to be handed out; they count as in
+  use in their tables until then.
+*/
+struct nodeArena {
+   struct node *apsSlots[2][NODE_ARENA_SLOTS];
+   size_t aulNext[2];
+   size_t aulHeld[2];
+};
+
+/* The key under which a thread keeps its arena, if it has one */
+static pthread_key_t sArenaKey;
+static pthread_once_t sArenaOnce = PTHREAD_ONCE_INIT;
+static boolean bArenaKeyMade = FALSE;
+
+/*
+  The number of users of Node_setDeferred that need deferral. While
+  it is not 0, removed nodes and replaced children arrays go to
+  Epoch_retire instead of being freed at once, since lock-free readers
+  may still be reading them. Changed under sTableLock.
+*/
+static unsigned int uiDeferring = 0;
+
+/* Returns the node in slot uiIndex of psTable. */
+static struct node *NodeTable_get(struct nodeTable *psTable,
+                                  unsigned int uiIndex) {
+   unsigned int uiSlab = uiIndex >> NODE_SLAB_SHIFT;
+
+   assert(psTable != NULL);
+   assert(psTable->appcChunks[uiSlab >> NODE_CHUNK_SHIFT] != NULL);
+
+   return (struct node *)
+      (psTable->appcChunks[uiSlab >> NODE_CHUNK_SHIFT]
+                          [uiSlab & (NODE_CHUNK_SIZE - 1)] +
+       (uiIndex & (NODE_SLAB_SIZE - 1)) * psTable->ulSlotSize);
+}
+
+/*
+  Hands out an uninitialized slot of psTable, with its uiIndex set.
+  Returns NULL if memory could not be allocated or the table has run
+  out of 32-bit indices. The caller must hold sTableLock.
+*/
+static struct node *NodeTable_alloc(struct nodeTable *psTable) {
+   struct node *psNode;
+   void *pvSlab;
+
+   assert(psTable != NULL);
+
+   if(psTable->uiFree != NODE_NONE) {
+      psNode = NodeTable_get(psTable, psTable->uiFree);
+      psTable->uiFree = psNode->uiParent;
+      psTable->uiLive++;
+      return psNode;
+   }
+
+   if(psTable->uiNext == NODE_NONE)
+      return NULL;
+
+   /* every slot handed out so far: add a slab, and the chunk to
+      point to it if this is the chunk's first slab */
+   if((psTable->uiNext & (NODE_SLAB_SIZE - 1)) == 0) {
+      char ***pppcChunk =
+         &psTable->appcChunks[psTable->uiNumSlabs >> NODE_CHUNK_SHIFT];
+
+      if(*pppcChunk == NULL) {
+         *pppcChunk = calloc(NODE_CHUNK_SIZE, sizeof(char *));
+         if(*pppcChunk == NULL)
+            return NULL;
+      }
+      if(posix_memalign(&pvSlab, NODE_CACHE_LINE,
+                        NODE_SLAB_SIZE * psTable->ulSlotSize) != 0)
+         return NULL;
+      (*pppcChunk)[psTable->uiNumSlabs & (NODE_CHUNK_SIZE - 1)] =
+         pvSlab;
+      psTable->uiNumSlabs++;
+   }
+
+   psTable->uiNext++;
+   psTable->uiLive++;
+   psNode = NodeTable_get(psTable, psTable->uiNext - 1);
+   psNode->uiIndex = psTable->uiNext - 1;
+   return psNode;
+}
+
+/*
+  Returns psNode's slot to psTable for reuse. Once no slot is in use,
+  releases all of psTable's slabs. The caller must hold sTableLock.
+*/
+static void NodeTable_release(struct nodeTable *psTable,
+                              struct node *psNode) {
+   unsigned int ui;
+
+   assert(psTable != NULL);
+   assert(psNode != NULL);
+   assert(psTable->uiLive > 0);
+
+   psNode->uiParent = psTable->uiFree;
+   psTable->uiFree = psNode->uiIndex;
+   psTable->uiLive--;
+
+   if(psTable->uiLive == 0) {
+      for(ui = 0; ui < psTable->uiNumSlabs; ui++)
+         free(psTable->appcChunks[ui >> NODE_CHUNK_SHIFT]
+                                 [ui & (NODE_CHUNK_SIZE - 1)]);
+      for(ui = 0; ui < NODE_MAX_CHUNKS; ui++) {
+         free(psTable->appcChunks[ui]);
+         psTable->appcChunks[ui] = NULL;
+      }
+      psTable->uiNumSlabs = 0;
+      psTable->uiNext = 0;
+      psTable->uiFree = NODE_NONE;
+   }
+}
+
+/* Returns the table that holds nodes of kind bIsFile. */
+static struct nodeTable *Node_getTable(boolean bIsFile) {
+   if(bIsFile)
+      return &sFileTable;
+   else
+      return &sDirTable;
+}
+
+/* Gives the unused slots of arena pvArena back to their tables and
+   frees it; also run for an arena whose thread exits. */
+static void Node_dropArena(void *pvArena) {
+   struct nodeArena *psArena = pvArena;
+   size_t ulKind;
+   size_t ulSlot;
+
+   assert(psArena != NULL);
+
+   (void) pthread_mutex_lock(&sTableLock);
+   for(ulKind = 0; ulKind < 2; ulKind++)
+      for(ulSlot = psArena->aulNext[ulKind];
+          ulSlot < psArena->aulHeld[ulKind]; ulSlot++)
+         NodeTable_release(Node_getTable((boolean) ulKind),
+                           psArena->apsSlots[ulKind][ulSlot]);
+   (void) pthread_mutex_unlock(&sTableLock);
+   free(psArena);
+}
+
+/* Creates sArenaKey; run once. */
+static void Node_makeArenaKey(void) {
+   bArenaKeyMade = (boolean)
+      (pthread_key_create(&sArenaKey, Node_dropArena) == 0);
+}
+
+/*
+  Hands out an uninitialized slot for a node of kind bIsFile, from
+  the calling thread's arena if it has one, refilling the arena first
+  if it has run dry. Returns NULL if no slot could be had.
+*/
+static struct node *Node_allocSlot(boolean bIsFile) {
+   struct nodeArena *psArena = NULL;
+   struct node *psNode;
+   size_t ulKind = (size_t) bIsFile;
+
+   (void) pthread_once(&sArenaOnce, Node_makeArenaKey);
+   if(bArenaKeyMade)
+      psArena = pthread_getspecific(sArenaKey);
+
+   if(psArena == NULL) {
+      (void) pthread_mutex_lock(&sTableLock);
+      psNode = NodeTable_alloc(Node_getTable(bIsFile));
+      (void) pthread_mutex_unlock(&sTableLock);
+      return psNode;
+   }
+
+   if(psArena->aulNext[ulKind] == psArena->aulHeld[ulKind]) {
+      psArena->aulNext[ulKind] = 0;
+      psArena->aulHeld[ulKind] = 0;
+      (void) pthread_mutex_lock(&sTableLock);
+      while(psArena->aulHeld[ulKind] < NODE_ARENA_SLOTS) {
+         psNode = NodeTable_alloc(Node_getTable(bIsFile));
+         if(psNode == NULL)
+            break;
+         psArena->apsSlots[ulKind][psArena->aulHeld[ulKind]++] = psNode;
+      }
+      (void) pthread_mutex_unlock(&sTableLock);
+      if(psArena->aulHeld[ulKind] == 0)
+         return NULL;
+   }
+   return psArena->apsSlots[ulKind][psArena->aulNext[ulKind]++];
+}
+
+/* Returns the contents block of file node oNNode. */
+static struct nodeContents *Node_contents(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   return (struct nodeContents *) ((char *) oNNode + NODE_CACHE_LINE);
+}
+
+/* Returns the lock of directory node oNNode. */
+static pthread_rwlock_t *Node_getLock(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(!oNNode->bIsFile);
+
+   return &((struct nodeLock *)
+            ((char *) oNNode + NODE_CACHE_LINE))->sLock;
+}
+
+/* Returns the address of directory node oNNode's running sums. */
+static size_t **Node_prefixSlot(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(!oNNode->bIsFile);
+
+   return &((struct nodeLock *)
+            ((char *) oNNode + NODE_CACHE_LINE))->pulPrefix;
+}
+
 /*
   Compares oNFirst and oNSecond lexicographically based on their paths.
   Returns <0, 0, or >0 if oNFirst is less than, equal to, or greater
   than oNSecond, respectively.
 */
 static int Node_compare(Node_T oNFirst, Node_T oNSecond);
+
+/* Returns TRUE if freeing must go through Epoch_retire. */
+static boolean Node_isDeferring(void) {
+   return (boolean) (__atomic_load_n(&uiDeferring, __ATOMIC_RELAXED)
+                     != 0);
+}
+
+/*
+  Makes oNNode's version odd before a change to its children or
+  contents, ordered before every store of the change.
+*/
+static void Node_beginWrite(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->uiVersion % 2 == 0);
+
+   __atomic_store_n(&oNNode->uiVersion, oNNode->uiVersion + 1,
+                    __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Makes oNNode's version even again after a change, ordered after
+   every store of the change. */
+static void Node_endWrite(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->uiVersion % 2 == 1);
+
+   __atomic_store_n(&oNNode->uiVersion, oNNode->uiVersion + 1,
+                    __ATOMIC_RELEASE);
+}
+
+/* Marks oNNode as removed, leaving its version odd for good, unless
+   it already is. */
+static void Node_markRemoved(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(oNNode->uiVersion % 2 == 0)
+      Node_beginWrite(oNNode);
+}
+
+/*
+  Frees the running sums of oNNode, if it has any. Writers under
+  FT_LOCK_DIRS may drop those of a shared ancestor at once, so only
+  the one that clears bPrefixed frees them.
+*/
+static void Node_dropPrefix(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   /* most nodes have none, and this reads only the node's own line */
+   if(!__atomic_load_n(&oNNode->bPrefixed, __ATOMIC_RELAXED))
+      return;
+   if(!__atomic_exchange_n(&oNNode->bPrefixed, FALSE, __ATOMIC_ACQ_REL))
+      return;
+   free(__atomic_exchange_n(Node_prefixSlot(oNNode), NULL,
+                            __ATOMIC_ACQ_REL));
+}
+
+/*
+  Adds uiFiles files, uiDirs directories and ulBytes bytes to the
+  subtree totals of oNNode if bAdd is TRUE, or takes them off
+  otherwise, and does the same for each node above it up to the first
+  that is not linked. Writers under FT_LOCK_DIRS may change the totals
+  of a shared ancestor at once, so the totals change atomically. A
+  change in the number of nodes makes the running sums of each node
+  it reaches stale, so they are dropped.
+*/
+static void Node_addToTotals(Node_T oNNode, unsigned int uiFiles,
+                             unsigned int uiDirs, size_t ulBytes,
+                             boolean bAdd) {
+   assert(oNNode != NULL);
+
+   for(;;) {
+      if(bAdd) {
+         (void) __atomic_add_fetch(&oNNode->uiFiles, uiFiles,
+                                   __ATOMIC_RELAXED);
+         (void) __atomic_add_fetch(&oNNode->uiDirs, uiDirs,
+                                   __ATOMIC_RELAXED);
+         (void) __atomic_add_fetch(&oNNode->ulBytes, ulBytes,
+                                   __ATOMIC_RELAXED);
+      }
+      else {
+         (void) __atomic_sub_fetch(&oNNode->uiFiles, uiFiles,
+                                   __ATOMIC_RELAXED);
+         (void) __atomic_sub_fetch(&oNNode->uiDirs, uiDirs,
+                                   __ATOMIC_RELAXED);
+         (void) __atomic_sub_fetch(&oNNode->ulBytes, ulBytes,
+                                   __ATOMIC_RELAXED);
+      }
+      if(uiFiles != 0 || uiDirs != 0)
+         Node_dropPrefix(oNNode);
+      if(!oNNode->bLinked)
+         return;
+      oNNode = Node_getParent(oNNode);
+   }
+}
+
+/*
+  Adds the subtree totals of oNChild to those of oNParent and the
+  nodes above it if bAdd is TRUE, or takes them off otherwise.
+*/
+static void Node_addSubtree(Node_T oNParent, Node_T oNChild,
+                            boolean bAdd) {
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   Node_addToTotals(oNParent, oNChild->uiFiles, oNChild->uiDirs,
+                    oNChild->ulBytes, bAdd);
+}
+
+/*
+  Brings the byte totals of file oNNode and the nodes above it up to
+  date after its contents changed from ulOldLength bytes to the length
+  they have now.
+*/
+static void Node_updateBytes(Node_T oNNode, size_t ulOldLength) {
+   size_t ulNewLength;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   ulNewLength = Node_contents(oNNode)->ulLength;
+   if(ulNewLength >= ulOldLength)
+      Node_addToTotals(oNNode, 0, 0, ulNewLength - ulOldLength, TRUE);
+   else
+      Node_addToTotals(oNNode, 0, 0, ulOldLength - ulNewLength, FALSE);
+}
+
 /*
-  Links new child oNChild into oNParent's children array at index
-  ulIndex. Returns SUCCESS if the new child was added successfully,
-  or MEMORY_ERROR if allocation fails adding oNChild to the array.
+  Returns TRUE if oNNode's contents live in its inline storage rather
+  than in a separately allocated buffer.
+*/
+static boolean Node_isInline(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return Node_contents(oNNode)->pvContents ==
+          (void *) Node_contents(oNNode)->acInline;
+}
+
+/*
+  Stores a copy of the ulLength bytes at pvContents as oNNode's
+  contents, inline if they fit in NODE_INLINE_MAX bytes and in a new
+  heap buffer otherwise. Does not release any previous contents.
+  Returns SUCCESS, or MEMORY_ERROR (leaving oNNode unchanged) if the
+  heap buffer could not be allocated.
+*/
+static int Node_storeContents(Node_T oNNode, const void *pvContents,
+                              size_t ulLength) {
+   void *pvCopy;
+
+   assert(oNNode != NULL);
+
+   if(pvContents == NULL || ulLength == 0)
+      pvCopy = NULL;
+   else if(ulLength <= NODE_INLINE_MAX)
+      pvCopy = Node_contents(oNNode)->acInline;
+   else {
+      pvCopy = malloc(ulLength);
+      if(pvCopy == NULL)
+         return MEMORY_ERROR;
+   }
+
+   if(pvCopy != NULL)
+      memcpy(pvCopy, pvContents, ulLength);
+   Node_contents(oNNode)->pvContents = pvCopy;
+   Node_contents(oNNode)->ulLength = ulLength;
+   return SUCCESS;
+}
+
+/* Destroys the node's lock and frees its running sums, if it is a
+   directory, and returns the node's slot to its table. */
+static void Node_release(struct node *psNode) {
+   assert(psNode != NULL);
+
+   if(!psNode->bIsFile) {
+      free(*Node_prefixSlot(psNode));
+      (void) pthread_rwlock_destroy(Node_getLock(psNode));
+   }
+   (void) pthread_mutex_lock(&sTableLock);
+   NodeTable_release(Node_getTable(psNode->bIsFile), psNode);
+   (void) pthread_mutex_unlock(&sTableLock);
+}
+
+/*
+  Allocates an empty children array with room for ulCapacity
+  children, or for NODE_ARRAY_MIN if that is more. Returns the array,
+  or NULL if allocation fails.
+*/
+static struct nodeArray *NodeArray_new(size_t ulCapacity) {
+   struct nodeArray *psArray;
+
+   if(ulCapacity < NODE_ARRAY_MIN)
+      ulCapacity = NODE_ARRAY_MIN;
+   psArray = malloc(sizeof(struct nodeArray) +
+                    ulCapacity * sizeof(Node_T));
+   if(psArray == NULL)
+      return NULL;
+   psArray->ulLength = 0;
+   psArray->ulCapacity = ulCapacity;
+   psArray->aoNChildren = (Node_T *) (psArray + 1);
+   return psArray;
+}
+
+/* Returns the length of children array psArray, which may be NULL. */
+static size_t NodeArray_getLength(struct nodeArray *psArray) {
+   if(psArray == NULL)
+      return 0;
+   return __atomic_load_n(&psArray->ulLength, __ATOMIC_ACQUIRE);
+}
+
+/* Returns the child at index ulIndex of children array psArray. */
+static Node_T NodeArray_get(struct nodeArray *psArray,
+                            size_t ulIndex) {
+   assert(psArray != NULL);
+   assert(ulIndex < psArray->ulCapacity);
+
+   return __atomic_load_n(&psArray->aoNChildren[ulIndex],
+                          __ATOMIC_ACQUIRE);
+}
+
+/*
+  Stores oNChild at index ulIndex of children array psArray. A reader
+  that loads it also sees the child's fields as they were stored.
+*/
+static void NodeArray_set(struct nodeArray *psArray, size_t ulIndex,
+                          Node_T oNChild) {
+   assert(psArray != NULL);
+   assert(ulIndex < psArray->ulCapacity);
+
+   __atomic_store_n(&psArray->aoNChildren[ulIndex], oNChild,
+                    __ATOMIC_RELEASE);
+}
+
+/*
+  Binary searches children array psArray, which may be NULL, for a
+  child that pfCompare finds equal to pvKey, as DynArray_bsearch
+  does. Returns TRUE and sets *pulIndex to the child's index if
+  found; otherwise returns FALSE and sets *pulIndex to the index at
+  which such a child would belong. A writer may change the array
+  meanwhile, in which case the result may be wrong but the search
+  still reads only children that were stored.
+*/
+static boolean NodeArray_bsearch(struct nodeArray *psArray,
+                                 const void *pvKey, size_t *pulIndex,
+                                 int (*pfCompare)(const void *,
+                                                  const void *)) {
+   size_t ulLow = 0;
+   size_t ulHigh;
+   size_t ulMid;
+   int iCompare;
+
+   assert(pulIndex != NULL);
+   assert(pfCompare != NULL);
+
+   ulHigh = NodeArray_getLength(psArray);
+   while(ulLow < ulHigh) {
+      ulMid = ulLow + (ulHigh - ulLow) / 2;
+      iCompare = (*pfCompare)(NodeArray_get(psArray, ulMid), pvKey);
+      if(iCompare < 0)
+         ulLow = ulMid + 1;
+      else if(iCompare > 0)
+         ulHigh = ulMid;
+      else {
+         *pulIndex = ulMid;
+         return TRUE;
+      }
+   }
+   *pulIndex = ulLow;
+   return FALSE;
+}
+
+/*
+  Removes the child at index ulIndex of children array psArray,
+  shifting the later children down in place and then publishing the
+  shorter length. The room freed stays for later insertions. Readers
+  meanwhile may miss a child or meet one twice, which the parent's
+  version, bumped around the change, lets them detect.
+*/
+static void NodeArray_removeAt(struct nodeArray *psArray,
+                               size_t ulIndex) {
+   size_t ulLength;
+   size_t ul;
+
+   assert(psArray != NULL);
+
+   ulLength = psArray->ulLength;
+   assert(ulIndex < ulLength);
+   for(ul = ulIndex; ul + 1 < ulLength; ul++)
+      NodeArray_set(psArray, ul, NodeArray_get(psArray, ul + 1));
+   __atomic_store_n(&psArray->ulLength, ulLength - 1,
+                    __ATOMIC_RELEASE);
+}
+
+/*
+  Returns the children array of oNNode that holds its last child,
+  taking directories before files, or NULL if oNNode has no children
+  left.
+*/
+static struct nodeArray *Node_lastChildArray(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(NodeArray_getLength(oNNode->psDirs) > 0)
+      return oNNode->psDirs;
+   if(NodeArray_getLength(oNNode->psFiles) > 0)
+      return oNNode->psFiles;
+   return NULL;
+}
+
+/*
+  Frees oNNode, which must have no children left and must already be
+  unlinked from its parent: its children arrays, file contents, path,
+  and slot.
+*/
+static void Node_freeNow(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   free(oNNode->psFiles);
+   free(oNNode->psDirs);
+
+   /* free file contents if it's a file with a heap buffer */
+   if(oNNode->bIsFile && Node_contents(oNNode)->pvContents != NULL &&
+      !Node_isInline(oNNode))
+      free(Node_contents(oNNode)->pvContents);
+
+   Path_free(oNNode->oPPath);
+   Node_release(oNNode);
+}
+
+/* Frees node pvNode as Node_freeNow does; an Epoch_retire callback. */
+static void Node_reclaimNode(void *pvNode) {
+   Node_freeNow(pvNode);
+}
+
+/* Frees children array pvArray; an Epoch_retire callback. */
+static void Node_reclaimArray(void *pvArray) {
+   free(pvArray);
+}
+
+/*
+  Frees oNNode as Node_freeNow does, at once or, if lock-free readers
+  may still be reading it, once they are done.
+*/
+static void Node_freeChildless(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(Node_isDeferring())
+      Epoch_retire(oNNode, Node_reclaimNode);
+   else
+      Node_freeNow(oNNode);
+}
+
+/*
+  Frees children array psArray at once or, if lock-free readers may
+  still be reading it, once they are done.
+*/
+static void Node_discardArray(struct nodeArray *psArray) {
+   assert(psArray != NULL);
+
+   if(Node_isDeferring())
+      Epoch_retire(psArray, Node_reclaimArray);
+   else
+      free(psArray);
+}
+
+/*
+  Returns the children array of oNParent that holds children of the
+  kind given by bIsFile: the file array if bIsFile is TRUE, otherwise
+  the directory array.
+*/
+static struct nodeArray *Node_getChildArray(Node_T oNParent,
+                                            boolean bIsFile) {
+   assert(oNParent != NULL);
+   assert(!oNParent->bIsFile);
+
+   if(bIsFile)
+      return oNParent->psFiles;
+   else
+      return oNParent->psDirs;
+}
+
+/* Returns the address of the children array of oNParent that holds
+   children of the same kind as oNChild. */
+static struct nodeArray **Node_siblingArray(Node_T oNParent,
+                                            Node_T oNChild) {
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   if(oNChild->bIsFile)
+      return &oNParent->psFiles;
+   else
+      return &oNParent->psDirs;
+}
+
+/*
+  Links new child oNChild into the oNParent children array for
+  oNChild's kind (file or directory) at index ulIndex. Returns SUCCESS
+  if the new child was added successfully, or MEMORY_ERROR if
+  allocation fails adding oNChild to the array.
+
+  While the array has room, the child goes in place, after the later
+  children are shifted up, last first; lock-free readers bound their
+  search by the length, which is published last. A full array is
+  copied into one twice its size, which replaces it once complete, and
+  the old array is discarded as Node_discardArray does, so an
+  insertion copies the array only when its room runs out.
 */
 static int Node_addChild(Node_T oNParent, Node_T oNChild,
                          size_t ulIndex) {
+   struct nodeArray **ppsArray;
+   struct nodeArray *psArray;
+   struct nodeArray *psNew;
+   size_t ulLength;
+   size_t ul;
+
    assert(oNParent != NULL);
    assert(oNChild != NULL);
 
-   if(DynArray_addAt(oNParent->oDChildren, ulIndex, oNChild))
+   /* children arrays are created on demand */
+   ppsArray = Node_siblingArray(oNParent, oNChild);
+   psArray = *ppsArray;
+   ulLength = NodeArray_getLength(psArray);
+   assert(ulIndex <= ulLength);
+
+   if(psArray != NULL && ulLength < psArray->ulCapacity) {
+      for(ul = ulLength; ul > ulIndex; ul--)
+         NodeArray_set(psArray, ul, NodeArray_get(psArray, ul - 1));
+      NodeArray_set(psArray, ulIndex, oNChild);
+      __atomic_store_n(&psArray->ulLength, ulLength + 1,
+                       __ATOMIC_RELEASE);
       return SUCCESS;
-   else
+   }
+
+   psNew = NodeArray_new(2 * ulLength);
+   if(psNew == NULL)
       return MEMORY_ERROR;
+   for(ul = 0; ul < ulLength; ul++)
+      psNew->aoNChildren[(ul < ulIndex) ? ul : ul + 1] =
+         psArray->aoNChildren[ul];
+   psNew->aoNChildren[ulIndex] = oNChild;
+   psNew->ulLength = ulLength + 1;
+
+   /* the copy is complete before readers can reach it */
+   __atomic_store_n(ppsArray, psNew, __ATOMIC_RELEASE);
+   if(psArray != NULL)
+      Node_discardArray(psArray);
+   return SUCCESS;
 }
 
 /*
@@ -61,189 +862,509 @@ static int Node_compareString(const Node_T oNFirst,
    return Path_compareString(oNFirst->oPPath, pcSecond);
 }
 
+/*
+  Compares the last component of oNFirst's path with the component
+  name pcName. Since siblings share every other component, this orders
+  siblings exactly as Node_compareString does.
+  Returns <0, 0, or >0 if oNFirst is "less than", "equal to", or
+  "greater than" pcName, respectively.
+*/
+static int Node_compareName(const Node_T oNFirst, const char *pcName) {
+   assert(oNFirst != NULL);
+   assert(pcName != NULL);
 
-int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult,
-             boolean bIsFile, void *pvContents, size_t ulLength) {
+   return strcmp(Path_getComponent(oNFirst->oPPath,
+                    Path_getDepth(oNFirst->oPPath) - 1), pcName);
+}
+
+/*
+  Binary searches the oNParent children array for kind bIsFile for a
+  child with path oPPath. Returns TRUE and sets *pulIndex to that
+  child's index in the array if found. Otherwise returns FALSE and
+  sets *pulIndex to the index at which such a child would belong.
+*/
+static boolean Node_searchChildArray(Node_T oNParent, Path_T oPPath,
+                                     boolean bIsFile,
+                                     size_t *pulIndex) {
+   assert(oNParent != NULL);
+   assert(oPPath != NULL);
+   assert(pulIndex != NULL);
+
+   return NodeArray_bsearch(Node_getChildArray(oNParent, bIsFile),
+            Path_getPathname(oPPath), pulIndex,
+            (int (*)(const void*,const void*)) Node_compareString);
+}
+
+
+/*
+  Allocates a node of the kind given by bIsFile with path oPPath,
+  parent index uiParent and no children, holding a copy of the
+  ulLength bytes at pvContents if it is a file. The node takes over
+  oPPath. Returns SUCCESS and sets *poNResult to the node, or sets
+  *poNResult to NULL, leaves oPPath to the caller and returns
+  MEMORY_ERROR.
+*/
+static int Node_create(Path_T oPPath, unsigned int uiParent,
+                       boolean bIsFile, void *pvContents,
+                       size_t ulLength, Node_T *poNResult) {
    struct node *psNew;
-   Path_T oPParentPath = NULL;
-   Path_T oPNewPath = NULL;
-   size_t ulParentDepth;
-   size_t ulIndex = 0;
    int iStatus;
 
    assert(oPPath != NULL);
+   assert(poNResult != NULL);
 
    /* allocate space for a new node */
-   psNew = malloc(sizeof(struct node));
+   psNew = Node_allocSlot(bIsFile);
    if(psNew == NULL) {
       *poNResult = NULL;
       return MEMORY_ERROR;
    }
+   psNew->bIsFile = bIsFile;
+   psNew->uiVersion = 0;
+   psNew->bPrefixed = FALSE;
+
+   if(!bIsFile && pthread_rwlock_init(Node_getLock(psNew), NULL) != 0) {
+      /* the slot goes back without a lock to destroy */
+      (void) pthread_mutex_lock(&sTableLock);
+      NodeTable_release(&sDirTable, psNew);
+      (void) pthread_mutex_unlock(&sTableLock);
+      *poNResult = NULL;
+      return MEMORY_ERROR;
+   }
+   if(!bIsFile)
+      *Node_prefixSlot(psNew) = NULL;
+
+   psNew->oPPath = oPPath;
+   psNew->uiParent = uiParent;
+   psNew->bLinked = FALSE;
+   psNew->uiFiles = bIsFile ? 1 : 0;
+   psNew->uiDirs = bIsFile ? 0 : 1;
+   psNew->ulBytes = 0;
+
+   /* children arrays are created with the first child */
+   psNew->psFiles = NULL;
+   psNew->psDirs = NULL;
+
+   /* copy contents if provided */
+   if(bIsFile) {
+      if(pvContents == NULL)
+         ulLength = 0;
+      iStatus = Node_storeContents(psNew, pvContents, ulLength);
+      if(iStatus != SUCCESS) {
+         Node_release(psNew);
+         *poNResult = NULL;
+         return iStatus;
+      }
+      psNew->ulBytes = Node_contents(psNew)->ulLength;
+   }
+
+   *poNResult = psNew;
+   return SUCCESS;
+}
+
+/*
+  Checks that a node of the kind given by bIsFile with path oPPath may
+  become a child of oNParent. Returns SUCCESS and sets *pulIndex to its
+  place among oNParent's children of that kind, or returns a status
+  as Node_new does.
+*/
+static int Node_checkChild(Node_T oNParent, Path_T oPPath,
+                           boolean bIsFile, size_t *pulIndex) {
+   size_t ulParentDepth;
+
+   assert(oNParent != NULL);
+   assert(oPPath != NULL);
+   assert(pulIndex != NULL);
+
+   /* parent cannot be a file */
+   if(oNParent->bIsFile)
+      return NOT_A_DIRECTORY;
+
+   /* parent must be an ancestor of child */
+   ulParentDepth = Path_getDepth(oNParent->oPPath);
+   if(Path_getSharedPrefixDepth(oPPath, oNParent->oPPath) <
+      ulParentDepth)
+      return CONFLICTING_PATH;
+
+   /* parent must be exactly one level up from child */
+   if(Path_getDepth(oPPath) != ulParentDepth + 1)
+      return NO_SUCH_PATH;
+
+   /* parent must not already have child with this path,
+      as either a file or a directory */
+   if(Node_searchChildArray(oNParent, oPPath, !bIsFile, pulIndex) ||
+      Node_searchChildArray(oNParent, oPPath, bIsFile, pulIndex))
+      return ALREADY_IN_TREE;
+
+   return SUCCESS;
+}
+
+/*
+  Links oNChild, which is not linked, into oNParent's children at
+  index ulIndex of the array for its kind, and adds its subtree to
+  the totals above it. Returns SUCCESS, or MEMORY_ERROR with oNChild
+  still unlinked.
+*/
+static int Node_linkAt(Node_T oNParent, Node_T oNChild,
+                       size_t ulIndex) {
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+   assert(!oNChild->bLinked);
+
+   /* the child names its parent before anyone can reach it */
+   oNChild->uiParent = oNParent->uiIndex;
+   Node_beginWrite(oNParent);
+   iStatus = Node_addChild(oNParent, oNChild, ulIndex);
+   Node_endWrite(oNParent);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   oNChild->bLinked = TRUE;
+   Node_addSubtree(oNParent, oNChild, TRUE);
+   return SUCCESS;
+}
+
+int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult,
+             boolean bIsFile, void *pvContents, size_t ulLength) {
+   Node_T oNNew;
+   Path_T oPNewPath = NULL;
+   size_t ulIndex = 0;
+   int iStatus;
+
+   assert(oPPath != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+
+   /* validate the new node's parent */
+   if(oNParent != NULL) {
+      iStatus = Node_checkChild(oNParent, oPPath, bIsFile, &ulIndex);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   /* new node must be root */
+   /* can only create one "level" at a time */
+   else if(Path_getDepth(oPPath) != 1)
+      return NO_SUCH_PATH;
 
-   /* set the new node's path */
+   /* the new node gets its own copy of the path */
    iStatus = Path_dup(oPPath, &oPNewPath);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   iStatus = Node_create(oPNewPath, NODE_NONE, bIsFile, pvContents,
+                         ulLength, &oNNew);
    if(iStatus != SUCCESS) {
-      free(psNew);
-      *poNResult = NULL;
+      Path_free(oPNewPath);
       return iStatus;
    }
-   psNew->oPPath = oPNewPath;
 
-   /* validate and set the new node's parent */
+   /* Link into parent's children list */
    if(oNParent != NULL) {
-      size_t ulSharedDepth;
-
-      /* parent cannot be a file */
-      if(oNParent->bIsFile) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return NOT_A_DIRECTORY;
+      iStatus = Node_linkAt(oNParent, oNNew, ulIndex);
+      if(iStatus != SUCCESS) {
+         Node_freeNow(oNNew);
+         return iStatus;
       }
+   }
 
-      oPParentPath = oNParent->oPPath;
-      ulParentDepth = Path_getDepth(oPParentPath);
-      ulSharedDepth = Path_getSharedPrefixDepth(psNew->oPPath,
-                                                oPParentPath);
-      /* parent must be an ancestor of child */
-      if(ulSharedDepth < ulParentDepth) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return CONFLICTING_PATH;
-      }
+   *poNResult = oNNew;
+   return SUCCESS;
+}
 
-      /* parent must be exactly one level up from child */
-      if(Path_getDepth(psNew->oPPath) != ulParentDepth + 1) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return NO_SUCH_PATH;
-      }
+int Node_newUnlinked(Path_T oPPath, Node_T oNParent, Node_T *poNResult,
+                     boolean bIsFile, void *pvContents,
+                     size_t ulLength) {
+   assert(oPPath != NULL);
+   assert(poNResult != NULL);
+   assert(oNParent == NULL || !oNParent->bIsFile);
+   assert(oNParent == NULL || Path_getDepth(oPPath) ==
+          Path_getDepth(oNParent->oPPath) + 1);
 
-      /* parent must not already have child with this path */
-      if(Node_hasChild(oNParent, oPPath, &ulIndex)) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return ALREADY_IN_TREE;
-      }
-   }
-   else {
-      /* new node must be root */
-      /* can only create one "level" at a time */
-      if(Path_getDepth(psNew->oPPath) != 1) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return NO_SUCH_PATH;
-      }
-   }
-   psNew->oNParent = oNParent;
+   return Node_create(oPPath, (oNParent != NULL) ?
+                      oNParent->uiIndex : NODE_NONE,
+                      bIsFile, pvContents, ulLength, poNResult);
+}
 
-   /* initialize file-specific fields */
-   psNew->bIsFile = bIsFile;
-   if(bIsFile) {
-      /* files have no children */
-      psNew->oDChildren = NULL;
-      
-      /* copy contents if provided */
-      if(pvContents != NULL && ulLength > 0) {
-         psNew->pvContents = malloc(ulLength);
-         if(psNew->pvContents == NULL) {
-            Path_free(psNew->oPPath);
-            free(psNew);
-            *poNResult = NULL;
-            return MEMORY_ERROR;
-         }
-         memcpy(psNew->pvContents, pvContents, ulLength);
-         psNew->ulLength = ulLength;
-      }
-      else {
-         psNew->pvContents = NULL;
-         psNew->ulLength = 0;
-      }
-   }
-   else {
-      /* directories have no contents */
-      psNew->pvContents = NULL;
-      psNew->ulLength = 0;
-      
-      /* initialize children array */
-      psNew->oDChildren = DynArray_new(0);
-      if(psNew->oDChildren == NULL) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
+int Node_setChildren(Node_T oNParent, DynArray_T oDFiles,
+                     size_t ulFirstFile, DynArray_T oDDirs,
+                     size_t ulFirstDir) {
+   struct nodeArray *apsArrays[2];
+   DynArray_T aoDSources[2];
+   size_t aulFirst[2];
+   Node_T oNChild;
+   unsigned int uiFiles = 0;
+   unsigned int uiDirs = 0;
+   size_t ulBytes = 0;
+   size_t ulLength;
+   size_t ulArray;
+   size_t ul;
+
+   assert(oNParent != NULL);
+   assert(!oNParent->bIsFile);
+   assert(oNParent->psFiles == NULL && oNParent->psDirs == NULL);
+   assert(oDFiles != NULL);
+   assert(oDDirs != NULL);
+   assert(ulFirstFile <= DynArray_getLength(oDFiles));
+   assert(ulFirstDir <= DynArray_getLength(oDDirs));
+
+   aoDSources[0] = oDFiles;
+   aoDSources[1] = oDDirs;
+   aulFirst[0] = ulFirstFile;
+   aulFirst[1] = ulFirstDir;
+   for(ulArray = 0; ulArray < 2; ulArray++) {
+      apsArrays[ulArray] = NULL;
+      ulLength = DynArray_getLength(aoDSources[ulArray]) -
+                 aulFirst[ulArray];
+      if(ulLength == 0)
+         continue;
+      apsArrays[ulArray] = NodeArray_new(ulLength);
+      if(apsArrays[ulArray] == NULL) {
+         free(apsArrays[0]);
          return MEMORY_ERROR;
       }
+      for(ul = 0; ul < ulLength; ul++)
+         apsArrays[ulArray]->aoNChildren[ul] =
+            DynArray_get(aoDSources[ulArray], aulFirst[ulArray] + ul);
+      apsArrays[ulArray]->ulLength = ulLength;
    }
 
-   /* Link into parent's children list */
-   if(oNParent != NULL) {
-      iStatus = Node_addChild(oNParent, psNew, ulIndex);
-      if(iStatus != SUCCESS) {
-         Path_free(psNew->oPPath);
-         if(psNew->oDChildren != NULL)
-            DynArray_free(psNew->oDChildren);
-         if(psNew->pvContents != NULL)
-            free(psNew->pvContents);
-         free(psNew);
-         *poNResult = NULL;
-         return iStatus;
+   for(ulArray = 0; ulArray < 2; ulArray++)
+      for(ul = 0; ul < NodeArray_getLength(apsArrays[ulArray]); ul++) {
+         oNChild = apsArrays[ulArray]->aoNChildren[ul];
+         assert(oNChild->uiParent == oNParent->uiIndex);
+         oNChild->bLinked = TRUE;
+         uiFiles += oNChild->uiFiles;
+         uiDirs += oNChild->uiDirs;
+         ulBytes += oNChild->ulBytes;
       }
-   }
 
-   *poNResult = psNew;
+   /* the children are complete before readers can reach them */
+   __atomic_store_n(&oNParent->psFiles, apsArrays[0], __ATOMIC_RELEASE);
+   __atomic_store_n(&oNParent->psDirs, apsArrays[1], __ATOMIC_RELEASE);
+   Node_addToTotals(oNParent, uiFiles, uiDirs, ulBytes, TRUE);
    return SUCCESS;
 }
 
-size_t Node_free(Node_T oNNode) {
+int Node_link(Node_T oNParent, Node_T oNChild) {
    size_t ulIndex = 0;
-   size_t ulCount = 0;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+   assert(!oNChild->bLinked);
+
+   iStatus = Node_checkChild(oNParent, oNChild->oPPath,
+                             oNChild->bIsFile, &ulIndex);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   return Node_linkAt(oNParent, oNChild, ulIndex);
+}
+
+/*
+  Removes oNNode from its parent's list of children, if it is linked,
+  and takes its subtree off the totals above it. The children array
+  keeps its room, so that Node_restore can put oNNode back without
+  allocating.
+*/
+static void Node_unlink(Node_T oNNode) {
+   size_t ulIndex = 0;
+   Node_T oNParent;
+   struct nodeArray *psSiblings;
+   boolean bFound;
+
+   assert(oNNode != NULL);
+
+   if(!oNNode->bLinked)
+      return;
+
+   oNParent = Node_getParent(oNNode);
+   psSiblings = *Node_siblingArray(oNParent, oNNode);
+   bFound = NodeArray_bsearch(psSiblings, oNNode, &ulIndex,
+               (int (*)(const void *, const void *)) Node_compare);
+   assert(bFound);
+   (void) bFound;
+
+   Node_beginWrite(oNParent);
+   NodeArray_removeAt(psSiblings, ulIndex);
+   Node_endWrite(oNParent);
+   oNNode->bLinked = FALSE;
+   Node_addSubtree(oNParent, oNNode, FALSE);
+}
+
+/*
+  Frees nodes of the subtree rooted at oNNode, which must not be
+  linked, until ulMax have been freed or none is left, and adds the
+  number freed to *pulFreed. Returns TRUE if the whole subtree,
+  oNNode included, is gone, and FALSE otherwise.
+*/
+static boolean Node_tearDown(Node_T oNNode, size_t ulMax,
+                             size_t *pulFreed) {
+   size_t ulFreed = 0;
+   Node_T oNCurr;
+   Node_T oNChild;
+   struct nodeArray *psArray;
+   boolean bDrained;
 
    assert(oNNode != NULL);
+   assert(!oNNode->bLinked);
+   assert(pulFreed != NULL);
 
-   /* remove from parent's list */
-   if(oNNode->oNParent != NULL) {
-      if(DynArray_bsearch(
-            oNNode->oNParent->oDChildren,
-            oNNode, &ulIndex,
-            (int (*)(const void *, const void *)) Node_compare)
-        )
-         (void) DynArray_removeAt(oNNode->oNParent->oDChildren,
-                                  ulIndex);
+   /* tear the subtree down without recursion: descend through the
+      last child until reaching a childless node, free it, climb back
+      to its parent through the parent index, and drop it from there.
+      Every node is freed once, and no stack grows with depth. A node
+      is dropped from its parent only once it is freed, so that
+      whatever is left is still a subtree under oNNode, from which
+      another call can carry on. Each node is marked removed before
+      its children are freed, so that readers still inside the
+      subtree give up. */
+   oNCurr = oNNode;
+   Node_markRemoved(oNCurr);
+
+   /* the arrays below change in place, so lock-free readers that were
+      inside the subtree when it was unlinked are waited out first;
+      none can reach it since, so its nodes can go at once */
+   bDrained = FALSE;
+   if(Node_isDeferring() && Node_lastChildArray(oNNode) != NULL) {
+      Epoch_drain();
+      bDrained = TRUE;
    }
 
-   /* recursively remove children (only if directory) */
-   if(!oNNode->bIsFile && oNNode->oDChildren != NULL) {
-      while(DynArray_getLength(oNNode->oDChildren) != 0) {
-         ulCount += Node_free(DynArray_get(oNNode->oDChildren, 0));
+   while(ulFreed < ulMax) {
+      psArray = Node_lastChildArray(oNCurr);
+      if(psArray != NULL) {
+         oNCurr = NodeArray_get(psArray,
+                                NodeArray_getLength(psArray) - 1);
+         Node_markRemoved(oNCurr);
+         continue;
       }
-      DynArray_free(oNNode->oDChildren);
-   }
 
-   /* free file contents if it's a file */
-   if(oNNode->bIsFile && oNNode->pvContents != NULL) {
-      free(oNNode->pvContents);
+      oNChild = oNCurr;
+      if(oNChild == oNNode)
+         oNCurr = NULL;
+      else
+         oNCurr = Node_getParent(oNChild);
+      if(bDrained)
+         Node_freeNow(oNChild);
+      else
+         Node_freeChildless(oNChild);
+      ulFreed++;
+
+      if(oNCurr == NULL) {
+         *pulFreed += ulFreed;
+         return TRUE;
+      }
+      psArray = Node_lastChildArray(oNCurr);
+      NodeArray_removeAt(psArray, NodeArray_getLength(psArray) - 1);
    }
 
-   /* remove path */
-   Path_free(oNNode->oPPath);
+   *pulFreed += ulFreed;
+   return FALSE;
+}
+
+size_t Node_free(Node_T oNNode) {
+   size_t ulCount = 0;
+
+   assert(oNNode != NULL);
 
-   /* finally, free the struct node */
-   free(oNNode);
-   ulCount++;
+   Node_unlink(oNNode);
+   (void) Node_tearDown(oNNode, (size_t) -1, &ulCount);
    return ulCount;
 }
 
+boolean Node_freeSome(Node_T oNNode, size_t ulMax) {
+   size_t ulFreed = 0;
+
+   assert(oNNode != NULL);
+   assert(ulMax > 0);
+
+   return Node_tearDown(oNNode, ulMax, &ulFreed);
+}
+
+void Node_detach(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_unlink(oNNode);
+   Node_markRemoved(oNNode);
+   oNNode->uiParent = NODE_NONE;
+}
+
+void Node_setAside(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_unlink(oNNode);
+}
+
+void Node_restore(Node_T oNNode) {
+   Node_T oNParent;
+   size_t ulIndex = 0;
+   boolean bFound;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(!oNNode->bLinked);
+
+   if(oNNode->uiParent == NODE_NONE)
+      return;
+
+   /* the room oNNode left is still there, so this allocates nothing */
+   oNParent = Node_getParent(oNNode);
+   bFound = NodeArray_bsearch(*Node_siblingArray(oNParent, oNNode),
+               oNNode, &ulIndex,
+               (int (*)(const void *, const void *)) Node_compare);
+   assert(!bFound);
+   (void) bFound;
+   iStatus = Node_linkAt(oNParent, oNNode, ulIndex);
+   assert(iStatus == SUCCESS);
+   (void) iStatus;
+}
+
+void Node_forget(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   /* Node_unlink would find any node that took oNNode's name since,
+      so oNNode is not looked for among its former siblings */
+   Node_markRemoved(oNNode);
+   oNNode->uiParent = NODE_NONE;
+}
+
 Path_T Node_getPath(Node_T oNNode) {
    assert(oNNode != NULL);
    return oNNode->oPPath;
 }
 
+boolean Node_hasChildNamed(Node_T oNParent, const char *pcName,
+                           size_t *pulChildID) {
+   size_t ulIndex;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(pulChildID != NULL);
+
+   /* files have no children */
+   if(oNParent->bIsFile)
+      return FALSE;
+
+   /* child IDs number the files first, then the directories */
+   if(NodeArray_bsearch(oNParent->psFiles, pcName, &ulIndex,
+         (int (*)(const void*,const void*)) Node_compareName)) {
+      *pulChildID = ulIndex;
+      return TRUE;
+   }
+   if(NodeArray_bsearch(oNParent->psDirs, pcName, &ulIndex,
+         (int (*)(const void*,const void*)) Node_compareName)) {
+      *pulChildID = NodeArray_getLength(oNParent->psFiles) + ulIndex;
+      return TRUE;
+   }
+   return FALSE;
+}
+
 boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
                       size_t *pulChildID) {
+   size_t ulIndex;
+
    assert(oNParent != NULL);
    assert(oPPath != NULL);
    assert(pulChildID != NULL);
@@ -252,10 +1373,16 @@ boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
    if(oNParent->bIsFile)
       return FALSE;
 
-   /* *pulChildID is the index into oNParent->oDChildren */
-   return DynArray_bsearch(oNParent->oDChildren,
-            (char*) Path_getPathname(oPPath), pulChildID,
-            (int (*)(const void*,const void*)) Node_compareString);
+   /* child IDs number the files first, then the directories */
+   if(Node_searchChildArray(oNParent, oPPath, TRUE, &ulIndex)) {
+      *pulChildID = ulIndex;
+      return TRUE;
+   }
+   if(Node_searchChildArray(oNParent, oPPath, FALSE, &ulIndex)) {
+      *pulChildID = NodeArray_getLength(oNParent->psFiles) + ulIndex;
+      return TRUE;
+   }
+   return FALSE;
 }
 
 size_t Node_getNumChildren(Node_T oNParent) {
@@ -264,11 +1391,13 @@ size_t Node_getNumChildren(Node_T oNParent) {
    if(oNParent->bIsFile)
       return 0;
 
-   return DynArray_getLength(oNParent->oDChildren);
+   return NodeArray_getLength(oNParent->psFiles) +
+          NodeArray_getLength(oNParent->psDirs);
 }
 
 int Node_getChild(Node_T oNParent, size_t ulChildID,
                   Node_T *poNResult) {
+   size_t ulNumFiles;
 
    assert(oNParent != NULL);
    assert(poNResult != NULL);
@@ -279,20 +1408,179 @@ int Node_getChild(Node_T oNParent, size_t ulChildID,
       return NO_SUCH_PATH;
    }
 
-   /* ulChildID is the index into oNParent->oDChildren */
    if(ulChildID >= Node_getNumChildren(oNParent)) {
       *poNResult = NULL;
       return NO_SUCH_PATH;
    }
-   else {
-      *poNResult = DynArray_get(oNParent->oDChildren, ulChildID);
-      return SUCCESS;
-   }
+
+   /* ulChildID indexes oNParent->psFiles, then oNParent->psDirs */
+   ulNumFiles = NodeArray_getLength(oNParent->psFiles);
+   if(ulChildID < ulNumFiles)
+      *poNResult = NodeArray_get(oNParent->psFiles, ulChildID);
+   else
+      *poNResult = NodeArray_get(oNParent->psDirs,
+                                ulChildID - ulNumFiles);
+   return SUCCESS;
 }
 
 Node_T Node_getParent(Node_T oNNode) {
    assert(oNNode != NULL);
-   return oNNode->oNParent;
+
+   if(oNNode->uiParent == NODE_NONE)
+      return NULL;
+   return NodeTable_get(&sDirTable, oNNode->uiParent);
+}
+
+size_t Node_getSubtreeSize(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return (size_t) __atomic_load_n(&oNNode->uiFiles, __ATOMIC_RELAXED) +
+      __atomic_load_n(&oNNode->uiDirs, __ATOMIC_RELAXED);
+}
+
+void Node_getTotals(Node_T oNNode, size_t *pulFiles, size_t *pulDirs,
+                    size_t *pulBytes) {
+   assert(oNNode != NULL);
+   assert(pulFiles != NULL);
+   assert(pulDirs != NULL);
+   assert(pulBytes != NULL);
+
+   *pulFiles = __atomic_load_n(&oNNode->uiFiles, __ATOMIC_RELAXED);
+   *pulDirs = __atomic_load_n(&oNNode->uiDirs, __ATOMIC_RELAXED);
+   *pulBytes = __atomic_load_n(&oNNode->ulBytes, __ATOMIC_RELAXED);
+}
+
+/*
+  Returns the running sums of the subtree sizes of directory
+  oNParent's children, as struct nodeLock describes them, or NULL if
+  it has fewer than NODE_PREFIX_MIN children or memory could not be
+  allocated. The sums are made the first time they are needed after
+  the children change. Readers holding the FT's lock shared may make
+  them at once, so each makes its own and the first to publish them
+  wins; no writer runs meanwhile.
+*/
+static size_t *Node_getPrefix(Node_T oNParent) {
+   size_t *pulPrefix;
+   size_t *pulOld = NULL;
+   size_t ulNumChildren;
+   Node_T oNChild = NULL;
+   size_t ul;
+
+   assert(oNParent != NULL);
+
+   ulNumChildren = Node_getNumChildren(oNParent);
+   if(ulNumChildren < NODE_PREFIX_MIN)
+      return NULL;
+   if(__atomic_load_n(&oNParent->bPrefixed, __ATOMIC_ACQUIRE))
+      return __atomic_load_n(Node_prefixSlot(oNParent),
+                             __ATOMIC_ACQUIRE);
+
+   pulPrefix = malloc((ulNumChildren + 1) * sizeof(size_t));
+   if(pulPrefix == NULL)
+      return NULL;
+   pulPrefix[0] = 0;
+   for(ul = 0; ul < ulNumChildren; ul++) {
+      (void) Node_getChild(oNParent, ul, &oNChild);
+      pulPrefix[ul + 1] = pulPrefix[ul] + Node_getSubtreeSize(oNChild);
+   }
+
+   if(!__atomic_compare_exchange_n(Node_prefixSlot(oNParent), &pulOld,
+                                   pulPrefix, FALSE, __ATOMIC_ACQ_REL,
+                                   __ATOMIC_ACQUIRE)) {
+      free(pulPrefix);
+      pulPrefix = pulOld;
+   }
+   __atomic_store_n(&oNParent->bPrefixed, TRUE, __ATOMIC_RELEASE);
+   return pulPrefix;
+}
+
+size_t Node_countBefore(Node_T oNParent, size_t ulChildID) {
+   size_t *pulPrefix;
+   size_t ulNumChildren;
+   size_t ulCount = 0;
+   Node_T oNChild = NULL;
+   size_t ul;
+
+   assert(oNParent != NULL);
+   assert(ulChildID < Node_getNumChildren(oNParent));
+
+   pulPrefix = Node_getPrefix(oNParent);
+   if(pulPrefix != NULL)
+      return pulPrefix[ulChildID];
+
+   ulNumChildren = Node_getNumChildren(oNParent);
+   if(ulChildID <= ulNumChildren / 2) {
+      for(ul = 0; ul < ulChildID; ul++) {
+         (void) Node_getChild(oNParent, ul, &oNChild);
+         ulCount += Node_getSubtreeSize(oNChild);
+      }
+      return ulCount;
+   }
+
+   /* the later children are fewer: take them off, with ulChildID's */
+   for(ul = ulChildID; ul < ulNumChildren; ul++) {
+      (void) Node_getChild(oNParent, ul, &oNChild);
+      ulCount += Node_getSubtreeSize(oNChild);
+   }
+   return Node_getSubtreeSize(oNParent) - 1 - ulCount;
+}
+
+size_t Node_findChildAt(Node_T oNParent, size_t *pulIndex) {
+   size_t *pulPrefix;
+   size_t ulNumChildren;
+   size_t ulBelow;
+   size_t ulLow;
+   size_t ulHigh;
+   size_t ulMid;
+   Node_T oNChild = NULL;
+   size_t ul;
+
+   assert(oNParent != NULL);
+   assert(pulIndex != NULL);
+
+   ulNumChildren = Node_getNumChildren(oNParent);
+   ulBelow = Node_getSubtreeSize(oNParent) - 1;
+   assert(*pulIndex < ulBelow);
+
+   /* the last child whose running sum is at most *pulIndex: every
+      subtree holds at least its root, so the sums strictly rise */
+   pulPrefix = Node_getPrefix(oNParent);
+   if(pulPrefix != NULL) {
+      ulLow = 0;
+      ulHigh = ulNumChildren;
+      while(ulHigh - ulLow > 1) {
+         ulMid = ulLow + (ulHigh - ulLow) / 2;
+         if(pulPrefix[ulMid] <= *pulIndex)
+            ulLow = ulMid;
+         else
+            ulHigh = ulMid;
+      }
+      *pulIndex -= pulPrefix[ulLow];
+      return ulLow;
+   }
+
+   if(*pulIndex < ulBelow / 2) {
+      for(ul = 0; ul + 1 < ulNumChildren; ul++) {
+         (void) Node_getChild(oNParent, ul, &oNChild);
+         if(*pulIndex < Node_getSubtreeSize(oNChild))
+            break;
+         *pulIndex -= Node_getSubtreeSize(oNChild);
+      }
+      return ul;
+   }
+
+   /* near the end: count from the end, where the last child's
+      subtree ends at ulBelow */
+   for(ul = ulNumChildren - 1; ul > 0; ul--) {
+      (void) Node_getChild(oNParent, ul, &oNChild);
+      ulBelow -= Node_getSubtreeSize(oNChild);
+      if(*pulIndex >= ulBelow)
+         break;
+   }
+   if(ul == 0)
+      ulBelow = 0;
+   *pulIndex -= ulBelow;
+   return ul;
 }
 
 /*
@@ -331,7 +1619,7 @@ void *Node_getContents(Node_T oNNode) {
    if(!oNNode->bIsFile)
       return NULL;
    
-   return oNNode->pvContents;
+   return Node_contents(oNNode)->pvContents;
 }
 
 size_t Node_getLength(Node_T oNNode) {
@@ -340,22 +1628,213 @@ size_t Node_getLength(Node_T oNNode) {
    if(!oNNode->bIsFile)
       return 0;
    
-   return oNNode->ulLength;
+   return Node_contents(oNNode)->ulLength;
 }
 
 
 int Node_replaceContents(Node_T oNNode, void *pvNewContents,
-                         size_t ulNewLength) {
+                         size_t ulNewLength, void **ppvOldContents) {
+   void *pvOld;
+   size_t ulOldLength;
+   int iStatus;
+
    assert(oNNode != NULL);
-   
+   assert(ppvOldContents != NULL);
+
    /* can only replace contents of files */
    if(!oNNode->bIsFile)
       return NOT_A_FILE;
-   
-   /* Don't free old contents - caller will handle that */
-   /* Just replace the pointer directly */
-   oNNode->pvContents = pvNewContents;
-   oNNode->ulLength = ulNewLength;
-   
+
+   /* hand the old contents to the caller in a buffer it can own:
+      a heap buffer is passed along as is, inline contents are copied
+      out first since the new contents may overwrite them */
+   pvOld = Node_contents(oNNode)->pvContents;
+   ulOldLength = Node_contents(oNNode)->ulLength;
+   if(pvOld != NULL && Node_isInline(oNNode)) {
+      pvOld = malloc(Node_contents(oNNode)->ulLength);
+      if(pvOld == NULL)
+         return MEMORY_ERROR;
+      memcpy(pvOld, Node_contents(oNNode)->acInline,
+             Node_contents(oNNode)->ulLength);
+   }
+
+   Node_beginWrite(oNNode);
+   iStatus = Node_storeContents(oNNode, pvNewContents, ulNewLength);
+   Node_endWrite(oNNode);
+   if(iStatus != SUCCESS) {
+      if(pvOld != Node_contents(oNNode)->pvContents)
+         free(pvOld);
+      return iStatus;
+   }
+   Node_updateBytes(oNNode, ulOldLength);
+
+   *ppvOldContents = pvOld;
    return SUCCESS;
 }
+
+void Node_restoreContents(Node_T oNNode, void *pvContents,
+                          size_t ulLength) {
+   void *pvCurrent;
+   size_t ulOldLength;
+
+   assert(oNNode != NULL);
+   assert(oNNode->bIsFile);
+
+   pvCurrent = Node_contents(oNNode)->pvContents;
+   ulOldLength = Node_contents(oNNode)->ulLength;
+   if(pvCurrent != NULL && Node_isInline(oNNode))
+      pvCurrent = NULL;
+
+   /* contents small enough go back inline, as Node_storeContents
+      would have put them, so copying them needs no memory */
+   Node_beginWrite(oNNode);
+   if(pvContents == NULL || ulLength <= NODE_INLINE_MAX) {
+      (void) Node_storeContents(oNNode, pvContents, ulLength);
+      free(pvContents);
+   }
+   else {
+      Node_contents(oNNode)->pvContents = pvContents;
+      Node_contents(oNNode)->ulLength = ulLength;
+   }
+   Node_endWrite(oNNode);
+   Node_updateBytes(oNNode, ulOldLength);
+   free(pvCurrent);
+}
+
+void Node_lockShared(Node_T oNDir) {
+   assert(oNDir != NULL);
+
+   (void) pthread_rwlock_rdlock(Node_getLock(oNDir));
+}
+
+void Node_lockExclusive(Node_T oNDir) {
+   assert(oNDir != NULL);
+
+   (void) pthread_rwlock_wrlock(Node_getLock(oNDir));
+}
+
+void Node_unlock(Node_T oNDir) {
+   assert(oNDir != NULL);
+
+   (void) pthread_rwlock_unlock(Node_getLock(oNDir));
+}
+
+/* The key of a lock-free search for a child: the name sought, and the
+   child found with it, if any */
+struct nodeSearch {
+   const char *pcName;
+   Node_T oNFound;
+};
+
+/*
+  Compares the last component of oNChild's path with psSearch's name,
+  as Node_compareName does, and records oNChild in psSearch if they
+  are equal. Recording the match spares the search a NodeArray_get,
+  whose index may no longer be valid once a writer has removed a
+  child meanwhile.
+*/
+static int Node_compareSearch(const Node_T oNChild,
+                              struct nodeSearch *psSearch) {
+   int iCompare;
+
+   assert(psSearch != NULL);
+
+   iCompare = Node_compareName(oNChild, psSearch->pcName);
+   if(iCompare == 0)
+      psSearch->oNFound = oNChild;
+   return iCompare;
+}
+
+unsigned int Node_readBegin(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return __atomic_load_n(&oNNode->uiVersion, __ATOMIC_ACQUIRE);
+}
+
+boolean Node_readValidate(Node_T oNNode, unsigned int uiVersion) {
+   assert(oNNode != NULL);
+
+   /* the reads being validated happen before the second load */
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return (boolean) (uiVersion % 2 == 0 &&
+                     __atomic_load_n(&oNNode->uiVersion,
+                                     __ATOMIC_RELAXED) == uiVersion);
+}
+
+Node_T Node_findChildNamed(Node_T oNParent, const char *pcName) {
+   struct nodeSearch sSearch;
+   size_t ulIndex;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+
+   if(oNParent->bIsFile)
+      return NULL;
+
+   sSearch.pcName = pcName;
+   sSearch.oNFound = NULL;
+
+   (void) NodeArray_bsearch(
+            __atomic_load_n(&oNParent->psFiles, __ATOMIC_ACQUIRE),
+            &sSearch, &ulIndex,
+            (int (*)(const void*,const void*)) Node_compareSearch);
+   if(sSearch.oNFound != NULL)
+      return sSearch.oNFound;
+
+   (void) NodeArray_bsearch(
+            __atomic_load_n(&oNParent->psDirs, __ATOMIC_ACQUIRE),
+            &sSearch, &ulIndex,
+            (int (*)(const void*,const void*)) Node_compareSearch);
+   return sSearch.oNFound;
+}
+
+void Node_setDeferred(boolean bDefer) {
+   boolean bDrain;
+
+   (void) pthread_mutex_lock(&sTableLock);
+   if(bDefer)
+      uiDeferring++;
+   else {
+      assert(uiDeferring > 0);
+      uiDeferring--;
+   }
+   bDrain = (boolean) (uiDeferring == 0);
+   (void) pthread_mutex_unlock(&sTableLock);
+
+   /* Epoch_retire's callbacks take sTableLock themselves */
+   if(bDrain)
+      Epoch_drain();
+}
+
+int Node_beginArena(void) {
+   struct nodeArena *psArena;
+
+   (void) pthread_once(&sArenaOnce, Node_makeArenaKey);
+   if(!bArenaKeyMade)
+      return MEMORY_ERROR;
+   if(pthread_getspecific(sArenaKey) != NULL)
+      return SUCCESS;
+
+   psArena = calloc(1, sizeof(struct nodeArena));
+   if(psArena == NULL)
+      return MEMORY_ERROR;
+   if(pthread_setspecific(sArenaKey, psArena) != 0) {
+      free(psArena);
+      return MEMORY_ERROR;
+   }
+   return SUCCESS;
+}
+
+void Node_endArena(void) {
+   struct nodeArena *psArena;
+
+   (void) pthread_once(&sArenaOnce, Node_makeArenaKey);
+   if(!bArenaKeyMade)
+      return;
+
+   psArena = pthread_getspecific(sArenaKey);
+   if(psArena == NULL)
+      return;
+   (void) pthread_setspecific(sArenaKey, NULL);
+   Node_dropArena(psArena);
+}
@@ -9,11 +9,16 @@
 #include <stddef.h>
 #include "a4def.h"
 #include "path.h"
+#include "dynarray.h"
 
 /* A Node_T is an object that contains a path payload and references to
    the node's parent (if it exists) and children (if they exist). */
 typedef struct node *Node_T;
 
+/* File contents of at most this many bytes are stored inside the node
+   itself; larger contents get a separately allocated buffer. */
+enum { NODE_INLINE_MAX = 32 };
+
 /*
   Creates a new node with path oPPath and parent oNParent. Returns an
   int SUCCESS status and sets *poNResult to be the new node if
@@ -26,22 +31,105 @@ typedef struct node *Node_T;
   * ALREADY_IN_TREE if oNParent already has a child with this path
   * NOT_A_DIRECTORY if oNParent is a file (files cannot have children)
   
-  If bIsFile is TRUE, creates a file node with contents pvContents of
-  length ulLength. If bIsFile is FALSE, creates a directory node
-  (pvContents and ulLength are ignored).
+  If bIsFile is TRUE, creates a file node with a copy of the contents
+  pvContents of length ulLength. If bIsFile is FALSE, creates a
+  directory node (pvContents and ulLength are ignored).
 */
 int Node_new(Path_T oPPath, Node_T oNParent, Node_T *poNResult,
              boolean bIsFile, void *pvContents, size_t ulLength);
 
+/*
+  Creates a new node as Node_new does, but takes over oPPath rather
+  than copying it, and neither checks it against oNParent nor links
+  the node into oNParent's children: the caller vouches that oPPath
+  is the path of a new child of directory oNParent, or of a root if
+  oNParent is NULL, and links the node with Node_setChildren or
+  Node_link. Until then, Node_free can still free it. Returns SUCCESS,
+  or MEMORY_ERROR with oPPath still the caller's.
+*/
+int Node_newUnlinked(Path_T oPPath, Node_T oNParent, Node_T *poNResult,
+                     boolean bIsFile, void *pvContents,
+                     size_t ulLength);
+
+/*
+  Gives directory oNParent, which must have no children yet, as its
+  file children the nodes of oDFiles from index ulFirstFile up, and
+  as its directory children those of oDDirs from index ulFirstDir up.
+  Each range must hold, in increasing order of name, nodes created by
+  Node_newUnlinked with oNParent as their parent. The arrays stay the
+  caller's. Returns SUCCESS, or MEMORY_ERROR with nothing changed.
+*/
+int Node_setChildren(Node_T oNParent, DynArray_T oDFiles,
+                     size_t ulFirstFile, DynArray_T oDDirs,
+                     size_t ulFirstDir);
+
+/*
+  Links oNChild, created by Node_newUnlinked and not linked since,
+  into the children of oNParent in its sorted place, as Node_new links
+  a new node. Returns SUCCESS, or a status as Node_new does with
+  oNChild still unlinked.
+*/
+int Node_link(Node_T oNParent, Node_T oNChild);
+
 /*
   Destroys the entire hierarchy of nodes rooted at oNNode,
   including oNNode itself. Returns the number of nodes destroyed.
+  Uses constant stack space regardless of the hierarchy's depth.
 */
 size_t Node_free(Node_T oNNode);
 
+/*
+  Frees nodes of the hierarchy rooted at oNNode, which must be a
+  root or detached, as Node_free does, but stops after ulMax of them.
+  Returns TRUE once the whole hierarchy, oNNode included, is freed,
+  and FALSE otherwise, leaving the rest for another call with the
+  same oNNode.
+*/
+boolean Node_freeSome(Node_T oNNode, size_t ulMax);
+
+/*
+  Removes oNNode from its parent's children and marks it removed, but
+  leaves it and its descendants allocated and linked to one another,
+  so that whoever still holds oNNode can keep reading the subtree.
+  oNNode becomes a root without a parent: it must eventually be given
+  to Node_free, which then frees the subtree without touching the
+  former parent.
+*/
+void Node_detach(Node_T oNNode);
+
+/*
+  Removes oNNode from its parent's children, as Node_detach does, but
+  leaves oNNode itself untouched, so that the removal can still be
+  undone. The parent's children array keeps the room oNNode took.
+  Needs no memory, so cannot fail. The node must then be given to
+  Node_restore or Node_forget, while its parent is still allocated;
+  until then it must not be given to Node_free.
+*/
+void Node_setAside(Node_T oNNode);
+
+/*
+  Puts oNNode, set aside by Node_setAside, back where it was among
+  its parent's children, which must be as they were right after it
+  was set aside. Needs no memory, so cannot fail.
+*/
+void Node_restore(Node_T oNNode);
+
+/*
+  Makes the removal of oNNode, set aside by Node_setAside, final:
+  leaves oNNode as Node_detach would have, ready for Node_free.
+*/
+void Node_forget(Node_T oNNode);
+
 /* Returns the path object of oNNode. */
 Path_T Node_getPath(Node_T oNNode);
 
+/*
+  Children of a node are identified by consecutive IDs starting at 0:
+  all file children come first, in lexicographic order, followed by
+  all directory children, in lexicographic order. A pre-order walk
+  over children in ID order therefore visits files before directories.
+*/
+
 /*
   Returns TRUE if oNParent has a child with path oPPath and returns
   that child's identifier in *pulChildID. Returns FALSE if no such
@@ -50,6 +138,16 @@ Path_T Node_getPath(Node_T oNNode);
 boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
                       size_t *pulChildID);
 
+/*
+  Returns TRUE if oNParent has a child whose last path component is
+  pcName and returns that child's identifier in *pulChildID. Returns
+  FALSE if no such child exists. *pulChildID is unchanged if there is
+  no such child. Unlike Node_hasChild, this needs no Path_T for the
+  child, so walking down a path costs no allocation per level.
+*/
+boolean Node_hasChildNamed(Node_T oNParent, const char *pcName,
+                           size_t *pulChildID);
+
 /* Returns the number of children of oNParent. */
 size_t Node_getNumChildren(Node_T oNParent);
 
@@ -64,6 +162,46 @@ int Node_getChild(Node_T oNParent, size_t ulChildID,
 /* Returns the parent of oNNode, or NULL if oNNode is the root. */
 Node_T Node_getParent(Node_T oNNode);
 
+/*
+  Returns the number of nodes in the hierarchy rooted at oNNode,
+  oNNode included, in constant time. Every change below a linked node
+  updates it, so it is exact for any node in a tree.
+*/
+size_t Node_getSubtreeSize(Node_T oNNode);
+
+/*
+  Sets *pulFiles and *pulDirs to the numbers of files and of
+  directories in the hierarchy rooted at oNNode, oNNode included, and
+  *pulBytes to the total length of those files' contents, in constant
+  time. They are kept up to date as Node_getSubtreeSize is.
+*/
+void Node_getTotals(Node_T oNNode, size_t *pulFiles, size_t *pulDirs,
+                    size_t *pulBytes);
+
+/*
+  Returns the number of nodes in the hierarchies rooted at the
+  children of directory oNParent whose identifiers are below
+  ulChildID, which must identify a child.
+*/
+size_t Node_countBefore(Node_T oNParent, size_t ulChildID);
+
+/*
+  Returns the identifier of the child of directory oNParent whose
+  hierarchy holds the node *pulIndex places after oNParent in a
+  pre-order walk that visits children in identifier order, counting
+  from 0 for the node right after oNParent, and sets *pulIndex to that
+  node's place within the child's hierarchy. *pulIndex must be less
+  than the number of nodes below oNParent.
+
+  Node_countBefore and Node_findChildAt take time logarithmic in the
+  number of children of a directory with many children, once one of
+  them has been called since its children last changed; over few
+  children, or the first time, they scan the children's sizes. Several
+  readers may call them at once, but no writer may change the tree
+  meanwhile.
+*/
+size_t Node_findChildAt(Node_T oNParent, size_t *pulIndex);
+
 /*
   Returns a string representation of oNNode's path, or NULL if there
   is an allocation error. Allocates memory for the returned string,
@@ -80,8 +218,10 @@ char *Node_toString(Node_T oNNode);
 boolean Node_isFile(Node_T oNNode);
 
 /*
-  Returns a pointer to the contents of oNNode, Returns NULL if 
-  oNNode is a directory,
+  Returns a pointer to the contents of oNNode, Returns NULL if
+  oNNode is a directory or has no contents. The pointer may refer to
+  storage inside oNNode itself, so it is valid only until oNNode's
+  contents are replaced or oNNode is freed.
 */
 void *Node_getContents(Node_T oNNode);
 
@@ -93,13 +233,84 @@ size_t Node_getLength(Node_T oNNode);
 
 
 /*
-  Replaces the contents pointer of file oNNode with pointer pvNewContents
-  of length ulNewLength (does not free the old contents; used for replacement).
+  Replaces the contents of file oNNode with a copy of the ulNewLength
+  bytes at pvNewContents, and sets *ppvOldContents to a heap buffer
+  holding the old contents (or NULL if there were none). Ownership of
+  that buffer passes to the caller, who must free it; old contents
+  that were stored inline in oNNode are copied out to a new buffer.
   Returns SUCCESS if successful, or:
   * NOT_A_FILE if oNNode is a directory
-  Caller is responsible for managing the old contents memory.
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  On failure oNNode and *ppvOldContents are unchanged.
 */
 int Node_replaceContents(Node_T oNNode, void *pvNewContents,
-                         size_t ulNewLength);
+                         size_t ulNewLength, void **ppvOldContents);
+
+/*
+  Gives file oNNode back the ulLength bytes of contents pvContents,
+  a buffer that Node_replaceContents handed out for it, and frees the
+  contents it has now. oNNode takes pvContents over. Needs no memory,
+  so cannot fail.
+*/
+void Node_restoreContents(Node_T oNNode, void *pvContents,
+                          size_t ulLength);
+
+/*
+  Every directory node has a reader-writer lock, which the node itself
+  never takes: its users decide what it guards. Node_lockShared takes
+  the lock of directory oNDir for reading, Node_lockExclusive for
+  writing, and Node_unlock releases it. A node must not be freed while
+  its lock is held.
+*/
+void Node_lockShared(Node_T oNDir);
+void Node_lockExclusive(Node_T oNDir);
+void Node_unlock(Node_T oNDir);
+
+/*
+  Lock-free reads. Every node has a version that the node functions
+  make odd while they change its children or contents, and leave odd
+  for good once Node_free removes it. A reader that takes no lock
+  calls Node_readBegin, reads what it needs, and then trusts what it
+  read only if Node_readValidate(oNNode, uiVersion) returns TRUE;
+  otherwise a writer interfered and the reader must start over. Such
+  readers must run between Epoch_enter and Epoch_exit, and the
+  writers must call Node_setDeferred(TRUE) first, so that nothing the
+  readers may reach is freed under them.
+*/
+unsigned int Node_readBegin(Node_T oNNode);
+boolean Node_readValidate(Node_T oNNode, unsigned int uiVersion);
+
+/*
+  Returns the child of oNParent whose last path component is pcName,
+  or NULL if there is none. Unlike Node_hasChildNamed followed by
+  Node_getChild, this is safe for a lock-free reader while a writer
+  changes oNParent's children, though its answer is only meaningful
+  if oNParent then validates.
+*/
+Node_T Node_findChildNamed(Node_T oNParent, const char *pcName);
+
+/*
+  Adds (bDefer TRUE) or drops (bDefer FALSE) a need for deferred
+  freeing. While any need remains, Node_free and children arrays
+  replaced to grow hand their memory to Epoch_retire instead of
+  freeing it at once. Dropping the last need waits for all readers and
+  frees whatever was deferred.
+*/
+void Node_setDeferred(boolean bDefer);
+
+/*
+  Gives the calling thread an arena of node slots, so that the nodes
+  it creates take their slots from a small stock of its own, which it
+  refills from the shared tables a batch at a time, rather than
+  taking the tables' lock for every node. Threads that build many
+  nodes at once use one to stay out of each other's way. Returns
+  SUCCESS, or MEMORY_ERROR if the arena could not be set up, in which
+  case the thread keeps taking slots one at a time.
+*/
+int Node_beginArena(void);
+
+/* Gives the unused slots of the calling thread's arena, if it has
+   one, back to the shared tables, and drops the arena. */
+void Node_endArena(void);
 
 #endif
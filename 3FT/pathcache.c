@@ -0,0 +1,245 @@
+/*--------------------------------------------------------------------*/
+/* pathcache.c                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "pathcache.h"
+
+/* The number of slots in a new cache; always a power of two */
+enum { PATHCACHE_MIN_SLOTS = 64 };
+
+/* A slot of the table: pcKey is NULL if the slot is empty */
+struct pathCacheEntry {
+   /* the pathname, owned by the client */
+   const char *pcKey;
+   /* the hash of pcKey, kept to skip most string comparisons */
+   size_t ulHash;
+   /* the value mapped to pcKey */
+   void *pvValue;
+};
+
+/*
+  An open-addressed hash table with linear probing. It is kept at most
+  half full, so probe sequences stay short, and removal shifts later
+  entries back instead of leaving tombstones.
+*/
+struct pathCache {
+   /* the slots, ulSlots of them */
+   struct pathCacheEntry *psEntries;
+   /* the number of slots, a power of two */
+   size_t ulSlots;
+   /* the number of occupied slots */
+   size_t ulLength;
+   /* lookup counters */
+   size_t ulHits;
+   size_t ulMisses;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the FNV-1a hash of string pcKey. */
+static size_t PathCache_hash(const char *pcKey) {
+   unsigned long ulHash = 2166136261UL;
+
+   assert(pcKey != NULL);
+
+   while(*pcKey != '\0') {
+      ulHash ^= (unsigned char) *pcKey++;
+      ulHash *= 16777619UL;
+   }
+   return (size_t) ulHash;
+}
+
+/*
+  Returns the index of the slot of oPCache that holds key pcKey with
+  hash ulHash, or of the empty slot where probing for it stopped.
+*/
+static size_t PathCache_find(PathCache_T oPCache, const char *pcKey,
+                             size_t ulHash) {
+   size_t ulMask = oPCache->ulSlots - 1;
+   size_t ul = ulHash & ulMask;
+
+   while(oPCache->psEntries[ul].pcKey != NULL) {
+      if(oPCache->psEntries[ul].ulHash == ulHash &&
+         strcmp(oPCache->psEntries[ul].pcKey, pcKey) == 0)
+         break;
+      ul = (ul + 1) & ulMask;
+   }
+   return ul;
+}
+
+/*
+  Moves the entries of oPCache into a new table of ulSlots slots.
+  Returns SUCCESS, or MEMORY_ERROR with oPCache unchanged.
+*/
+static int PathCache_resize(PathCache_T oPCache, size_t ulSlots) {
+   struct pathCacheEntry *psOld = oPCache->psEntries;
+   size_t ulOldSlots = oPCache->ulSlots;
+   size_t ul;
+
+   assert(ulSlots > oPCache->ulLength);
+
+   oPCache->psEntries = calloc(ulSlots, sizeof(struct pathCacheEntry));
+   if(oPCache->psEntries == NULL) {
+      oPCache->psEntries = psOld;
+      return MEMORY_ERROR;
+   }
+   oPCache->ulSlots = ulSlots;
+
+   for(ul = 0; ul < ulOldSlots; ul++) {
+      size_t ulNew;
+
+      if(psOld[ul].pcKey == NULL)
+         continue;
+      ulNew = PathCache_find(oPCache, psOld[ul].pcKey, psOld[ul].ulHash);
+      oPCache->psEntries[ulNew] = psOld[ul];
+   }
+
+   free(psOld);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+PathCache_T PathCache_new(void) {
+   PathCache_T oPCache;
+
+   oPCache = malloc(sizeof(struct pathCache));
+   if(oPCache == NULL)
+      return NULL;
+
+   oPCache->psEntries = calloc(PATHCACHE_MIN_SLOTS,
+                               sizeof(struct pathCacheEntry));
+   if(oPCache->psEntries == NULL) {
+      free(oPCache);
+      return NULL;
+   }
+   oPCache->ulSlots = PATHCACHE_MIN_SLOTS;
+   oPCache->ulLength = 0;
+   oPCache->ulHits = 0;
+   oPCache->ulMisses = 0;
+   return oPCache;
+}
+
+void PathCache_free(PathCache_T oPCache) {
+   if(oPCache == NULL)
+      return;
+
+   free(oPCache->psEntries);
+   free(oPCache);
+}
+
+void PathCache_clear(PathCache_T oPCache) {
+   assert(oPCache != NULL);
+
+   memset(oPCache->psEntries, 0,
+          oPCache->ulSlots * sizeof(struct pathCacheEntry));
+   oPCache->ulLength = 0;
+}
+
+int PathCache_add(PathCache_T oPCache, const char *pcKey,
+                  void *pvValue) {
+   size_t ulHash;
+   size_t ul;
+   int iStatus;
+
+   assert(oPCache != NULL);
+   assert(pcKey != NULL);
+
+   /* keep the table at most half full */
+   if(2 * (oPCache->ulLength + 1) > oPCache->ulSlots) {
+      iStatus = PathCache_resize(oPCache, 2 * oPCache->ulSlots);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   ulHash = PathCache_hash(pcKey);
+   ul = PathCache_find(oPCache, pcKey, ulHash);
+   if(oPCache->psEntries[ul].pcKey == NULL)
+      oPCache->ulLength++;
+
+   oPCache->psEntries[ul].pcKey = pcKey;
+   oPCache->psEntries[ul].ulHash = ulHash;
+   oPCache->psEntries[ul].pvValue = pvValue;
+   return SUCCESS;
+}
+
+void PathCache_remove(PathCache_T oPCache, const char *pcKey) {
+   size_t ulMask;
+   size_t ulHole;
+   size_t ul;
+   size_t ulHome;
+
+   assert(oPCache != NULL);
+   assert(pcKey != NULL);
+
+   ulMask = oPCache->ulSlots - 1;
+   ulHole = PathCache_find(oPCache, pcKey, PathCache_hash(pcKey));
+   if(oPCache->psEntries[ulHole].pcKey == NULL)
+      return;
+
+   /* shift back each later entry of the run whose home slot is not
+      cyclically between the hole and the entry itself, so that every
+      remaining key is still reachable from its home slot */
+   ul = ulHole;
+   for(;;) {
+      ul = (ul + 1) & ulMask;
+      if(oPCache->psEntries[ul].pcKey == NULL)
+         break;
+      ulHome = oPCache->psEntries[ul].ulHash & ulMask;
+      if(((ul - ulHome) & ulMask) >= ((ul - ulHole) & ulMask)) {
+         oPCache->psEntries[ulHole] = oPCache->psEntries[ul];
+         ulHole = ul;
+      }
+   }
+
+   oPCache->psEntries[ulHole].pcKey = NULL;
+   oPCache->psEntries[ulHole].pvValue = NULL;
+   oPCache->ulLength--;
+}
+
+void *PathCache_lookup(PathCache_T oPCache, const char *pcKey) {
+   size_t ul;
+
+   assert(oPCache != NULL);
+   assert(pcKey != NULL);
+
+   ul = PathCache_find(oPCache, pcKey, PathCache_hash(pcKey));
+   if(oPCache->psEntries[ul].pcKey == NULL) {
+      oPCache->ulMisses++;
+      return NULL;
+   }
+
+   oPCache->ulHits++;
+   return oPCache->psEntries[ul].pvValue;
+}
+
+void *PathCache_peek(PathCache_T oPCache, const char *pcKey) {
+   size_t ul;
+
+   assert(oPCache != NULL);
+   assert(pcKey != NULL);
+
+   ul = PathCache_find(oPCache, pcKey, PathCache_hash(pcKey));
+   return oPCache->psEntries[ul].pvValue;
+}
+
+size_t PathCache_getLength(PathCache_T oPCache) {
+   assert(oPCache != NULL);
+
+   return oPCache->ulLength;
+}
+
+void PathCache_getStats(PathCache_T oPCache, size_t *pulHits,
+                        size_t *pulMisses) {
+   assert(oPCache != NULL);
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+   *pulHits = oPCache->ulHits;
+   *pulMisses = oPCache->ulMisses;
+}
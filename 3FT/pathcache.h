@@ -0,0 +1,71 @@
+/*--------------------------------------------------------------------*/
+/* pathcache.h                                                        */
+/* Author: Helen Hui, George Xie                                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef PATHCACHE_INCLUDED
+#define PATHCACHE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A PathCache_T is a hash map from full pathnames to values, used to
+  answer repeated lookups of the same path without walking the tree.
+  The cache does not copy its keys: each key string must stay valid,
+  and unchanged, for as long as its entry is in the cache.
+*/
+typedef struct pathCache *PathCache_T;
+
+/*
+  Returns a new, empty PathCache_T, or NULL if memory could not be
+  allocated.
+*/
+PathCache_T PathCache_new(void);
+
+/* Frees oPCache. Neither its keys nor its values are freed. */
+void PathCache_free(PathCache_T oPCache);
+
+/*
+  Removes every entry from oPCache, keeping its hit and miss counts.
+*/
+void PathCache_clear(PathCache_T oPCache);
+
+/*
+  Maps key pcKey to pvValue in oPCache, replacing any value pcKey
+  already had. Returns SUCCESS, or MEMORY_ERROR if the cache needed to
+  grow and could not; oPCache is then unchanged.
+*/
+int PathCache_add(PathCache_T oPCache, const char *pcKey,
+                  void *pvValue);
+
+/*
+  Removes the entry with key pcKey from oPCache, if there is one.
+  Never allocates memory, so it cannot fail.
+*/
+void PathCache_remove(PathCache_T oPCache, const char *pcKey);
+
+/*
+  Returns the value mapped to key pcKey in oPCache, or NULL if pcKey
+  has no entry. Counts the call as a hit or a miss accordingly.
+*/
+void *PathCache_lookup(PathCache_T oPCache, const char *pcKey);
+
+/*
+  Like PathCache_lookup, but does not count the call. It thus leaves
+  oPCache unmodified, so several threads may call it at once as long
+  as none modifies oPCache meanwhile.
+*/
+void *PathCache_peek(PathCache_T oPCache, const char *pcKey);
+
+/* Returns the number of entries in oPCache. */
+size_t PathCache_getLength(PathCache_T oPCache);
+
+/*
+  Sets *pulHits and *pulMisses to the number of PathCache_lookup calls
+  on oPCache that found and did not find an entry, respectively.
+*/
+void PathCache_getStats(PathCache_T oPCache, size_t *pulHits,
+                        size_t *pulMisses);
+
+#endif